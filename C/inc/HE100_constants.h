@@ -57,8 +57,16 @@
 #define HE_FAILED_GET_CONFIG            32
 #define HE_FAILED_READ                  33
 #define HE_FAILED_PREPARE_TRANSMISSION  34
+#define HE_FAILED_ACK_TIMEOUT           35
+#define HE_INVALID_FRAGMENT             36
+#define HE_FAILED_REASSEMBLY_TIMEOUT    37
+#define HE_INVALID_TELEMETRY            38
+#define HE_FAILED_TELEMETRY_STORE       39
+#define HE_INVALID_FIRMWARE             40
+#define HE_FAILED_CAPTURE               41
+#define HE_INVALID_AX25                 42
 
-extern const char *HE_STATUS[34];
+extern const char *HE_STATUS[43];
 extern const char *CMD_CODE_LIST[32];
 extern const char *if_baudrate[6];
 extern const char *rf_baudrate[5];
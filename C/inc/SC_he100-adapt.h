@@ -0,0 +1,115 @@
+#ifndef SC_HE100_ADAPT_H_
+#define SC_HE100_ADAPT_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-adapt.h
+ *
+ *    Description:  RF rate adaptation over a pass. The link carries more at
+ *                  high elevation than near the horizon, so rather than one
+ *                  worst case rate for the whole pass the controller moves
+ *                  rx_rf_baud_rate and tx_rf_baud_rate between CFG_RF_BAUD_*
+ *                  steps as the link allows:
+ *
+ *                  - the RSSI of telemetry samples, smoothed, and the share of
+ *                    invalid frames and NACKs among the frames decoded over a
+ *                    window of them are the measures of the link;
+ *                  - one bad window, or the RSSI falling below the floor of
+ *                    the rate in use, steps down at once;
+ *                  - stepping up takes up_windows good windows in a row, the
+ *                    RSSI rssi_hysteresis above the floor of the next rate,
+ *                    and hold_ns since the last change, so a link at the edge
+ *                    of a rate does not flap between two.
+ *
+ *                  Changes go to the radio through HE100_handleSetConfig.
+ *                  The other end of the link must move with it, by running
+ *                  the same controller on what it hears or by a schedule of
+ *                  its own; this one only decides for the local radio.
+ *
+ *        Version:  1.0
+ *        Created:  27-10-17 02:37:12 AM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <stdint.h>
+#include <SC_he100.h>
+#include <SC_he100-handle.h>
+#include <SC_he100-scheduler.h>
+
+#define HE100_ADAPT_RATES   (MAX_RF_BAUD_RATE+1)
+
+struct he100_adapt_policy {
+    int min_rate;               // CFG_RF_BAUD_*, never below
+    int max_rate;               // never above
+    int rssi_floor[HE100_ADAPT_RATES]; // telemetry RSSI each rate holds at, at least; calibrate per station
+    int rssi_hysteresis;        // above the next rate's floor before stepping up to it
+    uint32_t window_frames;     // frames decoded for a window to be judged
+    int down_percent;           // invalid frames and NACKs above this share of a window step down
+    int up_percent;             // at most this share for a window to be good
+    int up_windows;             // good windows in a row before stepping up
+    uint64_t hold_ns;           // no step up sooner after a change
+};
+
+struct he100_adapt_stats {
+    uint64_t windows;           // judged
+    uint64_t ups;
+    uint64_t downs;
+    uint64_t failed;            // changes HE100_handleSetConfig did not take
+};
+
+struct he100_adapt {
+    int rate;                   // CFG_RF_BAUD_* the radio runs at
+    int rssi;                   // smoothed, in sixteenths; -1 until a sample came
+    uint64_t frames;            // handle counters when the window opened
+    uint64_t errors;
+    int good;                   // good windows in a row
+    uint64_t changed;           // HE100_monotonicNs of the last change
+    struct he100_scheduler *scheduler;
+    struct he100_adapt_stats stats;
+};
+
+/**
+ * Function to fill a policy with the defaults: 1200 to 38400, windows of
+ * 32 frames, down above 10% errors, up after 3 windows at 2% or less and
+ * 20 s at the rate. The RSSI floors are raw telemetry values, placeholders
+ * until the station has been calibrated against its link budget.
+ */
+void HE100_adaptDefaults (struct he100_adapt_policy *policy);
+
+/**
+ * Function to start at the RF rate the handle's configuration is at, with
+ * the window opening on its counters as they are
+ * @param scheduler - paced to each new rate, or NULL
+ * @return - HE_SUCCESS, HE_INVALID_RF_BAUD_RATE, or what HE100_handleCurrentConfig returned
+ */
+int HE100_adaptInit (struct he100_adapt *adapt, HE100_Handle *handle, struct he100_scheduler *scheduler);
+
+/* Function to take the RSSI of a telemetry sample, such as one HE100_handleTelemetry read */
+void HE100_adaptRssi (struct he100_adapt *adapt, const TELEMETRY_STRUCTURE_type *telemetry);
+
+/**
+ * Function to decide the rate from the handle's counters, with no serial
+ * traffic. Closes the window once window_frames have been decoded in it.
+ * Without RSSI samples the errors alone decide.
+ * @param now - HE100_monotonicNs
+ * @return - the CFG_RF_BAUD_* rate to run at, adapt->rate to stay
+ */
+int HE100_adaptDecide (struct he100_adapt *adapt, const struct he100_adapt_policy *policy, const struct he100_handle_stats *stats, uint64_t now);
+
+/**
+ * Function to decide and, for a new rate, set it on the radio through the
+ * configuration and pace adapt->scheduler to it. Call it after each
+ * telemetry sample, or as often as the link should be judged.
+ * @return - HE_SUCCESS, with or without a change; or what HE100_handleCurrentConfig
+ *           or HE100_handleSetConfig returned, the rate unchanged
+ */
+int HE100_adaptStep (struct he100_adapt *adapt, const struct he100_adapt_policy *policy, HE100_Handle *handle);
+
+#endif
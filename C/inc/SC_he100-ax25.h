@@ -0,0 +1,136 @@
+#ifndef SC_HE100_AX25_H_
+#define SC_HE100_AX25_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-ax25.h
+ *
+ *    Description:  AX.25 header of received CMD_RECEIVE_DATA payloads, read in
+ *                  place, and a demultiplexer routing each payload to the
+ *                  handler registered for its destination (or source) station.
+ *
+ *                  A view points into the caller's buffer and is valid as long
+ *                  as it is; nothing is copied. Each address is 7 bytes: the
+ *                  callsign, space padded and shifted left one bit, then the
+ *                  SSID byte, whose low bit marks the last address:
+ *                    86 A2 40 40 40 40 60   CQ, SSID 0
+ *                    AC 8A 64 86 AA 82 E1   VE2CUA, SSID 0, last address
+ *
+ *                  Routes are keyed on the address bytes as they arrive, so a
+ *                  lookup hashes 7 bytes and probes a small open addressed
+ *                  table without decoding the callsign.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 08:47:36 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HE100_AX25_ADDRESS_LENGTH   7
+#define HE100_AX25_CALLSIGN_LENGTH  6
+#define HE100_AX25_MAX_DIGIPEATERS  8
+#define HE100_AX25_CALLSIGN_STRING  10  // "VE2CUA-15" and its terminator
+#define HE100_AX25_NO_PID           -1  // supervisory and unnumbered frames other than UI
+#define HE100_AX25_ANY_SSID         -1  // register a callsign for all its SSIDs
+
+/* which address a demultiplexer routes on */
+#define HE100_AX25_ROUTE_DESTINATION 0
+#define HE100_AX25_ROUTE_SOURCE      1
+
+#define HE100_AX25_MAX_ROUTES       32
+#define HE100_AX25_ROUTE_SLOTS      64  // power of two, at most half full
+
+struct he100_ax25_view {
+    const unsigned char *destination;   // HE100_AX25_ADDRESS_LENGTH bytes
+    const unsigned char *source;
+    const unsigned char *digipeaters;   // digipeater_count addresses, back to back
+    int digipeater_count;
+    unsigned char control;
+    int pid;                            // or HE100_AX25_NO_PID
+    const unsigned char *information;
+    size_t information_length;
+};
+
+/**
+ * Demultiplexer callback
+ * @param view - the header of the payload, pointing into the received frame
+ * @param context - the pointer given when the route was registered
+ */
+typedef void (*he100_ax25_callback)(const struct he100_ax25_view *view, void *context);
+
+struct he100_ax25_route {
+    uint64_t key;                       // 0 while the slot is free
+    he100_ax25_callback callback;
+    void *context;
+};
+
+struct he100_ax25_demux {
+    int route_on;                       // HE100_AX25_ROUTE_DESTINATION or HE100_AX25_ROUTE_SOURCE
+    int route_count;
+    struct he100_ax25_route routes[HE100_AX25_ROUTE_SLOTS];
+    he100_ax25_callback fallback;       // payloads no route matched, may be NULL
+    void *fallback_context;
+    // counters
+    uint64_t routed;
+    uint64_t unrouted;
+    uint64_t invalid;                   // not an AX.25 header
+};
+
+/**
+ * Function to read the AX.25 header at the start of a payload
+ * @param payload - a CMD_RECEIVE_DATA payload, which must outlive the view
+ * @return - HE_SUCCESS, or HE_INVALID_AX25 if the header is cut short or malformed
+ */
+int HE100_ax25View (struct he100_ax25_view *view, const unsigned char *payload, size_t length);
+
+/* Function returning the SSID of an address, 0 to 15 */
+int HE100_ax25Ssid (const unsigned char *address);
+
+/**
+ * Function to write an address as text, "VE2CUA" or "VE2CUA-5"
+ * @param text - HE100_AX25_CALLSIGN_STRING bytes
+ * @return - the length of the text
+ */
+int HE100_ax25Callsign (const unsigned char *address, char *text);
+
+/**
+ * Function to encode a callsign as it appears in an address
+ * @param callsign - up to HE100_AX25_CALLSIGN_LENGTH letters and digits, either case
+ * @param address - HE100_AX25_ADDRESS_LENGTH bytes, the last address bit left clear
+ * @return - HE_SUCCESS, or HE_INVALID_AX25 if the callsign cannot be encoded
+ */
+int HE100_ax25Address (const char *callsign, int ssid, unsigned char *address);
+
+/* Function to set up a demultiplexer with no routes */
+void HE100_ax25DemuxInit (struct he100_ax25_demux *demux, int route_on, he100_ax25_callback fallback, void *fallback_context);
+
+/**
+ * Function to route payloads for a station to a callback. A route for one SSID
+ * is taken before one registered with HE100_AX25_ANY_SSID.
+ * @param ssid - 0 to 15, or HE100_AX25_ANY_SSID
+ * @return - HE_SUCCESS, HE_INVALID_AX25 for a bad callsign, or -1 if all
+ *           HE100_AX25_MAX_ROUTES are taken; registering a station again replaces its route
+ */
+int HE100_ax25DemuxRegister (struct he100_ax25_demux *demux, const char *callsign, int ssid, he100_ax25_callback callback, void *context);
+
+/**
+ * Function to hand a payload to the route for its station, or the fallback
+ * @return - HE_SUCCESS if a route took it, -1 if none did, or HE_INVALID_AX25
+ */
+int HE100_ax25DemuxPayload (struct he100_ax25_demux *demux, const unsigned char *payload, size_t length);
+
+/**
+ * Receive engine callback, register it for CMD_RECEIVE_DATA with the demultiplexer as context
+ */
+void HE100_ax25DemuxRxCallback (const unsigned char *frame, size_t length, int status, void *context);
+
+#endif
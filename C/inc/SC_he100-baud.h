@@ -0,0 +1,69 @@
+#ifndef SC_HE100_BAUD_H_
+#define SC_HE100_BAUD_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-baud.h
+ *
+ *    Description:  Interface rate negotiation. The radio takes a new
+ *                  interface_baud_rate from CMD_SET_CONFIG and switches once
+ *                  its ACK is out, so the host must follow after reading the
+ *                  ACK and before writing anything else. A rate that does not
+ *                  work on the line would leave the radio out of reach, so
+ *                  the switch is confirmed with a NOOP, and if none is
+ *                  answered the host goes back to the rate that worked,
+ *                  looking for the radio at the others if it switched anyway.
+ *
+ *                  The host side changes both directions with one tcsetattr
+ *                  once written bytes have drained, then drops what was read
+ *                  around the switch.
+ *
+ *        Version:  1.0
+ *        Created:  27-10-17 12:21:50 AM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <termios.h>
+#include <SC_he100.h>
+#include <SC_he100-handle.h>
+
+#define HE100_BAUD_CONFIRM_ATTEMPTS 2   // NOOPs written at a new rate before it is given up
+
+/**
+ * Function to map a CFG_IF_BAUD_* rate to a termios speed
+ * @return - HE_SUCCESS, or HE_INVALID_IF_BAUD_RATE if the host cannot run at it
+ */
+int HE100_baudSpeed (int if_baud_rate, speed_t *speed);
+
+/**
+ * Function returning the rate a serial device runs at
+ * @return - a CFG_IF_BAUD_* rate, or -1 if it is none of them or not a tty
+ */
+int HE100_baudHostRate (int fdin);
+
+/**
+ * Function to switch a serial device to a CFG_IF_BAUD_* rate, input and
+ * output at once, after bytes already written have gone at the old rate
+ * @return - HE_SUCCESS, HE_INVALID_IF_BAUD_RATE, or HE_FAILED_SET_BAUD
+ */
+int HE100_baudSetHost (int fdin, int if_baud_rate);
+
+/**
+ * Function to move the radio and the host to a new interface rate together,
+ * falling back to the rate in use if the radio cannot be heard at the new one.
+ * Resets the handle's response timeouts, they were measured at the old rate.
+ * @param if_baud_rate - CFG_IF_BAUD_9600 to CFG_IF_BAUD_115200
+ * @return - HE_SUCCESS at the new rate; HE_FAILED_SET_BAUD once back at a rate
+ *           the radio answers, or if it answers at none; HE_INVALID_IF_BAUD_RATE;
+ *           or what HE100_handleCurrentConfig returned
+ */
+int HE100_baudNegotiate (HE100_Handle *handle, int if_baud_rate);
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef SC_HE100_CAPTURE_H_
+#define SC_HE100_CAPTURE_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-capture.h
+ *
+ *    Description:  Raw serial capture and replay. While a capture is started,
+ *                  every byte HE100_decoderFill reads and every frame the
+ *                  write functions send is appended to a memory mapped file,
+ *                  as it went over the line, with a CLOCK_MONOTONIC
+ *                  timestamp. The file is sized when opened; writers reserve
+ *                  space with an atomic add and never lock, and a record
+ *                  counts only once its length is stored, last, so a file
+ *                  left by a crash reads up to the last whole record.
+ *
+ *                  Replay feeds the received bytes of a capture to a decoder
+ *                  in the pieces they were read in, at the recorded pace,
+ *                  scaled, or as fast as possible, and hands each frame to a
+ *                  callback as the receive engine does.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 08:12:51 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include <SC_he100-decoder.h>
+#include <SC_he100-rx.h>
+
+#define HE100_CAPTURE_MAGIC         "HE100CAP"
+#define HE100_CAPTURE_VERSION       1
+#define HE100_CAPTURE_CAPACITY      (16*1024*1024) // bytes, the default
+#define HE100_CAPTURE_ALIGN         8
+
+/* record directions */
+#define HE100_CAPTURE_RX            0
+#define HE100_CAPTURE_TX            1
+
+struct he100_capture_file_header {
+    char magic[8];              // HE100_CAPTURE_MAGIC
+    uint32_t version;           // HE100_CAPTURE_VERSION
+    uint32_t header_size;
+    uint64_t capacity;          // bytes of records the file holds
+    uint64_t used;              // bytes of records reserved, may pass capacity when full
+    uint64_t start_ns;          // CLOCK_MONOTONIC when opened
+    uint64_t start_realtime_ns; // CLOCK_REALTIME at the same moment
+    uint64_t dropped;           // records that did not fit
+    uint64_t reserved;
+};
+
+/* the bytes follow, then padding to HE100_CAPTURE_ALIGN */
+struct he100_capture_record {
+    uint64_t ns;                // CLOCK_MONOTONIC
+    uint32_t length;            // bytes, stored last; 0 means not written
+    uint16_t direction;         // HE100_CAPTURE_RX or HE100_CAPTURE_TX
+    uint16_t channel;           // the file descriptor, to tell radios apart
+};
+
+struct he100_capture {
+    int fd;
+    int writable;
+    size_t map_length;
+    struct he100_capture_file_header *header;
+    unsigned char *records;
+};
+
+struct he100_replay_stats {
+    uint64_t records;
+    uint64_t rx_bytes;
+    uint64_t tx_records;        // skipped, the decoder only sees what was received
+    uint64_t frames;
+};
+
+/**
+ * Function to create a capture file, replacing any file at path
+ * @param capacity - bytes of records, 0 for HE100_CAPTURE_CAPACITY
+ * @return - HE_SUCCESS, or HE_FAILED_CAPTURE
+ */
+int HE100_captureOpen (struct he100_capture *capture, const char *path, uint64_t capacity);
+
+/* Function to open a capture file to replay or inspect */
+int HE100_captureOpenReadOnly (struct he100_capture *capture, const char *path);
+
+/* Function to close a capture, trimming the file to its records if it was being written */
+void HE100_captureClose (struct he100_capture *capture);
+
+/**
+ * Function to record serial bytes into every later HE100_captureBytes call,
+ * until HE100_captureStop. A write under way when it stops may still land,
+ * so close the capture once the serial threads are idle.
+ */
+void HE100_captureStart (struct he100_capture *capture);
+void HE100_captureStop (void);
+
+/**
+ * Function to append bytes to the started capture, if any. HE100_decoderFill
+ * calls it with what each read returned, the write functions with each frame
+ * as they start writing it.
+ * @param direction - HE100_CAPTURE_RX or HE100_CAPTURE_TX
+ * @param length - bytes to take from the pieces, which may hold more
+ */
+void HE100_captureBytes (int direction, int fd, const struct iovec *pieces, int count, size_t length);
+
+/* Function to append a record to a capture directly */
+int HE100_captureRecord (struct he100_capture *capture, int direction, int fd, const struct iovec *pieces, int count, size_t length);
+
+/**
+ * Function to step through the records of a capture
+ * @param offset - 0 to start, advanced past the record returned
+ * @return - the record, its bytes right after it, or NULL at the end
+ */
+const struct he100_capture_record *HE100_captureNext (const struct he100_capture *capture, uint64_t *offset);
+
+/**
+ * Function to replay the received bytes of a capture through a decoder
+ * @param decoder - initialized by the caller, and left with any partial frame
+ * @param speed - 1.0 for the recorded timing, 2.0 twice as fast, 0 as fast as possible
+ * @param callback - called with each frame and its HE100_validateDecodedFrame status
+ * @param stats - receives what was replayed, may be NULL
+ * @return - the number of frames delivered
+ */
+uint64_t HE100_captureReplay (const struct he100_capture *capture, struct he100_decoder *decoder, double speed, he100_rx_callback callback, void *context, struct he100_replay_stats *stats);
+
+#endif
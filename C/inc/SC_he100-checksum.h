@@ -0,0 +1,58 @@
+#ifndef SC_HE100_CHECKSUM_H_
+#define SC_HE100_CHECKSUM_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-checksum.h
+ *
+ *    Description:  Vectorized Fletcher-16 kernels behind HE100_fletcher16. The
+ *                  fastest kernel the CPU supports is picked on first use: AVX2
+ *                  or SSE2 on the ground PC, NEON on the BeagleBone, the scalar
+ *                  loop everywhere else. Every kernel returns the same sums as
+ *                  fletcher_checksum16.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 01:05:52 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <stddef.h>
+#include <SC_he100.h>
+
+#define HE100_CHECKSUM_SCALAR   0
+#define HE100_CHECKSUM_SSE2     1
+#define HE100_CHECKSUM_AVX2     2
+#define HE100_CHECKSUM_NEON     3
+#define HE100_CHECKSUM_KERNELS  4
+
+extern const char *HE100_CHECKSUM_KERNEL_NAMES[HE100_CHECKSUM_KERNELS];
+
+/**
+ * Function to check whether a kernel was built in and runs on this CPU
+ * @param kernel - one of HE100_CHECKSUM_SCALAR .. HE100_CHECKSUM_NEON
+ * @return - 1 if it can be selected, else 0
+ */
+int HE100_checksumSupported (int kernel);
+
+/**
+ * Function to force a kernel, for tests and benchmarks
+ * @return - HE_SUCCESS, or -1 if the kernel is not supported
+ */
+int HE100_checksumSelect (int kernel);
+
+/* Function to return the kernel HE100_fletcher16 currently runs */
+int HE100_checksumKernel (void);
+
+#if defined(HE100_CHECKSUM_NEON_KERNEL)
+/* NEON kernel, built in SC_he100-checksum-neon.c with -mfpu=neon */
+void HE100_fletcher16Neon (struct HE100_checksum *checksum, const unsigned char *data, size_t bytes);
+#endif
+
+#endif
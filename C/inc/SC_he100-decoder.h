@@ -0,0 +1,103 @@
+#ifndef SC_HE100_DECODER_H_
+#define SC_HE100_DECODER_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-decoder.h
+ *
+ *    Description:  Resumable frame decoder for bytes streamed from the He100. Bytes
+ *                  are pulled from the serial device in bulk into a ring buffer, and
+ *                  every complete frame found in the ring is handed back in turn.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 09:12:40 AM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <HE100_constants.h>
+#include <SC_he100.h>
+
+// the ring must be a power of two, and hold at least a few full frames
+#define HE100_DECODER_RING_SIZE     1024
+#define HE100_DECODER_RING_MASK     (HE100_DECODER_RING_SIZE-1)
+// longest frame on the wire: payload length byte maxed out plus the wrapper
+#define HE100_MAX_WIRE_FRAME        (MAX_FRAME_LENGTH+WRAPPER_LENGTH)
+
+struct he100_decoder {
+    unsigned char ring[HE100_DECODER_RING_SIZE];
+    size_t start;           // absolute index of the first byte of the candidate frame
+    size_t tail;            // absolute index one past the last byte received
+    size_t position;        // bytes of the candidate frame referenced so far
+    size_t frame_length;    // expected length of the candidate, MAX_FRAME_LENGTH until known
+    // Fletcher sums over the candidate, updated as each byte is parsed
+    struct HE100_checksum sum;
+    struct HE100_checksum check;    // sums a pair of checksum bytes must match
+    int candidate_status;   // HE_FAILED_CHECKSUM once a payload checksum byte mismatched
+    int status;             // candidate_status of the frame last returned
+    // counters, never reset by the decoder itself
+    uint64_t read_calls;    // syscalls issued by HE100_decoderFill
+    uint64_t bytes_in;      // bytes accepted into the ring
+    uint64_t frames;        // complete frames handed back
+    uint64_t discarded;     // bytes dropped while looking for a frame
+    uint64_t header_failures;   // candidates dropped at their header checksum
+    uint64_t payload_failures;  // frames returned with a bad payload checksum
+    uint64_t discarded_at_frame;    // discarded when the last frame was returned
+};
+
+/**
+ * Function to clear a decoder before first use
+ * @param decoder - the decoder to initialize
+ */
+void HE100_decoderInit (struct he100_decoder *decoder);
+
+/**
+ * Function to copy bytes already in memory into the decoder
+ * @param decoder - the decoder to fill
+ * @param bytes - the bytes to append
+ * @param length - the number of bytes to append
+ * @return - the number of bytes accepted, less than length if the ring is full
+ */
+size_t HE100_decoderFeed (struct he100_decoder *decoder, const unsigned char *bytes, size_t length);
+
+/**
+ * Function to pull every byte currently available on a file descriptor into the
+ * decoder with a single readv(). Call it once poll() reports the device readable,
+ * otherwise it blocks like read() would.
+ * @param decoder - the decoder to fill
+ * @param fdin - the file descriptor representing the serial device
+ * @return - bytes read, 0 if nothing was available or the ring is full, -1 on error
+ */
+ssize_t HE100_decoderFill (struct he100_decoder *decoder, int fdin);
+
+/**
+ * Function to extract the next complete frame from the decoder. Parsing resumes
+ * where the previous call stopped, so it can be called repeatedly until it
+ * returns 0 to collect every frame delivered by one read.
+ * Both checksums are checked as the bytes are parsed. A candidate whose header
+ * checksum fails is dropped at its eighth byte; a frame whose payload checksum
+ * fails is still returned, with decoder->status set to HE_FAILED_CHECKSUM.
+ * A dropped candidate gives up only its first byte, and parsing resumes at the
+ * next 48 65 sync pair after it, found with memchr rather than byte by byte.
+ * @param decoder - the decoder to parse
+ * @param frame - a buffer of at least HE100_MAX_WIRE_FRAME bytes to receive the frame
+ * @param length - set to the total length of the frame in bytes
+ * @return - 1 if a frame was copied to the buffer, 0 if more bytes are needed
+ */
+int HE100_decoderNext (struct he100_decoder *decoder, unsigned char *frame, size_t *length);
+
+/**
+ * Function returning the number of received bytes not yet parsed into a frame
+ */
+size_t HE100_decoderPending (const struct he100_decoder *decoder);
+
+#endif
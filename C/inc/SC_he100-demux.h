@@ -0,0 +1,99 @@
+#ifndef SC_HE100_DEMUX_H_
+#define SC_HE100_DEMUX_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-demux.h
+ *
+ *    Description:  Receive demultiplexer for frames the radio sends unasked.
+ *                  The He100 is full duplex: data heard on the air, telemetry
+ *                  dumps and over-the-air commands come down the interface
+ *                  whenever they arrive, between a command and its ACK as
+ *                  readily as anywhere else. A handle waiting for an answer
+ *                  puts each such frame in the bounded queue of its class
+ *                  instead of taking it for the answer, and HE100_handleRead
+ *                  hands them back in the order they arrived.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 11:12:27 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <SC_he100-decoder.h>
+
+/* queues, by the command byte of the frame */
+#define HE100_DEMUX_RECEIVED    0   // CMD_RECEIVE_DATA, heard on the air
+#define HE100_DEMUX_TELEMETRY   1   // CMD_TELEMETRY nobody asked for, CMD_TELEMETRY_DUMP
+#define HE100_DEMUX_OA          2   // over-the-air commands, CMD_PING_RETURN to CMD_TOGGLE_PIN
+#define HE100_DEMUX_QUEUES      3
+
+#define HE100_DEMUX_QUEUE_LENGTH    16  // frames per queue, a power of two
+
+struct he100_demux_frame {
+    unsigned char frame[HE100_MAX_WIRE_FRAME];
+    size_t length;
+    uint64_t sequence;          // arrival order across the queues
+};
+
+struct he100_demux_queue {
+    struct he100_demux_frame entries[HE100_DEMUX_QUEUE_LENGTH];
+    uint32_t head;              // next to hand back
+    uint32_t tail;              // next free, head == tail when empty
+    uint64_t queued;
+    uint64_t dropped;           // arrived while the queue was full
+};
+
+struct he100_demux {
+    struct he100_demux_queue queues[HE100_DEMUX_QUEUES];
+    uint64_t next_sequence;
+};
+
+/* Function to empty every queue */
+void HE100_demuxInit (struct he100_demux *demux);
+
+/**
+ * Function returning the queue a frame goes in when it answers nothing
+ * @return - HE100_DEMUX_RECEIVED, HE100_DEMUX_TELEMETRY, HE100_DEMUX_OA, or -1
+ *           for ACKs, NACKs and responses, which only ever answer a command
+ */
+int HE100_demuxClass (const unsigned char *frame, size_t length);
+
+/**
+ * Function to queue a frame that answers nothing. A full queue keeps what it
+ * holds and counts the frame as dropped.
+ * @return - the queue of the frame, or -1 if no queue takes it
+ */
+int HE100_demuxPush (struct he100_demux *demux, const unsigned char *frame, size_t length);
+
+/**
+ * Function to take the oldest frame from one queue
+ * @param frame - a buffer of at least HE100_MAX_WIRE_FRAME bytes
+ * @return - 1 if a frame was copied, 0 if the queue is empty
+ */
+int HE100_demuxPop (struct he100_demux *demux, int queue, unsigned char *frame, size_t *length);
+
+/**
+ * Function to take the frame that arrived first, whatever its queue
+ * @return - the queue it came from, or -1 if every queue is empty
+ */
+int HE100_demuxNext (struct he100_demux *demux, unsigned char *frame, size_t *length);
+
+/* Function returning the frames waiting in a queue */
+size_t HE100_demuxPending (const struct he100_demux *demux, int queue);
+
+/**
+ * Receive callback for HE100_rxRegister, or the unsolicited frames of a
+ * pipeline, queueing every valid frame of a class into the demux in context
+ */
+void HE100_demuxRxCallback (const unsigned char *frame, size_t length, int status, void *context);
+
+#endif
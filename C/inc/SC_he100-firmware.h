@@ -0,0 +1,118 @@
+#ifndef SC_HE100_FIRMWARE_H_
+#define SC_HE100_FIRMWARE_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-firmware.h
+ *
+ *    Description:  Firmware upload. The Intel HEX image is mapped and decoded
+ *                  once into packets of contiguous bytes, each sent as a
+ *                  CMD_FIRMWARE_PACKET through the pipeline, so packets stream
+ *                  back to back and ACKs are collected as they come. Once
+ *                  every packet is acknowledged, CMD_FIRMWARE_UPDATE carries
+ *                  the MD5 of the image and the radio flashes it.
+ *
+ *                  The interface manual leaves the packet layout TBD. Each
+ *                  packet here is the 4 byte flash address, little endian,
+ *                  then up to HE100_FIRMWARE_PACKET_DATA bytes: a packet sent
+ *                  twice writes the same bytes twice, so resending one whose
+ *                  ACK went missing is harmless.
+ *
+ *                  What was acknowledged is kept in the upload, and in a
+ *                  progress file if one is named, so an upload that stopped,
+ *                  or a process that died, carries on with the packets left.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 07:30:12 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <SC_he100-pipeline.h>
+
+#define HE100_FIRMWARE_ADDRESS_LENGTH   4
+#define HE100_FIRMWARE_PACKET_DATA      128 // bytes of image per CMD_FIRMWARE_PACKET
+#define HE100_FIRMWARE_MD5_LENGTH       16
+#define HE100_FIRMWARE_RETRIES          5   // passes over the packets not acknowledged, per upload call
+#define HE100_FIRMWARE_SAVE_EVERY       64  // acknowledged packets between progress file writes
+#define HE100_FIRMWARE_PROGRESS_MAGIC   "HE100FWP"
+
+/* packet states in he100_firmware_upload.state */
+#define HE100_FIRMWARE_UNSENT           0
+#define HE100_FIRMWARE_SENT             1
+#define HE100_FIRMWARE_ACKED            2
+
+struct he100_firmware_packet {
+    uint32_t address;
+    uint32_t offset;            // into he100_firmware_image.data
+    uint32_t length;
+};
+
+struct he100_firmware_image {
+    unsigned char *data;        // the bytes of every data record, in file order
+    size_t size;
+    struct he100_firmware_packet *packets;
+    size_t packet_count;
+    unsigned char md5[HE100_FIRMWARE_MD5_LENGTH];   // of the file as distributed
+};
+
+struct he100_firmware_upload {
+    const struct he100_firmware_image *image;
+    unsigned char *state;       // HE100_FIRMWARE_* per packet
+    const char *progress_path;  // NULL to keep progress in memory only
+    size_t packets_acked;
+    size_t saved_at;            // packets_acked when the progress file was last written
+    uint64_t bytes_acked;       // image bytes
+    uint64_t bytes_written;     // frames, wrapper and resends included
+    uint64_t resent;            // packets sent again
+    uint64_t elapsed_ns;        // time spent in HE100_firmwareUpload, over every call
+};
+
+/**
+ * Function to decode an Intel HEX text into packets. Data, end of file,
+ * extended segment and extended linear address records are understood;
+ * start address records are ignored.
+ * @return - HE_SUCCESS, or HE_INVALID_FIRMWARE on a malformed record or checksum
+ */
+int HE100_firmwareParse (struct he100_firmware_image *image, const char *text, size_t length);
+
+/**
+ * Function to map an Intel HEX file and decode it, as HE100_firmwareParse
+ * @return - HE_SUCCESS, or HE_INVALID_FIRMWARE if unreadable or malformed
+ */
+int HE100_firmwareLoad (struct he100_firmware_image *image, const char *path);
+
+void HE100_firmwareFree (struct he100_firmware_image *image);
+
+/**
+ * Function to start an upload of an image with nothing acknowledged
+ * @param progress_path - file to keep progress in, read back if it is for the same image; may be NULL
+ * @return - HE_SUCCESS, or HE_INVALID_FIRMWARE if out of memory
+ */
+int HE100_firmwareUploadInit (struct he100_firmware_upload *upload, const struct he100_firmware_image *image, const char *progress_path);
+
+void HE100_firmwareUploadFree (struct he100_firmware_upload *upload);
+
+/**
+ * Function to send every packet not yet acknowledged, then CMD_FIRMWARE_UPDATE.
+ * Packets NACKed or left without an ACK are sent again, for up to
+ * HE100_FIRMWARE_RETRIES passes; call again to resume after a failure.
+ * @return - HE_SUCCESS once the update command is acknowledged,
+ *           HE_FAILED_ACK_TIMEOUT if packets are still missing,
+ *           HE_FAILED_NACK if the radio refused the update,
+ *           or an error from HE100_pipelineSubmit
+ */
+int HE100_firmwareUpload (struct he100_pipeline *pipeline, struct he100_firmware_upload *upload);
+
+/* Function returning the image bytes acknowledged per second of upload */
+double HE100_firmwareRate (const struct he100_firmware_upload *upload);
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef SC_HE100_FRAGMENT_H_
+#define SC_HE100_FRAGMENT_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-fragment.h
+ *
+ *    Description:  Fragmentation and reassembly of messages larger than one frame.
+ *                  A message is sent as numbered fragments, each filling a
+ *                  CMD_TRANSMIT_DATA frame to MAX_TESTED_FRAME. On receive the
+ *                  fragments are put back together in a fixed table of slots;
+ *                  a message that stops arriving is given up after a timeout,
+ *                  reporting which fragments never came.
+ *
+ *                  Fragment layout, in front of each slice of the message:
+ *                    0     HE100_FRAGMENT_MARKER
+ *                    1-2   message id, big endian
+ *                    3     fragment index, from 0
+ *                    4     fragment count
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 03:02:18 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <SC_he100.h>
+
+#define HE100_FRAGMENT_MARKER       0xf5
+#define HE100_FRAGMENT_HEADER       5
+#define HE100_FRAGMENT_DATA         (MAX_TESTED_FRAME-HE100_FRAGMENT_HEADER) // message bytes per fragment
+#ifndef HE100_FRAGMENT_MAX_COUNT
+#define HE100_FRAGMENT_MAX_COUNT    64 // fragments per message, at most 255
+#endif
+#define HE100_FRAGMENT_MAX_MESSAGE  (HE100_FRAGMENT_MAX_COUNT*HE100_FRAGMENT_DATA)
+#define HE100_FRAGMENT_BITMAP_WORDS ((HE100_FRAGMENT_MAX_COUNT+31)/32)
+
+#define HE100_REASSEMBLY_SLOTS      4
+#define HE100_REASSEMBLY_TIMEOUT_MS 30000
+#define HE100_REASSEMBLY_COMPLETED  16 // ids of the latest messages completed, their late fragments within the timeout are duplicates
+
+// a received CMD_RECEIVE_DATA payload starts with the AX.25 address, control and PID
+#define HE100_AX25_HEADER_LENGTH    16
+
+/**
+ * Reassembly callback, once per message
+ * @param status - HE_SUCCESS when complete, HE_FAILED_REASSEMBLY_TIMEOUT when given up
+ * @param message - the message, NULL when given up
+ * @param missing - bit i of word i/32 is set while fragment i has not arrived
+ * @param context - the pointer given to HE100_reassemblyInit
+ */
+typedef void (*he100_message_callback)(int status, uint16_t message_id, const unsigned char *message, size_t length, const uint32_t *missing, void *context);
+
+struct he100_reassembly_slot {
+    int in_use;
+    uint16_t message_id;
+    uint8_t count;              // fragments in the message
+    uint8_t received;           // distinct fragments so far
+    size_t length;              // known once the last fragment is in
+    uint64_t updated;           // CLOCK_MONOTONIC ns of the latest fragment
+    uint32_t missing[HE100_FRAGMENT_BITMAP_WORDS];
+    unsigned char data[HE100_FRAGMENT_MAX_MESSAGE];
+};
+
+struct he100_reassembly {
+    struct he100_reassembly_slot slots[HE100_REASSEMBLY_SLOTS];
+    int timeout_ms;
+    he100_message_callback callback;
+    void *context;
+    uint16_t completed_ids[HE100_REASSEMBLY_COMPLETED]; // a ring, the next goes in completed % HE100_REASSEMBLY_COMPLETED
+    uint64_t completed_at[HE100_REASSEMBLY_COMPLETED];  // CLOCK_MONOTONIC ns each was completed
+    // counters
+    uint64_t fragments;
+    uint64_t duplicates;        // fragments already in, also of messages already completed
+    uint64_t rejected;          // not a fragment, or inconsistent with its slot
+    uint64_t completed;
+    uint64_t expired;           // timed out, or pushed out by a newer message
+};
+
+/**
+ * Function returning how many fragments a message of length bytes needs
+ * @return - the count, or -1 if the message is empty or too long
+ */
+int HE100_fragmentCount (size_t length);
+
+/**
+ * Function to fill in the header of one fragment and point at its slice
+ * @param header - HE100_FRAGMENT_HEADER bytes to fill in
+ * @param slice - set to the message bytes the fragment carries
+ * @return - HE_SUCCESS, or HE_INVALID_FRAGMENT
+ */
+int HE100_fragmentPrepare (const unsigned char *message, size_t length, uint16_t message_id, int index, unsigned char *header, struct iovec *slice);
+
+/**
+ * Function to transmit a message of up to HE100_FRAGMENT_MAX_MESSAGE bytes as
+ * fragments, waiting for the ACK of each one
+ * @return - HE_SUCCESS, or the error of the first fragment that failed
+ */
+int HE100_fragmentSend (int fdin, const unsigned char *message, size_t length, uint16_t message_id);
+
+/**
+ * Function to transmit a message, numbering it after the previous one. The
+ * first number is drawn from the time and process id, so a restarted sender
+ * does not reuse the ids the receiver has just completed.
+ */
+int HE100_transmitMessage (int fdin, const unsigned char *message, size_t length);
+
+/* Function to set up an empty reassembly table */
+void HE100_reassemblyInit (struct he100_reassembly *reassembly, int timeout_ms, he100_message_callback callback, void *context);
+
+/**
+ * Function to take one fragment, as it was sent
+ * @return - HE_SUCCESS if taken, 1 if it completed a message, or HE_INVALID_FRAGMENT
+ */
+int HE100_reassemblyAccept (struct he100_reassembly *reassembly, const unsigned char *fragment, size_t length);
+
+/**
+ * Function to take a received CMD_RECEIVE_DATA frame, sync bytes through
+ * payload checksum, and pass on the fragment it carries
+ */
+int HE100_reassemblyFrame (struct he100_reassembly *reassembly, const unsigned char *frame, size_t length);
+
+/**
+ * Receive engine callback, register it for CMD_RECEIVE_DATA with the table as context
+ */
+void HE100_reassemblyRxCallback (const unsigned char *frame, size_t length, int status, void *context);
+
+/**
+ * Function to give up on messages that have not progressed within the timeout
+ * @return - the number of messages given up
+ */
+int HE100_reassemblyExpire (struct he100_reassembly *reassembly);
+
+/**
+ * Function to copy the missing fragment bitmap of a message being reassembled
+ * @return - HE_SUCCESS, or -1 if no slot holds the message
+ */
+int HE100_reassemblyMissing (struct he100_reassembly *reassembly, uint16_t message_id, uint32_t *missing);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef SC_HE100_FRAMES_H_
+#define SC_HE100_FRAMES_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-frames.h
+ *
+ *    Description:  Command frames worked out by the compiler. The control
+ *                  commands with no payload never change, and the one byte
+ *                  commands have only 256 forms each, so their frames are
+ *                  constant arrays, checksums included, and sending one is a
+ *                  single write.
+ *
+ *                  The checksums are macros over constants rather than
+ *                  function calls, so they fold at compile time in C and in
+ *                  every C++ the flight compilers accept. Fletcher mod 256
+ *                  over bytes a,b,c,... is sum1 = a+b+c+... and
+ *                  sum2 = n*a + (n-1)*b + ... , both taken mod 256.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 06:03:44 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <HE100_constants.h>
+
+#define HE100_EMPTY_FRAME_LENGTH    WRAPPER_LENGTH      // header and two zero bytes
+#define HE100_BYTE_FRAME_LENGTH     (WRAPPER_LENGTH+1)  // header, the byte, payload checksum
+
+// the header checksum, over direction, command and the two length bytes
+#define HE100_HEADER_SUM1(command, length) ((CMD_TRANSMIT + (command) + (length)) & 0xff)
+#define HE100_HEADER_SUM2(command, length) ((4*CMD_TRANSMIT + 3*(command) + (length)) & 0xff)
+
+#define HE100_FRAME_HEADER(command, length) \
+    SYNC1, SYNC2, CMD_TRANSMIT, (command), 0x00, (length), \
+    HE100_HEADER_SUM1(command, length), HE100_HEADER_SUM2(command, length)
+
+// the payload checksum of a one byte payload runs on over the header checksum
+#define HE100_BYTE_SUM1(command, value) \
+    ((CMD_TRANSMIT + (command) + 1 + HE100_HEADER_SUM1(command, 1) + HE100_HEADER_SUM2(command, 1) + (value)) & 0xff)
+#define HE100_BYTE_SUM2(command, value) \
+    ((7*CMD_TRANSMIT + 6*(command) + 4 + 3*HE100_HEADER_SUM1(command, 1) + 2*HE100_HEADER_SUM2(command, 1) + (value)) & 0xff)
+
+// no payload goes out with two zero bytes after the header, as HE100_prepareTransmission leaves them
+#define HE100_EMPTY_FRAME(command) { HE100_FRAME_HEADER(command, 0), 0x00, 0x00 }
+#define HE100_BYTE_FRAME(command, value) \
+    { HE100_FRAME_HEADER(command, 1), (value), HE100_BYTE_SUM1(command, value), HE100_BYTE_SUM2(command, value) },
+
+extern const unsigned char HE100_FRAME_NOOP[HE100_EMPTY_FRAME_LENGTH];
+extern const unsigned char HE100_FRAME_RESET[HE100_EMPTY_FRAME_LENGTH];
+extern const unsigned char HE100_FRAME_GET_CONFIG[HE100_EMPTY_FRAME_LENGTH];
+extern const unsigned char HE100_FRAME_READ_FIRMWARE_V[HE100_EMPTY_FRAME_LENGTH];
+extern const unsigned char HE100_FRAME_TELEMETRY[HE100_EMPTY_FRAME_LENGTH];
+
+// indexed by the payload byte: the power level, or the beacon interval in seconds
+extern const unsigned char HE100_FRAME_FAST_SET_PA[256][HE100_BYTE_FRAME_LENGTH];
+extern const unsigned char HE100_FRAME_BEACON_CONFIG[256][HE100_BYTE_FRAME_LENGTH];
+
+#endif
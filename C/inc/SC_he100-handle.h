@@ -0,0 +1,182 @@
+#ifndef SC_HE100_HANDLE_H_
+#define SC_HE100_HANDLE_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-handle.h
+ *
+ *    Description:  Per-radio handle. Everything one radio needs between calls
+ *                  lives in its HE100_Handle: the decoder holding bytes read
+ *                  ahead, the response buffer, statistics and the error
+ *                  policy. Nothing is shared between handles, so each radio
+ *                  can be driven from its own thread.
+ *
+ *                  The handle also caches the radio configuration, filled by
+ *                  HE100_handleGetConfig and kept up to date by each
+ *                  successful HE100_handleSetConfig, so reading it back or
+ *                  setting it unchanged costs no serial traffic. A soft reset
+ *                  restores the flash settings and drops the cache.
+ *
+ *                  Frames the radio sends unasked, such as data received
+ *                  while a command waits for its ACK, are queued in the
+ *                  handle's demux and read back by HE100_handleRead.
+ *
+ *                  The fd functions in SC_he100.h run on a handle kept for
+ *                  each fd they are given, with the legacy policy, so radios
+ *                  on different fds keep their state apart as with handles.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 03:48:05 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <SC_he100.h>
+#include <SC_he100-decoder.h>
+#include <SC_he100-rto.h>
+#include <SC_he100-demux.h>
+#include <SC_he100-recovery.h>
+
+#define HE100_HANDLE_READ_TIMEOUT   2 // seconds, as HE100_write waits for an ACK
+#define HE100_LEGACY_HANDLES        8 // fds the fd functions keep handles for at once
+
+struct he100_policy {
+    time_t ack_timeout;         // seconds to wait for the ACK of each command, at most
+    int soft_reset_on_invalid;  // soft reset the radio after invalid frames, as recovery allows
+    struct he100_recovery_policy recovery;
+    int adaptive_timeout;       // wait as long as handle->rto gives each command, not ack_timeout
+};
+
+struct he100_handle_stats {
+    uint64_t commands;          // frames written
+    uint64_t bytes_written;
+    uint64_t write_errors;
+    uint64_t frames;            // frames decoded
+    uint64_t acks;
+    uint64_t nacks;
+    uint64_t invalid;           // frames that failed validation, NACKs aside
+    uint64_t timeouts;          // reads that ended with no frame
+    uint64_t read_errors;
+    uint64_t soft_resets;       // issued by the policy, see also recovery.stats
+    uint64_t config_hits;       // configuration reads answered from the cache
+    uint64_t config_skipped;    // HE100_handleSetConfig calls that matched the cache
+    uint64_t stale;             // answers to another command, such as ACKs come after it was given up
+};
+
+struct he100_config_cache {
+    int valid;
+    unsigned char bytes[CFG_PAYLOAD_LENGTH];    // as HE100_prepareConfig makes them, for comparing
+    struct he100_settings settings;
+};
+
+typedef struct he100_handle {
+    int fdin;
+    struct he100_decoder decoder;
+    struct he100_policy policy;
+    struct he100_handle_stats stats;
+    unsigned char response[HE100_MAX_WIRE_FRAME];   // the frame last read
+    size_t response_length;
+    int status;                 // validation result of the frame last read
+    uint64_t sent;              // HE100_monotonicNs when the last command was written
+    struct he100_config_cache config;
+    struct he100_rto rto;       // response timeouts, from HE100_RTO_FLOOR_MS to ack_timeout
+    struct he100_demux demux;   // frames sent unasked while a command waited
+    struct he100_recovery recovery; // when the policy may soft reset next
+} HE100_Handle;
+
+/**
+ * Function to set up a handle on an open serial device, with the default
+ * policy: no soft reset on invalid frames, adaptive timeouts. Changes to
+ * policy.recovery take effect at once, the breaker state carries over.
+ * @return - HE_SUCCESS, or HE_FAILED_OPEN_PORT
+ */
+int HE100_handleInit (HE100_Handle *handle, int fdin);
+
+/**
+ * Function to read the next frame, as HE100_read does. Frames queued in
+ * handle->demux while a command waited come first, oldest first.
+ * @param timeout - seconds to wait for a frame
+ * @param payload - receives the payload, may be NULL to leave it in handle->response
+ * @return - the number of payload bytes, or -1 with handle->status telling why
+ */
+int HE100_handleRead (HE100_Handle *handle, time_t timeout, unsigned char *payload);
+
+/**
+ * Function to wait for the ACK, NACK or response to the command written at
+ * handle->sent. Reads until handle->sent plus the command's timeout and times
+ * the answer. Frames for other commands are no answer: received data,
+ * telemetry and over-the-air commands are queued in handle->demux, anything
+ * else is passed over.
+ * @param payload - as for HE100_handleRead
+ * @return - as HE100_handleRead
+ */
+int HE100_handleAwait (HE100_Handle *handle, unsigned char command, unsigned char *payload);
+
+/**
+ * Function to write a command and wait for its ACK, as HE100_dispatchTransmissionv does
+ * @return - HE_SUCCESS, HE_FAILED_PREPARE_TRANSMISSION, or 1 if the write or ACK failed
+ */
+int HE100_handleDispatch (HE100_Handle *handle, const struct iovec *payload, int iovcnt, unsigned char *command);
+
+/**
+ * Function to write a frame built beforehand, such as one of SC_he100-frames.h,
+ * and wait for its ACK
+ * @return - as HE100_handleDispatch
+ */
+int HE100_handleDispatchFrame (HE100_Handle *handle, const unsigned char *frame, size_t length);
+
+/* The commands of SC_he100.h, on a handle */
+int HE100_handleNOOP (HE100_Handle *handle);
+int HE100_handleTransmitData (HE100_Handle *handle, unsigned char *transmit_data_payload, size_t transmit_data_len);
+int HE100_handleSetBeaconInterval (HE100_Handle *handle, int beacon_interval);
+int HE100_handleSetBeaconMessage (HE100_Handle *handle, unsigned char *set_beacon_message_payload, size_t beacon_message_len);
+int HE100_handleFastSetPA (HE100_Handle *handle, int power_level);
+int HE100_handleSoftReset (HE100_Handle *handle);
+int HE100_handleReadFirmwareRevision (HE100_Handle *handle);
+int HE100_handleGetConfig (HE100_Handle *handle, struct he100_settings *settings);
+int HE100_handleSetConfig (HE100_Handle *handle, struct he100_settings he100_new_settings);
+
+/**
+ * Function to read the configuration from the cache, with no serial traffic,
+ * or with HE100_handleGetConfig if nothing is cached
+ * @return - HE_SUCCESS, or what HE100_handleGetConfig returned
+ */
+int HE100_handleCurrentConfig (HE100_Handle *handle, struct he100_settings *settings);
+
+/* Function to drop the cached configuration, so the next read asks the radio */
+void HE100_handleInvalidateConfig (HE100_Handle *handle);
+
+/**
+ * Function returning the handle the fd functions use for an fd, set up on
+ * first use to soft reset on invalid frames with the default recovery policy,
+ * and set up again once the fd is found open on another file than it was.
+ * The same file closed and opened again on the fd, such as one more pty
+ * master from /dev/ptmx, looks no different: close with HE100_closePort.
+ * Handles of up to HE100_LEGACY_HANDLES fds are kept; past that the least
+ * recently used one no call is using goes to the new fd. Finding the handle
+ * is thread safe, using it is as for any handle: one thread per fd.
+ * @return - the handle, to give back with HE100_legacyPut; NULL if every
+ *           handle is in use
+ */
+HE100_Handle *HE100_legacyHandle (int fdin);
+
+/* Function to give back a handle HE100_legacyHandle returned, once the call using it is done */
+void HE100_legacyPut (HE100_Handle *handle);
+
+/**
+ * Function to drop the handle of an fd about to be closed, so a device opened
+ * on the same fd later starts afresh; HE100_closePort does it
+ */
+void HE100_legacyRelease (int fdin);
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef SC_HE100_PIPELINE_H_
+#define SC_HE100_PIPELINE_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-pipeline.h
+ *
+ *    Description:  Pipelined transmit. Keeps a window of frames in flight and
+ *                  matches each incoming ACK/NACK (48 65 20 <cmd> 0a 0a ..) to the
+ *                  oldest outstanding frame with the same command byte, completing
+ *                  it through a callback instead of blocking on every round trip.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 11:20:37 AM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <SC_he100-rx.h>
+
+#define HE100_PIPELINE_MAX_WINDOW       16
+#define HE100_PIPELINE_DEFAULT_WINDOW   8
+#define HE100_PIPELINE_ACK_TIMEOUT_MS   2000 // same window HE100_write waits
+
+/**
+ * Transmit completion callback
+ * @param status - HE_SUCCESS on ACK, HE_FAILED_NACK on NACK, HE_FAILED_ACK_TIMEOUT
+ * @param response - the frame that completed the request, NULL on timeout
+ * @param length - the entire length of the response in bytes
+ * @param context - the pointer given when the frame was submitted
+ */
+typedef void (*he100_tx_callback)(int status, const unsigned char *response, size_t length, void *context);
+
+struct he100_pending {
+    uint32_t sequence;      // submission order
+    unsigned char command;  // command byte the response must carry
+    uint64_t sent;          // CLOCK_MONOTONIC ns when the frame was written
+    he100_tx_callback callback;
+    void *context;
+};
+
+struct he100_pipeline {
+    struct he100_rx_engine rx;
+    int window;                 // frames allowed in flight
+    int ack_timeout_ms;
+    struct he100_pending pending[HE100_PIPELINE_MAX_WINDOW];
+    int in_flight;              // entries used in pending, unordered
+    uint32_t next_sequence;
+    // frames that answer nothing outstanding, such as CMD_RECEIVE_DATA
+    he100_rx_callback unsolicited;
+    void *unsolicited_context;
+    // counters
+    uint64_t submitted;
+    uint64_t acked;
+    uint64_t nacked;
+    uint64_t timed_out;
+};
+
+/**
+ * Function to set up a pipeline on an open serial device
+ * @param window - frames allowed in flight, 1 to HE100_PIPELINE_MAX_WINDOW
+ * @return - HE_SUCCESS, or HE_FAILED_OPEN_PORT
+ */
+int HE100_pipelineInit (struct he100_pipeline *pipeline, int fdin, int window);
+
+/**
+ * Function to prepare and write a frame without waiting for its ACK. Blocks
+ * only while the window is full, processing responses until a slot frees.
+ * @param command - the two command bytes, as for HE100_dispatchTransmission
+ * @param callback - called once with the outcome, may be NULL
+ * @return - HE_SUCCESS once written, else an error code
+ */
+int HE100_pipelineSubmit (struct he100_pipeline *pipeline, unsigned char *payload, size_t length, unsigned char *command, he100_tx_callback callback, void *context);
+
+/**
+ * Function to queue HE100_transmitData through the pipeline
+ */
+int HE100_pipelineTransmitData (struct he100_pipeline *pipeline, unsigned char *payload, size_t length, he100_tx_callback callback, void *context);
+
+/**
+ * Function to process responses and expire frames whose ACK never came
+ * @param timeout_ms - how long to wait for a response at most, -1 for as long
+ *                     as it takes; never past the ACK deadline of a frame in flight
+ * @return - the number of submissions completed, -1 if the device failed
+ */
+int HE100_pipelinePoll (struct he100_pipeline *pipeline, int timeout_ms);
+
+/**
+ * Function to wait until every frame in flight is completed
+ * @return - HE_SUCCESS, or -1 if the device failed
+ */
+int HE100_pipelineFlush (struct he100_pipeline *pipeline);
+
+/**
+ * Function to release the pipeline. Frames still in flight are completed
+ * with HE_FAILED_ACK_TIMEOUT.
+ */
+void HE100_pipelineClose (struct he100_pipeline *pipeline);
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef SC_HE100_RECOVERY_H_
+#define SC_HE100_RECOVERY_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-recovery.h
+ *
+ *    Description:  When to soft reset the radio after invalid frames. A reset
+ *                  writes a frame and waits out an ACK window of its own, so
+ *                  resetting on every corrupted frame of a noisy pass keeps
+ *                  the radio offline. Instead:
+ *
+ *                  - errors are counted over a window of frames, and a reset
+ *                    is only called for once enough of them are invalid;
+ *                  - a reset is judged by the frames after it: a run of valid
+ *                    ones and it helped, more errors first and it did not;
+ *                  - each reset that did not help doubles the time before the
+ *                    next one may be issued;
+ *                  - after breaker_threshold such resets in a row the breaker
+ *                    opens and no reset is issued for the cool-down. Then one
+ *                    trial reset is allowed; the breaker closes if it helps
+ *                    and opens again if not.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 11:46:09 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <stdint.h>
+
+/* breaker states */
+#define HE100_RECOVERY_CLOSED       0   // resets issued when the error rate calls for one
+#define HE100_RECOVERY_OPEN         1   // resets kept failing, none until the cool-down ends
+#define HE100_RECOVERY_HALF_OPEN    2   // one trial reset allowed
+
+struct he100_recovery_policy {
+    uint64_t window_ns;         // errors are counted over windows this long
+    int error_threshold;        // invalid frames in a window before a reset, at least
+    int error_percent;          // and this share of the frames in it
+    int recovered_frames;       // valid frames in a row after a reset for it to have helped
+    uint64_t backoff_ns;        // time after a reset before the next, doubled for each that did not help
+    uint64_t backoff_max_ns;
+    int breaker_threshold;      // resets in a row that did not help before the breaker opens, 0 never
+    uint64_t cooldown_ns;       // how long the breaker stays open
+};
+
+struct he100_recovery_stats {
+    uint64_t resets;            // allowed and issued
+    uint64_t suppressed;        // called for by the error rate but held back
+    uint64_t failed;            // resets followed by more errors, not recovery
+    uint64_t recovered;         // resets followed by recovered_frames valid frames
+    uint64_t trips;             // times the breaker opened
+};
+
+struct he100_recovery {
+    int state;
+    uint64_t window_start;      // CLOCK_MONOTONIC ns
+    uint32_t window_frames;
+    uint32_t window_errors;
+    int judging;                // a reset was issued and not judged yet
+    int clean;                  // valid frames in a row
+    int failures;               // resets in a row that did not help
+    uint64_t backoff_ns;        // wait after the next reset
+    uint64_t not_before;        // no reset before then
+    uint64_t opened;            // when the breaker last opened
+    struct he100_recovery_stats stats;
+};
+
+/**
+ * Function to fill a policy with the defaults: a reset once 3 of the frames
+ * of a 10 s window, and a fifth of them, are invalid; 1 s backoff up to 64 s;
+ * the breaker opens after 3 resets in a row that did not help, for 60 s
+ */
+void HE100_recoveryDefaults (struct he100_recovery_policy *policy);
+
+/* Function to close the breaker and clear the counts */
+void HE100_recoveryInit (struct he100_recovery *recovery, const struct he100_recovery_policy *policy);
+
+/**
+ * Function to count a decoded frame
+ * @param valid - 0 for a frame that failed validation, NACKs are valid
+ * @param now - HE100_monotonicNs
+ */
+void HE100_recoveryFrame (struct he100_recovery *recovery, const struct he100_recovery_policy *policy, int valid, uint64_t now);
+
+/**
+ * Function to decide whether to soft reset now, after an invalid frame.
+ * Counts the reset in stats.suppressed if the error rate calls for one but
+ * the backoff or the breaker holds it back.
+ * @return - 1 to reset, then report it with HE100_recoveryReset; else 0
+ */
+int HE100_recoveryAllow (struct he100_recovery *recovery, const struct he100_recovery_policy *policy, uint64_t now);
+
+/**
+ * Function to note a reset allowed by HE100_recoveryAllow was issued
+ * @param result - what HE100_handleSoftReset returned, for the log
+ */
+void HE100_recoveryReset (struct he100_recovery *recovery, const struct he100_recovery_policy *policy, int result, uint64_t now);
+
+/* Function returning "closed", "open" or "half open" */
+const char *HE100_recoveryStateName (int state);
+
+#endif
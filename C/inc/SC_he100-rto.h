@@ -0,0 +1,64 @@
+#ifndef SC_HE100_RTO_H_
+#define SC_HE100_RTO_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-rto.h
+ *
+ *    Description:  Response timeouts from measured round trips, per command
+ *                  byte, as TCP computes its retransmission timeout (RFC 6298):
+ *                  a smoothed round trip time and its mean deviation, the
+ *                  timeout four deviations above the mean, held between a
+ *                  floor and a ceiling. Until a command has been timed it gets
+ *                  the ceiling; each timeout doubles its wait until the next
+ *                  answer is timed.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 10:05:44 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <stdint.h>
+#include <SC_he100-stats.h>
+
+#define HE100_RTO_FLOOR_MS          20
+#define HE100_RTO_CEILING_MS        2000    // the window HE100_write always waited
+#define HE100_RTO_GRANULARITY_NS    1000000 // poll() waits in milliseconds
+
+struct he100_rto_estimate {
+    uint64_t srtt_ns;           // smoothed round trip, 0 until timed
+    uint64_t rttvar_ns;         // its mean deviation
+    uint64_t rto_ns;            // the wait now, backed off after timeouts
+    uint64_t samples;
+    uint64_t timeouts;
+};
+
+struct he100_rto {
+    uint64_t floor_ns;
+    uint64_t ceiling_ns;
+    struct he100_rto_estimate commands[HE100_STATS_COMMANDS]; // slot 0 also takes any above, as the stats
+};
+
+/* Function to start every command at the ceiling */
+void HE100_rtoInit (struct he100_rto *rto, int floor_ms, int ceiling_ms);
+
+/* Function returning how long to wait for the answer to a command, in nanoseconds */
+uint64_t HE100_rtoTimeout (const struct he100_rto *rto, unsigned char command);
+
+/**
+ * Function to take the time from writing a command to its ACK, NACK or
+ * response, and publish the new estimate with HE100_statsRto
+ */
+void HE100_rtoSample (struct he100_rto *rto, unsigned char command, uint64_t rtt_ns);
+
+/* Function to double the wait of a command that went unanswered, up to the ceiling */
+void HE100_rtoBackoff (struct he100_rto *rto, unsigned char command);
+
+#endif
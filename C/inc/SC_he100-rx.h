@@ -0,0 +1,91 @@
+#ifndef SC_HE100_RX_H_
+#define SC_HE100_RX_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-rx.h
+ *
+ *    Description:  Event driven receive engine. Sleeps in epoll until the serial
+ *                  device is readable or a deadline passes, decodes every frame
+ *                  that arrived and hands each one to the callbacks registered
+ *                  for its command byte.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 10:02:11 AM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <SC_he100-decoder.h>
+
+#define HE100_RX_MAX_HANDLERS   8
+#define HE100_RX_ANY_COMMAND    -1 // register for every command byte
+
+/**
+ * Receive callback
+ * @param frame - the complete frame, sync bytes through payload checksum
+ * @param length - the entire length of the frame in bytes
+ * @param status - the result of HE100_validateDecodedFrame on the frame
+ * @param context - the pointer given when the callback was registered
+ */
+typedef void (*he100_rx_callback)(const unsigned char *frame, size_t length, int status, void *context);
+
+struct he100_rx_handler {
+    int command;
+    he100_rx_callback callback;
+    void *context;
+};
+
+struct he100_rx_engine {
+    int epfd;
+    int fdin;
+    struct he100_decoder decoder;
+    struct he100_rx_handler handlers[HE100_RX_MAX_HANDLERS];
+    int handler_count;
+    // timing, in nanoseconds of CLOCK_MONOTONIC
+    uint64_t last_fill;         // when the latest bytes were read from the device
+    uint64_t wakeups;           // times epoll_wait returned
+    uint64_t latency_samples;   // frames delivered
+    uint64_t latency_last;      // last byte read to callback, last frame
+    uint64_t latency_max;
+    uint64_t latency_total;
+};
+
+/**
+ * Function to set up an engine on an open serial device
+ * @param engine - the engine to initialize
+ * @param fdin - the file descriptor representing the serial device
+ * @return - HE_SUCCESS, or HE_FAILED_OPEN_PORT if epoll could not be set up
+ */
+int HE100_rxInit (struct he100_rx_engine *engine, int fdin);
+
+/**
+ * Function to register a callback for frames carrying a command byte
+ * @param command - the command byte to match, or HE100_RX_ANY_COMMAND
+ * @return - HE_SUCCESS, or -1 if every handler slot is taken
+ */
+int HE100_rxRegister (struct he100_rx_engine *engine, int command, he100_rx_callback callback, void *context);
+
+/**
+ * Function to wait for frames and deliver them. Sleeps until the device is
+ * readable, then delivers every frame completed by what was read. Returns as
+ * soon as at least one frame was delivered, or once timeout_ms has elapsed.
+ * @param timeout_ms - how long to wait at most, -1 to wait forever
+ * @return - number of frames delivered, -1 if the device failed
+ */
+int HE100_rxRun (struct he100_rx_engine *engine, int timeout_ms);
+
+/**
+ * Function to release the epoll instance. Does not close the serial device.
+ */
+void HE100_rxClose (struct he100_rx_engine *engine);
+
+#endif
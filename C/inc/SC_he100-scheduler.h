@@ -0,0 +1,144 @@
+#ifndef SC_HE100_SCHEDULER_H_
+#define SC_HE100_SCHEDULER_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-scheduler.h
+ *
+ *    Description:  Transmit scheduler paced to the RF rate. The radio ACKs a
+ *                  CMD_TRANSMIT_DATA as soon as it is over the interface, and
+ *                  the interface is faster than the air, so a long burst fills
+ *                  the radio's transmit buffer and ends in NACKs. Frames are
+ *                  queued here by class instead and written by
+ *                  HE100_schedulerRun, commands first, then data, then
+ *                  beacons, each class in order.
+ *
+ *                  Data is paced with a token bucket of air bits, filled at the
+ *                  tx_rf_baud_rate of the cached configuration and as deep as
+ *                  the radio buffers. A frame costs its preamble and postamble
+ *                  flags, AX.25 header, FCS, closing flag and the bits HDLC
+ *                  stuffing adds, counted exactly over the data. The bucket is
+ *                  kept as the time the radio's buffer would drain, so waiting
+ *                  for tokens is a comparison with the clock. Commands never go
+ *                  on the air and are not paced.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 09:24:03 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include <SC_he100.h>
+#include <SC_he100-handle.h>
+#include <SC_he100-pipeline.h>
+
+/* queues, in the order they are served */
+#define HE100_SCHEDULER_COMMAND     0
+#define HE100_SCHEDULER_DATA        1
+#define HE100_SCHEDULER_BEACON      2
+#define HE100_SCHEDULER_CLASSES     3
+
+#define HE100_SCHEDULER_QUEUE_LENGTH    16  // frames per class, a power of two
+#define HE100_SCHEDULER_DEPTH_FRAMES    2   // longest frames the radio buffers by default: one on the air, one waiting
+#define HE100_SCHEDULER_RETRIES         3   // writes of a NACKed data frame before it is dropped
+#define HE100_SCHEDULER_DEFAULT_FLAGS   20  // preamble or postamble flags configured as 0
+
+struct he100_scheduled {
+    unsigned char frame[HE100_MAX_WIRE_FRAME];
+    size_t length;
+    uint64_t air_ns;            // time on the air, 0 for commands
+    int attempts;
+    he100_tx_callback callback;
+    void *context;
+};
+
+struct he100_scheduler_queue {
+    struct he100_scheduled entries[HE100_SCHEDULER_QUEUE_LENGTH];
+    uint32_t head;              // next to send
+    uint32_t tail;              // next free, head == tail when empty
+};
+
+struct he100_scheduler_stats {
+    uint64_t sent[HE100_SCHEDULER_CLASSES];     // frames ACKed, by class
+    uint64_t air_bits;          // charged to the bucket for ACKed frames
+    uint64_t nacks;
+    uint64_t failed;            // given up: NACKed too often, or not written
+    uint64_t paced;             // times HE100_schedulerRun slept for tokens
+    uint64_t paced_ns;
+};
+
+struct he100_scheduler {
+    HE100_Handle *handle;
+    int rf_baud;                // air bits per second
+    int preamble_flags;
+    int postamble_flags;
+    uint64_t depth_ns;          // bucket depth, as time on the air
+    uint64_t air_free;          // CLOCK_MONOTONIC ns when the radio's buffer drains; the bucket is full from then on
+    struct he100_scheduler_queue queues[HE100_SCHEDULER_CLASSES];
+    struct he100_scheduler_stats stats;
+};
+
+/**
+ * Function to set up a scheduler writing through a handle, paced to the
+ * configuration it has cached, or reads from the radio
+ * @return - HE_SUCCESS, or what HE100_handleCurrentConfig returned
+ */
+int HE100_schedulerInit (struct he100_scheduler *scheduler, HE100_Handle *handle);
+
+/**
+ * Function to pace to a configuration, such as one just given to
+ * HE100_handleSetConfig. Resets the bucket depth to HE100_SCHEDULER_DEPTH_FRAMES.
+ * @return - HE_SUCCESS, or HE_INVALID_RF_BAUD_RATE
+ */
+int HE100_schedulerConfigure (struct he100_scheduler *scheduler, const struct he100_settings *settings);
+
+/**
+ * Function returning the time a CMD_TRANSMIT_DATA payload spends on the air
+ * @return - nanoseconds
+ */
+uint64_t HE100_schedulerAirtime (const struct he100_scheduler *scheduler, const unsigned char *data, size_t length);
+
+/**
+ * Function to queue a command for HE100_schedulerRun
+ * @param queue - HE100_SCHEDULER_COMMAND, HE100_SCHEDULER_DATA or HE100_SCHEDULER_BEACON
+ * @param command - the two command bytes, as for HE100_dispatchTransmission
+ * @param callback - called once with the outcome, may be NULL
+ * @return - HE_SUCCESS, HE_FAILED_PREPARE_TRANSMISSION, or -1 if the queue is full
+ */
+int HE100_schedulerSubmit (struct he100_scheduler *scheduler, int queue, const struct iovec *payload, int iovcnt, unsigned char *command, he100_tx_callback callback, void *context);
+
+/* Function to queue a frame built beforehand, such as one of SC_he100-frames.h */
+int HE100_schedulerSubmitFrame (struct he100_scheduler *scheduler, int queue, const unsigned char *frame, size_t length, he100_tx_callback callback, void *context);
+
+/* Commands of SC_he100.h, queued */
+int HE100_schedulerTransmitData (struct he100_scheduler *scheduler, const unsigned char *data, size_t length, he100_tx_callback callback, void *context);
+int HE100_schedulerFastSetPA (struct he100_scheduler *scheduler, int power_level, he100_tx_callback callback, void *context);
+
+/**
+ * Function returning how long until the next queued frame may be written
+ * @return - nanoseconds, 0 if now, UINT64_MAX if nothing is queued
+ */
+uint64_t HE100_schedulerDelay (const struct he100_scheduler *scheduler);
+
+/* Function returning the frames queued in every class */
+int HE100_schedulerPending (const struct he100_scheduler *scheduler);
+
+/**
+ * Function to write queued frames as the bucket allows, waiting for the ACK
+ * of each. A command queued from a callback goes before any more data.
+ * Returns once the queues are empty, or timeout_ms has elapsed.
+ * @param timeout_ms - how long to run at most, -1 until the queues are empty
+ * @return - the number of frames completed, ACKed or given up
+ */
+int HE100_schedulerRun (struct he100_scheduler *scheduler, int timeout_ms);
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef SC_HE100_STATS_H_
+#define SC_HE100_STATS_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-stats.h
+ *
+ *    Description:  Link counters kept per command byte: frames and bytes each
+ *                  way, ACKs, NACKs, checksum failures, resyncs, and a
+ *                  histogram of the time from writing a frame to its ACK or
+ *                  response. Frames are counted where every frame passes,
+ *                  the write functions and the decoder, with relaxed atomic
+ *                  adds and no locks, so any thread may update or read them.
+ *
+ *                  The histogram is log-linear, as HdrHistogram: each power of
+ *                  two of microseconds is split in HE100_LATENCY_SUB_BUCKETS,
+ *                  so a recorded value is off by at most 1/8th.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 05:22:09 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define HE100_STATS_COMMANDS        64  // command bytes 0x00 to 0x3f, slot 0 also takes any above
+#define HE100_LATENCY_SUB_BITS      3
+#define HE100_LATENCY_SUB_BUCKETS   (1 << HE100_LATENCY_SUB_BITS)
+// microseconds up to 2^32, about 71 minutes, beyond that lands in the last bucket
+#define HE100_LATENCY_BUCKETS       ((32 - HE100_LATENCY_SUB_BITS + 1) * HE100_LATENCY_SUB_BUCKETS)
+
+struct he100_latency_histogram {
+    uint64_t count;
+    uint64_t total_us;
+    uint64_t max_us;
+    uint64_t buckets[HE100_LATENCY_BUCKETS];
+};
+
+struct he100_command_stats {
+    uint64_t frames_sent;
+    uint64_t bytes_out;
+    uint64_t frames_received;
+    uint64_t bytes_in;
+    uint64_t acks;
+    uint64_t nacks;
+    uint64_t checksum_failures;
+    uint64_t resyncs;           // frames the decoder found after dropping bytes
+    // response timeout of the handle that last timed the command, see SC_he100-rto.h
+    uint64_t rto_srtt_us;
+    uint64_t rto_rttvar_us;
+    uint64_t rto_us;
+    uint64_t rto_timeouts;      // answers not in within the timeout
+    struct he100_latency_histogram latency; // write to ACK or response
+};
+
+struct he100_stats_snapshot {
+    uint64_t ns;                // HE100_monotonicNs when taken
+    struct he100_command_stats commands[HE100_STATS_COMMANDS];
+};
+
+/* Function to count a frame written to the radio */
+void HE100_statsSent (unsigned char command, size_t bytes);
+
+/**
+ * Function to count a frame the decoder completed, and the ACK or NACK it is
+ * @param checksum_status - HE_SUCCESS, or HE_FAILED_CHECKSUM
+ * @param resynced - bytes were dropped since the frame before
+ */
+void HE100_statsReceived (const unsigned char *frame, size_t length, int checksum_status, int resynced);
+
+/**
+ * Function to record the time from writing a command to its ACK or response
+ * @param ns - the time taken, in nanoseconds
+ */
+void HE100_statsLatency (unsigned char command, uint64_t ns);
+
+/**
+ * Function to publish the response timeout estimate of a command
+ * @param timed_out - the command went unanswered, count it
+ */
+void HE100_statsRto (unsigned char command, uint64_t srtt_ns, uint64_t rttvar_ns, uint64_t rto_ns, int timed_out);
+
+/**
+ * Function to copy every counter. Each one is read atomically, but updates
+ * from other threads may land between two of them.
+ */
+void HE100_statsSnapshot (struct he100_stats_snapshot *snapshot);
+
+/* Function to zero every counter */
+void HE100_statsReset (void);
+
+/**
+ * Function to read a percentile off a histogram
+ * @param percentile - 0 to 100
+ * @return - microseconds, the top of the bucket holding the percentile, 0 if empty
+ */
+uint64_t HE100_latencyPercentile (const struct he100_latency_histogram *histogram, double percentile);
+
+/**
+ * Function to print one line per command with any traffic: counts, then
+ * latency p50, p90, p99 and max, then the response timeout estimate, in microseconds
+ * @param out - where to print, or NULL to log to Shakespeare
+ * @return - the number of lines
+ */
+int HE100_statsDump (FILE *out, const struct he100_stats_snapshot *snapshot);
+
+#endif
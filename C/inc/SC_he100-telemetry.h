@@ -0,0 +1,158 @@
+#ifndef SC_HE100_TELEMETRY_H_
+#define SC_HE100_TELEMETRY_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-telemetry.h
+ *
+ *    Description:  Telemetry sampling. A poller sends CMD_TELEMETRY at a set
+ *                  period, decodes the answer into a TELEMETRY_STRUCTURE_type
+ *                  and appends it to a ring of fixed size samples kept in a
+ *                  memory mapped file. The file is the ring: samples are
+ *                  written in place, so the history outlives the process, and
+ *                  readers in other processes map the same file and use the
+ *                  samples where they lie, with no copy.
+ *
+ *                  The ring has one writer. Each slot carries the sequence
+ *                  number of the sample in it, zeroed while the slot is being
+ *                  written, so a reader can tell a sample that was overwritten
+ *                  while it was looking at it (HE100_telemetryIntact).
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 06:41:27 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <SC_he100.h>
+#include <SC_he100-handle.h>
+
+#define HE100_TELEMETRY_LENGTH      16  // payload of the answer to CMD_TELEMETRY
+#define HE100_TELEMETRY_MAGIC       "HE100TLM"
+#define HE100_TELEMETRY_VERSION     1
+#define HE100_TELEMETRY_CAPACITY    4096 // samples, the default, rounded up to a power of two
+
+/* 32 bytes, two samples to a cache line, the file header takes a line of its own */
+struct he100_telemetry_sample {
+    uint64_t ns;                // CLOCK_REALTIME, the samples outlive the boot
+    uint32_t sequence;          // the sample's index plus one, 0 while it is written
+    uint32_t latency_us;        // from the query to its answer
+    TELEMETRY_STRUCTURE_type telemetry;
+};
+
+struct he100_telemetry_file_header {
+    char magic[8];              // HE100_TELEMETRY_MAGIC
+    uint32_t version;           // HE100_TELEMETRY_VERSION
+    uint32_t sample_size;
+    uint32_t capacity;          // samples, a power of two
+    uint32_t reserved;
+    uint64_t count;             // samples ever appended, the next one goes in count % capacity
+    unsigned char padding[32];
+};
+
+struct he100_telemetry_ring {
+    int fd;
+    int writable;
+    size_t map_length;
+    struct he100_telemetry_file_header *header;
+    struct he100_telemetry_sample *samples;
+};
+
+struct he100_telemetry_poller {
+    HE100_Handle *handle;
+    struct he100_telemetry_ring *ring;
+    int period_ms;
+    uint64_t polls;
+    uint64_t failures;
+    int status;                 // result of the last poll
+    int stop;
+    int running;
+    pthread_t thread;
+};
+
+/**
+ * Function to decode the answer to CMD_TELEMETRY, fields little endian as
+ * the MSP430 keeps them
+ * @return - HE_SUCCESS, or HE_INVALID_TELEMETRY if the payload is not HE100_TELEMETRY_LENGTH bytes
+ */
+int HE100_decodeTelemetry (const unsigned char *payload, size_t length, TELEMETRY_STRUCTURE_type *telemetry);
+
+/**
+ * Function to query a telemetry frame
+ * @return - HE_SUCCESS, HE_FAILED_READ if no answer came, HE_INVALID_TELEMETRY,
+ *           or what HE100_handleDispatchFrame returned
+ */
+int HE100_handleTelemetry (HE100_Handle *handle, TELEMETRY_STRUCTURE_type *telemetry);
+
+/**
+ * Function to open a ring file for appending, creating it if need be. An
+ * existing ring carries on where it stopped.
+ * @param capacity - samples kept, 0 for HE100_TELEMETRY_CAPACITY; ignored for an existing ring
+ * @return - HE_SUCCESS, or HE_FAILED_TELEMETRY_STORE if the file cannot be
+ *           mapped or holds something other than a ring of this version
+ */
+int HE100_telemetryOpen (struct he100_telemetry_ring *ring, const char *path, uint32_t capacity);
+
+/* Function to open an existing ring file to read, as ground tools do */
+int HE100_telemetryOpenReadOnly (struct he100_telemetry_ring *ring, const char *path);
+
+void HE100_telemetryClose (struct he100_telemetry_ring *ring);
+
+/**
+ * Function to append a sample, overwriting the oldest once the ring is full.
+ * Only one thread, in one process, may append to a ring.
+ */
+void HE100_telemetryAppend (struct he100_telemetry_ring *ring, const TELEMETRY_STRUCTURE_type *telemetry, uint32_t latency_us);
+
+/* Function returning how many samples were ever appended */
+uint64_t HE100_telemetryCount (const struct he100_telemetry_ring *ring);
+
+/**
+ * Function to find the latest samples
+ * @param n - how many are wanted
+ * @param first - receives the index of the oldest of them
+ * @return - how many there are, at most n and the capacity
+ */
+size_t HE100_telemetryLatest (const struct he100_telemetry_ring *ring, size_t n, uint64_t *first);
+
+/**
+ * Function returning the sample at an index, in place in the mapped file
+ * @return - the sample, or NULL if it was not written yet, was overwritten,
+ *           or is being written
+ */
+const struct he100_telemetry_sample *HE100_telemetrySample (const struct he100_telemetry_ring *ring, uint64_t index);
+
+/**
+ * Function to tell, once done with a sample, that the writer did not start
+ * overwriting it meanwhile. Only needed while a writer is running.
+ */
+int HE100_telemetryIntact (const struct he100_telemetry_sample *sample, uint64_t index);
+
+/**
+ * Function to query telemetry once and append it to the ring, for callers
+ * with a loop of their own; poller->handle and poller->ring must be set
+ * @return - as HE100_handleTelemetry; nothing is appended unless HE_SUCCESS
+ */
+int HE100_telemetryPoll (struct he100_telemetry_poller *poller);
+
+/**
+ * Function to start a thread polling every period_ms. The handle is the
+ * thread's until HE100_telemetryStop returns, nothing else may use it.
+ * @param poller - zeroed before it is first started
+ * @return - HE_SUCCESS, or -1 if already running or the thread failed to start
+ */
+int HE100_telemetryStart (struct he100_telemetry_poller *poller, HE100_Handle *handle, struct he100_telemetry_ring *ring, int period_ms);
+
+/* Function to stop the polling thread, waits for the poll under way if any */
+void HE100_telemetryStop (struct he100_telemetry_poller *poller);
+
+#endif
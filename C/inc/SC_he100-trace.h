@@ -0,0 +1,118 @@
+#ifndef SC_HE100_TRACE_H_
+#define SC_HE100_TRACE_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-trace.h
+ *
+ *    Description:  Binary trace of frame path events. Recording stores an event
+ *                  id, its arguments and a timestamp in a ring owned by the
+ *                  calling thread, with no lock and no formatting. The text is
+ *                  produced later, by HE100_traceDrain on a background thread
+ *                  or by tools/he100-trace-decode on a file of raw events.
+ *
+ *                  Events are only recorded once HE100_traceStart has a drain
+ *                  running, or HE100_traceEnable asked for it. Until then each
+ *                  one is formatted and logged as it happens, as the frame
+ *                  path always did, so nothing is lost to a ring no one reads.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 02:14:40 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HE100_TRACE_RING_EVENTS     1024 // per thread, a power of two
+#define HE100_TRACE_ARGS            5
+#define HE100_TRACE_FRAME_CHUNK     16   // frame bytes carried by one HE100_TRACE_FRAME_BYTES
+
+/* event ids, the arguments each one carries are listed with it */
+#define HE100_TRACE_ACK             1 // arg0 command byte
+#define HE100_TRACE_NACK            2 // arg0 command byte
+#define HE100_TRACE_EMPTY_RESPONSE  3 // arg0 command byte
+#define HE100_TRACE_UNKNOWN_RESPONSE 4 // arg0 command byte
+#define HE100_TRACE_TX_PREPARED     5 // arg0 command bytes, arg1 frame length, arg2 prepare result
+#define HE100_TRACE_FRAME_BYTES     6 // arg0 offset | count<<16, arg1..4 the bytes, first in the low byte
+#define HE100_TRACE_EVENTS          7
+
+/* raw trace files start with this, then hold struct he100_trace_event records */
+#define HE100_TRACE_MAGIC           "HE100TRC"
+#define HE100_TRACE_VERSION         1
+
+struct he100_trace_event {
+    uint64_t ns;        // HE100_monotonicNs when recorded
+    uint16_t id;        // HE100_TRACE_*
+    uint16_t thread;    // the ring it was recorded in
+    uint32_t arg[HE100_TRACE_ARGS];
+};
+
+struct he100_trace_file_header {
+    char magic[8];      // HE100_TRACE_MAGIC
+    uint32_t version;   // HE100_TRACE_VERSION
+    uint32_t event_size;
+};
+
+/**
+ * Function called by HE100_traceDrain for each event, oldest first per thread
+ */
+typedef void (*he100_trace_sink)(const struct he100_trace_event *event, void *context);
+
+/**
+ * Function to record events for HE100_traceDrain, or with 0 to log them as
+ * they happen again; off by default, HE100_traceStart turns it on and
+ * HE100_traceStop off
+ */
+void HE100_traceEnable (int enable);
+
+/**
+ * Function to record an event in the calling thread's ring. Never blocks: if
+ * the ring is full the event is counted as dropped. With recording off it is
+ * logged instead.
+ */
+void HE100_trace (uint16_t id, uint32_t arg0, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4);
+
+/**
+ * Function to record the bytes of a frame as HE100_TRACE_FRAME_BYTES events
+ * @param frame - the bytes to record
+ * @param length - how many, at most MAX_FRAME_LENGTH are kept
+ */
+void HE100_traceFrame (const unsigned char *frame, size_t length);
+
+/**
+ * Function to take every recorded event out of the rings
+ * @param sink - called for each event
+ * @return - the number of events drained
+ */
+int HE100_traceDrain (he100_trace_sink sink, void *context);
+
+/**
+ * Function to turn an event into a log line
+ * @return - the length snprintf reports
+ */
+int HE100_traceFormat (const struct he100_trace_event *event, char *output, size_t size);
+
+/* Function returning the events dropped on full rings since startup */
+uint64_t HE100_traceDropped (void);
+
+/**
+ * Function to start a thread that drains the rings periodically
+ * @param fd - a file to write the raw events to, after a file header, or -1
+ *             to format them and send them to Shakespeare::log
+ * @param period_ms - how long the thread sleeps between drains
+ * @return - HE_SUCCESS, or -1 if the thread is already running or could not start
+ */
+int HE100_traceStart (int fd, int period_ms);
+
+/* Function to stop the drain thread, after a last drain, and log events as they happen again */
+void HE100_traceStop (void);
+
+#endif
@@ -23,12 +23,20 @@
 #include <stddef.h>
 #include <time.h>
 #include <stdio.h>
+#include <sys/uio.h>
 #include <HE100_constants.h>    // contains all constants specific to hardware bytes
 #include <SC_serial.h>          // contains serial access functionality
 
 #define BE 1
 #define LE 0
 
+#define HE100_MAX_PAYLOAD_IOV 16 // payload buffers accepted by the scatter-gather path
+
+struct HE100_checksum {
+    uint8_t sum1;
+    uint8_t sum2;
+};
+
 // function_config bit values - 16-bit
 struct function_config { 
     unsigned led:2;
@@ -75,6 +83,9 @@ struct he100_settings {
 
 char endian(void);
 
+/* Function returning the monotonic clock in nanoseconds, for deadlines and latencies */
+uint64_t HE100_monotonicNs (void);
+
 /**
  * Telemetry structure
  */
@@ -97,18 +108,40 @@ typedef struct {
     uint32_t rx_frequency_offset; //Up to 20 kHz
 } RADIO_RF_CONFIGURATION_TYPE;
 
+/**
+ * Function to close a serial device the fd functions were used on, dropping
+ * what they kept for it: bytes read ahead, the cached configuration, timeouts
+ * and recovery state. A device opened on the same fd afterwards starts afresh.
+ * @return - what close() returned
+ */
+int HE100_closePort (int fdin);
+
 /* Function to write a char array to a serial device at given file descriptor */
 int HE100_write (int fdin, unsigned char *bytes, size_t size);
 
+/* Function to write a complete frame without waiting for the ACK, returns bytes written or -1 */
+int HE100_writeFrame (int fdin, const unsigned char *bytes, size_t size);
+
+/* Function to write header, payload buffers and trailer with writev, returns bytes written or -1 */
+int HE100_writeFramev (int fdin, const unsigned char *header, const struct iovec *payload, int iovcnt, const unsigned char *trailer);
+
 /** Optimized Fletcher Checksum
  * 16-bit implementation of the Fletcher Checksum
  * returns two 8-bit sums
  * @param data - uint8_t const - data on which to perform checksum
  * @param bytes - size_t - number of bytes to process
  * inspired by http://en.wikipedia.org/wiki/Fletcher%27s_checksum#Optimizations
+ * runs the fastest kernel in SC_he100-checksum.c the CPU supports
  */
 struct HE100_checksum HE100_fletcher16 (unsigned char *data, size_t bytes);
 
+/**
+ * Function to continue a Fletcher checksum over one more buffer, so a frame
+ * held in several pieces can be summed without joining it first
+ * @param checksum - running sums, start from {0,0}
+ */
+void HE100_fletcher16Update (struct HE100_checksum *checksum, const unsigned char *data, size_t bytes);
+
 /**
  * Function to parse a given frame, validate it, and write its payload to pipe
  * @param response - the frame data to be validated
@@ -116,6 +149,12 @@ struct HE100_checksum HE100_fletcher16 (unsigned char *data, size_t bytes);
  */
 int HE100_validateFrame (unsigned char *response, size_t length);
 
+/**
+ * Function to validate a frame whose checksums the decoder already compared
+ * @param checksum_status - HE_SUCCESS, or HE_FAILED_CHECKSUM
+ */
+int HE100_validateDecodedFrame (unsigned char *response, size_t length, int checksum_status);
+
 /* Function to dump a given array to a given file descriptor */
 void print_binary(int n);
 int HE100_dumpBinary (FILE *fdout, unsigned char *bytes, size_t size);
@@ -138,6 +177,15 @@ int HE100_read (int fdin, time_t timeout, unsigned char * payload);
  * @param size_t length - length of data stream
  */
 int HE100_prepareTransmission(unsigned char *payload, unsigned char *prepared_transmission, size_t length, unsigned char *command);
+
+/**
+ * Function to prepare the bytes around a payload held in separate buffers.
+ * The payload itself is only read, to checksum it.
+ * @param header - 8 bytes, filled with sync, command, length and header checksum
+ * @param trailer - 2 bytes, filled with the payload checksum
+ * @return - the payload length, or HE_FAILED_PREPARE_TRANSMISSION if too long
+ */
+int HE100_prepareTransmissionv(const struct iovec *payload, int iovcnt, unsigned char *command, unsigned char *header, unsigned char *trailer);
 //unsigned char * HE100_prepareTransmission (unsigned char *payload, size_t length, unsigned char *command);
 
 /* Function to ensure byte-by-byte that we are receiving a HE100 frame */
@@ -159,6 +207,15 @@ int HE100_interpretResponse (unsigned char *response, size_t length);
  */
 int HE100_dispatchTransmission(int fdin, unsigned char *payload, size_t payload_length, unsigned char *command);
 
+/**
+ * Function to write a command to the radio without copying its payload. The
+ * header, each payload buffer and the trailer go out with a single writev.
+ * @param payload - up to HE100_MAX_PAYLOAD_IOV buffers sent back to back
+ * @param iovcnt - number of payload buffers, may be 0
+ * @param command
+ */
+int HE100_dispatchTransmissionv(int fdin, const struct iovec *payload, int iovcnt, unsigned char *command);
+
 /**
  * Function to return NOOP byte sequence
  * no arguments
@@ -206,6 +263,11 @@ int HE100_readFirmwareRevision(int fdin);
 struct he100_settings HE100_collectConfig (unsigned char * buffer);
 //int HE100_getConfig (int fdin);
 int HE100_getConfig (int fdin, struct he100_settings * settings);
+/* Function to read the config cached by HE100_getConfig and HE100_setConfig, with no serial traffic */
+int HE100_currentConfig (int fdin, struct he100_settings * settings);
+
+/* Function to query a telemetry frame, see SC_he100-telemetry.h for periodic sampling */
+int HE100_telemetry (int fdin, TELEMETRY_STRUCTURE_type * telemetry);
 
 // swap endianness of anything larger than 1 byte in the config array
 int HE100_swapConfigEndianness (struct he100_settings & settings);
@@ -217,8 +279,12 @@ int HE100_validateConfig (struct he100_settings he100_new_settings);
 
 /* Function to configure the Helium board based on altered input struct he100_settings */
 /* validation will occur here, and if valid values have passed constraints, apply the settings */
+/* settings already on the radio are not sent again; the cache is dropped with the fd's handle, see HE100_closePort */
 int HE100_setConfig (int fdin, struct he100_settings he100_new_settings);
 
+/* Function to raise or lower the interface rate of the transceiver and the serial device together, see SC_he100-baud.h */
+int HE100_negotiateBaud (int fdin, int if_baud_rate);
+
 void HE100_printSettings(FILE* fdout, struct he100_settings settings);
 
 #endif
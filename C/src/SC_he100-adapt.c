@@ -0,0 +1,149 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-adapt.c
+ *
+ *    Description:  RF rate adaptation from RSSI and frame errors.
+ *
+ *        Version:  1.0
+ *        Created:  27-10-17 02:37:12 AM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <string.h>     /*  String function definitions */
+
+#include <SC_he100.h>
+#include <SC_he100-adapt.h>
+#include "SpaceDecl.h"
+#include "shakespeare.h"
+
+// logging
+#define PROCESS "HE100"
+#define MAX_LOG_BUFFER_LEN CS1_MAX_LOG_ENTRY
+
+void
+HE100_adaptDefaults (struct he100_adapt_policy *policy)
+{
+    static const int rssi_floor[HE100_ADAPT_RATES] = {0, 40, 80, 120};
+    policy->min_rate = CFG_RF_BAUD_1200;
+    policy->max_rate = CFG_RF_BAUD_38400;
+    memcpy(policy->rssi_floor, rssi_floor, sizeof(rssi_floor));
+    policy->rssi_hysteresis = 8;
+    policy->window_frames = 32;
+    policy->down_percent = 10;
+    policy->up_percent = 2;
+    policy->up_windows = 3;
+    policy->hold_ns = 20000000000ULL;
+}
+
+// the next window starts from the counters as they are now
+static void
+HE100_adaptOpen (struct he100_adapt *adapt, const struct he100_handle_stats *stats)
+{
+    adapt->frames = stats->frames;
+    adapt->errors = stats->invalid + stats->nacks;
+}
+
+int
+HE100_adaptInit (struct he100_adapt *adapt, HE100_Handle *handle, struct he100_scheduler *scheduler)
+{
+    struct he100_settings settings;
+    int result = HE100_handleCurrentConfig(handle, &settings);
+    if (result != HE_SUCCESS) return result;
+    if (settings.tx_rf_baud_rate > MAX_RF_BAUD_RATE) return HE_INVALID_RF_BAUD_RATE;
+
+    memset(adapt, 0, sizeof(*adapt));
+    adapt->scheduler = scheduler;
+    adapt->rate = settings.tx_rf_baud_rate;
+    adapt->rssi = -1;
+    adapt->changed = HE100_monotonicNs();
+    HE100_adaptOpen(adapt, &handle->stats);
+    return HE_SUCCESS;
+}
+
+void
+HE100_adaptRssi (struct he100_adapt *adapt, const TELEMETRY_STRUCTURE_type *telemetry)
+{
+    int sample = telemetry->rssi * 16;
+    // a quarter of each new sample, a pass changes over seconds, not samples
+    if (adapt->rssi < 0) adapt->rssi = sample;
+    else adapt->rssi += (sample - adapt->rssi) / 4;
+}
+
+int
+HE100_adaptDecide (struct he100_adapt *adapt, const struct he100_adapt_policy *policy, const struct he100_handle_stats *stats, uint64_t now)
+{
+    int rate = adapt->rate;
+    if (rate < policy->min_rate) return policy->min_rate;
+    if (rate > policy->max_rate) return policy->max_rate;
+
+    // the signal has gone below what this rate holds at
+    if (adapt->rssi >= 0 && rate > policy->min_rate && adapt->rssi < policy->rssi_floor[rate] * 16) {
+        adapt->good = 0;
+        return rate - 1;
+    }
+
+    uint64_t frames = stats->frames - adapt->frames;
+    if (frames < policy->window_frames) return rate;
+    uint64_t errors = stats->invalid + stats->nacks - adapt->errors;
+    HE100_adaptOpen(adapt, stats);
+    adapt->stats.windows++;
+
+    if (errors * 100 > (uint64_t)policy->down_percent * frames) {
+        adapt->good = 0;
+        return rate > policy->min_rate ? rate - 1 : rate;
+    }
+    if (errors * 100 > (uint64_t)policy->up_percent * frames) {
+        adapt->good = 0;
+        return rate;
+    }
+
+    adapt->good++;
+    if (adapt->good < policy->up_windows || rate >= policy->max_rate || now - adapt->changed < policy->hold_ns) return rate;
+    if (adapt->rssi >= 0 && adapt->rssi < (policy->rssi_floor[rate+1] + policy->rssi_hysteresis) * 16) return rate;
+    return rate + 1;
+}
+
+int
+HE100_adaptStep (struct he100_adapt *adapt, const struct he100_adapt_policy *policy, HE100_Handle *handle)
+{
+    int rate = HE100_adaptDecide(adapt, policy, &handle->stats, HE100_monotonicNs());
+    if (rate == adapt->rate) return HE_SUCCESS;
+
+    char log_buffer[MAX_LOG_BUFFER_LEN];
+    struct he100_settings settings;
+    int result = HE100_handleCurrentConfig(handle, &settings);
+    if (result == HE_SUCCESS) {
+        settings.rx_rf_baud_rate = rate;
+        settings.tx_rf_baud_rate = rate;
+        result = HE100_handleSetConfig(handle, settings);
+    }
+    if (result != HE_SUCCESS) {
+        adapt->stats.failed++;
+        snprintf(log_buffer, MAX_LOG_BUFFER_LEN, "RF rate not changed, %s to %s: %d", rf_baudrate[adapt->rate], rf_baudrate[rate], result);
+        Shakespeare::log(Shakespeare::WARNING, PROCESS, log_buffer);
+        return result;
+    }
+
+    snprintf(
+        log_buffer, MAX_LOG_BUFFER_LEN,
+        "RF rate %s, %s to %s, RSSI %d",
+        rate > adapt->rate ? "up" : "down", rf_baudrate[adapt->rate], rf_baudrate[rate], adapt->rssi < 0 ? -1 : adapt->rssi / 16
+    );
+    Shakespeare::log(Shakespeare::NOTICE, PROCESS, log_buffer);
+    if (rate > adapt->rate) adapt->stats.ups++;
+    else adapt->stats.downs++;
+    adapt->rate = rate;
+    adapt->good = 0;
+    adapt->changed = HE100_monotonicNs();
+    // errors at the old rate say nothing of the new one
+    HE100_adaptOpen(adapt, &handle->stats);
+    if (adapt->scheduler != NULL) HE100_schedulerConfigure(adapt->scheduler, &settings);
+    return HE_SUCCESS;
+}
@@ -0,0 +1,192 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-ax25.c
+ *
+ *    Description:  AX.25 header views and the callsign demultiplexer.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 08:47:36 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <string.h>     /*  String function definitions */
+#include <ctype.h>
+
+#include <SC_he100.h>
+#include <SC_he100-ax25.h>
+#include "SpaceDecl.h"
+#include "shakespeare.h"
+
+// logging
+#define PROCESS "HE100"
+#define MAX_LOG_BUFFER_LEN CS1_MAX_LOG_ENTRY
+
+#define HE100_AX25_LAST_ADDRESS     0x01    // in the SSID byte
+#define HE100_AX25_SSID_RESERVED    0x60    // the two reserved SSID bits, set when unused
+#define HE100_AX25_KEY_ANY_SSID     (1ull << 52)
+
+int
+HE100_ax25View (struct he100_ax25_view *view, const unsigned char *payload, size_t length)
+{
+    memset(view, 0, sizeof(*view));
+    view->pid = HE100_AX25_NO_PID;
+
+    // destination, source, then digipeaters until the last address bit
+    size_t offset = 0;
+    int addresses = 0;
+    for (;;) {
+        if (offset + HE100_AX25_ADDRESS_LENGTH > length) return HE_INVALID_AX25;
+        const unsigned char *address = payload + offset;
+        int i;
+        for (i=0; i<HE100_AX25_CALLSIGN_LENGTH; i++) {
+            if (address[i] & 0x01) return HE_INVALID_AX25;
+        }
+        addresses++;
+        offset += HE100_AX25_ADDRESS_LENGTH;
+        if (address[HE100_AX25_CALLSIGN_LENGTH] & HE100_AX25_LAST_ADDRESS) break;
+        if (addresses == 2 + HE100_AX25_MAX_DIGIPEATERS) return HE_INVALID_AX25;
+    }
+    if (addresses < 2 || offset >= length) return HE_INVALID_AX25;
+
+    view->destination = payload;
+    view->source = payload + HE100_AX25_ADDRESS_LENGTH;
+    view->digipeater_count = addresses - 2;
+    if (view->digipeater_count > 0) view->digipeaters = payload + 2*HE100_AX25_ADDRESS_LENGTH;
+
+    // I and UI frames carry a PID, modulo 8 control field
+    view->control = payload[offset++];
+    if ((view->control & 0x01) == 0 || (view->control & 0xef) == 0x03) {
+        if (offset >= length) return HE_INVALID_AX25;
+        view->pid = payload[offset++];
+    }
+    view->information = payload + offset;
+    view->information_length = length - offset;
+    return HE_SUCCESS;
+}
+
+int
+HE100_ax25Ssid (const unsigned char *address)
+{
+    return (address[HE100_AX25_CALLSIGN_LENGTH] >> 1) & 0x0f;
+}
+
+int
+HE100_ax25Callsign (const unsigned char *address, char *text)
+{
+    int length = 0;
+    int i;
+    for (i=0; i<HE100_AX25_CALLSIGN_LENGTH; i++) {
+        char c = (char)(address[i] >> 1);
+        if (c == ' ') break;
+        text[length++] = c;
+    }
+    int ssid = HE100_ax25Ssid(address);
+    if (ssid > 0) length += snprintf(text + length, HE100_AX25_CALLSIGN_STRING - length, "-%d", ssid);
+    text[length] = '\0';
+    return length;
+}
+
+int
+HE100_ax25Address (const char *callsign, int ssid, unsigned char *address)
+{
+    size_t length = strlen(callsign);
+    if (length == 0 || length > HE100_AX25_CALLSIGN_LENGTH || ssid < 0 || ssid > 15) return HE_INVALID_AX25;
+    size_t i;
+    for (i=0; i<HE100_AX25_CALLSIGN_LENGTH; i++) {
+        unsigned char c = i < length ? (unsigned char)toupper((unsigned char)callsign[i]) : ' ';
+        if (i < length && !isalnum(c)) return HE_INVALID_AX25;
+        address[i] = c << 1;
+    }
+    address[HE100_AX25_CALLSIGN_LENGTH] = HE100_AX25_SSID_RESERVED | (ssid << 1);
+    return HE_SUCCESS;
+}
+
+// the callsign bytes as sent and the SSID; never 0, the callsign is at least one character
+static uint64_t
+HE100_ax25Key (const unsigned char *address)
+{
+    uint64_t key = 0;
+    memcpy(&key, address, HE100_AX25_CALLSIGN_LENGTH);
+    return key | ((uint64_t)HE100_ax25Ssid(address) << 48);
+}
+
+static struct he100_ax25_route *
+HE100_ax25Slot (struct he100_ax25_demux *demux, uint64_t key)
+{
+    // multiplicative hash, then linear probing; the table is never more than half full
+    size_t slot = (size_t)((key * 0x9e3779b97f4a7c15ull) >> 58) & (HE100_AX25_ROUTE_SLOTS - 1);
+    while (demux->routes[slot].key != 0 && demux->routes[slot].key != key) {
+        slot = (slot + 1) & (HE100_AX25_ROUTE_SLOTS - 1);
+    }
+    return &demux->routes[slot];
+}
+
+void
+HE100_ax25DemuxInit (struct he100_ax25_demux *demux, int route_on, he100_ax25_callback fallback, void *fallback_context)
+{
+    memset(demux, 0, sizeof(*demux));
+    demux->route_on = route_on;
+    demux->fallback = fallback;
+    demux->fallback_context = fallback_context;
+}
+
+int
+HE100_ax25DemuxRegister (struct he100_ax25_demux *demux, const char *callsign, int ssid, he100_ax25_callback callback, void *context)
+{
+    unsigned char address[HE100_AX25_ADDRESS_LENGTH];
+    int any = ssid == HE100_AX25_ANY_SSID;
+    if (HE100_ax25Address(callsign, any ? 0 : ssid, address) != HE_SUCCESS) return HE_INVALID_AX25;
+    uint64_t key = HE100_ax25Key(address) | (any ? HE100_AX25_KEY_ANY_SSID : 0);
+
+    struct he100_ax25_route *route = HE100_ax25Slot(demux, key);
+    if (route->key == 0) {
+        if (demux->route_count == HE100_AX25_MAX_ROUTES) {
+            char log_buffer[MAX_LOG_BUFFER_LEN];
+            snprintf(log_buffer, MAX_LOG_BUFFER_LEN, "AX.25: no room to route %s, %d routes taken", callsign, demux->route_count);
+            Shakespeare::log(Shakespeare::WARNING, PROCESS, log_buffer);
+            return -1;
+        }
+        demux->route_count++;
+        route->key = key;
+    }
+    route->callback = callback;
+    route->context = context;
+    return HE_SUCCESS;
+}
+
+int
+HE100_ax25DemuxPayload (struct he100_ax25_demux *demux, const unsigned char *payload, size_t length)
+{
+    struct he100_ax25_view view;
+    if (HE100_ax25View(&view, payload, length) != HE_SUCCESS) {
+        demux->invalid++;
+        return HE_INVALID_AX25;
+    }
+
+    uint64_t key = HE100_ax25Key(demux->route_on == HE100_AX25_ROUTE_SOURCE ? view.source : view.destination);
+    struct he100_ax25_route *route = HE100_ax25Slot(demux, key);
+    if (route->key == 0) route = HE100_ax25Slot(demux, (key & 0xffffffffffffull) | HE100_AX25_KEY_ANY_SSID);
+    if (route->key != 0) {
+        demux->routed++;
+        route->callback(&view, route->context);
+        return HE_SUCCESS;
+    }
+
+    demux->unrouted++;
+    if (demux->fallback != NULL) demux->fallback(&view, demux->fallback_context);
+    return -1;
+}
+
+void
+HE100_ax25DemuxRxCallback (const unsigned char *frame, size_t length, int status, void *context)
+{
+    if (status != HE_SUCCESS || length <= WRAPPER_LENGTH || frame[HE_CMD_BYTE] != CMD_RECEIVE_DATA) return;
+    HE100_ax25DemuxPayload((struct he100_ax25_demux *)context, frame + HE_FIRST_PAYLOAD_BYTE, length - WRAPPER_LENGTH);
+}
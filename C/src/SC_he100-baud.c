@@ -0,0 +1,153 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-baud.c
+ *
+ *    Description:  Interface rate negotiation, radio and host together.
+ *
+ *        Version:  1.0
+ *        Created:  27-10-17 12:21:50 AM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <string.h>     /*  String function definitions */
+#include <termios.h>    /*  POSIX terminal control definitions */
+
+#include <SC_he100.h>
+#include <SC_he100-baud.h>
+#include <SC_he100-handle.h>
+#include "SpaceDecl.h"
+#include "shakespeare.h"
+
+// logging
+#define PROCESS "HE100"
+#define MAX_LOG_BUFFER_LEN CS1_MAX_LOG_ENTRY
+
+int
+HE100_baudSpeed (int if_baud_rate, speed_t *speed)
+{
+    switch (if_baud_rate) {
+        case CFG_IF_BAUD_9600 :     *speed = B9600; return HE_SUCCESS;
+        case CFG_IF_BAUD_19200 :    *speed = B19200; return HE_SUCCESS;
+        case CFG_IF_BAUD_38400 :    *speed = B38400; return HE_SUCCESS;
+#ifdef B76800
+        case CFG_IF_BAUD_76800 :    *speed = B76800; return HE_SUCCESS;
+#endif
+        case CFG_IF_BAUD_115200 :   *speed = B115200; return HE_SUCCESS;
+        default :                   return HE_INVALID_IF_BAUD_RATE; // 76800 is no standard rate on Linux
+    }
+}
+
+int
+HE100_baudHostRate (int fdin)
+{
+    struct termios settings;
+    if (tcgetattr(fdin, &settings) != 0) return -1;
+    speed_t host = cfgetospeed(&settings);
+    int rate;
+    for (rate=CFG_IF_BAUD_9600; rate<=MAX_IF_BAUD_RATE; rate++) {
+        speed_t speed;
+        if (HE100_baudSpeed(rate, &speed) == HE_SUCCESS && speed == host) return rate;
+    }
+    return -1;
+}
+
+int
+HE100_baudSetHost (int fdin, int if_baud_rate)
+{
+    speed_t speed;
+    if (HE100_baudSpeed(if_baud_rate, &speed) != HE_SUCCESS) return HE_INVALID_IF_BAUD_RATE;
+
+    struct termios settings;
+    if (tcgetattr(fdin, &settings) != 0) return HE_FAILED_SET_BAUD;
+    cfsetispeed(&settings, speed);
+    cfsetospeed(&settings, speed);
+    if (tcsetattr(fdin, TCSADRAIN, &settings) != 0) return HE_FAILED_SET_BAUD;
+    // whatever arrived around the switch was framed at one rate and read at the other
+    tcflush(fdin, TCIFLUSH);
+    return HE_SUCCESS;
+}
+
+// move the host to a rate and see whether the radio answers there
+static int
+HE100_baudConfirm (HE100_Handle *handle, int if_baud_rate)
+{
+    if (HE100_baudSetHost(handle->fdin, if_baud_rate) != HE_SUCCESS) return HE_FAILED_SET_BAUD;
+    // round trips timed at another rate say nothing about this one
+    HE100_rtoInit(&handle->rto, HE100_RTO_FLOOR_MS, (int)handle->policy.ack_timeout * 1000);
+    int attempt;
+    for (attempt=0; attempt<HE100_BAUD_CONFIRM_ATTEMPTS; attempt++) {
+        if (HE100_handleNOOP(handle) == HE_SUCCESS) return HE_SUCCESS;
+    }
+    return HE_FAILED_SET_BAUD;
+}
+
+static void
+HE100_baudLog (Shakespeare::Priority priority, const char *outcome, int from, int to)
+{
+    char log_buffer[MAX_LOG_BUFFER_LEN];
+    snprintf(log_buffer, MAX_LOG_BUFFER_LEN, "Interface rate %s, %s to %s", outcome, if_baudrate[from], if_baudrate[to]);
+    Shakespeare::log(priority, PROCESS, log_buffer);
+}
+
+int
+HE100_baudNegotiate (HE100_Handle *handle, int if_baud_rate)
+{
+    speed_t speed;
+    if (if_baud_rate < CFG_IF_BAUD_9600 || HE100_baudSpeed(if_baud_rate, &speed) != HE_SUCCESS) return HE_INVALID_IF_BAUD_RATE;
+    int old_rate = HE100_baudHostRate(handle->fdin);
+    if (old_rate == -1) return HE_FAILED_SET_BAUD;
+
+    struct he100_settings settings;
+    int result = HE100_handleCurrentConfig(handle, &settings);
+    if (result != HE_SUCCESS) return result;
+    if (settings.interface_baud_rate == if_baud_rate && old_rate == if_baud_rate) return HE_SUCCESS;
+
+    settings.interface_baud_rate = if_baud_rate;
+    result = HE100_handleSetConfig(handle, settings);
+    if (result != HE_SUCCESS && handle->status == HE_FAILED_NACK) {
+        // refused, the radio is still where it was
+        HE100_baudLog(Shakespeare::WARNING, "refused", old_rate, if_baud_rate);
+        return HE_FAILED_SET_BAUD;
+    }
+
+    // the ACK went out at the old rate, the radio is at the new one now; or the ACK was lost and it may be
+    if (HE100_baudConfirm(handle, if_baud_rate) == HE_SUCCESS) {
+        HE100_baudLog(Shakespeare::NOTICE, "changed", old_rate, if_baud_rate);
+        return HE_SUCCESS;
+    }
+
+    // fall back to the rate that worked, the radio may never have switched
+    HE100_handleInvalidateConfig(handle);
+    if (HE100_baudConfirm(handle, old_rate) == HE_SUCCESS) {
+        HE100_baudLog(Shakespeare::WARNING, "not confirmed, fell back", if_baud_rate, old_rate);
+        return HE_FAILED_SET_BAUD;
+    }
+
+    // or it is somewhere else: find it, then put it back
+    int rate;
+    for (rate=CFG_IF_BAUD_9600; rate<=MAX_IF_BAUD_RATE; rate++) {
+        if (rate == if_baud_rate || rate == old_rate || HE100_baudSpeed(rate, &speed) != HE_SUCCESS) continue;
+        if (HE100_baudConfirm(handle, rate) != HE_SUCCESS) continue;
+        settings.interface_baud_rate = old_rate;
+        if (HE100_handleSetConfig(handle, settings) == HE_SUCCESS && HE100_baudConfirm(handle, old_rate) == HE_SUCCESS) {
+            HE100_baudLog(Shakespeare::WARNING, "not confirmed, restored", rate, old_rate);
+        } else if (HE100_baudConfirm(handle, rate) == HE_SUCCESS) {
+            HE100_baudLog(Shakespeare::ERROR, "not confirmed, radio found", old_rate, rate);
+        } else {
+            continue;
+        }
+        HE100_handleInvalidateConfig(handle);
+        return HE_FAILED_SET_BAUD;
+    }
+
+    HE100_baudSetHost(handle->fdin, old_rate);
+    HE100_baudLog(Shakespeare::ERROR, "not confirmed, radio not answering", if_baud_rate, old_rate);
+    return HE_FAILED_SET_BAUD;
+}
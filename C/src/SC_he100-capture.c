@@ -0,0 +1,259 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-capture.c
+ *
+ *    Description:  Memory mapped serial capture and its replay through the decoder.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 08:12:51 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <string.h>     /*  String function definitions */
+#include <errno.h>      /*  Error number definitions */
+#include <fcntl.h>      /*  File control definitions */
+#include <unistd.h>     /*  UNIX standard function definitions */
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <SC_he100.h>
+#include <SC_he100-capture.h>
+#include "SpaceDecl.h"
+#include "shakespeare.h"
+
+// logging
+#define PROCESS "HE100"
+#define MAX_LOG_BUFFER_LEN CS1_MAX_LOG_ENTRY
+
+static struct he100_capture *HE100_capture_active = NULL;
+
+static uint64_t
+HE100_captureAligned (uint64_t length)
+{
+    return (length + HE100_CAPTURE_ALIGN - 1) & ~(uint64_t)(HE100_CAPTURE_ALIGN - 1);
+}
+
+static int
+HE100_captureFail (struct he100_capture *capture, const char *path, const char *why)
+{
+    char log_buffer[MAX_LOG_BUFFER_LEN];
+    snprintf(log_buffer, MAX_LOG_BUFFER_LEN, "Capture %s: %s", path, why);
+    Shakespeare::log(Shakespeare::ERROR, PROCESS, log_buffer);
+    if (capture->header != NULL) munmap(capture->header, capture->map_length);
+    if (capture->fd >= 0) close(capture->fd);
+    memset(capture, 0, sizeof(*capture));
+    capture->fd = -1;
+    return HE_FAILED_CAPTURE;
+}
+
+int
+HE100_captureOpen (struct he100_capture *capture, const char *path, uint64_t capacity)
+{
+    memset(capture, 0, sizeof(*capture));
+    if (capacity == 0) capacity = HE100_CAPTURE_CAPACITY;
+    capacity = HE100_captureAligned(capacity);
+
+    capture->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (capture->fd < 0) return HE100_captureFail(capture, path, strerror(errno));
+
+    // sparse until written, unwritten records read back as zero length
+    capture->map_length = sizeof(struct he100_capture_file_header) + capacity;
+    if (ftruncate(capture->fd, capture->map_length) != 0) return HE100_captureFail(capture, path, strerror(errno));
+    void *map = mmap(NULL, capture->map_length, PROT_READ|PROT_WRITE, MAP_SHARED, capture->fd, 0);
+    if (map == MAP_FAILED) return HE100_captureFail(capture, path, strerror(errno));
+    capture->header = (struct he100_capture_file_header *)map;
+    capture->records = (unsigned char *)(capture->header + 1);
+    capture->writable = 1;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    capture->header->version = HE100_CAPTURE_VERSION;
+    capture->header->header_size = sizeof(struct he100_capture_file_header);
+    capture->header->capacity = capacity;
+    capture->header->start_ns = HE100_monotonicNs();
+    capture->header->start_realtime_ns = (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+    memcpy(capture->header->magic, HE100_CAPTURE_MAGIC, sizeof(capture->header->magic));
+    return HE_SUCCESS;
+}
+
+int
+HE100_captureOpenReadOnly (struct he100_capture *capture, const char *path)
+{
+    memset(capture, 0, sizeof(*capture));
+    capture->fd = open(path, O_RDONLY);
+    if (capture->fd < 0) return HE100_captureFail(capture, path, strerror(errno));
+
+    struct stat st;
+    struct he100_capture_file_header header;
+    if (
+            fstat(capture->fd, &st) != 0
+        ||  pread(capture->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+        ||  memcmp(header.magic, HE100_CAPTURE_MAGIC, sizeof(header.magic)) != 0
+        ||  header.version != HE100_CAPTURE_VERSION
+        ||  header.header_size != sizeof(struct he100_capture_file_header)
+       )
+    {
+        return HE100_captureFail(capture, path, "not a capture of this version");
+    }
+
+    // a closed capture is trimmed to its records, one left by a crash is not
+    capture->map_length = st.st_size;
+    void *map = mmap(NULL, capture->map_length, PROT_READ, MAP_SHARED, capture->fd, 0);
+    if (map == MAP_FAILED) return HE100_captureFail(capture, path, strerror(errno));
+    capture->header = (struct he100_capture_file_header *)map;
+    capture->records = (unsigned char *)(capture->header + 1);
+    return HE_SUCCESS;
+}
+
+void
+HE100_captureClose (struct he100_capture *capture)
+{
+    if (capture->header == NULL) return;
+    if (__atomic_load_n(&HE100_capture_active, __ATOMIC_ACQUIRE) == capture) HE100_captureStop();
+
+    off_t trimmed = 0;
+    if (capture->writable) {
+        uint64_t used = capture->header->used;
+        if (used > capture->header->capacity) used = capture->header->capacity;
+        capture->header->used = used;
+        trimmed = sizeof(struct he100_capture_file_header) + used;
+        msync(capture->header, capture->map_length, MS_SYNC);
+    }
+    munmap(capture->header, capture->map_length);
+    if (trimmed > 0 && ftruncate(capture->fd, trimmed) != 0) {
+        Shakespeare::log(Shakespeare::WARNING, PROCESS, "Capture: could not trim the file");
+    }
+    close(capture->fd);
+    memset(capture, 0, sizeof(*capture));
+    capture->fd = -1;
+}
+
+void
+HE100_captureStart (struct he100_capture *capture)
+{
+    __atomic_store_n(&HE100_capture_active, capture, __ATOMIC_RELEASE);
+}
+
+void
+HE100_captureStop (void)
+{
+    __atomic_store_n(&HE100_capture_active, (struct he100_capture *)NULL, __ATOMIC_RELEASE);
+}
+
+int
+HE100_captureRecord (struct he100_capture *capture, int direction, int fd, const struct iovec *pieces, int count, size_t length)
+{
+    if (length == 0) return HE_SUCCESS;
+    uint64_t size = HE100_captureAligned(sizeof(struct he100_capture_record) + length);
+    uint64_t offset = __atomic_fetch_add(&capture->header->used, size, __ATOMIC_RELAXED);
+    if (offset + size > capture->header->capacity) {
+        __atomic_fetch_add(&capture->header->dropped, 1, __ATOMIC_RELAXED);
+        return HE_FAILED_CAPTURE;
+    }
+
+    struct he100_capture_record *record = (struct he100_capture_record *)(capture->records + offset);
+    record->ns = HE100_monotonicNs();
+    record->direction = (uint16_t)direction;
+    record->channel = (uint16_t)fd;
+    unsigned char *bytes = (unsigned char *)(record + 1);
+    size_t copied = 0;
+    int i;
+    for (i=0; i<count && copied < length; i++) {
+        size_t take = pieces[i].iov_len < length - copied ? pieces[i].iov_len : length - copied;
+        memcpy(bytes + copied, pieces[i].iov_base, take);
+        copied += take;
+    }
+    // the length makes the record visible, so it goes in after everything else
+    __atomic_store_n(&record->length, (uint32_t)copied, __ATOMIC_RELEASE);
+    return HE_SUCCESS;
+}
+
+void
+HE100_captureBytes (int direction, int fd, const struct iovec *pieces, int count, size_t length)
+{
+    struct he100_capture *capture = __atomic_load_n(&HE100_capture_active, __ATOMIC_ACQUIRE);
+    if (capture == NULL) return;
+    HE100_captureRecord(capture, direction, fd, pieces, count, length);
+}
+
+const struct he100_capture_record *
+HE100_captureNext (const struct he100_capture *capture, uint64_t *offset)
+{
+    uint64_t used = __atomic_load_n(&capture->header->used, __ATOMIC_ACQUIRE);
+    uint64_t end = capture->map_length - sizeof(struct he100_capture_file_header);
+    if (used < end) end = used;
+    if (*offset + sizeof(struct he100_capture_record) > end) return NULL;
+
+    const struct he100_capture_record *record = (const struct he100_capture_record *)(capture->records + *offset);
+    uint32_t length = __atomic_load_n(&record->length, __ATOMIC_ACQUIRE);
+    if (length == 0 || *offset + sizeof(struct he100_capture_record) + length > end) return NULL;
+    *offset += HE100_captureAligned(sizeof(struct he100_capture_record) + length);
+    return record;
+}
+
+// hand every complete frame in the decoder to the callback
+static uint64_t
+HE100_captureDeliver (struct he100_decoder *decoder, he100_rx_callback callback, void *context)
+{
+    unsigned char frame[HE100_MAX_WIRE_FRAME];
+    size_t length;
+    uint64_t delivered = 0;
+    while (HE100_decoderNext(decoder, frame, &length) == 1) {
+        int status = HE100_validateDecodedFrame(frame, length, decoder->status);
+        if (callback != NULL) callback(frame, length, status, context);
+        delivered++;
+    }
+    return delivered;
+}
+
+uint64_t
+HE100_captureReplay (const struct he100_capture *capture, struct he100_decoder *decoder, double speed, he100_rx_callback callback, void *context, struct he100_replay_stats *stats)
+{
+    struct he100_replay_stats replayed;
+    memset(&replayed, 0, sizeof(replayed));
+    uint64_t replay_start = HE100_monotonicNs();
+    uint64_t first_ns = 0;
+    uint64_t offset = 0;
+    const struct he100_capture_record *record;
+
+    while ((record = HE100_captureNext(capture, &offset)) != NULL) {
+        if (replayed.records++ == 0) first_ns = record->ns;
+        if (record->direction != HE100_CAPTURE_RX) {
+            replayed.tx_records++;
+            continue;
+        }
+
+        if (speed > 0) {
+            uint64_t due = replay_start + (uint64_t)((record->ns - first_ns) / speed);
+            uint64_t now = HE100_monotonicNs();
+            if (due > now) {
+                struct timespec wait;
+                wait.tv_sec = (due - now) / 1000000000;
+                wait.tv_nsec = (due - now) % 1000000000;
+                while (nanosleep(&wait, &wait) == -1 && errno == EINTR);
+            }
+        }
+
+        // each read goes in whole, as it did on the line, the ring drained as it fills
+        const unsigned char *bytes = (const unsigned char *)(record + 1);
+        size_t fed = 0;
+        while (fed < record->length) {
+            size_t accepted = HE100_decoderFeed(decoder, bytes + fed, record->length - fed);
+            fed += accepted;
+            replayed.frames += HE100_captureDeliver(decoder, callback, context);
+            if (accepted == 0 && HE100_decoderPending(decoder) == HE100_DECODER_RING_SIZE) break;
+        }
+        replayed.rx_bytes += fed;
+    }
+
+    if (stats != NULL) *stats = replayed;
+    return replayed.frames;
+}
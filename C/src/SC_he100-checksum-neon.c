@@ -0,0 +1,78 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-checksum-neon.c
+ *
+ *    Description:  NEON Fletcher-16 kernel for the BeagleBone. Kept in its own
+ *                  file so only it is built with -mfpu=neon; the dispatcher in
+ *                  SC_he100-checksum.c checks the CPU before calling it.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 01:05:52 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdint.h>     /*  Standard integer types */
+#include <stddef.h>
+
+#include <SC_he100.h>
+#include <SC_he100-checksum.h>
+
+#if defined(HE100_CHECKSUM_NEON_KERNEL) && defined(__ARM_NEON)
+#include <arm_neon.h>
+
+static uint32_t
+HE100_hsumNeon (uint32x4_t v)
+{
+    uint32x2_t pair = vadd_u32(vget_low_u32(v), vget_high_u32(v));
+    return vget_lane_u32(vpadd_u32(pair, pair), 0);
+}
+
+void
+HE100_fletcher16Neon (struct HE100_checksum *checksum, const unsigned char *data, size_t bytes)
+{
+    static const uint8_t weights[16] = {16,15,14,13,12,11,10,9,8,7,6,5,4,3,2,1};
+    size_t blocks = bytes / 16;
+
+    if (blocks > 0) {
+        const uint8x8_t weights_lo = vld1_u8(weights);
+        const uint8x8_t weights_hi = vld1_u8(weights+8);
+        uint32x4_t vs1 = vdupq_n_u32(0);
+        uint32x4_t vs2 = vdupq_n_u32(0);
+        uint32x4_t vprev = vdupq_n_u32(0);
+
+        size_t b;
+        for (b=0; b<blocks; b++) {
+            uint8x16_t v = vld1q_u8(data + 16*b);
+            vprev = vaddq_u32(vprev, vs1);
+            vs1 = vpadalq_u16(vs1, vpaddlq_u8(v));
+            uint16x8_t weighted = vmull_u8(vget_low_u8(v), weights_lo);
+            weighted = vmlal_u8(weighted, vget_high_u8(v), weights_hi);
+            vs2 = vpadalq_u16(vs2, weighted);
+        }
+
+        uint32_t n = (uint32_t)(16*blocks);
+        uint32_t sum1 = checksum->sum1 + HE100_hsumNeon(vs1);
+        uint32_t sum2 = checksum->sum2 + n*checksum->sum1 + HE100_hsumNeon(vs2) + 16*HE100_hsumNeon(vprev);
+        checksum->sum1 = (uint8_t)sum1;
+        checksum->sum2 = (uint8_t)sum2;
+    }
+
+    // the last few bytes one at a time
+    uint8_t sum1 = checksum->sum1;
+    uint8_t sum2 = checksum->sum2;
+    size_t i;
+    for (i=16*blocks; i<bytes; i++) {
+        sum1 += data[i];
+        sum2 += sum1;
+    }
+    checksum->sum1 = sum1;
+    checksum->sum2 = sum2;
+}
+
+#endif
@@ -0,0 +1,232 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-checksum.c
+ *
+ *    Description:  Fletcher-16 kernels and runtime CPU dispatch.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 01:05:52 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdint.h>     /*  Standard integer types */
+#include <stddef.h>
+
+#include <SC_he100.h>
+#include <SC_he100-checksum.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HE100_CHECKSUM_X86
+#include <immintrin.h>  /*  SSE2 and AVX2 intrinsics */
+#endif
+
+#if defined(HE100_CHECKSUM_NEON_KERNEL) && defined(__arm__)
+#include <sys/auxv.h>   /*  getauxval() */
+#include <asm/hwcap.h>  /*  HWCAP_NEON */
+#endif
+
+/*
+ * Over a block of n bytes d[0..n-1] the running sums move as
+ *   sum1 += d[0] + .. + d[n-1]
+ *   sum2 += n*sum1 + n*d[0] + (n-1)*d[1] + .. + 1*d[n-1]
+ * so a block can be summed with one horizontal add and one weighted add.
+ * Both sums are kept mod 2^32 and truncated at the end, which is exact since
+ * the checksum only keeps them mod 256.
+ */
+
+typedef void (*he100_fletcher_kernel)(struct HE100_checksum *, const unsigned char *, size_t);
+
+const char *HE100_CHECKSUM_KERNEL_NAMES[HE100_CHECKSUM_KERNELS] = {
+    "scalar",
+    "sse2",
+    "avx2",
+    "neon"
+};
+
+static void
+HE100_fletcher16Scalar (struct HE100_checksum *checksum, const unsigned char *data, size_t bytes)
+{
+    // the sums wrap at 256, as fletcher_checksum16 does
+    uint8_t sum1 = checksum->sum1;
+    uint8_t sum2 = checksum->sum2;
+    size_t i;
+    for (i=0; i<bytes; i++) {
+        sum1 += data[i];
+        sum2 += sum1;
+    }
+    checksum->sum1 = sum1;
+    checksum->sum2 = sum2;
+}
+
+#ifdef HE100_CHECKSUM_X86
+
+// always inlined, so inside the AVX2 kernel it is VEX encoded as well
+__attribute__((target("sse2"), always_inline)) static inline uint32_t
+HE100_hsum128 (__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1,0,3,2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2,3,0,1)));
+    return (uint32_t)_mm_cvtsi128_si32(v);
+}
+
+__attribute__((target("sse2"))) static void
+HE100_fletcher16Sse2 (struct HE100_checksum *checksum, const unsigned char *data, size_t bytes)
+{
+    size_t blocks = bytes / 16;
+    if (blocks > 0) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i weights_lo = _mm_setr_epi16(16,15,14,13,12,11,10,9);
+        const __m128i weights_hi = _mm_setr_epi16(8,7,6,5,4,3,2,1);
+        __m128i vs1 = zero;     // byte sums
+        __m128i vs2 = zero;     // weighted byte sums
+        __m128i vprev = zero;   // vs1 before each block, times 16 at the end
+
+        size_t b;
+        for (b=0; b<blocks; b++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(data + 16*b));
+            vprev = _mm_add_epi32(vprev, vs1);
+            vs1 = _mm_add_epi32(vs1, _mm_sad_epu8(v, zero));
+            __m128i lo = _mm_unpacklo_epi8(v, zero);
+            __m128i hi = _mm_unpackhi_epi8(v, zero);
+            vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(lo, weights_lo));
+            vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(hi, weights_hi));
+        }
+
+        uint32_t n = (uint32_t)(16*blocks);
+        uint32_t sum1 = checksum->sum1 + HE100_hsum128(vs1);
+        uint32_t sum2 = checksum->sum2 + n*checksum->sum1 + HE100_hsum128(vs2) + 16*HE100_hsum128(vprev);
+        checksum->sum1 = (uint8_t)sum1;
+        checksum->sum2 = (uint8_t)sum2;
+    }
+    HE100_fletcher16Scalar(checksum, data + 16*blocks, bytes - 16*blocks);
+}
+
+__attribute__((target("avx2"))) static void
+HE100_fletcher16Avx2 (struct HE100_checksum *checksum, const unsigned char *data, size_t bytes)
+{
+    size_t blocks = bytes / 32;
+    if (blocks > 0) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i ones = _mm256_set1_epi16(1);
+        const __m256i weights = _mm256_setr_epi8(
+            32,31,30,29,28,27,26,25,24,23,22,21,20,19,18,17,
+            16,15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1
+        );
+        __m256i vs1 = zero;
+        __m256i vs2 = zero;
+        __m256i vprev = zero;
+
+        size_t b;
+        for (b=0; b<blocks; b++) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(data + 32*b));
+            vprev = _mm256_add_epi32(vprev, vs1);
+            vs1 = _mm256_add_epi32(vs1, _mm256_sad_epu8(v, zero));
+            // pairs of byte*weight fit in 16 bits: 2*255*32 < 32768
+            __m256i pairs = _mm256_maddubs_epi16(v, weights);
+            vs2 = _mm256_add_epi32(vs2, _mm256_madd_epi16(pairs, ones));
+        }
+
+        __m128i s1 = _mm_add_epi32(_mm256_castsi256_si128(vs1), _mm256_extracti128_si256(vs1, 1));
+        __m128i s2 = _mm_add_epi32(_mm256_castsi256_si128(vs2), _mm256_extracti128_si256(vs2, 1));
+        __m128i prev = _mm_add_epi32(_mm256_castsi256_si128(vprev), _mm256_extracti128_si256(vprev, 1));
+
+        uint32_t n = (uint32_t)(32*blocks);
+        uint32_t sum1 = checksum->sum1 + HE100_hsum128(s1);
+        uint32_t sum2 = checksum->sum2 + n*checksum->sum1 + HE100_hsum128(s2) + 32*HE100_hsum128(prev);
+        checksum->sum1 = (uint8_t)sum1;
+        checksum->sum2 = (uint8_t)sum2;
+    }
+    // a 16 byte block left over still goes through SSE2, clear the upper
+    // halves first so the legacy SSE code does not stall on them
+    _mm256_zeroupper();
+    HE100_fletcher16Sse2(checksum, data + 32*blocks, bytes - 32*blocks);
+}
+
+#endif
+
+static const he100_fletcher_kernel HE100_CHECKSUM_KERNEL_TABLE[HE100_CHECKSUM_KERNELS] = {
+    HE100_fletcher16Scalar,
+#ifdef HE100_CHECKSUM_X86
+    HE100_fletcher16Sse2,
+    HE100_fletcher16Avx2,
+#else
+    NULL,
+    NULL,
+#endif
+#ifdef HE100_CHECKSUM_NEON_KERNEL
+    HE100_fletcher16Neon
+#else
+    NULL
+#endif
+};
+
+int
+HE100_checksumSupported (int kernel)
+{
+    if (kernel < 0 || kernel >= HE100_CHECKSUM_KERNELS) return 0;
+    if (HE100_CHECKSUM_KERNEL_TABLE[kernel] == NULL) return 0;
+    switch (kernel) {
+#ifdef HE100_CHECKSUM_X86
+        case HE100_CHECKSUM_SSE2 : return __builtin_cpu_supports("sse2") ? 1 : 0;
+        case HE100_CHECKSUM_AVX2 : return __builtin_cpu_supports("avx2") ? 1 : 0;
+#endif
+#if defined(HE100_CHECKSUM_NEON_KERNEL) && defined(__arm__)
+        case HE100_CHECKSUM_NEON : return (getauxval(AT_HWCAP) & HWCAP_NEON) ? 1 : 0;
+#endif
+        default : return 1; // scalar, and NEON on aarch64 where it is always there
+    }
+}
+
+// -1 until the first checksum picks a kernel
+static int HE100_checksum_kernel = -1;
+
+static he100_fletcher_kernel
+HE100_checksumResolve (void)
+{
+    int kernel = __atomic_load_n(&HE100_checksum_kernel, __ATOMIC_RELAXED);
+    if (kernel == -1) {
+        kernel = HE100_CHECKSUM_SCALAR;
+        int k;
+        for (k=HE100_CHECKSUM_SSE2; k<HE100_CHECKSUM_KERNELS; k++) {
+            if (HE100_checksumSupported(k)) kernel = k;
+        }
+        // every thread resolves to the same kernel, so racing here is harmless
+        __atomic_store_n(&HE100_checksum_kernel, kernel, __ATOMIC_RELAXED);
+    }
+    return HE100_CHECKSUM_KERNEL_TABLE[kernel];
+}
+
+int
+HE100_checksumSelect (int kernel)
+{
+    if (!HE100_checksumSupported(kernel)) return -1;
+    __atomic_store_n(&HE100_checksum_kernel, kernel, __ATOMIC_RELAXED);
+    return HE_SUCCESS;
+}
+
+int
+HE100_checksumKernel (void)
+{
+    HE100_checksumResolve();
+    return __atomic_load_n(&HE100_checksum_kernel, __ATOMIC_RELAXED);
+}
+
+void
+HE100_fletcher16Update (struct HE100_checksum *checksum, const unsigned char *data, size_t bytes)
+{
+    HE100_checksumResolve()(checksum, data, bytes);
+}
+
+struct HE100_checksum
+HE100_fletcher16 (unsigned char *data, size_t bytes)
+{
+    struct HE100_checksum checksum = {0,0};
+    HE100_checksumResolve()(&checksum, data, bytes);
+    return checksum;
+}
@@ -0,0 +1,201 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-decoder.c
+ *
+ *    Description:  Resumable frame decoder for bytes streamed from the He100.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 09:12:40 AM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <string.h>     /*  String function definitions */
+#include <unistd.h>     /*  UNIX standard function definitions */
+#include <errno.h>      /*  Error number definitions */
+#include <sys/uio.h>    /*  Definitions for readv() */
+
+#include <SC_he100.h>
+#include <SC_he100-decoder.h>
+#include <SC_he100-stats.h>
+#include <SC_he100-capture.h>
+
+void
+HE100_decoderInit (struct he100_decoder *decoder)
+{
+    memset(decoder, 0, sizeof(struct he100_decoder));
+    decoder->frame_length = MAX_FRAME_LENGTH;
+}
+
+size_t
+HE100_decoderPending (const struct he100_decoder *decoder)
+{
+    return decoder->tail - decoder->start;
+}
+
+size_t
+HE100_decoderFeed (struct he100_decoder *decoder, const unsigned char *bytes, size_t length)
+{
+    size_t space = HE100_DECODER_RING_SIZE - HE100_decoderPending(decoder);
+    if (length > space) length = space;
+
+    size_t offset = decoder->tail & HE100_DECODER_RING_MASK;
+    size_t first = HE100_DECODER_RING_SIZE - offset; // contiguous bytes before the ring wraps
+    if (first > length) first = length;
+
+    memcpy(decoder->ring+offset, bytes, first);
+    memcpy(decoder->ring, bytes+first, length-first);
+
+    decoder->tail += length;
+    decoder->bytes_in += length;
+    return length;
+}
+
+ssize_t
+HE100_decoderFill (struct he100_decoder *decoder, int fdin)
+{
+    size_t space = HE100_DECODER_RING_SIZE - HE100_decoderPending(decoder);
+    if (space == 0) return 0;
+
+    // the free space is at most two runs: up to the end of the ring, then from its start
+    size_t offset = decoder->tail & HE100_DECODER_RING_MASK;
+    size_t first = HE100_DECODER_RING_SIZE - offset;
+    if (first > space) first = space;
+
+    struct iovec runs[2];
+    runs[0].iov_base = decoder->ring+offset;
+    runs[0].iov_len = first;
+    runs[1].iov_base = decoder->ring;
+    runs[1].iov_len = space-first;
+
+    ssize_t r = readv(fdin, runs, runs[1].iov_len > 0 ? 2 : 1);
+    decoder->read_calls++;
+
+    if (r > 0) {
+        HE100_captureBytes(HE100_CAPTURE_RX, fdin, runs, 2, r);
+        decoder->tail += r;
+        decoder->bytes_in += r;
+    } else if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        r = 0; // nothing there after all, not an error
+    }
+    return r;
+}
+
+// move past the current candidate and start parsing a new one
+static void
+HE100_decoderRestart (struct he100_decoder *decoder, size_t skip)
+{
+    decoder->start += skip;
+    decoder->position = 0;
+    decoder->frame_length = MAX_FRAME_LENGTH;
+    decoder->sum.sum1 = 0;
+    decoder->sum.sum2 = 0;
+    decoder->candidate_status = HE_SUCCESS;
+}
+
+/*
+ * Move the start of the candidate to the next 48 65 sync pair, discarding the
+ * bytes before it. memchr looks for the first sync byte a word or vector at a
+ * time, so garbage between frames costs far less than parsing it byte by byte.
+ * A lone 0x48 as the last byte received is kept, its pair may be on the way.
+ */
+static void
+HE100_decoderSync (struct he100_decoder *decoder)
+{
+    while (decoder->start < decoder->tail)
+    {
+        // search up to the end of the ring or of the bytes received, the pair may straddle the wrap
+        size_t offset = decoder->start & HE100_DECODER_RING_MASK;
+        size_t run = HE100_DECODER_RING_SIZE - offset;
+        if (run > HE100_decoderPending(decoder)) run = HE100_decoderPending(decoder);
+
+        const unsigned char *found = (const unsigned char *)memchr(decoder->ring+offset, SYNC1, run);
+        size_t skip = found == NULL ? run : (size_t)(found - (decoder->ring+offset));
+        decoder->discarded += skip;
+        decoder->start += skip;
+        if (found == NULL) continue;
+
+        if ( decoder->start + 1 == decoder->tail || decoder->ring[(decoder->start+1) & HE100_DECODER_RING_MASK] == SYNC2 ) return;
+        decoder->discarded++;
+        decoder->start++;
+    }
+}
+
+int
+HE100_decoderNext (struct he100_decoder *decoder, unsigned char *frame, size_t *length)
+{
+    while (decoder->start + decoder->position < decoder->tail)
+    {
+        if ( decoder->position == 0 ) {
+            HE100_decoderSync(decoder);
+            if ( decoder->start == decoder->tail ) break;
+        }
+        unsigned char byte = decoder->ring[(decoder->start+decoder->position) & HE100_DECODER_RING_MASK];
+
+        // set break condition based on incoming byte pattern
+        if ( decoder->position == HE_LENGTH_BYTE_0 && (byte == HE_ACK || byte == HE_NOACK) ) {
+            decoder->frame_length = NOPAY_COMMAND_LENGTH; // ack is 8 bytes
+        } else if ( decoder->position == HE_LENGTH_BYTE && decoder->frame_length == MAX_FRAME_LENGTH ) {
+            // this is the length byte, and we haven't already set the break point
+            decoder->frame_length = byte + WRAPPER_LENGTH;
+        }
+
+        if ( HE100_referenceByteSequence(&byte, decoder->position) != 0 ) {
+            // drop only the first sync byte, the next frame may start anywhere after it,
+            // the offending byte included
+            decoder->discarded++;
+            HE100_decoderRestart(decoder, 1);
+            continue;
+        }
+
+        // checksum bytes are compared with the sums over everything before them
+        if ( decoder->position == HE_HEADER_CHECKSUM_BYTE_1 ) {
+            decoder->check = decoder->sum;
+        } else if ( decoder->frame_length > WRAPPER_LENGTH && decoder->position == decoder->frame_length-2 ) {
+            decoder->check = decoder->sum;
+        }
+        if ( decoder->position == HE_HEADER_CHECKSUM_BYTE_1 || decoder->position == HE_HEADER_CHECKSUM_BYTE_2 ) {
+            uint8_t expected = decoder->position == HE_HEADER_CHECKSUM_BYTE_1 ? decoder->check.sum1 : decoder->check.sum2;
+            if (byte != expected) {
+                // the sync bytes were not a frame after all, the next one may start inside them
+                decoder->header_failures++;
+                decoder->discarded++;
+                HE100_decoderRestart(decoder, 1);
+                continue;
+            }
+        } else if ( decoder->frame_length > WRAPPER_LENGTH && decoder->position >= decoder->frame_length-2 ) {
+            uint8_t expected = decoder->position == decoder->frame_length-2 ? decoder->check.sum1 : decoder->check.sum2;
+            if (byte != expected) decoder->candidate_status = HE_FAILED_CHECKSUM;
+        }
+        if ( decoder->position >= HE_TX_RX_BYTE ) {
+            decoder->sum.sum1 += byte;
+            decoder->sum.sum2 += decoder->sum.sum1;
+        }
+        decoder->position++;
+
+        if ( decoder->position == decoder->frame_length )
+        {
+            size_t offset = decoder->start & HE100_DECODER_RING_MASK;
+            size_t first = HE100_DECODER_RING_SIZE - offset;
+            if (first > decoder->frame_length) first = decoder->frame_length;
+
+            memcpy(frame, decoder->ring+offset, first);
+            memcpy(frame+first, decoder->ring, decoder->frame_length-first);
+            *length = decoder->frame_length;
+
+            decoder->status = decoder->candidate_status;
+            if (decoder->status != HE_SUCCESS) decoder->payload_failures++;
+            HE100_statsReceived(frame, *length, decoder->status, decoder->discarded != decoder->discarded_at_frame);
+            decoder->discarded_at_frame = decoder->discarded;
+            HE100_decoderRestart(decoder, decoder->frame_length);
+            decoder->frames++;
+            return 1;
+        }
+    }
+    return 0;
+}
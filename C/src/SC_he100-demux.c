@@ -0,0 +1,127 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-demux.c
+ *
+ *    Description:  Bounded queues for the frames the radio sends unasked.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 11:12:27 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <string.h>     /*  String function definitions */
+
+#include <SC_he100.h>
+#include <SC_he100-demux.h>
+#include "SpaceDecl.h"
+#include "shakespeare.h"
+
+// logging
+#define PROCESS "HE100"
+#define MAX_LOG_BUFFER_LEN CS1_MAX_LOG_ENTRY
+
+void
+HE100_demuxInit (struct he100_demux *demux)
+{
+    memset(demux, 0, sizeof(*demux));
+}
+
+int
+HE100_demuxClass (const unsigned char *frame, size_t length)
+{
+    // ACKs and NACKs carry no payload, every unsolicited frame does
+    if (length <= WRAPPER_LENGTH) return -1;
+    switch (frame[HE_CMD_BYTE]) {
+        case CMD_RECEIVE_DATA :
+            return HE100_DEMUX_RECEIVED;
+        case CMD_TELEMETRY :
+        case CMD_TELEMETRY_DUMP :
+            return HE100_DEMUX_TELEMETRY;
+        case CMD_PING_RETURN :
+        case CMD_CODE_UPLOAD :
+        case CMD_TOGGLE_PIN :
+            return HE100_DEMUX_OA;
+        default :
+            return -1;
+    }
+}
+
+int
+HE100_demuxPush (struct he100_demux *demux, const unsigned char *frame, size_t length)
+{
+    int queue = HE100_demuxClass(frame, length);
+    if (queue == -1 || length > HE100_MAX_WIRE_FRAME) return -1;
+
+    struct he100_demux_queue *q = &demux->queues[queue];
+    if (q->tail - q->head == HE100_DEMUX_QUEUE_LENGTH) {
+        // the oldest are kept, whoever reads them sees the gap in the counter
+        if (q->dropped++ == 0) {
+            char log_buffer[MAX_LOG_BUFFER_LEN];
+            snprintf(log_buffer, MAX_LOG_BUFFER_LEN, "Demux: queue %d full, dropping command 0x%02x frames", queue, frame[HE_CMD_BYTE]);
+            Shakespeare::log(Shakespeare::WARNING, PROCESS, log_buffer);
+        }
+        return queue;
+    }
+
+    struct he100_demux_frame *entry = &q->entries[q->tail & (HE100_DEMUX_QUEUE_LENGTH - 1)];
+    memcpy(entry->frame, frame, length);
+    entry->length = length;
+    entry->sequence = demux->next_sequence++;
+    q->tail++;
+    q->queued++;
+    return queue;
+}
+
+int
+HE100_demuxPop (struct he100_demux *demux, int queue, unsigned char *frame, size_t *length)
+{
+    if (queue < 0 || queue >= HE100_DEMUX_QUEUES) return 0;
+    struct he100_demux_queue *q = &demux->queues[queue];
+    if (q->head == q->tail) return 0;
+
+    struct he100_demux_frame *entry = &q->entries[q->head & (HE100_DEMUX_QUEUE_LENGTH - 1)];
+    memcpy(frame, entry->frame, entry->length);
+    *length = entry->length;
+    q->head++;
+    return 1;
+}
+
+int
+HE100_demuxNext (struct he100_demux *demux, unsigned char *frame, size_t *length)
+{
+    int oldest = -1;
+    uint64_t sequence = 0;
+    int i;
+    for (i=0; i<HE100_DEMUX_QUEUES; i++) {
+        struct he100_demux_queue *q = &demux->queues[i];
+        if (q->head == q->tail) continue;
+        uint64_t s = q->entries[q->head & (HE100_DEMUX_QUEUE_LENGTH - 1)].sequence;
+        if (oldest == -1 || s < sequence) {
+            oldest = i;
+            sequence = s;
+        }
+    }
+    if (oldest != -1) HE100_demuxPop(demux, oldest, frame, length);
+    return oldest;
+}
+
+size_t
+HE100_demuxPending (const struct he100_demux *demux, int queue)
+{
+    if (queue < 0 || queue >= HE100_DEMUX_QUEUES) return 0;
+    return demux->queues[queue].tail - demux->queues[queue].head;
+}
+
+void
+HE100_demuxRxCallback (const unsigned char *frame, size_t length, int status, void *context)
+{
+    if (status != HE_SUCCESS) return;
+    HE100_demuxPush((struct he100_demux *)context, frame, length);
+}
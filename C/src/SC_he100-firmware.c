@@ -0,0 +1,418 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-firmware.c
+ *
+ *    Description:  Intel HEX decoding and pipelined firmware upload.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 07:30:12 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <stdlib.h>     /*  C Standard General Utilities Library */
+#include <string.h>     /*  String function definitions */
+#include <errno.h>      /*  Error number definitions */
+#include <fcntl.h>      /*  File control definitions */
+#include <unistd.h>     /*  UNIX standard function definitions */
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+
+#include <SC_he100.h>
+#include <SC_he100-firmware.h>
+#include "SpaceDecl.h"
+#include "shakespeare.h"
+
+// logging
+#define PROCESS "HE100"
+#define MAX_LOG_BUFFER_LEN CS1_MAX_LOG_ENTRY
+
+// Intel HEX record types
+#define HEX_DATA                0x00
+#define HEX_END_OF_FILE         0x01
+#define HEX_EXTENDED_SEGMENT    0x02
+#define HEX_START_SEGMENT       0x03
+#define HEX_EXTENDED_LINEAR     0x04
+#define HEX_START_LINEAR        0x05
+#define HEX_MIN_RECORD          11  // ':', count, address, type and checksum, as text
+
+static void
+HE100_firmwareLog (Shakespeare::Priority priority, const char *what, unsigned long value)
+{
+    char log_buffer[MAX_LOG_BUFFER_LEN];
+    snprintf(log_buffer, MAX_LOG_BUFFER_LEN, "Firmware: %s %lu", what, value);
+    Shakespeare::log(priority, PROCESS, log_buffer);
+}
+
+static int
+HE100_hexNibble (char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// the bytes of one record, from the text after ':'; the count of them or -1
+static int
+HE100_hexRecord (const char *text, size_t length, unsigned char *record)
+{
+    size_t i = 0;
+    while (i+1 < length) {
+        int high = HE100_hexNibble(text[i]);
+        int low = HE100_hexNibble(text[i+1]);
+        if (high < 0 || low < 0) break;
+        record[i/2] = (unsigned char)(high << 4 | low);
+        i += 2;
+        if (i/2 >= 5 && i/2 == (size_t)record[0] + 5) return (int)(i/2);
+    }
+    return -1;
+}
+
+// adds bytes at an address, to the last packet while they follow on from it
+static void
+HE100_firmwareAppend (struct he100_firmware_image *image, uint32_t address, const unsigned char *bytes, size_t count)
+{
+    while (count > 0) {
+        struct he100_firmware_packet *packet = image->packet_count > 0 ? &image->packets[image->packet_count-1] : NULL;
+        if (
+                packet == NULL
+            ||  packet->address + packet->length != address
+            ||  packet->offset + packet->length != image->size
+            ||  packet->length == HE100_FIRMWARE_PACKET_DATA
+           )
+        {
+            packet = &image->packets[image->packet_count++];
+            packet->address = address;
+            packet->offset = (uint32_t)image->size;
+            packet->length = 0;
+        }
+        size_t take = HE100_FIRMWARE_PACKET_DATA - packet->length;
+        if (take > count) take = count;
+        memcpy(image->data + image->size, bytes, take);
+        image->size += take;
+        packet->length += (uint32_t)take;
+        address += (uint32_t)take;
+        bytes += take;
+        count -= take;
+    }
+}
+
+int
+HE100_firmwareParse (struct he100_firmware_image *image, const char *text, size_t length)
+{
+    memset(image, 0, sizeof(*image));
+
+    // every record holds at most half its text as data, and starts at most one packet besides the full ones
+    size_t data_bound = length / 2 + 1;
+    size_t packet_bound = length / HEX_MIN_RECORD + data_bound / HE100_FIRMWARE_PACKET_DATA + 1;
+    image->data = (unsigned char *)malloc(data_bound);
+    image->packets = (struct he100_firmware_packet *)malloc(packet_bound * sizeof(struct he100_firmware_packet));
+    if (image->data == NULL || image->packets == NULL) {
+        HE100_firmwareFree(image);
+        return HE_INVALID_FIRMWARE;
+    }
+
+    uint32_t base = 0;
+    int line = 0;
+    int ended = 0;
+    size_t i = 0;
+    while (i < length && !ended) {
+        if (text[i] == '\r' || text[i] == '\n' || text[i] == ' ' || text[i] == '\t') {
+            if (text[i] == '\n') line++;
+            i++;
+            continue;
+        }
+        unsigned char record[260];
+        int count = text[i] == ':' ? HE100_hexRecord(text+i+1, length-i-1, record) : -1;
+        unsigned char sum = 0;
+        int j;
+        for (j=0; j<count; j++) sum += record[j];
+        if (count < 0 || sum != 0) {
+            HE100_firmwareLog(Shakespeare::ERROR, "malformed record on line", line+1);
+            HE100_firmwareFree(image);
+            return HE_INVALID_FIRMWARE;
+        }
+        i += 1 + 2*count;
+
+        // an address record carries exactly its address, else base would come from past the record
+        int fixed = -1;
+        if (record[3] == HEX_EXTENDED_SEGMENT || record[3] == HEX_EXTENDED_LINEAR) fixed = 2;
+        if (record[3] == HEX_START_SEGMENT || record[3] == HEX_START_LINEAR) fixed = 4;
+        if (fixed != -1 && record[0] != fixed) {
+            HE100_firmwareLog(Shakespeare::ERROR, "bad address record length on line", line+1);
+            HE100_firmwareFree(image);
+            return HE_INVALID_FIRMWARE;
+        }
+
+        uint32_t address = (uint32_t)record[1] << 8 | record[2];
+        switch (record[3]) {
+            case HEX_DATA :
+                HE100_firmwareAppend(image, base + address, record+4, record[0]);
+                break;
+            case HEX_END_OF_FILE :
+                ended = 1;
+                break;
+            case HEX_EXTENDED_SEGMENT :
+                base = ((uint32_t)record[4] << 8 | record[5]) << 4;
+                break;
+            case HEX_EXTENDED_LINEAR :
+                base = ((uint32_t)record[4] << 8 | record[5]) << 16;
+                break;
+            case HEX_START_SEGMENT :
+            case HEX_START_LINEAR :
+                break;
+            default :
+                HE100_firmwareLog(Shakespeare::ERROR, "unknown record type on line", line+1);
+                HE100_firmwareFree(image);
+                return HE_INVALID_FIRMWARE;
+        }
+    }
+    if (!ended || image->size == 0) {
+        HE100_firmwareLog(Shakespeare::ERROR, ended ? "no data in image, records" : "no end of file record, lines", line);
+        HE100_firmwareFree(image);
+        return HE_INVALID_FIRMWARE;
+    }
+
+    unsigned int md5_length = 0;
+    EVP_Digest(text, length, image->md5, &md5_length, EVP_md5(), NULL);
+    return HE_SUCCESS;
+}
+
+int
+HE100_firmwareLoad (struct he100_firmware_image *image, const char *path)
+{
+    memset(image, 0, sizeof(*image));
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        char log_buffer[MAX_LOG_BUFFER_LEN];
+        snprintf(log_buffer, MAX_LOG_BUFFER_LEN, "Firmware: cannot read %s: %s", path, fd < 0 ? strerror(errno) : "empty");
+        Shakespeare::log(Shakespeare::ERROR, PROCESS, log_buffer);
+        if (fd >= 0) close(fd);
+        return HE_INVALID_FIRMWARE;
+    }
+
+    // decoded once from the mapping, the text is not kept
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return HE_INVALID_FIRMWARE;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    int result = HE100_firmwareParse(image, (const char *)map, st.st_size);
+    munmap(map, st.st_size);
+    return result;
+}
+
+void
+HE100_firmwareFree (struct he100_firmware_image *image)
+{
+    free(image->data);
+    free(image->packets);
+    memset(image, 0, sizeof(*image));
+}
+
+/*
+ * The progress file: HE100_FIRMWARE_PROGRESS_MAGIC, the MD5 of the image, the
+ * packet count, then a byte per packet, written whole to a temporary file and
+ * renamed over the last one so an interruption leaves one or the other.
+ */
+static void
+HE100_firmwareSaveProgress (struct he100_firmware_upload *upload)
+{
+    if (upload->progress_path == NULL) return;
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", upload->progress_path);
+
+    FILE *progress = fopen(temporary, "wb");
+    if (progress == NULL) return;
+    uint32_t count = (uint32_t)upload->image->packet_count;
+    int ok =
+            fwrite(HE100_FIRMWARE_PROGRESS_MAGIC, 8, 1, progress) == 1
+        &&  fwrite(upload->image->md5, HE100_FIRMWARE_MD5_LENGTH, 1, progress) == 1
+        &&  fwrite(&count, sizeof(count), 1, progress) == 1
+        &&  fwrite(upload->state, count, 1, progress) == 1;
+    if (fclose(progress) != 0) ok = 0;
+    if (ok) rename(temporary, upload->progress_path);
+    else unlink(temporary);
+    upload->saved_at = upload->packets_acked;
+}
+
+static void
+HE100_firmwareLoadProgress (struct he100_firmware_upload *upload)
+{
+    FILE *progress = fopen(upload->progress_path, "rb");
+    if (progress == NULL) return;
+
+    char magic[8];
+    unsigned char md5[HE100_FIRMWARE_MD5_LENGTH];
+    uint32_t count;
+    if (
+            fread(magic, sizeof(magic), 1, progress) == 1
+        &&  memcmp(magic, HE100_FIRMWARE_PROGRESS_MAGIC, sizeof(magic)) == 0
+        &&  fread(md5, sizeof(md5), 1, progress) == 1
+        &&  memcmp(md5, upload->image->md5, sizeof(md5)) == 0
+        &&  fread(&count, sizeof(count), 1, progress) == 1
+        &&  count == upload->image->packet_count
+        &&  fread(upload->state, count, 1, progress) == 1
+       )
+    {
+        size_t i;
+        for (i=0; i<count; i++) {
+            // what was in flight when the file was written may or may not have arrived
+            if (upload->state[i] != HE100_FIRMWARE_ACKED) {
+                upload->state[i] = HE100_FIRMWARE_UNSENT;
+                continue;
+            }
+            upload->packets_acked++;
+            upload->bytes_acked += upload->image->packets[i].length;
+        }
+        upload->saved_at = upload->packets_acked;
+        HE100_firmwareLog(Shakespeare::NOTICE, "resuming, packets acknowledged", upload->packets_acked);
+    } else {
+        memset(upload->state, HE100_FIRMWARE_UNSENT, upload->image->packet_count);
+    }
+    fclose(progress);
+}
+
+int
+HE100_firmwareUploadInit (struct he100_firmware_upload *upload, const struct he100_firmware_image *image, const char *progress_path)
+{
+    memset(upload, 0, sizeof(*upload));
+    upload->image = image;
+    upload->progress_path = progress_path;
+    upload->state = (unsigned char *)calloc(image->packet_count > 0 ? image->packet_count : 1, 1);
+    if (upload->state == NULL) return HE_INVALID_FIRMWARE;
+    if (progress_path != NULL) HE100_firmwareLoadProgress(upload);
+    return HE_SUCCESS;
+}
+
+void
+HE100_firmwareUploadFree (struct he100_firmware_upload *upload)
+{
+    free(upload->state);
+    memset(upload, 0, sizeof(*upload));
+}
+
+// the packet is known by where its state byte sits
+static void
+HE100_firmwarePacketDone (int status, const unsigned char *response, size_t length, void *context)
+{
+    (void)response;
+    (void)length;
+    unsigned char *state = (unsigned char *)context;
+    if (status == HE_SUCCESS) *state = HE100_FIRMWARE_ACKED;
+}
+
+static void
+HE100_firmwareUpdateDone (int status, const unsigned char *response, size_t length, void *context)
+{
+    (void)response;
+    (void)length;
+    *(int *)context = status;
+}
+
+// packets_acked and bytes_acked follow the state bytes the callbacks set
+static void
+HE100_firmwareCount (struct he100_firmware_upload *upload)
+{
+    size_t acked = 0;
+    uint64_t bytes = 0;
+    size_t i;
+    for (i=0; i<upload->image->packet_count; i++) {
+        if (upload->state[i] != HE100_FIRMWARE_ACKED) continue;
+        acked++;
+        bytes += upload->image->packets[i].length;
+    }
+    upload->packets_acked = acked;
+    upload->bytes_acked = bytes;
+}
+
+static int
+HE100_firmwareSendPackets (struct he100_pipeline *pipeline, struct he100_firmware_upload *upload)
+{
+    const struct he100_firmware_image *image = upload->image;
+    unsigned char command[2] = {CMD_TRANSMIT, CMD_FIRMWARE_PACKET};
+    unsigned char payload[HE100_FIRMWARE_ADDRESS_LENGTH + HE100_FIRMWARE_PACKET_DATA];
+    size_t i;
+    for (i=0; i<image->packet_count; i++) {
+        if (upload->state[i] == HE100_FIRMWARE_ACKED) continue;
+
+        const struct he100_firmware_packet *packet = &image->packets[i];
+        payload[0] = packet->address & 0xff;
+        payload[1] = (packet->address >> 8) & 0xff;
+        payload[2] = (packet->address >> 16) & 0xff;
+        payload[3] = (packet->address >> 24) & 0xff;
+        memcpy(payload+HE100_FIRMWARE_ADDRESS_LENGTH, image->data+packet->offset, packet->length);
+        size_t length = HE100_FIRMWARE_ADDRESS_LENGTH + packet->length;
+
+        if (upload->state[i] == HE100_FIRMWARE_SENT) upload->resent++;
+        int r = HE100_pipelineSubmit(pipeline, payload, length, command, HE100_firmwarePacketDone, &upload->state[i]);
+        if (r != HE_SUCCESS) return r;
+        upload->state[i] = HE100_FIRMWARE_SENT;
+        upload->bytes_written += length + WRAPPER_LENGTH;
+
+        // ACKs are marked by the callbacks as the submits wait for room, counted here now and then
+        if (upload->progress_path != NULL && i % HE100_FIRMWARE_SAVE_EVERY == 0) {
+            HE100_firmwareCount(upload);
+            if (upload->packets_acked - upload->saved_at >= HE100_FIRMWARE_SAVE_EVERY) HE100_firmwareSaveProgress(upload);
+        }
+    }
+    if (HE100_pipelineFlush(pipeline) != HE_SUCCESS) return HE_FAILED_READ;
+    HE100_firmwareCount(upload);
+    return HE_SUCCESS;
+}
+
+int
+HE100_firmwareUpload (struct he100_pipeline *pipeline, struct he100_firmware_upload *upload)
+{
+    const struct he100_firmware_image *image = upload->image;
+    uint64_t start = HE100_monotonicNs();
+    int result = HE_SUCCESS;
+
+    int pass;
+    for (pass=0; pass<HE100_FIRMWARE_RETRIES && upload->packets_acked < image->packet_count; pass++) {
+        result = HE100_firmwareSendPackets(pipeline, upload);
+        if (result != HE_SUCCESS) break;
+    }
+    HE100_firmwareSaveProgress(upload);
+
+    if (result == HE_SUCCESS && upload->packets_acked < image->packet_count) result = HE_FAILED_ACK_TIMEOUT;
+    if (result == HE_SUCCESS) {
+        unsigned char command[2] = {CMD_TRANSMIT, CMD_FIRMWARE_UPDATE};
+        int update = HE_FAILED_ACK_TIMEOUT;
+        result = HE100_pipelineSubmit(pipeline, (unsigned char *)image->md5, HE100_FIRMWARE_MD5_LENGTH, command, HE100_firmwareUpdateDone, &update);
+        if (result == HE_SUCCESS) {
+            upload->bytes_written += HE100_FIRMWARE_MD5_LENGTH + WRAPPER_LENGTH;
+            if (HE100_pipelineFlush(pipeline) != HE_SUCCESS) result = HE_FAILED_READ;
+            else result = update;
+        }
+    }
+    upload->elapsed_ns += HE100_monotonicNs() - start;
+
+    char log_buffer[MAX_LOG_BUFFER_LEN];
+    snprintf(
+        log_buffer,
+        MAX_LOG_BUFFER_LEN,
+        "Firmware: %lu/%lu packets, %llu bytes in %.3f s, %.0f B/s, %llu resent: %s",
+        (unsigned long)upload->packets_acked, (unsigned long)image->packet_count,
+        (unsigned long long)upload->bytes_acked, upload->elapsed_ns / 1e9,
+        HE100_firmwareRate(upload), (unsigned long long)upload->resent,
+        HE_STATUS[result]
+    );
+    Shakespeare::log(result == HE_SUCCESS ? Shakespeare::NOTICE : Shakespeare::ERROR, PROCESS, log_buffer);
+    return result;
+}
+
+double
+HE100_firmwareRate (const struct he100_firmware_upload *upload)
+{
+    if (upload->elapsed_ns == 0) return 0;
+    return upload->bytes_acked * 1e9 / upload->elapsed_ns;
+}
@@ -0,0 +1,294 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-fragment.c
+ *
+ *    Description:  Fragmentation of large messages and their reassembly.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 03:02:18 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <string.h>     /*  String function definitions */
+#include <sys/uio.h>    /*  struct iovec */
+#include <time.h>       /*  time, to seed message ids */
+#include <unistd.h>     /*  getpid */
+
+#include <SC_he100.h>
+#include <SC_he100-fragment.h>
+#include "SpaceDecl.h"
+#include "shakespeare.h"
+
+// logging
+#define PROCESS "HE100"
+#define MAX_LOG_BUFFER_LEN CS1_MAX_LOG_ENTRY
+
+// above any uint16_t, marks the message id counter as seeded
+#define HE100_MESSAGE_ID_SEEDED 0x10000
+
+int
+HE100_fragmentCount (size_t length)
+{
+    if (length == 0 || length > HE100_FRAGMENT_MAX_MESSAGE) return -1;
+    return (int)((length + HE100_FRAGMENT_DATA - 1) / HE100_FRAGMENT_DATA);
+}
+
+int
+HE100_fragmentPrepare (const unsigned char *message, size_t length, uint16_t message_id, int index, unsigned char *header, struct iovec *slice)
+{
+    int count = HE100_fragmentCount(length);
+    if (count < 0 || index < 0 || index >= count) return HE_INVALID_FRAGMENT;
+
+    size_t offset = (size_t)index * HE100_FRAGMENT_DATA;
+    header[0] = HE100_FRAGMENT_MARKER;
+    header[1] = message_id >> 8;
+    header[2] = message_id & 0xff;
+    header[3] = (unsigned char)index;
+    header[4] = (unsigned char)count;
+    slice->iov_base = (void *)(message + offset);
+    slice->iov_len = length - offset < HE100_FRAGMENT_DATA ? length - offset : HE100_FRAGMENT_DATA;
+    return HE_SUCCESS;
+}
+
+int
+HE100_fragmentSend (int fdin, const unsigned char *message, size_t length, uint16_t message_id)
+{
+    unsigned char transmit_data_command[2] = {CMD_TRANSMIT, CMD_TRANSMIT_DATA};
+    int count = HE100_fragmentCount(length);
+    if (count < 0) return HE_INVALID_FRAGMENT;
+
+    int index;
+    for (index=0; index<count; index++) {
+        // the fragment header and the message slice go out in one writev
+        unsigned char header[HE100_FRAGMENT_HEADER];
+        struct iovec fragment[2];
+        HE100_fragmentPrepare(message, length, message_id, index, header, &fragment[1]);
+        fragment[0].iov_base = header;
+        fragment[0].iov_len = HE100_FRAGMENT_HEADER;
+
+        int r = HE100_dispatchTransmissionv(fdin, fragment, 2, transmit_data_command);
+        if (r != HE_SUCCESS) {
+            char error[MAX_LOG_BUFFER_LEN];
+            snprintf (
+                error,
+                MAX_LOG_BUFFER_LEN,
+                "Message %u failed at fragment %d of %d: %s",
+                message_id, index+1, count, r >= 0 && r < (int)(sizeof(HE_STATUS)/sizeof(HE_STATUS[0])) ? HE_STATUS[r] : "unknown"
+            );
+            Shakespeare::log(Shakespeare::ERROR, PROCESS, error);
+            return r;
+        }
+    }
+    return HE_SUCCESS;
+}
+
+int
+HE100_transmitMessage (int fdin, const unsigned char *message, size_t length)
+{
+    // ids start somewhere new each run, so the first messages after a restart
+    // are not taken for the last ones before it; 0 until the first message
+    static uint32_t next_message_id = 0;
+    uint32_t unseeded = 0;
+    uint32_t seed = HE100_MESSAGE_ID_SEEDED | (uint16_t)(time(NULL) ^ getpid() ^ (HE100_monotonicNs() >> 10));
+    if (__atomic_load_n(&next_message_id, __ATOMIC_RELAXED) == 0) {
+        __atomic_compare_exchange_n(&next_message_id, &unseeded, seed, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+    uint16_t message_id = (uint16_t)__atomic_fetch_add(&next_message_id, 1, __ATOMIC_RELAXED);
+    return HE100_fragmentSend(fdin, message, length, message_id);
+}
+
+void
+HE100_reassemblyInit (struct he100_reassembly *reassembly, int timeout_ms, he100_message_callback callback, void *context)
+{
+    memset(reassembly, 0, sizeof(*reassembly));
+    reassembly->timeout_ms = timeout_ms > 0 ? timeout_ms : HE100_REASSEMBLY_TIMEOUT_MS;
+    reassembly->callback = callback;
+    reassembly->context = context;
+}
+
+// report a message as given up and free its slot
+static void
+HE100_reassemblyGiveUp (struct he100_reassembly *reassembly, struct he100_reassembly_slot *slot)
+{
+    char error[MAX_LOG_BUFFER_LEN];
+    snprintf (
+        error,
+        MAX_LOG_BUFFER_LEN,
+        "Message %u given up with %d of %d fragments",
+        slot->message_id, slot->received, slot->count
+    );
+    Shakespeare::log(Shakespeare::WARNING, PROCESS, error);
+
+    reassembly->expired++;
+    slot->in_use = 0;
+    if (reassembly->callback != NULL) {
+        reassembly->callback(HE_FAILED_REASSEMBLY_TIMEOUT, slot->message_id, NULL, 0, slot->missing, reassembly->context);
+    }
+}
+
+int
+HE100_reassemblyExpire (struct he100_reassembly *reassembly)
+{
+    uint64_t now = HE100_monotonicNs();
+    uint64_t timeout = (uint64_t)reassembly->timeout_ms * 1000000;
+    int expired = 0;
+    int i;
+    for (i=0; i<HE100_REASSEMBLY_SLOTS; i++) {
+        struct he100_reassembly_slot *slot = &reassembly->slots[i];
+        if (slot->in_use && now - slot->updated >= timeout) {
+            HE100_reassemblyGiveUp(reassembly, slot);
+            expired++;
+        }
+    }
+    return expired;
+}
+
+// the slot holding message_id, else a free one set up for it, else the stalest one
+static struct he100_reassembly_slot *
+HE100_reassemblySlot (struct he100_reassembly *reassembly, uint16_t message_id, int count)
+{
+    struct he100_reassembly_slot *free_slot = NULL;
+    struct he100_reassembly_slot *stalest = NULL;
+    int i;
+    for (i=0; i<HE100_REASSEMBLY_SLOTS; i++) {
+        struct he100_reassembly_slot *slot = &reassembly->slots[i];
+        if (!slot->in_use) {
+            if (free_slot == NULL) free_slot = slot;
+            continue;
+        }
+        if (slot->message_id == message_id) return slot;
+        if (stalest == NULL || slot->updated < stalest->updated) stalest = slot;
+    }
+
+    if (free_slot == NULL) {
+        HE100_reassemblyGiveUp(reassembly, stalest);
+        free_slot = stalest;
+    }
+
+    free_slot->in_use = 1;
+    free_slot->message_id = message_id;
+    free_slot->count = (uint8_t)count;
+    free_slot->received = 0;
+    free_slot->length = 0;
+    memset(free_slot->missing, 0, sizeof(free_slot->missing));
+    for (i=0; i<count; i++) free_slot->missing[i/32] |= 1u << (i%32);
+    return free_slot;
+}
+
+// whether message_id is among the latest completed within the timeout, none
+// of them still has a slot; past that the id is free for a new message, as
+// after the sender restarts
+static int
+HE100_reassemblyCompleted (const struct he100_reassembly *reassembly, uint16_t message_id)
+{
+    uint64_t now = HE100_monotonicNs();
+    uint64_t timeout = (uint64_t)reassembly->timeout_ms * 1000000;
+    uint64_t kept = reassembly->completed < HE100_REASSEMBLY_COMPLETED ? reassembly->completed : HE100_REASSEMBLY_COMPLETED;
+    uint64_t i;
+    for (i=0; i<kept; i++) {
+        if (reassembly->completed_ids[i] == message_id && now - reassembly->completed_at[i] < timeout) return 1;
+    }
+    return 0;
+}
+
+int
+HE100_reassemblyAccept (struct he100_reassembly *reassembly, const unsigned char *fragment, size_t length)
+{
+    if (length <= HE100_FRAGMENT_HEADER || fragment[0] != HE100_FRAGMENT_MARKER) {
+        reassembly->rejected++;
+        return HE_INVALID_FRAGMENT;
+    }
+
+    uint16_t message_id = (uint16_t)(fragment[1] << 8 | fragment[2]);
+    int index = fragment[3];
+    int count = fragment[4];
+    size_t data_length = length - HE100_FRAGMENT_HEADER;
+    if (
+            count == 0 || count > HE100_FRAGMENT_MAX_COUNT || index >= count
+        ||  data_length > HE100_FRAGMENT_DATA
+        ||  (index < count-1 && data_length != HE100_FRAGMENT_DATA) // only the last one is short
+       )
+    {
+        reassembly->rejected++;
+        return HE_INVALID_FRAGMENT;
+    }
+
+    HE100_reassemblyExpire(reassembly);
+
+    // a late or repeated fragment of a message already delivered, it needs no slot
+    if (HE100_reassemblyCompleted(reassembly, message_id)) {
+        reassembly->duplicates++;
+        return HE_SUCCESS;
+    }
+
+    struct he100_reassembly_slot *slot = HE100_reassemblySlot(reassembly, message_id, count);
+    if (slot->count != count) {
+        reassembly->rejected++;
+        return HE_INVALID_FRAGMENT;
+    }
+
+    slot->updated = HE100_monotonicNs();
+    if (!(slot->missing[index/32] & (1u << (index%32)))) {
+        reassembly->duplicates++;
+        return HE_SUCCESS;
+    }
+
+    memcpy(slot->data + (size_t)index*HE100_FRAGMENT_DATA, fragment + HE100_FRAGMENT_HEADER, data_length);
+    slot->missing[index/32] &= ~(1u << (index%32));
+    slot->received++;
+    reassembly->fragments++;
+    if (index == count-1) slot->length = (size_t)index*HE100_FRAGMENT_DATA + data_length;
+
+    if (slot->received < slot->count) return HE_SUCCESS;
+
+    reassembly->completed_ids[reassembly->completed % HE100_REASSEMBLY_COMPLETED] = message_id;
+    reassembly->completed_at[reassembly->completed % HE100_REASSEMBLY_COMPLETED] = HE100_monotonicNs();
+    reassembly->completed++;
+    slot->in_use = 0;
+    if (reassembly->callback != NULL) {
+        reassembly->callback(HE_SUCCESS, message_id, slot->data, slot->length, slot->missing, reassembly->context);
+    }
+    return 1;
+}
+
+int
+HE100_reassemblyFrame (struct he100_reassembly *reassembly, const unsigned char *frame, size_t length)
+{
+    if (length < WRAPPER_LENGTH + HE100_AX25_HEADER_LENGTH || frame[HE_CMD_BYTE] != CMD_RECEIVE_DATA) {
+        reassembly->rejected++;
+        return HE_INVALID_FRAGMENT;
+    }
+    return HE100_reassemblyAccept(
+        reassembly,
+        frame + HE_FIRST_PAYLOAD_BYTE + HE100_AX25_HEADER_LENGTH,
+        length - WRAPPER_LENGTH - HE100_AX25_HEADER_LENGTH
+    );
+}
+
+void
+HE100_reassemblyRxCallback (const unsigned char *frame, size_t length, int status, void *context)
+{
+    if (status != HE_SUCCESS) return;
+    HE100_reassemblyFrame((struct he100_reassembly *)context, frame, length);
+}
+
+int
+HE100_reassemblyMissing (struct he100_reassembly *reassembly, uint16_t message_id, uint32_t *missing)
+{
+    int i;
+    for (i=0; i<HE100_REASSEMBLY_SLOTS; i++) {
+        struct he100_reassembly_slot *slot = &reassembly->slots[i];
+        if (slot->in_use && slot->message_id == message_id) {
+            memcpy(missing, slot->missing, sizeof(slot->missing));
+            return HE_SUCCESS;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,33 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-frames.c
+ *
+ *    Description:  Constant command frames, built by the compiler.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 06:03:44 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <SC_he100-frames.h>
+
+const unsigned char HE100_FRAME_NOOP[HE100_EMPTY_FRAME_LENGTH] = HE100_EMPTY_FRAME(CMD_NOOP);
+const unsigned char HE100_FRAME_RESET[HE100_EMPTY_FRAME_LENGTH] = HE100_EMPTY_FRAME(CMD_RESET);
+const unsigned char HE100_FRAME_GET_CONFIG[HE100_EMPTY_FRAME_LENGTH] = HE100_EMPTY_FRAME(CMD_GET_CONFIG);
+const unsigned char HE100_FRAME_READ_FIRMWARE_V[HE100_EMPTY_FRAME_LENGTH] = HE100_EMPTY_FRAME(CMD_READ_FIRMWARE_V);
+const unsigned char HE100_FRAME_TELEMETRY[HE100_EMPTY_FRAME_LENGTH] = HE100_EMPTY_FRAME(CMD_TELEMETRY);
+
+// one row per payload byte, 0 to 255
+#define HE100_ROWS4(command, n)     HE100_BYTE_FRAME(command, n) HE100_BYTE_FRAME(command, n+1) HE100_BYTE_FRAME(command, n+2) HE100_BYTE_FRAME(command, n+3)
+#define HE100_ROWS16(command, n)    HE100_ROWS4(command, n) HE100_ROWS4(command, n+4) HE100_ROWS4(command, n+8) HE100_ROWS4(command, n+12)
+#define HE100_ROWS64(command, n)    HE100_ROWS16(command, n) HE100_ROWS16(command, n+16) HE100_ROWS16(command, n+32) HE100_ROWS16(command, n+48)
+#define HE100_ROWS256(command)      HE100_ROWS64(command, 0) HE100_ROWS64(command, 64) HE100_ROWS64(command, 128) HE100_ROWS64(command, 192)
+
+const unsigned char HE100_FRAME_FAST_SET_PA[256][HE100_BYTE_FRAME_LENGTH] = { HE100_ROWS256(CMD_FAST_SET_PA) };
+const unsigned char HE100_FRAME_BEACON_CONFIG[256][HE100_BYTE_FRAME_LENGTH] = { HE100_ROWS256(CMD_BEACON_CONFIG) };
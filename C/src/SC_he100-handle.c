@@ -0,0 +1,486 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-handle.c
+ *
+ *    Description:  Per-radio handle: reads, command dispatch and policy with no
+ *                  state outside the handle.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 03:48:05 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <string.h>     /*  String function definitions */
+#include <errno.h>      /*  Error number definitions */
+#include <poll.h>       /*  Definitions for the poll() function */
+#include <pthread.h>
+#include <sys/stat.h>   /*  fstat, to tell files on the same fd apart */
+
+#include <SC_he100.h>
+#include <SC_he100-handle.h>
+#include <SC_he100-stats.h>
+#include <SC_he100-frames.h>
+#include "SpaceDecl.h"
+#include "shakespeare.h"
+
+// logging
+#define PROCESS "HE100"
+#define MAX_LOG_BUFFER_LEN CS1_MAX_LOG_ENTRY
+
+int
+HE100_handleInit (HE100_Handle *handle, int fdin)
+{
+    memset(handle, 0, sizeof(*handle));
+    handle->fdin = fdin;
+    HE100_decoderInit(&handle->decoder);
+    handle->policy.ack_timeout = HE100_HANDLE_READ_TIMEOUT;
+    handle->policy.soft_reset_on_invalid = 0;
+    handle->policy.adaptive_timeout = 1;
+    HE100_recoveryDefaults(&handle->policy.recovery);
+    HE100_recoveryInit(&handle->recovery, &handle->policy.recovery);
+    HE100_rtoInit(&handle->rto, HE100_RTO_FLOOR_MS, HE100_HANDLE_READ_TIMEOUT * 1000);
+    HE100_demuxInit(&handle->demux);
+    return fdin == 0 ? HE_FAILED_OPEN_PORT : HE_SUCCESS;
+}
+
+// the fd functions' handles, one per fd; one no call is using is given up for another fd when all are taken
+static struct he100_legacy_slot {
+    int fdin;                   // -1 when free, or released while still in use
+    int users;                  // calls under way on the handle
+    int known;                  // fstat worked on fdin when the handle was set up
+    dev_t dev;                  // and found this file, so a new one on the same fd is told apart
+    ino_t ino;
+    dev_t rdev;
+    uint64_t used;
+    HE100_Handle handle;
+} HE100_legacy[HE100_LEGACY_HANDLES];
+static uint64_t HE100_legacy_uses;
+static int HE100_legacy_ready;
+static pthread_mutex_t HE100_legacy_lock = PTHREAD_MUTEX_INITIALIZER;
+
+HE100_Handle *
+HE100_legacyHandle (int fdin)
+{
+    struct stat st;
+    int known = fstat(fdin, &st) == 0;
+
+    pthread_mutex_lock(&HE100_legacy_lock);
+    int i;
+    if (!HE100_legacy_ready) {
+        for (i=0; i<HE100_LEGACY_HANDLES; i++) HE100_legacy[i].fdin = -1;
+        HE100_legacy_ready = 1;
+    }
+
+    struct he100_legacy_slot *slot = NULL;
+    for (i=0; i<HE100_LEGACY_HANDLES && slot == NULL; i++) {
+        struct he100_legacy_slot *candidate = &HE100_legacy[i];
+        if (candidate->fdin != fdin) continue;
+        if (
+                candidate->known == known
+            &&  (!known || (candidate->dev == st.st_dev && candidate->ino == st.st_ino && candidate->rdev == st.st_rdev))
+           )
+        {
+            slot = candidate;
+        } else {
+            // the fd was closed and reused for another file, nothing of the old one applies
+            candidate->fdin = -1;
+        }
+    }
+    if (slot == NULL) {
+        for (i=0; i<HE100_LEGACY_HANDLES; i++) {
+            struct he100_legacy_slot *candidate = &HE100_legacy[i];
+            if (candidate->users > 0) continue;
+            if (candidate->fdin == -1) { slot = candidate; break; }
+            if (slot == NULL || candidate->used < slot->used) slot = candidate;
+        }
+        if (slot == NULL) {
+            pthread_mutex_unlock(&HE100_legacy_lock);
+            char log_buffer[MAX_LOG_BUFFER_LEN];
+            snprintf(log_buffer, MAX_LOG_BUFFER_LEN, "No handle for fd %d, all %d are in use", fdin, HE100_LEGACY_HANDLES);
+            Shakespeare::log(Shakespeare::ERROR, PROCESS, log_buffer);
+            return NULL;
+        }
+        if (slot->fdin != -1) {
+            char log_buffer[MAX_LOG_BUFFER_LEN];
+            snprintf(log_buffer, MAX_LOG_BUFFER_LEN, "%d fds in use, the handle of fd %d goes to fd %d", HE100_LEGACY_HANDLES, slot->fdin, fdin);
+            Shakespeare::log(Shakespeare::WARNING, PROCESS, log_buffer);
+        }
+        HE100_handleInit(&slot->handle, fdin);
+        slot->handle.policy.soft_reset_on_invalid = 1;
+        slot->fdin = fdin;
+        slot->known = known;
+        slot->dev = known ? st.st_dev : 0;
+        slot->ino = known ? st.st_ino : 0;
+        slot->rdev = known ? st.st_rdev : 0;
+    }
+    slot->users++;
+    slot->used = ++HE100_legacy_uses;
+    pthread_mutex_unlock(&HE100_legacy_lock);
+    return &slot->handle;
+}
+
+void
+HE100_legacyPut (HE100_Handle *handle)
+{
+    if (handle == NULL) return;
+    struct he100_legacy_slot *slot = (struct he100_legacy_slot *)((char *)handle - offsetof(struct he100_legacy_slot, handle));
+    pthread_mutex_lock(&HE100_legacy_lock);
+    slot->users--;
+    pthread_mutex_unlock(&HE100_legacy_lock);
+}
+
+void
+HE100_legacyRelease (int fdin)
+{
+    pthread_mutex_lock(&HE100_legacy_lock);
+    int i;
+    for (i=0; i<HE100_LEGACY_HANDLES && HE100_legacy_ready; i++) {
+        // a call still under way keeps the slot until it is done
+        if (HE100_legacy[i].fdin == fdin) HE100_legacy[i].fdin = -1;
+    }
+    pthread_mutex_unlock(&HE100_legacy_lock);
+}
+
+// count a decoded frame by what validation made of it
+static void
+HE100_handleCount (HE100_Handle *handle, int status)
+{
+    handle->stats.frames++;
+    HE100_recoveryFrame(&handle->recovery, &handle->policy.recovery, status == HE_SUCCESS || status == HE_FAILED_NACK, HE100_monotonicNs());
+    if (status == HE_FAILED_NACK) {
+        handle->stats.nacks++;
+    } else if (status != HE_SUCCESS) {
+        handle->stats.invalid++;
+    } else if (handle->response_length == NOPAY_COMMAND_LENGTH && handle->response[HE_LENGTH_BYTE_0] == HE_ACK) {
+        handle->stats.acks++;
+    }
+}
+
+/*
+ * Sleeps in poll until the decoder completes a frame or the deadline passes;
+ * bytes read past the frame stay in the handle's decoder for the next call.
+ */
+static int
+HE100_handleReadUntil (HE100_Handle *handle, uint64_t deadline, unsigned char *payload)
+{
+    if (handle->fdin == 0) return -1;
+
+    struct he100_decoder *decoder = &handle->decoder;
+    int r=-1;
+    handle->status = HE_FAILED_READ;
+
+    struct pollfd fds;
+    fds.fd = handle->fdin;
+    fds.events = POLLIN;
+
+    while (1)
+    {
+        if ( HE100_decoderNext(decoder, handle->response, &handle->response_length) == 1 )
+        {   // the decoder checked the checksums on the way
+            handle->status = HE100_validateDecodedFrame(handle->response, handle->response_length, decoder->status);
+            HE100_handleCount(handle, handle->status);
+            if ( handle->status == HE_SUCCESS )
+            {
+                size_t payload_length = 0;
+                if (handle->response_length >= WRAPPER_LENGTH) {
+                    payload_length = handle->response_length - WRAPPER_LENGTH;
+                    if (payload != NULL) memcpy (payload, handle->response+HE_FIRST_PAYLOAD_BYTE, payload_length);
+                }
+                r=payload_length;
+            }
+            else
+            {
+                char error[MAX_LOG_BUFFER_LEN];
+                snprintf (
+                    error,
+                    MAX_LOG_BUFFER_LEN,
+                    "Invalid Data: %d, %d, %s, %d",
+                    handle->fdin, handle->status, __func__, __LINE__
+                );
+                Shakespeare::log(Shakespeare::ERROR, PROCESS, error);
+
+                // one corrupted frame of a noisy pass is not worth a reset, nor is a reset that keeps failing
+                if (handle->policy.soft_reset_on_invalid && HE100_recoveryAllow(&handle->recovery, &handle->policy.recovery, HE100_monotonicNs())) {
+                    char log_msg[MAX_LOG_BUFFER_LEN];
+                    // an invalid reply to the reset itself must not reset again
+                    unsigned char invalid[HE100_MAX_WIRE_FRAME];
+                    size_t invalid_length = handle->response_length;
+                    int invalid_status = handle->status;
+                    memcpy(invalid, handle->response, invalid_length);
+                    handle->policy.soft_reset_on_invalid = 0;
+                    int reset_result = HE100_handleSoftReset(handle);
+                    handle->policy.soft_reset_on_invalid = 1;
+                    // and the caller sees the frame that was invalid, not the reset's ACK
+                    memcpy(handle->response, invalid, invalid_length);
+                    handle->response_length = invalid_length;
+                    handle->status = invalid_status;
+                    handle->stats.soft_resets++;
+                    HE100_recoveryReset(&handle->recovery, &handle->policy.recovery, reset_result, HE100_monotonicNs());
+                    snprintf (
+                        log_msg,
+                        MAX_LOG_BUFFER_LEN,
+                        "Soft Reset %s: %d, %s, %d",
+                        reset_result == 0 ? "written successfully!" : "FAILED",
+                        handle->fdin, __func__, __LINE__
+                    );
+                    Shakespeare::log(Shakespeare::ERROR, PROCESS, log_msg);
+                }
+            }
+            return r;
+        }
+
+        uint64_t now = HE100_monotonicNs();
+        if (now >= deadline) break;
+        int wait_ms = (int)((deadline - now + 999999) / 1000000);
+
+        int ret_value = poll(&fds, 1, wait_ms); // sleep until bytes arrive
+        if ( ret_value > 0 )
+        {
+            if ( HE100_decoderFill(decoder, handle->fdin) == -1 )
+            {
+                char error[MAX_LOG_BUFFER_LEN];
+                snprintf (
+                    error,
+                    MAX_LOG_BUFFER_LEN,
+                    "Problem with read(): %d, %s, %s, %d",
+                    handle->fdin, strerror(errno), __func__, __LINE__
+                );
+                Shakespeare::log(Shakespeare::ERROR, PROCESS, error);
+                handle->stats.read_errors++;
+                return -1;
+            }
+        }
+        else if (ret_value == -1 && errno != EINTR)
+        {
+            char error[MAX_LOG_BUFFER_LEN];
+            snprintf (
+                error,
+                MAX_LOG_BUFFER_LEN,
+                "Problem with poll(): %d, %s, %s, %d",
+                handle->fdin, strerror(errno), __func__, __LINE__
+            );
+            Shakespeare::log(Shakespeare::ERROR, PROCESS, error);
+            handle->stats.read_errors++;
+            return -1;
+        }
+    }
+    handle->stats.timeouts++;
+    return r;
+}
+
+int
+HE100_handleRead (HE100_Handle *handle, time_t timeout, unsigned char *payload)
+{
+    // queued frames were validated and counted when they were decoded
+    if (HE100_demuxNext(&handle->demux, handle->response, &handle->response_length) != -1) {
+        size_t payload_length = handle->response_length - WRAPPER_LENGTH;
+        if (payload != NULL) memcpy(payload, handle->response+HE_FIRST_PAYLOAD_BYTE, payload_length);
+        handle->status = HE_SUCCESS;
+        return payload_length;
+    }
+    return HE100_handleReadUntil(handle, HE100_monotonicNs() + (uint64_t)timeout * 1000000000, payload);
+}
+
+int
+HE100_handleAwait (HE100_Handle *handle, unsigned char command, unsigned char *payload)
+{
+    uint64_t timeout = (uint64_t)handle->policy.ack_timeout * 1000000000;
+    if (handle->policy.adaptive_timeout && HE100_rtoTimeout(&handle->rto, command) < timeout) {
+        timeout = HE100_rtoTimeout(&handle->rto, command);
+    }
+    // a soft reset from the policy writes again, keep this command's own time
+    uint64_t sent = handle->sent;
+    uint64_t deadline = sent + timeout;
+
+    while (1) {
+        int r = HE100_handleReadUntil(handle, deadline, payload);
+        int answered = handle->status == HE_SUCCESS || handle->status == HE_FAILED_NACK;
+        if (handle->status == HE_FAILED_READ) {
+            if (HE100_monotonicNs() >= deadline) HE100_rtoBackoff(&handle->rto, command);
+            return r;
+        }
+        // the decoder checked the header checksum, so the command byte holds even if the payload's failed
+        if (handle->response[HE_CMD_BYTE] != command) {
+            if (handle->status == HE_SUCCESS && HE100_demuxPush(&handle->demux, handle->response, handle->response_length) != -1) continue;
+            // such as the late ACK of a command already given up on
+            if (answered) handle->stats.stale++;
+            continue;
+        }
+        if (!answered) return r;
+        uint64_t rtt = HE100_monotonicNs() - sent;
+        HE100_rtoSample(&handle->rto, command, rtt);
+        HE100_statsLatency(command, rtt);
+        return r;
+    }
+}
+
+// count a frame written at handle->sent and wait for its ACK
+static int
+HE100_handleConfirm (HE100_Handle *handle, unsigned char command, int w)
+{
+    if (w <= 0) {
+        handle->stats.write_errors++;
+        return 1;
+    }
+    handle->stats.commands++;
+    handle->stats.bytes_written += w;
+
+    // the configuration and telemetry come back in place of an ACK, their callers read them
+    if (command == CMD_GET_CONFIG || command == CMD_TELEMETRY) return HE_SUCCESS;
+    if (HE100_handleAwait(handle, command, NULL) == -1) return 1;
+    return HE_SUCCESS;
+}
+
+int
+HE100_handleDispatch (HE100_Handle *handle, const struct iovec *payload, int iovcnt, unsigned char *command)
+{
+    unsigned char header[HE_FIRST_PAYLOAD_BYTE];
+    unsigned char trailer[2];
+
+    if (handle->fdin == 0) return HE_FAILED_OPEN_PORT;
+    if (iovcnt < 0 || iovcnt > HE100_MAX_PAYLOAD_IOV) return HE_FAILED_PREPARE_TRANSMISSION;
+    int length = HE100_prepareTransmissionv(payload,iovcnt,command,header,trailer);
+    if (length < 0) {
+        Shakespeare::log(Shakespeare::ERROR,PROCESS,"Prepare failed");
+        return HE_FAILED_PREPARE_TRANSMISSION;
+    }
+
+    handle->sent = HE100_monotonicNs();
+    int w = HE100_writeFramev(handle->fdin,header,payload,iovcnt,trailer);
+    return HE100_handleConfirm(handle, command[1], w);
+}
+
+int
+HE100_handleDispatchFrame (HE100_Handle *handle, const unsigned char *frame, size_t length)
+{
+    if (handle->fdin == 0) return HE_FAILED_OPEN_PORT;
+    handle->sent = HE100_monotonicNs();
+    int w = HE100_writeFrame(handle->fdin, frame, length);
+    return HE100_handleConfirm(handle, frame[HE_CMD_BYTE], w);
+}
+
+// the command bytes of every command the radio is sent, bar the constant frames
+static int
+HE100_handleCommand (HE100_Handle *handle, unsigned char command, unsigned char *payload, size_t length)
+{
+    unsigned char transmit_command[2] = {CMD_TRANSMIT, command};
+    struct iovec payload_iov = {payload, length};
+    return HE100_handleDispatch(handle, &payload_iov, length > 0 ? 1 : 0, transmit_command);
+}
+
+int
+HE100_handleNOOP (HE100_Handle *handle)
+{
+    return HE100_handleDispatchFrame(handle, HE100_FRAME_NOOP, sizeof(HE100_FRAME_NOOP));
+}
+
+int
+HE100_handleTransmitData (HE100_Handle *handle, unsigned char *transmit_data_payload, size_t transmit_data_len)
+{
+    return HE100_handleCommand(handle, CMD_TRANSMIT_DATA, transmit_data_payload, transmit_data_len);
+}
+
+int
+HE100_handleSetBeaconInterval (HE100_Handle *handle, int beacon_interval)
+{
+    if (beacon_interval > 255 ) return -1;
+    return HE100_handleDispatchFrame(handle, HE100_FRAME_BEACON_CONFIG[beacon_interval & 0xff], HE100_BYTE_FRAME_LENGTH);
+}
+
+int
+HE100_handleSetBeaconMessage (HE100_Handle *handle, unsigned char *set_beacon_message_payload, size_t beacon_message_len)
+{
+    return HE100_handleCommand(handle, CMD_BEACON_DATA, set_beacon_message_payload, beacon_message_len);
+}
+
+int
+HE100_handleFastSetPA (HE100_Handle *handle, int power_level)
+{
+    if (power_level > MAX_POWER_LEVEL || power_level < MIN_POWER_LEVEL) return 1;
+    return HE100_handleDispatchFrame(handle, HE100_FRAME_FAST_SET_PA[power_level & 0xff], HE100_BYTE_FRAME_LENGTH);
+}
+
+int
+HE100_handleSoftReset (HE100_Handle *handle)
+{
+    // the radio goes back to its flash settings, whatever was set since
+    HE100_handleInvalidateConfig(handle);
+    return HE100_handleDispatchFrame(handle, HE100_FRAME_RESET, sizeof(HE100_FRAME_RESET));
+}
+
+int
+HE100_handleReadFirmwareRevision (HE100_Handle *handle)
+{
+    return HE100_handleDispatchFrame(handle, HE100_FRAME_READ_FIRMWARE_V, sizeof(HE100_FRAME_READ_FIRMWARE_V));
+}
+
+int
+HE100_handleGetConfig (HE100_Handle *handle, struct he100_settings *settings)
+{
+    int result = HE100_handleDispatchFrame(handle, HE100_FRAME_GET_CONFIG, sizeof(HE100_FRAME_GET_CONFIG));
+    if (result != HE_SUCCESS) return result;
+
+    if ( HE100_handleAwait(handle, CMD_GET_CONFIG, NULL) < CFG_PAYLOAD_LENGTH ) return HE_FAILED_READ;
+
+    // HE100_collectConfig swaps bytes in place, keep the response as it came
+    unsigned char config_bytes[CFG_PAYLOAD_LENGTH];
+    memcpy (config_bytes, handle->response+HE_FIRST_PAYLOAD_BYTE, CFG_PAYLOAD_LENGTH);
+    *settings = HE100_collectConfig(config_bytes);
+    result = HE100_validateConfig(*settings);
+
+    // only a configuration that could be set again is worth comparing against
+    handle->config.valid = 0;
+    if (result == HE_SUCCESS && HE100_prepareConfig(*handle->config.bytes, *settings) == HE_SUCCESS) {
+        handle->config.settings = *settings;
+        handle->config.valid = 1;
+    }
+    return result;
+}
+
+int
+HE100_handleSetConfig (HE100_Handle *handle, struct he100_settings he100_new_settings)
+{
+    unsigned char set_config_payload[CFG_PAYLOAD_LENGTH] = {0};
+
+    if (HE100_validateConfig(he100_new_settings) != HE_SUCCESS) return HE_INVALID_CONFIG;
+    if (HE100_prepareConfig(*set_config_payload,he100_new_settings) != HE_SUCCESS) return HE_INVALID_CONFIG;
+
+    // compared as prepared bytes, the struct has padding and unused fields
+    if (handle->config.valid && memcmp(handle->config.bytes, set_config_payload, CFG_PAYLOAD_LENGTH) == 0) {
+        handle->stats.config_skipped++;
+        return HE_SUCCESS;
+    }
+
+    int result = HE100_handleCommand(handle, CMD_SET_CONFIG, set_config_payload, CFG_PAYLOAD_LENGTH);
+    if (result == HE_SUCCESS) {
+        memcpy(handle->config.bytes, set_config_payload, CFG_PAYLOAD_LENGTH);
+        handle->config.settings = he100_new_settings;
+        handle->config.valid = 1;
+    } else if (handle->status != HE_FAILED_NACK) {
+        // a NACK leaves the old settings, a lost ACK may not have
+        handle->config.valid = 0;
+    }
+    return result;
+}
+
+int
+HE100_handleCurrentConfig (HE100_Handle *handle, struct he100_settings *settings)
+{
+    if (!handle->config.valid) return HE100_handleGetConfig(handle, settings);
+    *settings = handle->config.settings;
+    handle->stats.config_hits++;
+    return HE_SUCCESS;
+}
+
+void
+HE100_handleInvalidateConfig (HE100_Handle *handle)
+{
+    handle->config.valid = 0;
+}
@@ -0,0 +1,189 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-pipeline.c
+ *
+ *    Description:  Pipelined transmit with asynchronous ACK correlation.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 11:20:37 AM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <string.h>     /*  String function definitions */
+
+#include <SC_he100.h>
+#include <SC_he100-pipeline.h>
+#include <SC_he100-stats.h>
+#include "SpaceDecl.h"
+#include "shakespeare.h"
+
+// logging
+#define PROCESS "HE100"
+#define MAX_LOG_BUFFER_LEN CS1_MAX_LOG_ENTRY
+
+// remove an entry from the window, then report its outcome
+static void
+HE100_pipelineComplete (struct he100_pipeline *pipeline, int index, int status, const unsigned char *response, size_t length)
+{
+    struct he100_pending done = pipeline->pending[index];
+    pipeline->pending[index] = pipeline->pending[--pipeline->in_flight];
+
+    switch (status) {
+        case HE_SUCCESS             : pipeline->acked++; break;
+        case HE_FAILED_NACK         : pipeline->nacked++; break;
+        case HE_FAILED_ACK_TIMEOUT  : pipeline->timed_out++; break;
+    }
+    if (status != HE_FAILED_ACK_TIMEOUT) HE100_statsLatency(done.command, HE100_monotonicNs() - done.sent);
+    if (done.callback != NULL) done.callback(status, response, length, done.context);
+}
+
+// receive engine callback: match the frame to the oldest request with its command byte
+static void
+HE100_pipelineResponse (const unsigned char *frame, size_t length, int status, void *context)
+{
+    struct he100_pipeline *pipeline = (struct he100_pipeline *)context;
+
+    // a corrupted response is left to time out, it cannot be trusted to match
+    if (status != HE_SUCCESS && status != HE_FAILED_NACK) return;
+
+    int oldest = -1;
+    int i;
+    for (i=0; i<pipeline->in_flight; i++) {
+        if (pipeline->pending[i].command != frame[HE_CMD_BYTE]) continue;
+        if (oldest == -1 || (int32_t)(pipeline->pending[i].sequence - pipeline->pending[oldest].sequence) < 0) {
+            oldest = i;
+        }
+    }
+
+    if (oldest == -1) {
+        if (pipeline->unsolicited != NULL) {
+            pipeline->unsolicited(frame, length, status, pipeline->unsolicited_context);
+        }
+        return;
+    }
+    HE100_pipelineComplete(pipeline, oldest, status, frame, length);
+}
+
+// complete every request that has waited longer than the ACK timeout
+static void
+HE100_pipelineExpire (struct he100_pipeline *pipeline)
+{
+    uint64_t now = HE100_monotonicNs();
+    uint64_t timeout = (uint64_t)pipeline->ack_timeout_ms * 1000000;
+    int i = 0;
+    while (i < pipeline->in_flight) {
+        if (now - pipeline->pending[i].sent >= timeout) {
+            char error[MAX_LOG_BUFFER_LEN];
+            snprintf (
+                error,
+                MAX_LOG_BUFFER_LEN,
+                "No response to 0x%02x>%s>%d",
+                pipeline->pending[i].command,
+                __func__, __LINE__
+            );
+            Shakespeare::log(Shakespeare::ERROR, PROCESS, error);
+            HE100_pipelineComplete(pipeline, i, HE_FAILED_ACK_TIMEOUT, NULL, 0);
+        } else {
+            i++;
+        }
+    }
+}
+
+int
+HE100_pipelineInit (struct he100_pipeline *pipeline, int fdin, int window)
+{
+    memset(pipeline, 0, sizeof(struct he100_pipeline));
+    if (window < 1) window = 1;
+    if (window > HE100_PIPELINE_MAX_WINDOW) window = HE100_PIPELINE_MAX_WINDOW;
+    pipeline->window = window;
+    pipeline->ack_timeout_ms = HE100_PIPELINE_ACK_TIMEOUT_MS;
+
+    int r = HE100_rxInit(&pipeline->rx, fdin);
+    if (r != HE_SUCCESS) return r;
+    return HE100_rxRegister(&pipeline->rx, HE100_RX_ANY_COMMAND, HE100_pipelineResponse, pipeline);
+}
+
+int
+HE100_pipelinePoll (struct he100_pipeline *pipeline, int timeout_ms)
+{
+    uint64_t completed = pipeline->acked + pipeline->nacked + pipeline->timed_out;
+
+    HE100_pipelineExpire(pipeline);
+
+    // do not sleep past the moment the oldest request times out
+    int i;
+    uint64_t now = HE100_monotonicNs();
+    for (i=0; i<pipeline->in_flight; i++) {
+        uint64_t expires = pipeline->pending[i].sent + (uint64_t)pipeline->ack_timeout_ms * 1000000;
+        int left_ms = expires > now ? (int)((expires - now + 999999) / 1000000) : 0;
+        if (timeout_ms < 0 || left_ms < timeout_ms) timeout_ms = left_ms; // negative waits for ever
+    }
+
+    if (HE100_rxRun(&pipeline->rx, timeout_ms) == -1) return -1;
+    HE100_pipelineExpire(pipeline);
+
+    return (int)(pipeline->acked + pipeline->nacked + pipeline->timed_out - completed);
+}
+
+int
+HE100_pipelineSubmit (struct he100_pipeline *pipeline, unsigned char *payload, size_t length, unsigned char *command, he100_tx_callback callback, void *context)
+{
+    if (length > MAX_FRAME_LENGTH - WRAPPER_LENGTH) return HE_FAILED_PREPARE_TRANSMISSION;
+
+    while (pipeline->in_flight >= pipeline->window) {
+        if (HE100_pipelinePoll(pipeline, pipeline->ack_timeout_ms) == -1) return HE_FAILED_READ;
+    }
+
+    // the payload goes out from the caller's buffer, only header and trailer are built here
+    unsigned char header[HE_FIRST_PAYLOAD_BYTE];
+    unsigned char trailer[2];
+    struct iovec iov = {payload, length};
+    if (HE100_prepareTransmissionv(&iov, 1, command, header, trailer) < 0) {
+        return HE_FAILED_PREPARE_TRANSMISSION;
+    }
+    int frame_length = (int)length + WRAPPER_LENGTH;
+    if (HE100_writeFramev(pipeline->rx.fdin, header, &iov, 1, trailer) != frame_length) {
+        return HE_FAILED_OPEN_PORT;
+    }
+
+    struct he100_pending *pending = &pipeline->pending[pipeline->in_flight++];
+    pending->sequence = pipeline->next_sequence++;
+    pending->command = command[1];
+    pending->sent = HE100_monotonicNs();
+    pending->callback = callback;
+    pending->context = context;
+    pipeline->submitted++;
+    return HE_SUCCESS;
+}
+
+int
+HE100_pipelineTransmitData (struct he100_pipeline *pipeline, unsigned char *payload, size_t length, he100_tx_callback callback, void *context)
+{
+    unsigned char transmit_data_command[2] = {CMD_TRANSMIT, CMD_TRANSMIT_DATA};
+    return HE100_pipelineSubmit(pipeline, payload, length, transmit_data_command, callback, context);
+}
+
+int
+HE100_pipelineFlush (struct he100_pipeline *pipeline)
+{
+    while (pipeline->in_flight > 0) {
+        if (HE100_pipelinePoll(pipeline, pipeline->ack_timeout_ms) == -1) return -1;
+    }
+    return HE_SUCCESS;
+}
+
+void
+HE100_pipelineClose (struct he100_pipeline *pipeline)
+{
+    while (pipeline->in_flight > 0) {
+        HE100_pipelineComplete(pipeline, pipeline->in_flight-1, HE_FAILED_ACK_TIMEOUT, NULL, 0);
+    }
+    HE100_rxClose(&pipeline->rx);
+}
@@ -0,0 +1,155 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-recovery.c
+ *
+ *    Description:  Soft reset policy: error rate windows, backoff and breaker.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 11:46:09 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <string.h>     /*  String function definitions */
+
+#include <SC_he100.h>
+#include <SC_he100-recovery.h>
+#include "SpaceDecl.h"
+#include "shakespeare.h"
+
+// logging
+#define PROCESS "HE100"
+#define MAX_LOG_BUFFER_LEN CS1_MAX_LOG_ENTRY
+
+void
+HE100_recoveryDefaults (struct he100_recovery_policy *policy)
+{
+    policy->window_ns = 10000000000ULL;
+    policy->error_threshold = 3;
+    policy->error_percent = 20;
+    policy->recovered_frames = 4;
+    policy->backoff_ns = 1000000000ULL;
+    policy->backoff_max_ns = 64000000000ULL;
+    policy->breaker_threshold = 3;
+    policy->cooldown_ns = 60000000000ULL;
+}
+
+void
+HE100_recoveryInit (struct he100_recovery *recovery, const struct he100_recovery_policy *policy)
+{
+    memset(recovery, 0, sizeof(*recovery));
+    recovery->state = HE100_RECOVERY_CLOSED;
+    recovery->backoff_ns = policy->backoff_ns;
+}
+
+const char *
+HE100_recoveryStateName (int state)
+{
+    switch (state) {
+        case HE100_RECOVERY_CLOSED : return "closed";
+        case HE100_RECOVERY_OPEN : return "open";
+        case HE100_RECOVERY_HALF_OPEN : return "half open";
+        default : return "unknown";
+    }
+}
+
+static void
+HE100_recoveryState (struct he100_recovery *recovery, int state)
+{
+    if (recovery->state == state) return;
+    char log_buffer[MAX_LOG_BUFFER_LEN];
+    snprintf(
+        log_buffer, MAX_LOG_BUFFER_LEN,
+        "Recovery: breaker %s, was %s, %d resets in a row did not help",
+        HE100_recoveryStateName(state), HE100_recoveryStateName(recovery->state), recovery->failures
+    );
+    Shakespeare::log(state == HE100_RECOVERY_OPEN ? Shakespeare::ERROR : Shakespeare::NOTICE, PROCESS, log_buffer);
+    recovery->state = state;
+}
+
+void
+HE100_recoveryFrame (struct he100_recovery *recovery, const struct he100_recovery_policy *policy, int valid, uint64_t now)
+{
+    if (now - recovery->window_start >= policy->window_ns) {
+        recovery->window_start = now;
+        recovery->window_frames = 0;
+        recovery->window_errors = 0;
+    }
+    recovery->window_frames++;
+    if (!valid) {
+        recovery->window_errors++;
+        recovery->clean = 0;
+        return;
+    }
+
+    recovery->clean++;
+    if (recovery->judging && recovery->clean >= policy->recovered_frames) {
+        // the last reset helped: back to the first backoff
+        recovery->judging = 0;
+        recovery->failures = 0;
+        recovery->backoff_ns = policy->backoff_ns;
+        recovery->stats.recovered++;
+        HE100_recoveryState(recovery, HE100_RECOVERY_CLOSED);
+    }
+}
+
+int
+HE100_recoveryAllow (struct he100_recovery *recovery, const struct he100_recovery_policy *policy, uint64_t now)
+{
+    // one bad frame among many is no reason to reset
+    if (recovery->window_errors < (uint32_t)policy->error_threshold) return 0;
+    if ((uint64_t)recovery->window_errors * 100 < (uint64_t)policy->error_percent * recovery->window_frames) return 0;
+
+    if (recovery->judging) {
+        // errors enough for another reset before the frames that would have cleared the last
+        recovery->judging = 0;
+        recovery->failures++;
+        recovery->stats.failed++;
+        recovery->backoff_ns = recovery->backoff_ns * 2 < policy->backoff_max_ns ? recovery->backoff_ns * 2 : policy->backoff_max_ns;
+        recovery->not_before = now + recovery->backoff_ns;
+        if (recovery->state == HE100_RECOVERY_HALF_OPEN || (policy->breaker_threshold > 0 && recovery->failures >= policy->breaker_threshold)) {
+            recovery->opened = now;
+            recovery->stats.trips++;
+            HE100_recoveryState(recovery, HE100_RECOVERY_OPEN);
+        }
+    }
+
+    if (recovery->state == HE100_RECOVERY_OPEN) {
+        if (now - recovery->opened < policy->cooldown_ns) {
+            recovery->stats.suppressed++;
+            return 0;
+        }
+        HE100_recoveryState(recovery, HE100_RECOVERY_HALF_OPEN);
+        return 1;
+    }
+    if (now < recovery->not_before) {
+        recovery->stats.suppressed++;
+        return 0;
+    }
+    return 1;
+}
+
+void
+HE100_recoveryReset (struct he100_recovery *recovery, const struct he100_recovery_policy *policy, int result, uint64_t now)
+{
+    (void)policy;
+    recovery->stats.resets++;
+    recovery->judging = 1;
+    recovery->clean = 0;
+    recovery->not_before = now + recovery->backoff_ns;
+    // the errors that called for it are done with, the next window judges the reset
+    recovery->window_start = now;
+    recovery->window_frames = 0;
+    recovery->window_errors = 0;
+    if (result != HE_SUCCESS) {
+        char log_buffer[MAX_LOG_BUFFER_LEN];
+        snprintf(log_buffer, MAX_LOG_BUFFER_LEN, "Recovery: soft reset failed, %d, next no sooner than %llu ms", result, (unsigned long long)(recovery->backoff_ns / 1000000));
+        Shakespeare::log(Shakespeare::WARNING, PROCESS, log_buffer);
+    }
+}
@@ -0,0 +1,78 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-rto.c
+ *
+ *    Description:  Adaptive response timeouts per command byte.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 10:05:44 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <string.h>     /*  String function definitions */
+
+#include <SC_he100.h>
+#include <SC_he100-rto.h>
+
+static inline struct he100_rto_estimate *
+HE100_rtoFor (struct he100_rto *rto, unsigned char command)
+{
+    return &rto->commands[command < HE100_STATS_COMMANDS ? command : 0];
+}
+
+static uint64_t
+HE100_rtoClamp (const struct he100_rto *rto, uint64_t ns)
+{
+    if (ns < rto->floor_ns) return rto->floor_ns;
+    if (ns > rto->ceiling_ns) return rto->ceiling_ns;
+    return ns;
+}
+
+void
+HE100_rtoInit (struct he100_rto *rto, int floor_ms, int ceiling_ms)
+{
+    memset(rto, 0, sizeof(*rto));
+    rto->floor_ns = (uint64_t)floor_ms * 1000000;
+    rto->ceiling_ns = (uint64_t)(ceiling_ms > floor_ms ? ceiling_ms : floor_ms) * 1000000;
+    int i;
+    for (i=0; i<HE100_STATS_COMMANDS; i++) rto->commands[i].rto_ns = rto->ceiling_ns;
+}
+
+uint64_t
+HE100_rtoTimeout (const struct he100_rto *rto, unsigned char command)
+{
+    return rto->commands[command < HE100_STATS_COMMANDS ? command : 0].rto_ns;
+}
+
+void
+HE100_rtoSample (struct he100_rto *rto, unsigned char command, uint64_t rtt_ns)
+{
+    struct he100_rto_estimate *estimate = HE100_rtoFor(rto, command);
+    if (estimate->samples++ == 0) {
+        estimate->srtt_ns = rtt_ns;
+        estimate->rttvar_ns = rtt_ns / 2;
+    } else {
+        // gains of 1/4 and 1/8, in that order, the deviation against the old mean
+        uint64_t deviation = estimate->srtt_ns > rtt_ns ? estimate->srtt_ns - rtt_ns : rtt_ns - estimate->srtt_ns;
+        estimate->rttvar_ns = estimate->rttvar_ns - estimate->rttvar_ns / 4 + deviation / 4;
+        estimate->srtt_ns = estimate->srtt_ns - estimate->srtt_ns / 8 + rtt_ns / 8;
+    }
+    uint64_t spread = 4 * estimate->rttvar_ns;
+    estimate->rto_ns = HE100_rtoClamp(rto, estimate->srtt_ns + (spread > HE100_RTO_GRANULARITY_NS ? spread : HE100_RTO_GRANULARITY_NS));
+    HE100_statsRto(command, estimate->srtt_ns, estimate->rttvar_ns, estimate->rto_ns, 0);
+}
+
+void
+HE100_rtoBackoff (struct he100_rto *rto, unsigned char command)
+{
+    struct he100_rto_estimate *estimate = HE100_rtoFor(rto, command);
+    estimate->timeouts++;
+    estimate->rto_ns = HE100_rtoClamp(rto, 2 * estimate->rto_ns);
+    HE100_statsRto(command, estimate->srtt_ns, estimate->rttvar_ns, estimate->rto_ns, 1);
+}
@@ -0,0 +1,147 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-rx.c
+ *
+ *    Description:  Event driven receive engine built on epoll.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 10:02:11 AM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <string.h>     /*  String function definitions */
+#include <unistd.h>     /*  UNIX standard function definitions */
+#include <errno.h>      /*  Error number definitions */
+#include <sys/epoll.h>  /*  Definitions for epoll */
+
+#include <SC_he100.h>
+#include <SC_he100-rx.h>
+#include "SpaceDecl.h"
+#include "shakespeare.h"
+
+// logging
+#define PROCESS "HE100"
+#define MAX_LOG_BUFFER_LEN CS1_MAX_LOG_ENTRY
+
+int
+HE100_rxInit (struct he100_rx_engine *engine, int fdin)
+{
+    memset(engine, 0, sizeof(struct he100_rx_engine));
+    HE100_decoderInit(&engine->decoder);
+    engine->fdin = fdin;
+
+    engine->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (engine->epfd == -1) return HE_FAILED_OPEN_PORT;
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fdin;
+    if (epoll_ctl(engine->epfd, EPOLL_CTL_ADD, fdin, &event) == -1) {
+        char error[MAX_LOG_BUFFER_LEN];
+        snprintf (
+            error,
+            MAX_LOG_BUFFER_LEN,
+            "Problem with epoll_ctl(): %d, %s, %s, %d",
+            fdin, strerror(errno), __func__, __LINE__
+        );
+        Shakespeare::log(Shakespeare::ERROR, PROCESS, error);
+        close(engine->epfd);
+        engine->epfd = -1;
+        return HE_FAILED_OPEN_PORT;
+    }
+    return HE_SUCCESS;
+}
+
+int
+HE100_rxRegister (struct he100_rx_engine *engine, int command, he100_rx_callback callback, void *context)
+{
+    if (engine->handler_count == HE100_RX_MAX_HANDLERS) return -1;
+    struct he100_rx_handler *handler = &engine->handlers[engine->handler_count++];
+    handler->command = command;
+    handler->callback = callback;
+    handler->context = context;
+    return HE_SUCCESS;
+}
+
+// hand every complete frame in the decoder to its callbacks
+static int
+HE100_rxDeliver (struct he100_rx_engine *engine)
+{
+    unsigned char frame[HE100_MAX_WIRE_FRAME];
+    size_t length;
+    int delivered = 0;
+
+    while ( HE100_decoderNext(&engine->decoder, frame, &length) == 1 )
+    {
+        int status = HE100_validateDecodedFrame(frame, length, engine->decoder.status);
+        int i;
+        for (i=0; i<engine->handler_count; i++) {
+            struct he100_rx_handler *handler = &engine->handlers[i];
+            if (handler->command == HE100_RX_ANY_COMMAND || handler->command == frame[HE_CMD_BYTE]) {
+                handler->callback(frame, length, status, handler->context);
+            }
+        }
+
+        uint64_t latency = HE100_monotonicNs() - engine->last_fill;
+        engine->latency_last = latency;
+        engine->latency_total += latency;
+        if (latency > engine->latency_max) engine->latency_max = latency;
+        engine->latency_samples++;
+        delivered++;
+    }
+    return delivered;
+}
+
+int
+HE100_rxRun (struct he100_rx_engine *engine, int timeout_ms)
+{
+    // frames left over from the last read go out before sleeping again
+    int delivered = HE100_rxDeliver(engine);
+    if (delivered > 0) return delivered;
+
+    uint64_t deadline = 0;
+    if (timeout_ms >= 0) deadline = HE100_monotonicNs() + (uint64_t)timeout_ms * 1000000;
+
+    while (1)
+    {
+        int wait_ms = -1;
+        if (timeout_ms >= 0) {
+            uint64_t now = HE100_monotonicNs();
+            if (now >= deadline) return 0;
+            wait_ms = (int)((deadline - now + 999999) / 1000000);
+        }
+
+        struct epoll_event event;
+        int ready = epoll_wait(engine->epfd, &event, 1, wait_ms);
+        if (ready == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (ready == 0) return 0; // deadline passed with the line idle
+
+        engine->wakeups++;
+        if (event.events & EPOLLIN) {
+            if (HE100_decoderFill(&engine->decoder, engine->fdin) == -1) return -1;
+            engine->last_fill = HE100_monotonicNs();
+            delivered = HE100_rxDeliver(engine);
+            if (delivered > 0) return delivered;
+        } else if (event.events & (EPOLLERR | EPOLLHUP)) {
+            return -1;
+        }
+    }
+}
+
+void
+HE100_rxClose (struct he100_rx_engine *engine)
+{
+    if (engine->epfd != -1) close(engine->epfd);
+    engine->epfd = -1;
+}
@@ -0,0 +1,298 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-scheduler.c
+ *
+ *    Description:  Priority queues and RF rate pacing for transmit.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 09:24:03 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <string.h>     /*  String function definitions */
+#include <errno.h>      /*  Error number definitions */
+#include <time.h>
+
+#include <SC_he100.h>
+#include <SC_he100-scheduler.h>
+#include <SC_he100-frames.h>
+#include "SpaceDecl.h"
+#include "shakespeare.h"
+
+// logging
+#define PROCESS "HE100"
+#define MAX_LOG_BUFFER_LEN CS1_MAX_LOG_ENTRY
+
+// bits per second, indexed by tx_rf_baud_rate
+static const int HE100_SCHEDULER_RF_BAUD[] = {1200, 9600, 19200, 38400};
+
+// AX.25 address, control and PID in front of the data, then the FCS and closing flag
+#define HE100_SCHEDULER_AX25_HEADER     16
+#define HE100_SCHEDULER_AX25_TRAILER    3
+// at most one stuffed bit per five of the header and FCS, which the radio fills in
+#define HE100_SCHEDULER_HEADER_STUFFING (((HE100_SCHEDULER_AX25_HEADER + 2) * 8 + 4) / 5)
+
+// the configuration carries the flags low byte first, HE100_collectConfig reads them high byte first
+static int
+HE100_schedulerFlags (uint16_t configured)
+{
+    int flags = (configured & 0xff) << 8 | configured >> 8;
+    return flags == 0 ? HE100_SCHEDULER_DEFAULT_FLAGS : flags;
+}
+
+// bits HDLC inserts after five ones in a row, sent least significant bit first
+static uint64_t
+HE100_schedulerStuffing (const unsigned char *data, size_t length)
+{
+    uint64_t stuffed = 0;
+    int ones = 4; // the PID, 0xf0, ends in four ones
+    size_t i;
+    int bit;
+    for (i=0; i<length; i++) {
+        for (bit=0; bit<8; bit++) {
+            if ((data[i] >> bit) & 1) {
+                if (++ones == 5) {
+                    stuffed++;
+                    ones = 0;
+                }
+            } else {
+                ones = 0;
+            }
+        }
+    }
+    return stuffed;
+}
+
+int
+HE100_schedulerConfigure (struct he100_scheduler *scheduler, const struct he100_settings *settings)
+{
+    if (settings->tx_rf_baud_rate >= sizeof(HE100_SCHEDULER_RF_BAUD)/sizeof(HE100_SCHEDULER_RF_BAUD[0])) {
+        return HE_INVALID_RF_BAUD_RATE;
+    }
+    scheduler->rf_baud = HE100_SCHEDULER_RF_BAUD[settings->tx_rf_baud_rate];
+    scheduler->preamble_flags = HE100_schedulerFlags(settings->tx_preamble);
+    scheduler->postamble_flags = HE100_schedulerFlags(settings->tx_postamble);
+
+    unsigned char longest[MAX_TESTED_FRAME];
+    memset(longest, 0, sizeof(longest));
+    scheduler->depth_ns = HE100_SCHEDULER_DEPTH_FRAMES * HE100_schedulerAirtime(scheduler, longest, sizeof(longest));
+    return HE_SUCCESS;
+}
+
+int
+HE100_schedulerInit (struct he100_scheduler *scheduler, HE100_Handle *handle)
+{
+    memset(scheduler, 0, sizeof(*scheduler));
+    scheduler->handle = handle;
+
+    struct he100_settings settings;
+    int result = HE100_handleCurrentConfig(handle, &settings);
+    if (result != HE_SUCCESS) return result;
+    return HE100_schedulerConfigure(scheduler, &settings);
+}
+
+uint64_t
+HE100_schedulerAirtime (const struct he100_scheduler *scheduler, const unsigned char *data, size_t length)
+{
+    uint64_t bits =
+            (uint64_t)(scheduler->preamble_flags + HE100_SCHEDULER_AX25_HEADER + length + HE100_SCHEDULER_AX25_TRAILER + scheduler->postamble_flags) * 8
+        +   HE100_SCHEDULER_HEADER_STUFFING
+        +   HE100_schedulerStuffing(data, length);
+    return (bits * 1000000000ull + scheduler->rf_baud - 1) / scheduler->rf_baud;
+}
+
+// the slot to fill at the tail of a queue, or NULL if it is full
+static struct he100_scheduled *
+HE100_schedulerSlot (struct he100_scheduler *scheduler, int queue)
+{
+    if (queue < 0 || queue >= HE100_SCHEDULER_CLASSES) return NULL;
+    struct he100_scheduler_queue *q = &scheduler->queues[queue];
+    if (q->tail - q->head == HE100_SCHEDULER_QUEUE_LENGTH) return NULL;
+    return &q->entries[q->tail & (HE100_SCHEDULER_QUEUE_LENGTH - 1)];
+}
+
+// cost the frame in the tail slot and make it visible to HE100_schedulerRun
+static int
+HE100_schedulerQueue (struct he100_scheduler *scheduler, int queue, struct he100_scheduled *entry, he100_tx_callback callback, void *context)
+{
+    entry->air_ns = 0;
+    if (entry->frame[HE_CMD_BYTE] == CMD_TRANSMIT_DATA) {
+        entry->air_ns = HE100_schedulerAirtime(scheduler, entry->frame + HE_FIRST_PAYLOAD_BYTE, entry->length - WRAPPER_LENGTH);
+    }
+    entry->attempts = 0;
+    entry->callback = callback;
+    entry->context = context;
+    scheduler->queues[queue].tail++;
+    return HE_SUCCESS;
+}
+
+int
+HE100_schedulerSubmit (struct he100_scheduler *scheduler, int queue, const struct iovec *payload, int iovcnt, unsigned char *command, he100_tx_callback callback, void *context)
+{
+    struct he100_scheduled *entry = HE100_schedulerSlot(scheduler, queue);
+    if (entry == NULL) return -1;
+    if (iovcnt < 0 || iovcnt > HE100_MAX_PAYLOAD_IOV) return HE_FAILED_PREPARE_TRANSMISSION;
+
+    int length = HE100_prepareTransmissionv(payload, iovcnt, command, entry->frame, entry->frame + HE_FIRST_PAYLOAD_BYTE + MAX_FRAME_LENGTH);
+    if (length < 0) return HE_FAILED_PREPARE_TRANSMISSION;
+    size_t offset = HE_FIRST_PAYLOAD_BYTE;
+    int i;
+    for (i=0; i<iovcnt; i++) {
+        memcpy(entry->frame + offset, payload[i].iov_base, payload[i].iov_len);
+        offset += payload[i].iov_len;
+    }
+    // the trailer was built past the longest payload, it goes right after this one
+    memmove(entry->frame + offset, entry->frame + HE_FIRST_PAYLOAD_BYTE + MAX_FRAME_LENGTH, 2);
+    entry->length = offset + 2;
+    return HE100_schedulerQueue(scheduler, queue, entry, callback, context);
+}
+
+int
+HE100_schedulerSubmitFrame (struct he100_scheduler *scheduler, int queue, const unsigned char *frame, size_t length, he100_tx_callback callback, void *context)
+{
+    struct he100_scheduled *entry = HE100_schedulerSlot(scheduler, queue);
+    if (entry == NULL) return -1;
+    if (length < WRAPPER_LENGTH || length > HE100_MAX_WIRE_FRAME) return HE_FAILED_PREPARE_TRANSMISSION;
+    memcpy(entry->frame, frame, length);
+    entry->length = length;
+    return HE100_schedulerQueue(scheduler, queue, entry, callback, context);
+}
+
+int
+HE100_schedulerTransmitData (struct he100_scheduler *scheduler, const unsigned char *data, size_t length, he100_tx_callback callback, void *context)
+{
+    unsigned char transmit_data_command[2] = {CMD_TRANSMIT, CMD_TRANSMIT_DATA};
+    struct iovec payload = {(void *)data, length};
+    return HE100_schedulerSubmit(scheduler, HE100_SCHEDULER_DATA, &payload, 1, transmit_data_command, callback, context);
+}
+
+int
+HE100_schedulerFastSetPA (struct he100_scheduler *scheduler, int power_level, he100_tx_callback callback, void *context)
+{
+    if (power_level > MAX_POWER_LEVEL || power_level < MIN_POWER_LEVEL) return 1;
+    return HE100_schedulerSubmitFrame(scheduler, HE100_SCHEDULER_COMMAND, HE100_FRAME_FAST_SET_PA[power_level & 0xff], HE100_BYTE_FRAME_LENGTH, callback, context);
+}
+
+int
+HE100_schedulerPending (const struct he100_scheduler *scheduler)
+{
+    int pending = 0;
+    int q;
+    for (q=0; q<HE100_SCHEDULER_CLASSES; q++) pending += scheduler->queues[q].tail - scheduler->queues[q].head;
+    return pending;
+}
+
+// the queue served next, or -1 if all are empty
+static int
+HE100_schedulerHead (const struct he100_scheduler *scheduler)
+{
+    int q;
+    for (q=0; q<HE100_SCHEDULER_CLASSES; q++) {
+        if (scheduler->queues[q].tail != scheduler->queues[q].head) return q;
+    }
+    return -1;
+}
+
+// the time a frame with air_ns on the air fits in the bucket
+static uint64_t
+HE100_schedulerEligible (const struct he100_scheduler *scheduler, uint64_t air_ns)
+{
+    if (air_ns == 0) return 0;
+    uint64_t backlog_end = scheduler->air_free + air_ns;
+    return backlog_end > scheduler->depth_ns ? backlog_end - scheduler->depth_ns : 0;
+}
+
+uint64_t
+HE100_schedulerDelay (const struct he100_scheduler *scheduler)
+{
+    int q = HE100_schedulerHead(scheduler);
+    if (q < 0) return UINT64_MAX;
+    const struct he100_scheduler_queue *queue = &scheduler->queues[q];
+    uint64_t eligible = HE100_schedulerEligible(scheduler, queue->entries[queue->head & (HE100_SCHEDULER_QUEUE_LENGTH - 1)].air_ns);
+    uint64_t now = HE100_monotonicNs();
+    return eligible > now ? eligible - now : 0;
+}
+
+static void
+HE100_schedulerSleep (uint64_t ns)
+{
+    struct timespec wait;
+    wait.tv_sec = ns / 1000000000;
+    wait.tv_nsec = ns % 1000000000;
+    while (nanosleep(&wait, &wait) == -1 && errno == EINTR);
+}
+
+int
+HE100_schedulerRun (struct he100_scheduler *scheduler, int timeout_ms)
+{
+    HE100_Handle *handle = scheduler->handle;
+    uint64_t deadline = timeout_ms < 0 ? UINT64_MAX : HE100_monotonicNs() + (uint64_t)timeout_ms * 1000000;
+    int completed = 0;
+    int q;
+
+    while ((q = HE100_schedulerHead(scheduler)) >= 0) {
+        struct he100_scheduler_queue *queue = &scheduler->queues[q];
+        struct he100_scheduled *entry = &queue->entries[queue->head & (HE100_SCHEDULER_QUEUE_LENGTH - 1)];
+
+        uint64_t now = HE100_monotonicNs();
+        uint64_t eligible = HE100_schedulerEligible(scheduler, entry->air_ns);
+        if (eligible > now) {
+            if (eligible > deadline) {
+                if (deadline > now) HE100_schedulerSleep(deadline - now);
+                break;
+            }
+            scheduler->stats.paced++;
+            scheduler->stats.paced_ns += eligible - now;
+            HE100_schedulerSleep(eligible - now);
+        }
+
+        int result = HE100_handleDispatchFrame(handle, entry->frame, entry->length);
+        now = HE100_monotonicNs();
+        int nack = result != HE_SUCCESS && handle->status == HE_FAILED_NACK;
+        if (nack) scheduler->stats.nacks++;
+
+        // the radio holds the frame once it has ACKed it; a NACK means it holds more than it should
+        if (entry->air_ns > 0 && (result == HE_SUCCESS || nack)) {
+            scheduler->air_free = (scheduler->air_free > now ? scheduler->air_free : now) + entry->air_ns;
+        }
+        if (nack && entry->air_ns > 0 && ++entry->attempts < HE100_SCHEDULER_RETRIES) {
+            if (now >= deadline) break;
+            continue;
+        }
+
+        int status = HE_SUCCESS;
+        if (result != HE_SUCCESS) {
+            status = nack ? HE_FAILED_NACK : (result == HE_FAILED_OPEN_PORT ? result : HE_FAILED_ACK_TIMEOUT);
+            scheduler->stats.failed++;
+            char log_buffer[MAX_LOG_BUFFER_LEN];
+            snprintf(log_buffer, MAX_LOG_BUFFER_LEN, "Scheduler: gave up on command 0x%02x: %s", entry->frame[HE_CMD_BYTE], HE_STATUS[status]);
+            Shakespeare::log(Shakespeare::WARNING, PROCESS, log_buffer);
+        } else {
+            scheduler->stats.sent[q]++;
+            scheduler->stats.air_bits += entry->air_ns * scheduler->rf_baud / 1000000000;
+        }
+
+        // off the queue first, so the callback can queue more
+        he100_tx_callback callback = entry->callback;
+        void *context = entry->context;
+        queue->head++;
+        completed++;
+        if (callback != NULL) {
+            callback(
+                status,
+                result == HE_SUCCESS || nack ? handle->response : NULL,
+                result == HE_SUCCESS || nack ? handle->response_length : 0,
+                context
+            );
+        }
+        if (now >= deadline) break;
+    }
+    return completed;
+}
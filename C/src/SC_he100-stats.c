@@ -0,0 +1,203 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-stats.c
+ *
+ *    Description:  Lock-free per-command link counters and latency histograms.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 05:22:09 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <string.h>     /*  String function definitions */
+
+#include <SC_he100.h>
+#include <SC_he100-stats.h>
+#include "SpaceDecl.h"
+#include "shakespeare.h"
+
+// logging
+#define PROCESS "HE100"
+#define MAX_LOG_BUFFER_LEN CS1_MAX_LOG_ENTRY
+
+static struct he100_command_stats HE100_stats[HE100_STATS_COMMANDS];
+
+// counters only ever need to be exact, not ordered against each other
+static inline void
+HE100_statsAdd (uint64_t *counter, uint64_t value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline struct he100_command_stats *
+HE100_statsFor (unsigned char command)
+{
+    return &HE100_stats[command < HE100_STATS_COMMANDS ? command : 0];
+}
+
+void
+HE100_statsSent (unsigned char command, size_t bytes)
+{
+    struct he100_command_stats *stats = HE100_statsFor(command);
+    HE100_statsAdd(&stats->frames_sent, 1);
+    HE100_statsAdd(&stats->bytes_out, bytes);
+}
+
+void
+HE100_statsReceived (const unsigned char *frame, size_t length, int checksum_status, int resynced)
+{
+    struct he100_command_stats *stats = HE100_statsFor(frame[HE_CMD_BYTE]);
+    HE100_statsAdd(&stats->frames_received, 1);
+    HE100_statsAdd(&stats->bytes_in, length);
+    if (checksum_status != HE_SUCCESS) HE100_statsAdd(&stats->checksum_failures, 1);
+    if (resynced) HE100_statsAdd(&stats->resyncs, 1);
+    if (length == NOPAY_COMMAND_LENGTH) {
+        if (frame[HE_LENGTH_BYTE_0] == HE_ACK) HE100_statsAdd(&stats->acks, 1);
+        else if (frame[HE_LENGTH_BYTE_0] == HE_NOACK) HE100_statsAdd(&stats->nacks, 1);
+    }
+}
+
+/*
+ * Values under HE100_LATENCY_SUB_BUCKETS have a bucket each. Above, the
+ * highest set bit picks the power of two and the next HE100_LATENCY_SUB_BITS
+ * bits pick the bucket within it.
+ */
+static unsigned int
+HE100_latencyBucket (uint32_t us)
+{
+    if (us < HE100_LATENCY_SUB_BUCKETS) return us;
+    unsigned int top = 31 - __builtin_clz(us);
+    unsigned int shift = top - HE100_LATENCY_SUB_BITS;
+    return (shift + 1) * HE100_LATENCY_SUB_BUCKETS + (us >> shift) - HE100_LATENCY_SUB_BUCKETS;
+}
+
+// the largest value that falls in a bucket
+static uint64_t
+HE100_latencyBucketTop (unsigned int bucket)
+{
+    if (bucket < HE100_LATENCY_SUB_BUCKETS) return bucket;
+    unsigned int shift = bucket / HE100_LATENCY_SUB_BUCKETS - 1;
+    uint64_t bottom = (uint64_t)(HE100_LATENCY_SUB_BUCKETS + bucket % HE100_LATENCY_SUB_BUCKETS) << shift;
+    return bottom + ((uint64_t)1 << shift) - 1;
+}
+
+void
+HE100_statsLatency (unsigned char command, uint64_t ns)
+{
+    struct he100_latency_histogram *latency = &HE100_statsFor(command)->latency;
+    uint64_t us = ns / 1000;
+    uint32_t clamped = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+
+    HE100_statsAdd(&latency->buckets[HE100_latencyBucket(clamped)], 1);
+    HE100_statsAdd(&latency->total_us, us);
+    HE100_statsAdd(&latency->count, 1);
+    uint64_t max = __atomic_load_n(&latency->max_us, __ATOMIC_RELAXED);
+    while (us > max && !__atomic_compare_exchange_n(&latency->max_us, &max, us, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void
+HE100_statsRto (unsigned char command, uint64_t srtt_ns, uint64_t rttvar_ns, uint64_t rto_ns, int timed_out)
+{
+    struct he100_command_stats *stats = HE100_statsFor(command);
+    __atomic_store_n(&stats->rto_srtt_us, srtt_ns / 1000, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->rto_rttvar_us, rttvar_ns / 1000, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->rto_us, rto_ns / 1000, __ATOMIC_RELAXED);
+    if (timed_out) HE100_statsAdd(&stats->rto_timeouts, 1);
+}
+
+// the copy and the reset walk every counter the same way
+static void
+HE100_statsWalk (struct he100_command_stats *copy, int reset)
+{
+    uint64_t *from = (uint64_t *)HE100_stats;
+    uint64_t *to = (uint64_t *)copy;
+    size_t words = sizeof(HE100_stats) / (sizeof(uint64_t)); // counters, not commands
+    size_t i;
+    for (i=0; i<words; i++) {
+        if (reset) __atomic_store_n(&from[i], 0, __ATOMIC_RELAXED);
+        else to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+    }
+}
+
+void
+HE100_statsSnapshot (struct he100_stats_snapshot *snapshot)
+{
+    snapshot->ns = HE100_monotonicNs();
+    HE100_statsWalk(snapshot->commands, 0);
+}
+
+void
+HE100_statsReset (void)
+{
+    HE100_statsWalk(NULL, 1);
+}
+
+uint64_t
+HE100_latencyPercentile (const struct he100_latency_histogram *histogram, double percentile)
+{
+    uint64_t count = 0;
+    unsigned int i;
+    for (i=0; i<HE100_LATENCY_BUCKETS; i++) count += histogram->buckets[i];
+    if (count == 0) return 0;
+
+    // the rank of the sample at the percentile, counting from 1
+    uint64_t rank = (uint64_t)(percentile / 100.0 * count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+
+    uint64_t seen = 0;
+    for (i=0; i<HE100_LATENCY_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) break;
+    }
+    uint64_t top = HE100_latencyBucketTop(i);
+    return top < histogram->max_us ? top : histogram->max_us;
+}
+
+int
+HE100_statsDump (FILE *out, const struct he100_stats_snapshot *snapshot)
+{
+    char line[MAX_LOG_BUFFER_LEN];
+    int lines = 0;
+    int i;
+    for (i=0; i<HE100_STATS_COMMANDS; i++) {
+        const struct he100_command_stats *stats = &snapshot->commands[i];
+        if (stats->frames_sent == 0 && stats->frames_received == 0 && stats->latency.count == 0) continue;
+
+        // the list stops at 0x15, CMD_FAST_SET_PA sits in the entry after it
+        const char *command_name = "N/A";
+        if (i < 32 && CMD_CODE_LIST[i] != NULL) command_name = CMD_CODE_LIST[i];
+        if (i == CMD_FAST_SET_PA) command_name = CMD_CODE_LIST[0x16];
+
+        snprintf(
+            line,
+            MAX_LOG_BUFFER_LEN,
+            "0x%02x %s: sent %llu/%lluB received %llu/%lluB ack %llu nack %llu checksum %llu resync %llu"
+            " latency_us n %llu p50 %llu p90 %llu p99 %llu max %llu"
+            " rto_us srtt %llu rttvar %llu rto %llu timeouts %llu",
+            i, command_name,
+            (unsigned long long)stats->frames_sent, (unsigned long long)stats->bytes_out,
+            (unsigned long long)stats->frames_received, (unsigned long long)stats->bytes_in,
+            (unsigned long long)stats->acks, (unsigned long long)stats->nacks,
+            (unsigned long long)stats->checksum_failures, (unsigned long long)stats->resyncs,
+            (unsigned long long)stats->latency.count,
+            (unsigned long long)HE100_latencyPercentile(&stats->latency, 50),
+            (unsigned long long)HE100_latencyPercentile(&stats->latency, 90),
+            (unsigned long long)HE100_latencyPercentile(&stats->latency, 99),
+            (unsigned long long)stats->latency.max_us,
+            (unsigned long long)stats->rto_srtt_us, (unsigned long long)stats->rto_rttvar_us,
+            (unsigned long long)stats->rto_us, (unsigned long long)stats->rto_timeouts
+        );
+        if (out != NULL) fprintf(out, "%s\n", line);
+        else Shakespeare::log(Shakespeare::NOTICE, PROCESS, line);
+        lines++;
+    }
+    return lines;
+}
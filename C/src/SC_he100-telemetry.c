@@ -0,0 +1,313 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-telemetry.c
+ *
+ *    Description:  Telemetry poller and its memory mapped sample ring.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 06:41:27 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <string.h>     /*  String function definitions */
+#include <errno.h>      /*  Error number definitions */
+#include <fcntl.h>      /*  File control definitions */
+#include <unistd.h>     /*  UNIX standard function definitions */
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <SC_he100.h>
+#include <SC_he100-telemetry.h>
+#include <SC_he100-frames.h>
+#include <SC_he100-stats.h>
+#include "SpaceDecl.h"
+#include "shakespeare.h"
+
+// logging
+#define PROCESS "HE100"
+#define MAX_LOG_BUFFER_LEN CS1_MAX_LOG_ENTRY
+
+#define HE100_TELEMETRY_STOP_SLICE_MS 10 // how often a sleeping poller looks for HE100_telemetryStop
+
+static uint16_t
+HE100_telemetryLe16 (const unsigned char *bytes)
+{
+    return (uint16_t)(bytes[0] | bytes[1] << 8);
+}
+
+static uint32_t
+HE100_telemetryLe32 (const unsigned char *bytes)
+{
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+int
+HE100_decodeTelemetry (const unsigned char *payload, size_t length, TELEMETRY_STRUCTURE_type *telemetry)
+{
+    if (length != HE100_TELEMETRY_LENGTH) return HE_INVALID_TELEMETRY;
+    telemetry->op_counter = HE100_telemetryLe16(payload);
+    telemetry->msp430_temp = HE100_telemetryLe16(payload+2);
+    memcpy(telemetry->time_count, payload+4, sizeof(telemetry->time_count));
+    telemetry->rssi = payload[7];
+    telemetry->bytes_received = HE100_telemetryLe32(payload+8);
+    telemetry->bytes_transmitted = HE100_telemetryLe32(payload+12);
+    return HE_SUCCESS;
+}
+
+int
+HE100_handleTelemetry (HE100_Handle *handle, TELEMETRY_STRUCTURE_type *telemetry)
+{
+    int result = HE100_handleDispatchFrame(handle, HE100_FRAME_TELEMETRY, sizeof(HE100_FRAME_TELEMETRY));
+    if (result != HE_SUCCESS) return result;
+
+    int length = HE100_handleAwait(handle, CMD_TELEMETRY, NULL);
+    if (length < 0) return HE_FAILED_READ;
+    if (handle->response[HE_CMD_BYTE] != CMD_TELEMETRY) return HE_INVALID_TELEMETRY;
+    return HE100_decodeTelemetry(handle->response+HE_FIRST_PAYLOAD_BYTE, length, telemetry);
+}
+
+static size_t
+HE100_telemetryFileLength (uint32_t capacity)
+{
+    return sizeof(struct he100_telemetry_file_header) + (size_t)capacity * sizeof(struct he100_telemetry_sample);
+}
+
+static int
+HE100_telemetryFail (struct he100_telemetry_ring *ring, const char *path, const char *why)
+{
+    char log_buffer[MAX_LOG_BUFFER_LEN];
+    snprintf(log_buffer, MAX_LOG_BUFFER_LEN, "Telemetry ring %s: %s", path, why);
+    Shakespeare::log(Shakespeare::ERROR, PROCESS, log_buffer);
+    if (ring->header != NULL) munmap(ring->header, ring->map_length);
+    if (ring->fd >= 0) close(ring->fd);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    return HE_FAILED_TELEMETRY_STORE;
+}
+
+// maps the file and checks an existing header, or writes one if the file was empty
+static int
+HE100_telemetryMap (struct he100_telemetry_ring *ring, const char *path, int writable, uint32_t capacity)
+{
+    struct stat st;
+    if (fstat(ring->fd, &st) != 0) return HE100_telemetryFail(ring, path, strerror(errno));
+
+    int fresh = st.st_size == 0;
+    if (!fresh && writable) {
+        // a ring whose creation was cut short, before the header was done, starts again
+        struct he100_telemetry_file_header header;
+        if (pread(ring->fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) && header.magic[0] == 0) {
+            if (ftruncate(ring->fd, 0) != 0) return HE100_telemetryFail(ring, path, strerror(errno));
+            fresh = 1;
+        }
+    }
+    if (fresh) {
+        if (!writable) return HE100_telemetryFail(ring, path, "empty");
+        if (ftruncate(ring->fd, HE100_telemetryFileLength(capacity)) != 0) return HE100_telemetryFail(ring, path, strerror(errno));
+    } else {
+        // only the header first, the capacity in it gives the length
+        struct he100_telemetry_file_header header;
+        if (pread(ring->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) return HE100_telemetryFail(ring, path, "short header");
+        if (
+                memcmp(header.magic, HE100_TELEMETRY_MAGIC, sizeof(header.magic)) != 0
+            ||  header.version != HE100_TELEMETRY_VERSION
+            ||  header.sample_size != sizeof(struct he100_telemetry_sample)
+            ||  header.capacity == 0
+            ||  (header.capacity & (header.capacity - 1)) != 0
+            ||  (uint64_t)st.st_size < HE100_telemetryFileLength(header.capacity)
+           )
+        {
+            return HE100_telemetryFail(ring, path, "not a telemetry ring of this version");
+        }
+        capacity = header.capacity;
+    }
+
+    ring->map_length = HE100_telemetryFileLength(capacity);
+    void *map = mmap(NULL, ring->map_length, writable ? PROT_READ|PROT_WRITE : PROT_READ, MAP_SHARED, ring->fd, 0);
+    if (map == MAP_FAILED) return HE100_telemetryFail(ring, path, strerror(errno));
+    ring->header = (struct he100_telemetry_file_header *)map;
+    ring->samples = (struct he100_telemetry_sample *)(ring->header + 1);
+    ring->writable = writable;
+
+    if (fresh) {
+        // the file was zero filled by ftruncate, every slot reads as never written
+        ring->header->version = HE100_TELEMETRY_VERSION;
+        ring->header->sample_size = sizeof(struct he100_telemetry_sample);
+        ring->header->capacity = capacity;
+        // the magic last, a reader never sees a valid magic before the layout
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        memcpy(ring->header->magic, HE100_TELEMETRY_MAGIC, sizeof(ring->header->magic));
+    }
+    return HE_SUCCESS;
+}
+
+int
+HE100_telemetryOpen (struct he100_telemetry_ring *ring, const char *path, uint32_t capacity)
+{
+    memset(ring, 0, sizeof(*ring));
+    if (capacity == 0) capacity = HE100_TELEMETRY_CAPACITY;
+    if (capacity > (1u << 31)) capacity = 1u << 31;
+    uint32_t rounded = 1;
+    while (rounded < capacity) rounded <<= 1;
+
+    ring->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (ring->fd < 0) return HE100_telemetryFail(ring, path, strerror(errno));
+    return HE100_telemetryMap(ring, path, 1, rounded);
+}
+
+int
+HE100_telemetryOpenReadOnly (struct he100_telemetry_ring *ring, const char *path)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = open(path, O_RDONLY);
+    if (ring->fd < 0) return HE100_telemetryFail(ring, path, strerror(errno));
+    return HE100_telemetryMap(ring, path, 0, 0);
+}
+
+void
+HE100_telemetryClose (struct he100_telemetry_ring *ring)
+{
+    if (ring->header == NULL) return;
+    // MAP_SHARED pages reach the file anyway, this only makes closing a point of durability
+    if (ring->writable) msync(ring->header, ring->map_length, MS_SYNC);
+    munmap(ring->header, ring->map_length);
+    close(ring->fd);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+/*
+ * A per slot seqlock: the sequence is zeroed before the fields change and set
+ * after, so a reader that sees the same sequence before and after using a
+ * slot knows it saw one sample whole.
+ */
+void
+HE100_telemetryAppend (struct he100_telemetry_ring *ring, const TELEMETRY_STRUCTURE_type *telemetry, uint32_t latency_us)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    uint64_t index = ring->header->count;
+    struct he100_telemetry_sample *sample = &ring->samples[index & (ring->header->capacity - 1)];
+
+    __atomic_store_n(&sample->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    sample->ns = (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+    sample->latency_us = latency_us;
+    sample->telemetry = *telemetry;
+    __atomic_store_n(&sample->sequence, (uint32_t)(index + 1), __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->header->count, index + 1, __ATOMIC_RELEASE);
+}
+
+uint64_t
+HE100_telemetryCount (const struct he100_telemetry_ring *ring)
+{
+    return __atomic_load_n(&ring->header->count, __ATOMIC_ACQUIRE);
+}
+
+size_t
+HE100_telemetryLatest (const struct he100_telemetry_ring *ring, size_t n, uint64_t *first)
+{
+    uint64_t count = HE100_telemetryCount(ring);
+    uint64_t available = count < ring->header->capacity ? count : ring->header->capacity;
+    if (n > available) n = available;
+    *first = count - n;
+    return n;
+}
+
+const struct he100_telemetry_sample *
+HE100_telemetrySample (const struct he100_telemetry_ring *ring, uint64_t index)
+{
+    const struct he100_telemetry_sample *sample = &ring->samples[index & (ring->header->capacity - 1)];
+    if (__atomic_load_n(&sample->sequence, __ATOMIC_ACQUIRE) != (uint32_t)(index + 1)) return NULL;
+    return sample;
+}
+
+int
+HE100_telemetryIntact (const struct he100_telemetry_sample *sample, uint64_t index)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&sample->sequence, __ATOMIC_RELAXED) == (uint32_t)(index + 1);
+}
+
+int
+HE100_telemetryPoll (struct he100_telemetry_poller *poller)
+{
+    TELEMETRY_STRUCTURE_type telemetry;
+    uint64_t start = HE100_monotonicNs();
+    int result = HE100_handleTelemetry(poller->handle, &telemetry);
+
+    poller->polls++;
+    poller->status = result;
+    if (result != HE_SUCCESS) {
+        poller->failures++;
+        return result;
+    }
+    uint64_t us = (HE100_monotonicNs() - start) / 1000;
+    HE100_telemetryAppend(poller->ring, &telemetry, us > UINT32_MAX ? UINT32_MAX : (uint32_t)us);
+    return HE_SUCCESS;
+}
+
+static void *
+HE100_telemetryThread (void *arg)
+{
+    struct he100_telemetry_poller *poller = (struct he100_telemetry_poller *)arg;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (!__atomic_load_n(&poller->stop, __ATOMIC_ACQUIRE)) {
+        HE100_telemetryPoll(poller);
+
+        // deadlines are absolute, so the rate does not drift by the time a poll takes
+        next.tv_nsec += (long)poller->period_ms * 1000000;
+        next.tv_sec += next.tv_nsec / 1000000000;
+        next.tv_nsec %= 1000000000;
+        for (;;) {
+            if (__atomic_load_n(&poller->stop, __ATOMIC_ACQUIRE)) break;
+            struct timespec now, slice;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            int64_t left_ns = (int64_t)(next.tv_sec - now.tv_sec) * 1000000000 + (next.tv_nsec - now.tv_nsec);
+            if (left_ns <= 0) break;
+            if (left_ns > HE100_TELEMETRY_STOP_SLICE_MS * 1000000ll) left_ns = HE100_TELEMETRY_STOP_SLICE_MS * 1000000ll;
+            slice.tv_sec = 0;
+            slice.tv_nsec = left_ns;
+            nanosleep(&slice, NULL);
+        }
+    }
+    return NULL;
+}
+
+int
+HE100_telemetryStart (struct he100_telemetry_poller *poller, HE100_Handle *handle, struct he100_telemetry_ring *ring, int period_ms)
+{
+    if (poller->running) return -1;
+    if (ring->header == NULL || !ring->writable) return -1;
+
+    poller->handle = handle;
+    poller->ring = ring;
+    poller->period_ms = period_ms > 0 ? period_ms : 1;
+    __atomic_store_n(&poller->stop, 0, __ATOMIC_RELEASE);
+    if (pthread_create(&poller->thread, NULL, HE100_telemetryThread, poller) != 0) {
+        Shakespeare::log(Shakespeare::ERROR, PROCESS, "Telemetry poller thread failed to start");
+        return -1;
+    }
+    poller->running = 1;
+    return HE_SUCCESS;
+}
+
+void
+HE100_telemetryStop (struct he100_telemetry_poller *poller)
+{
+    if (!poller->running) return;
+    __atomic_store_n(&poller->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(poller->thread, NULL);
+    poller->running = 0;
+}
@@ -0,0 +1,321 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  SC_he100-trace.c
+ *
+ *    Description:  Per-thread lock-free binary trace rings, drained and formatted
+ *                  off the frame path.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 02:14:40 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdlib.h>     /*  C Standard General Utilities Library */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <string.h>     /*  String function definitions */
+#include <unistd.h>     /*  UNIX standard function definitions */
+#include <poll.h>       /*  poll() as a millisecond sleep */
+#include <pthread.h>
+
+#include <SC_he100.h>
+#include <SC_he100-trace.h>
+#include "SpaceDecl.h"
+#include "shakespeare.h"
+
+// logging
+#define PROCESS "HE100"
+#define MAX_LOG_BUFFER_LEN CS1_MAX_LOG_ENTRY
+
+/*
+ * Each ring has a single writer, the thread that owns it, and a single
+ * reader, whoever holds the drain lock. head is only stored by the writer and
+ * tail only by the reader, so neither side needs a lock. The two indexes sit
+ * on their own cache lines so the writer and the drain do not share one.
+ */
+struct he100_trace_ring {
+    struct he100_trace_event events[HE100_TRACE_RING_EVENTS];
+    uint32_t head __attribute__((aligned(64)));
+    uint64_t dropped;
+    uint32_t tail __attribute__((aligned(64)));
+    uint16_t thread;
+    int in_use;                     // owned by a live thread
+    struct he100_trace_ring *next;  // rings are never freed, only reused
+};
+
+struct he100_trace_type {
+    const char *format;
+    Shakespeare::Priority priority;
+};
+
+// the text each event had when it was logged straight from the frame path
+static const struct he100_trace_type HE100_TRACE_TYPES[HE100_TRACE_EVENTS] = {
+    { "Unknown trace event %u",                         Shakespeare::WARNING },
+    { "ACK>%s:HE100_validateDecodedFrame",              Shakespeare::NOTICE },
+    { "NACK>%s:HE100_validateDecodedFrame",             Shakespeare::ERROR },
+    { "Empty Response>%s:HE100_validateDecodedFrame",   Shakespeare::ERROR },
+    { "Unknown byte sequence>%s:HE100_validateDecodedFrame", Shakespeare::ERROR },
+    { "Prepare %s>0x%02x 0x%02x>%u bytes",              Shakespeare::NOTICE },
+    { "Prepared payload+%u:%s",                         Shakespeare::NOTICE }
+};
+
+static int HE100_trace_recording = 0;  // else each event is logged as it happens
+static struct he100_trace_ring *HE100_trace_rings = NULL;
+static uint16_t HE100_trace_threads = 0;
+static pthread_mutex_t HE100_trace_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread struct he100_trace_ring *HE100_trace_self = NULL;
+static pthread_key_t HE100_trace_key;
+static pthread_once_t HE100_trace_key_once = PTHREAD_ONCE_INIT;
+
+// also where events go while nothing records them
+static void
+HE100_traceLogSink (const struct he100_trace_event *event, void *context)
+{
+    (void)context;
+    char output[MAX_LOG_BUFFER_LEN];
+    HE100_traceFormat(event, output, MAX_LOG_BUFFER_LEN);
+    Shakespeare::Priority priority = event->id < HE100_TRACE_EVENTS ? HE100_TRACE_TYPES[event->id].priority : HE100_TRACE_TYPES[0].priority;
+    Shakespeare::log(priority, PROCESS, output);
+}
+
+// thread exit: hand the ring back, whatever is left in it still gets drained
+static void
+HE100_traceRelease (void *ring)
+{
+    __atomic_store_n(&((struct he100_trace_ring *)ring)->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void
+HE100_traceKeyCreate (void)
+{
+    pthread_key_create(&HE100_trace_key, HE100_traceRelease);
+}
+
+// first event on a thread: reuse the ring of a thread that exited, or add one
+static struct he100_trace_ring *
+HE100_traceAcquire (void)
+{
+    struct he100_trace_ring *ring;
+    pthread_once(&HE100_trace_key_once, HE100_traceKeyCreate);
+
+    for (ring = __atomic_load_n(&HE100_trace_rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        int free_ring = 0;
+        if (__atomic_compare_exchange_n(&ring->in_use, &free_ring, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) break;
+    }
+
+    if (ring == NULL) {
+        ring = (struct he100_trace_ring *)calloc(1, sizeof(struct he100_trace_ring));
+        if (ring == NULL) return NULL;
+        ring->in_use = 1;
+        ring->thread = __atomic_fetch_add(&HE100_trace_threads, 1, __ATOMIC_RELAXED);
+        ring->next = __atomic_load_n(&HE100_trace_rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&HE100_trace_rings, &ring->next, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            // ring->next was reloaded with the new list head
+        }
+    }
+
+    pthread_setspecific(HE100_trace_key, ring);
+    HE100_trace_self = ring;
+    return ring;
+}
+
+void
+HE100_traceEnable (int enable)
+{
+    __atomic_store_n(&HE100_trace_recording, enable ? 1 : 0, __ATOMIC_RELEASE);
+}
+
+void
+HE100_trace (uint16_t id, uint32_t arg0, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4)
+{
+    if (!__atomic_load_n(&HE100_trace_recording, __ATOMIC_ACQUIRE)) {
+        // nothing would drain it, so it is logged now, as it always was
+        struct he100_trace_event event = {HE100_monotonicNs(), id, 0, {arg0, arg1, arg2, arg3, arg4}};
+        HE100_traceLogSink(&event, NULL);
+        return;
+    }
+
+    struct he100_trace_ring *ring = HE100_trace_self;
+    if (ring == NULL && (ring = HE100_traceAcquire()) == NULL) return;
+
+    uint32_t head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= HE100_TRACE_RING_EVENTS) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    struct he100_trace_event *event = &ring->events[head & (HE100_TRACE_RING_EVENTS-1)];
+    event->ns = HE100_monotonicNs();
+    event->id = id;
+    event->thread = ring->thread;
+    event->arg[0] = arg0;
+    event->arg[1] = arg1;
+    event->arg[2] = arg2;
+    event->arg[3] = arg3;
+    event->arg[4] = arg4;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void
+HE100_traceFrame (const unsigned char *frame, size_t length)
+{
+    if (length > MAX_FRAME_LENGTH) length = MAX_FRAME_LENGTH;
+
+    size_t offset;
+    for (offset=0; offset<length; offset+=HE100_TRACE_FRAME_CHUNK) {
+        uint32_t words[4] = {0,0,0,0};
+        size_t count = length - offset < HE100_TRACE_FRAME_CHUNK ? length - offset : HE100_TRACE_FRAME_CHUNK;
+        size_t i;
+        for (i=0; i<count; i++) words[i/4] |= (uint32_t)frame[offset+i] << (8*(i%4));
+        HE100_trace(HE100_TRACE_FRAME_BYTES, (uint32_t)(offset | count << 16), words[0], words[1], words[2], words[3]);
+    }
+}
+
+int
+HE100_traceDrain (he100_trace_sink sink, void *context)
+{
+    int drained = 0;
+    struct he100_trace_ring *ring;
+
+    pthread_mutex_lock(&HE100_trace_drain_lock);
+    for (ring = __atomic_load_n(&HE100_trace_rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        uint32_t tail = ring->tail;
+        uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        while (tail != head) {
+            sink(&ring->events[tail & (HE100_TRACE_RING_EVENTS-1)], context);
+            tail++;
+            drained++;
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&HE100_trace_drain_lock);
+    return drained;
+}
+
+int
+HE100_traceFormat (const struct he100_trace_event *event, char *output, size_t size)
+{
+    // the list stops at 0x15, CMD_FAST_SET_PA sits in the entry after it
+    const char *command_name = "N/A";
+    if (event->arg[0] < 32 && CMD_CODE_LIST[event->arg[0]] != NULL) command_name = CMD_CODE_LIST[event->arg[0]];
+    if (event->arg[0] == CMD_FAST_SET_PA) command_name = CMD_CODE_LIST[0x16];
+    switch (event->id) {
+        case HE100_TRACE_ACK :
+        case HE100_TRACE_NACK :
+        case HE100_TRACE_EMPTY_RESPONSE :
+        case HE100_TRACE_UNKNOWN_RESPONSE :
+            return snprintf(output, size, HE100_TRACE_TYPES[event->id].format, command_name);
+        case HE100_TRACE_TX_PREPARED :
+            return snprintf(
+                output, size, HE100_TRACE_TYPES[event->id].format,
+                event->arg[2] == 0 ? "successful" : "failed",
+                (event->arg[0] >> 8) & 0xff, event->arg[0] & 0xff, event->arg[1]
+            );
+        case HE100_TRACE_FRAME_BYTES : {
+            char hex[3*HE100_TRACE_FRAME_CHUNK+1] = {0};
+            uint32_t count = event->arg[0] >> 16;
+            uint32_t i;
+            if (count > HE100_TRACE_FRAME_CHUNK) count = HE100_TRACE_FRAME_CHUNK;
+            for (i=0; i<count; i++) {
+                snprintf(hex+3*i, 4, " %02X", (event->arg[1+i/4] >> (8*(i%4))) & 0xff);
+            }
+            return snprintf(output, size, HE100_TRACE_TYPES[event->id].format, event->arg[0] & 0xffff, hex);
+        }
+        default :
+            return snprintf(output, size, HE100_TRACE_TYPES[0].format, event->id);
+    }
+}
+
+uint64_t
+HE100_traceDropped (void)
+{
+    uint64_t dropped = 0;
+    struct he100_trace_ring *ring;
+    for (ring = __atomic_load_n(&HE100_trace_rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    }
+    return dropped;
+}
+
+/* drain thread */
+
+static pthread_t HE100_trace_thread;
+static int HE100_trace_running = 0;
+static int HE100_trace_stop = 0;
+static int HE100_trace_fd = -1;
+static int HE100_trace_period_ms = 0;
+
+static void
+HE100_traceFileSink (const struct he100_trace_event *event, void *context)
+{
+    int fd = *(int *)context;
+    // a short write would misalign every record after it, so drop the rest
+    if (fd < 0) return;
+    if (write(fd, event, sizeof(*event)) != (ssize_t)sizeof(*event)) *(int *)context = -1;
+}
+
+static void
+HE100_traceDrainOnce (void)
+{
+    if (HE100_trace_fd >= 0) {
+        HE100_traceDrain(HE100_traceFileSink, &HE100_trace_fd);
+    } else {
+        HE100_traceDrain(HE100_traceLogSink, NULL);
+    }
+}
+
+static void *
+HE100_traceThread (void *arg)
+{
+    (void)arg;
+    while (!__atomic_load_n(&HE100_trace_stop, __ATOMIC_ACQUIRE)) {
+        HE100_traceDrainOnce();
+        poll(NULL, 0, HE100_trace_period_ms);
+    }
+    HE100_traceDrainOnce();
+    return NULL;
+}
+
+int
+HE100_traceStart (int fd, int period_ms)
+{
+    if (HE100_trace_running) return -1;
+
+    if (fd >= 0) {
+        struct he100_trace_file_header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, HE100_TRACE_MAGIC, sizeof(header.magic));
+        header.version = HE100_TRACE_VERSION;
+        header.event_size = sizeof(struct he100_trace_event);
+        if (write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) return -1;
+    }
+
+    HE100_trace_fd = fd;
+    HE100_trace_period_ms = period_ms > 0 ? period_ms : 1;
+    __atomic_store_n(&HE100_trace_stop, 0, __ATOMIC_RELEASE);
+    if (pthread_create(&HE100_trace_thread, NULL, HE100_traceThread, NULL) != 0) {
+        Shakespeare::log(Shakespeare::ERROR, PROCESS, "Trace drain thread failed to start");
+        return -1;
+    }
+    HE100_trace_running = 1;
+    HE100_traceEnable(1);
+    return HE_SUCCESS;
+}
+
+void
+HE100_traceStop (void)
+{
+    if (!HE100_trace_running) return;
+    // events from here on are logged again, the last drain takes what was recorded
+    HE100_traceEnable(0);
+    __atomic_store_n(&HE100_trace_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(HE100_trace_thread, NULL);
+    HE100_trace_running = 0;
+    HE100_trace_fd = -1;
+}
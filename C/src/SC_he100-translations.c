@@ -17,7 +17,7 @@
  * =====================================================================================
  */
 
-const char *HE_STATUS[34] = {
+const char *HE_STATUS[43] = {
     "HE_SUCCESS",
     "HE_FAILED_OPEN_PORT",
     "HE_FAILED_CLOSE_PORT",
@@ -51,7 +51,16 @@ const char *HE_STATUS[34] = {
     "HE_INVALID_LED",
     "HE_INVALID_CONFIG",
     "HE_FAILED_GET_CONFIG",
-    "HE_FAILED_READ"
+    "HE_FAILED_READ",
+    "HE_FAILED_PREPARE_TRANSMISSION",
+    "HE_FAILED_ACK_TIMEOUT",
+    "HE_INVALID_FRAGMENT",
+    "HE_FAILED_REASSEMBLY_TIMEOUT",
+    "HE_INVALID_TELEMETRY",
+    "HE_FAILED_TELEMETRY_STORE",
+    "HE_INVALID_FIRMWARE",
+    "HE_FAILED_CAPTURE",
+    "HE_INVALID_AX25"
 };
 
 const char *CMD_CODE_LIST[32] = {
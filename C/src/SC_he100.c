@@ -24,6 +24,7 @@
 #include <unistd.h>     /*  UNIX standard function definitions */
 #include <errno.h>      /*  Error number definitions */
 #include <poll.h>       /*  Definitions for the poll() function */
+#include <sys/uio.h>    /*  Definitions for writev() */
 
 // serial library from utls 
 #include "SC_serial.h"
@@ -33,8 +34,14 @@
 
 // project includes
 #include <SC_he100.h>   /*  Helium 100 header file */
+#include <SC_he100-handle.h>
+#include <SC_he100-trace.h>
+#include <SC_he100-stats.h>
+#include <SC_he100-frames.h>
+#include <SC_he100-telemetry.h>
+#include <SC_he100-capture.h>
+#include <SC_he100-baud.h>
 //#include <he100.h>      /*  exposes the correct serial device location */
-#include "fletcher.h"
 #include <timer.h>
 #include "SpaceDecl.h"
 #include "shakespeare.h"
@@ -50,18 +57,113 @@ char endian(void)
 }
 
 /**
- * Function to write a given byte sequence to the serial device
+ * Function returning the time of the monotonic clock in nanoseconds, used
+ * for deadlines and latency measurements
+ */
+uint64_t
+HE100_monotonicNs (void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Function to write a complete frame to the serial device without waiting
+ * for a response. Retries until every byte is written, since a tty can
+ * accept a frame in pieces.
  * @param fdin - the file descriptor representing the serial device
  * @param bytes - the char array containing the byte sequence to write
  * @param size - the length of the array in bytes
+ * @return - the number of bytes written, or -1 on error
  */
 int
-HE100_write (int fdin, unsigned char *bytes, size_t size)
+HE100_writeFrame (int fdin, const unsigned char *bytes, size_t size)
+{
+    struct iovec frame = {(void *)bytes, size};
+    HE100_captureBytes(HE100_CAPTURE_TX, fdin, &frame, 1, size);
+
+    size_t written = 0;
+    while (written < size) {
+        ssize_t w = write (fdin, bytes+written, size-written);
+        if (w == -1) {
+            if (errno == EAGAIN) { // non-blocking device is full, wait for room
+                struct pollfd fds;
+                fds.fd = fdin;
+                fds.events = POLLOUT;
+                poll(&fds, 1, -1);
+                continue;
+            }
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        written += w;
+    }
+    if (size > HE_CMD_BYTE) HE100_statsSent(bytes[HE_CMD_BYTE], written);
+    return (int)written;
+}
+
+/**
+ * Function to write a frame held in pieces with writev: the 8 header bytes,
+ * the caller's payload buffers as they are, then the 2 trailer bytes.
+ * @param iovcnt - number of payload buffers, at most HE100_MAX_PAYLOAD_IOV
+ * @return - the number of bytes written, or -1 on error
+ */
+int
+HE100_writeFramev (int fdin, const unsigned char *header, const struct iovec *payload, int iovcnt, const unsigned char *trailer)
+{
+    if (iovcnt < 0 || iovcnt > HE100_MAX_PAYLOAD_IOV) return -1;
+
+    struct iovec frame[HE100_MAX_PAYLOAD_IOV+2];
+    int count = 0;
+    size_t size = HE_FIRST_PAYLOAD_BYTE + 2;
+    frame[count].iov_base = (void *)header;
+    frame[count++].iov_len = HE_FIRST_PAYLOAD_BYTE;
+    int i;
+    for (i=0; i<iovcnt; i++) {
+        if (payload[i].iov_len == 0) continue;
+        frame[count++] = payload[i];
+        size += payload[i].iov_len;
+    }
+    frame[count].iov_base = (void *)trailer;
+    frame[count++].iov_len = 2;
+    HE100_captureBytes(HE100_CAPTURE_TX, fdin, frame, count, size);
+
+    // writev may stop part way on a tty, pick up from where it left off
+    struct iovec *next = frame;
+    size_t written = 0;
+    while (written < size) {
+        ssize_t w = writev (fdin, next, count);
+        if (w == -1) {
+            if (errno == EAGAIN) { // non-blocking device is full, wait for room
+                struct pollfd fds;
+                fds.fd = fdin;
+                fds.events = POLLOUT;
+                poll(&fds, 1, -1);
+                continue;
+            }
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        written += w;
+        while (count > 0 && (size_t)w >= next->iov_len) {
+            w -= next->iov_len;
+            next++; count--;
+        }
+        if (count > 0) {
+            next->iov_base = (char *)next->iov_base + w;
+            next->iov_len -= w;
+        }
+    }
+    HE100_statsSent(header[HE_CMD_BYTE], written);
+    return (int)written;
+}
+
+// wait for the ACK of a command written at sent, on the handle kept for fdin
+static int
+HE100_confirmWrite (int fdin, unsigned char command, int w, uint64_t sent)
 {
     int write_return = 1; // return value 
-    int w; // to count bytes written
-    if (fdin!=0) w = write (fdin, bytes, size); // Write byte array
-    else return HE_FAILED_OPEN_PORT;
 
     fflush( NULL ); fsync(fdin); // TODO fdin, is a tty device, ineffective?
 
@@ -69,9 +171,13 @@ HE100_write (int fdin, unsigned char *bytes, size_t size)
 
     int valid_bytes_returned = 0;
 
-    if (bytes[HE_CMD_BYTE] != CMD_GET_CONFIG) // some commands manually manage reading responses
-    { // Issue a read to check for ACK/NOACK
-        valid_bytes_returned = HE100_read(fdin, 2, response_buffer);
+    if (command != CMD_GET_CONFIG) // some commands manually manage reading responses
+    { // Issue a read to check for ACK/NOACK, for as long as this command usually takes
+        HE100_Handle *handle = HE100_legacyHandle(fdin);
+        if (handle == NULL) return write_return;
+        handle->sent = sent;
+        valid_bytes_returned = HE100_handleAwait(handle, command, response_buffer);
+        HE100_legacyPut(handle);
     }  else {
         valid_bytes_returned = 1;
     }
@@ -83,6 +189,23 @@ HE100_write (int fdin, unsigned char *bytes, size_t size)
     return write_return;
 }
 
+/**
+ * Function to write a given byte sequence to the serial device
+ * @param fdin - the file descriptor representing the serial device
+ * @param bytes - the char array containing the byte sequence to write
+ * @param size - the length of the array in bytes
+ */
+int
+HE100_write (int fdin, unsigned char *bytes, size_t size)
+{
+    int w; // to count bytes written
+    uint64_t sent = HE100_monotonicNs();
+    if (fdin!=0) w = HE100_writeFrame (fdin, bytes, size); // Write byte array
+    else return HE_FAILED_OPEN_PORT;
+
+    return HE100_confirmWrite(fdin, bytes[HE_CMD_BYTE], w, sent);
+}
+
 /**
  * Function to validate a given frame
  * @param response - the frame data to be validated
@@ -92,43 +215,34 @@ HE100_write (int fdin, unsigned char *bytes, size_t size)
 int
 HE100_validateFrame (unsigned char *response, size_t length)
 {
-    int r=1; // return value
-
     // Check first if command byte is a valid command
     if ( HE100_referenceByteSequence(&response[HE_CMD_BYTE],HE_CMD_BYTE) == HE_INVALID_COMMAND ) 
     {
         return HE_INVALID_COMMAND;
     } 
-    else
-    { 
-        r = 0; // so far so good
-    }
 
     // calculate positions for payload and checksums
     size_t data_length = length - 2; // response minus 2 sync bytes
     int pb1 = length-2; int pb2 = length-1;
 
     // calculate payload length
-    size_t payload_length;
+    size_t payload_length = 0;
     if ( length >= 10 ) 
     { 
         // a message of this minimum length will have a payload
         payload_length = length - WRAPPER_LENGTH; 
-        // response minus header minus 4 checksum bytes and 2 sync bytes and 2 length bytes
 
-        // validate length
+        // validate length before trusting where the checksums are
         if ( response[HE_LENGTH_BYTE] != payload_length ) 
         { 
             return CS1_WRONG_LENGTH;
         }
     } 
-    else 
-    { // empty payload control sequences
-        payload_length = 0;
-    }
+
+    int checksum_status = HE_SUCCESS;
 
     // generate and compare header checksum
-    fletcher_checksum h_chksum = fletcher_checksum16(response+2,4);
+    struct HE100_checksum h_chksum = HE100_fletcher16(response+2,4);
     uint8_t h_s1_chk = memcmp(&response[HE_HEADER_CHECKSUM_BYTE_1], &h_chksum.sum1, 1);
     uint8_t h_s2_chk = memcmp(&response[HE_HEADER_CHECKSUM_BYTE_2], &h_chksum.sum2, 1);
     int h_chk = h_s1_chk + h_s2_chk; // should be zero given valid chk
@@ -136,66 +250,15 @@ HE100_validateFrame (unsigned char *response, size_t length)
     int p_chk=0;
     uint8_t p_s1_chk;
     uint8_t p_s2_chk;
-    fletcher_checksum p_chksum;
+    struct HE100_checksum p_chksum;
     if (payload_length > 0) {
         // generate and compare payload checksum
-        p_chksum = fletcher_checksum16(response+2,data_length-2); // chksum everything except 'He' and payload checksum bytes
+        p_chksum = HE100_fletcher16(response+2,data_length-2); // chksum everything except 'He' and payload checksum bytes
         p_s1_chk = memcmp(&response[pb1], &p_chksum.sum1, 1);
         p_s2_chk = memcmp(&response[pb2], &p_chksum.sum2, 1);
         p_chk = p_s1_chk + p_s2_chk; // should be zero given valid chk
     }
 
-    if (
-            response[HE_LENGTH_BYTE_0] == response[HE_LENGTH_BYTE] 
-        ||  response[HE_LENGTH_BYTE_0] == HE_NOACK
-       ) /* ACK or NOACK or EMPTY length */
-    {
-        char output[MAX_LOG_BUFFER_LEN];
-        Shakespeare::Priority logPriority;
-        if (response[4] == HE_ACK) {
-            snprintf (
-                output, 
-                MAX_LOG_BUFFER_LEN, 
-                "ACK>%s:%s>%d", 
-                CMD_CODE_LIST[(int)response[HE_CMD_BYTE]], 
-                __func__, __LINE__
-            );
-            logPriority = Shakespeare::NOTICE;
-            r = 0;
-        } else if (response[4] == HE_NOACK) {
-            snprintf (
-                output, 
-                MAX_LOG_BUFFER_LEN, 
-                "NACK>%s:%s>%d", 
-                CMD_CODE_LIST[(int)response[HE_CMD_BYTE]], 
-                __func__, __LINE__
-            );
-            logPriority = Shakespeare::ERROR;
-            r = HE_FAILED_NACK;
-        } else if (response[4] == 0) {
-            snprintf (
-                output, 
-                MAX_LOG_BUFFER_LEN, 
-                "Empty Response>%s:%s>%d", 
-                CMD_CODE_LIST[(int)response[HE_CMD_BYTE]], 
-                __func__, __LINE__
-            );
-            logPriority = Shakespeare::ERROR;
-            r = HE_EMPTY_RESPONSE;
-        } else {
-            snprintf (
-                output, 
-                MAX_LOG_BUFFER_LEN, 
-                "Unknown byte sequence>%s:%s>%d", 
-                CMD_CODE_LIST[(int)response[HE_CMD_BYTE]], 
-                __func__, __LINE__
-            );
-            logPriority = Shakespeare::ERROR;
-            r = HE_INVALID_BYTE_SEQUENCE;
-        }
-        Shakespeare::log(logPriority, PROCESS, output);
-    }
-    
     if (h_chk != 0) {
        char error[MAX_LOG_BUFFER_LEN];
        snprintf (
@@ -207,7 +270,7 @@ HE100_validateFrame (unsigned char *response, size_t length)
             __func__, __LINE__
         );
         Shakespeare::log(Shakespeare::ERROR, PROCESS, error);
-        r=HE_FAILED_CHECKSUM;
+        checksum_status=HE_FAILED_CHECKSUM;
     }
 
     if (p_chk != 0) {
@@ -220,6 +283,76 @@ HE100_validateFrame (unsigned char *response, size_t length)
             __func__, __LINE__
         );
         Shakespeare::log(Shakespeare::ERROR, PROCESS, error);
+        checksum_status=HE_FAILED_CHECKSUM;
+    }
+
+    return HE100_validateDecodedFrame(response, length, checksum_status);
+}
+
+/**
+ * Function to validate a frame whose checksums were already compared, as
+ * the decoder does while it parses
+ * @param response - the frame data to be validated
+ * @param length - the entire length of the frame in bytes
+ * @param checksum_status - HE_SUCCESS, or HE_FAILED_CHECKSUM
+ * @return int - 0 if valid, else error code
+ */
+int
+HE100_validateDecodedFrame (unsigned char *response, size_t length, int checksum_status)
+{
+    int r=1; // return value
+
+    // Check first if command byte is a valid command
+    if ( HE100_referenceByteSequence(&response[HE_CMD_BYTE],HE_CMD_BYTE) == HE_INVALID_COMMAND ) 
+    {
+        return HE_INVALID_COMMAND;
+    } 
+    else
+    { 
+        r = 0; // so far so good
+    }
+
+    // calculate payload length
+    size_t payload_length;
+    if ( length >= 10 ) 
+    { 
+        // a message of this minimum length will have a payload
+        payload_length = length - WRAPPER_LENGTH; 
+        // response minus header minus 4 checksum bytes and 2 sync bytes and 2 length bytes
+
+        // validate length
+        if ( response[HE_LENGTH_BYTE] != payload_length ) 
+        { 
+            return CS1_WRONG_LENGTH;
+        }
+    } 
+    else 
+    { // empty payload control sequences
+        payload_length = 0;
+    }
+
+    if (
+            response[HE_LENGTH_BYTE_0] == response[HE_LENGTH_BYTE] 
+        ||  response[HE_LENGTH_BYTE_0] == HE_NOACK
+       ) /* ACK or NOACK or EMPTY length */
+    {
+        // recorded in binary, the trace drain formats and logs it off the frame path
+        if (response[4] == HE_ACK) {
+            HE100_trace(HE100_TRACE_ACK, response[HE_CMD_BYTE], 0, 0, 0, 0);
+            r = 0;
+        } else if (response[4] == HE_NOACK) {
+            HE100_trace(HE100_TRACE_NACK, response[HE_CMD_BYTE], 0, 0, 0, 0);
+            r = HE_FAILED_NACK;
+        } else if (response[4] == 0) {
+            HE100_trace(HE100_TRACE_EMPTY_RESPONSE, response[HE_CMD_BYTE], 0, 0, 0, 0);
+            r = HE_EMPTY_RESPONSE;
+        } else {
+            HE100_trace(HE100_TRACE_UNKNOWN_RESPONSE, response[HE_CMD_BYTE], 0, 0, 0, 0);
+            r = HE_INVALID_BYTE_SEQUENCE;
+        }
+    }
+    
+    if (checksum_status != HE_SUCCESS) {
         r=HE_FAILED_CHECKSUM;
     }
 
@@ -310,172 +443,55 @@ void HE100_snprintfHex(char * output_hex_array, unsigned char * input_byte_array
 }
 
 
+int
+HE100_closePort (int fdin)
+{
+    HE100_legacyRelease(fdin);
+    return close(fdin);
+}
+
 /**
  * The HE100_read function obtains communication payloads from the 
  * serial device and returns an execution status.
  *
- * It reads bytes in single-file from the serial device and
- * appends them to a reference array.
- *
- * A timer is set to poll a the file descriptor which 
- * handles the serial connection to the RX pin of the Radio. 
- * It does some preliminary parsing to identify the incoming frames,
- * and copies the payload data to a reference buffer if successful.
- * If not sucessful, it logs an error using Shakespeare
+ * It runs HE100_handleRead on the handle kept for fdin, so bytes that
+ * arrive after a complete frame stay buffered for the next call. Invalid
+ * frames may soft reset the transceiver, once the error rate over a window
+ * of frames calls for it and the backoff and breaker of the handle's
+ * policy.recovery allow it (SC_he100-recovery.h). Change the policy of the
+ * handle HE100_legacyHandle gives for fdin, or use a handle of your own, to
+ * choose otherwise.
  *
  * Parameters:
- * payload - the buffered bytes returned parsed from the radio
  * fdin - file descriptor for serial communication
+ * read_time - seconds to wait for a frame
  * payload - a reference buffer to pass sucessfully parsed data
  *
  * return r 
  * - if successful, return the number of payload bytes recieved (total minus metabytes) 
  * - if not successful for any reason, return -1 
- *
- * Notes: 
- * this function is doing too much
- *  1 start timer
- *  2 poll
- *  3 looping read byte
- *   3a set breakpoint as appropriate 
- *  4 validate frame upon reaching breakpoint
- *   4a if valid: strip and pass payload data through reference buffer
- *   4b if invalid: log error and exit return -1
- * TODO: split step 4 into another function, test
  **/
 int
 HE100_read (int fdin, time_t read_time, unsigned char * payload)
 {
     if (payload==NULL) return -1;
-
-    // Read response
-    unsigned char buffer[1]; // to hold each byte as device is read
-    unsigned char response[MAX_FRAME_LENGTH] = {0}; // initialize empty response buffer
-    int i=0;
-    int r=-1; // return value for HE100_read
-    int breakcond=MAX_FRAME_LENGTH;
-
-    // start timer from call
-    timer_t read_timer = timer_get();
-    timer_start(&read_timer,read_time,0);
-
-    // Variables for select
-    int ret_value;
-
-    struct pollfd fds;
-    fds.fd = fdin;
-    fds.events = POLLIN;
-   
     if (fdin==0) return -1;
+    HE100_Handle *handle = HE100_legacyHandle(fdin);
+    if (handle == NULL) return -1;
+    int r = HE100_handleRead(handle, read_time, payload);
+    HE100_legacyPut(handle);
+    return r;
+}
 
-    // Read continuously from serial device
-    while (!timer_complete(&read_timer))
-    {
-        if ( ( ret_value = poll(&fds, 1, 5) > -1 ) ) // if a byte is ready to be read
-        {
-            read(fdin, &buffer, 1);
-            // set break condition based on incoming byte pattern
-            if ( i==HE_LENGTH_BYTE_0 && (buffer[0] == 0x0A || buffer[0] == 0xFF) ) { 
-                // TODO could this EVER also be a large length > 255? 
-                // COULD BE getting an ack
-                breakcond=8; // ack is 8 bytes
-            } else if ( i==5 && breakcond==255 ) { 
-                // this is the length byte, and we haven't already set the break point. Set break point accordingly
-                breakcond = buffer[0] + WRAPPER_LENGTH;
-            }
-            // increment response array values based on byte pattern
-            // if byte is referenced correctly, continue
-            if ( HE100_referenceByteSequence(buffer,i) == 0 ) {
-                response[i]=buffer[0];
-                buffer[0] = '\0';
-                i++;
-            } else {
-                i=0; // restart message index
-                response[0] = '\0';
-                breakcond=255;
-            }
-            if (i==breakcond) 
-            {
-                // TODO this section might be split into another function
-                if (i>0) 
-                {   // we are at the expected end of our message, time to validate
-                    int SVR_result = HE100_validateFrame(response, breakcond);
-                    if ( SVR_result == 0 ) 
-                    {   // valid frame
-                        r = 0; // TODO why is this set to zero here if only to be reset to payload_length?
-                        size_t payload_length;
-                        if (breakcond >= 10) {
-                            payload_length = breakcond - WRAPPER_LENGTH;
-                            memcpy (payload, response+HE_FIRST_PAYLOAD_BYTE, payload_length);
-                        } else payload_length=0;
-                        r=payload_length;
-                    }
-                    else if (SVR_result == CS1_NULL_MALLOC) 
-                    {   // memory allocation problem in validateFrame()
-                        char error[MAX_LOG_BUFFER_LEN];
-                        snprintf (
-                            error, 
-                            MAX_LOG_BUFFER_LEN, 
-                            "Memory allocation problem: %d, %s, %s, %d", 
-                            fdin, strerror(errno), __func__, __LINE__
-                        );
-                        Shakespeare::log(Shakespeare::ERROR, PROCESS, error);
-                        r=-1;
-                    }
-                    else
-                    {   // something unexpected
-                        char error[MAX_LOG_BUFFER_LEN];
-                        snprintf (
-                            error, 
-                            MAX_LOG_BUFFER_LEN, 
-                            "Invalid Data: %d, %d, %s, %d", 
-                            fdin, SVR_result, __func__, __LINE__
-                        );
-                        Shakespeare::log(Shakespeare::ERROR, PROCESS, error);
-                        r=-1;
-                       
-                        // soft reset the transceiver
-                        char log_msg[MAX_LOG_BUFFER_LEN]; // prepare to log result of soft reset
-                        if ( HE100_softReset(fdin) == 0 ) {
-                            snprintf (
-                                log_msg, 
-                                MAX_LOG_BUFFER_LEN,
-                                "Soft Reset written successfully!: %d, %d, %s, %d", 
-                                fdin, SVR_result, __func__, __LINE__
-                            );
-                        } 
-                        else { 
-                            snprintf (
-                                log_msg, 
-                                MAX_LOG_BUFFER_LEN,
-                                "Soft Reset FAILED: %d, %d, %s, %d", 
-                                fdin, SVR_result, __func__, __LINE__
-                            );
-                        }
-                        Shakespeare::log(Shakespeare::ERROR, PROCESS, log_msg);
-                    }
-                    break; // TODO why is this break needed?
-                }
-                i=0; // restart message index
-                response[0] = '\0';
-                breakcond=255;
-            }
-            buffer[0] = '\0'; // wipe buffer each time
-        }
-        else if (ret_value == -1) 
-        {   // bad or no read
-            char error[MAX_LOG_BUFFER_LEN];
-            snprintf (
-                error, 
-                MAX_LOG_BUFFER_LEN, 
-                "Problem with poll(): %d, %s, %s, %d", 
-                fdin, strerror(errno), __func__, __LINE__
-            );
-            Shakespeare::log(Shakespeare::ERROR, PROCESS, error);
-            r = -1;
-        }
+// commands whose frame ends after the header checksum
+static int
+HE100_hasPayload (unsigned char command)
+{
+    // set the array bounds based on command
+    if (command == 0x01 || command == 0x02 || command == 0x12 || command == 0x05 || command == 0x07) /* empty payload */ {
+        return 0;
     }
-    return r;
+    return 1;
 }
 
 // @param prepared_transmission - the bytes prepared for use externally
@@ -483,14 +499,7 @@ HE100_read (int fdin, time_t read_time, unsigned char * payload)
 int 
 HE100_prepareTransmission(unsigned char *payload, unsigned char *prepared_transmission, size_t length, unsigned char *command)
 {
-    int has_payload; // bool to define whether the transmission has payload or not
-
-    // set the array bounds based on command
-    if (command[1] == 0x01 || command[1] == 0x02 || command[1] == 0x12 || command[1] == 0x05) /* empty payload */ {
-        has_payload = 0;
-    } else {
-        has_payload = 1;
-    }
+    int has_payload = HE100_hasPayload(command[1]); // bool to define whether the transmission has payload or not
 
     // TODO how to better check if length is not accurate?
     /*
@@ -516,7 +525,7 @@ HE100_prepareTransmission(unsigned char *payload, unsigned char *prepared_transm
     prepared_transmission[HE_LENGTH_BYTE] = (unsigned char) length & 0xff;
 
     // generate and attach header checksum
-    fletcher_checksum header_checksum = fletcher_checksum16(prepared_transmission+2,4);
+    struct HE100_checksum header_checksum = HE100_fletcher16(prepared_transmission+2,4);
     prepared_transmission[HE_HEADER_CHECKSUM_BYTE_1] = (unsigned char) header_checksum.sum1 & 0xff;
     prepared_transmission[HE_HEADER_CHECKSUM_BYTE_2] = (unsigned char) header_checksum.sum2 & 0xff;
    
@@ -525,7 +534,7 @@ HE100_prepareTransmission(unsigned char *payload, unsigned char *prepared_transm
     {
         memcpy (prepared_transmission+HE_FIRST_PAYLOAD_BYTE,payload,length);
         // generate and attach payload checksum
-        fletcher_checksum payload_checksum = fletcher_checksum16(prepared_transmission+HE_TX_RX_BYTE,length+6); // chksum everything except first two bytes 'He'
+        struct HE100_checksum payload_checksum = HE100_fletcher16(prepared_transmission+HE_TX_RX_BYTE,length+6); // chksum everything except first two bytes 'He'
         prepared_transmission[HE_FIRST_PAYLOAD_BYTE+length] = payload_checksum.sum1;
         prepared_transmission[HE_FIRST_PAYLOAD_BYTE+length+1] = payload_checksum.sum2;
     }
@@ -533,6 +542,45 @@ HE100_prepareTransmission(unsigned char *payload, unsigned char *prepared_transm
     return 0;
 }
 
+// @param header - the 8 bytes in front of the payload
+// @param trailer - the 2 bytes after it
+// @return int - payload length, or error code
+int
+HE100_prepareTransmissionv(const struct iovec *payload, int iovcnt, unsigned char *command, unsigned char *header, unsigned char *trailer)
+{
+    size_t length = 0;
+    int i;
+    for (i=0; i<iovcnt; i++) length += payload[i].iov_len;
+    if (length > MAX_FRAME_LENGTH - WRAPPER_LENGTH) return HE_FAILED_PREPARE_TRANSMISSION;
+
+    header[HE_SYNC_BYTE_1] = SYNC1;
+    header[HE_SYNC_BYTE_2] = SYNC2;
+    header[HE_TX_RX_BYTE] = (unsigned char) command[0];
+    header[HE_CMD_BYTE] = (unsigned char) command[1];
+    header[HE_LENGTH_BYTE_0] = length >> 8;
+    header[HE_LENGTH_BYTE] = (unsigned char) length & 0xff;
+
+    struct HE100_checksum checksum = {0,0};
+    HE100_fletcher16Update(&checksum, header+HE_TX_RX_BYTE, 4);
+    header[HE_HEADER_CHECKSUM_BYTE_1] = checksum.sum1;
+    header[HE_HEADER_CHECKSUM_BYTE_2] = checksum.sum2;
+
+    // empty payload commands carry two zero bytes, as HE100_dispatchTransmission sends them
+    trailer[0] = 0;
+    trailer[1] = 0;
+    if ( HE100_hasPayload(command[1]) )
+    {
+        // the payload checksum runs on from the header checksum bytes
+        HE100_fletcher16Update(&checksum, header+HE_HEADER_CHECKSUM_BYTE_1, 2);
+        for (i=0; i<iovcnt; i++) {
+            HE100_fletcher16Update(&checksum, (const unsigned char *)payload[i].iov_base, payload[i].iov_len);
+        }
+        trailer[0] = checksum.sum1;
+        trailer[1] = checksum.sum2;
+    }
+    return (int)length;
+}
+
 /* Function to ensure byte-by-byte that we are receiving a HE100 frame */
 int
 HE100_referenceByteSequence(unsigned char *response, int position)
@@ -554,8 +602,8 @@ HE100_referenceByteSequence(unsigned char *response, int position)
                 }
                 if ((int)*response==32) r=0; // CMD_RECEIVE  0x20
                 break;
-        case 3   : // response command could be between 1-20
-                if (*response > 0x00 && *response <= 0x20) { 
+        case 3   : // response command could be between 1-20, or an over-the-air command 30-34
+                if ((*response > 0x00 && *response <= 0x20) || (*response >= CMD_TELEMETRY_DUMP && *response <= CMD_TOGGLE_PIN)) { 
                   r=0;
                   //r=(int)*response; // wanted to return response, but breaks exit status convention
                 } else {
@@ -586,26 +634,38 @@ HE100_dispatchTransmission(int fdin, unsigned char *payload, size_t payload_leng
 
     int prepare_result = HE100_prepareTransmission(payload,transmission,payload_length,command);
 #ifdef CS1_DEBUG
-    char debug_msg[MAX_LOG_BUFFER_LEN] = {0};
-    char hex_representation[MAX_LOG_BUFFER_LEN] = {0};
-    HE100_snprintfHex(hex_representation,transmission,payload_length+WRAPPER_LENGTH);      
-    snprintf (debug_msg,MAX_LOG_BUFFER_LEN, "Prepared payload: %s",hex_representation);
+    HE100_trace(HE100_TRACE_TX_PREPARED, (uint32_t)command[0] << 8 | command[1], payload_length+WRAPPER_LENGTH, prepare_result != 0, 0, 0);
+    HE100_traceFrame(transmission,payload_length+WRAPPER_LENGTH);
 #endif
     if ( prepare_result == 0) {
-#ifdef CS1_DEBUG
-      Shakespeare::log(Shakespeare::NOTICE,PROCESS,"Prepare successful");
-      Shakespeare::log(Shakespeare::NOTICE,PROCESS,debug_msg);
-#endif
       return HE100_write(fdin,transmission,payload_length+WRAPPER_LENGTH);
     } else {
-#ifdef CS1_DEBUG
-      Shakespeare::log(Shakespeare::ERROR,PROCESS,"Prepare failed");
-      Shakespeare::log(Shakespeare::ERROR,PROCESS,debug_msg);
-#endif
         return HE_FAILED_PREPARE_TRANSMISSION;
     }
 }
 
+/**
+ * Function to take radio command and payload buffers and write them to the
+ * radio in a single writev, without assembling the frame in memory
+ */
+int
+HE100_dispatchTransmissionv(int fdin, const struct iovec *payload, int iovcnt, unsigned char *command)
+{
+    unsigned char header[HE_FIRST_PAYLOAD_BYTE];
+    unsigned char trailer[2];
+
+    if (fdin == 0) return HE_FAILED_OPEN_PORT;
+    if (iovcnt < 0 || iovcnt > HE100_MAX_PAYLOAD_IOV) return HE_FAILED_PREPARE_TRANSMISSION;
+    if (HE100_prepareTransmissionv(payload,iovcnt,command,header,trailer) < 0) {
+        Shakespeare::log(Shakespeare::ERROR,PROCESS,"Prepare failed");
+        return HE_FAILED_PREPARE_TRANSMISSION;
+    }
+
+    uint64_t sent = HE100_monotonicNs();
+    int w = HE100_writeFramev(fdin,header,payload,iovcnt,trailer);
+    return HE100_confirmWrite(fdin, command[1], w, sent);
+}
+
 /**
  * Function to return NOOP byte sequence
  * no arguments
@@ -613,9 +673,7 @@ HE100_dispatchTransmission(int fdin, unsigned char *payload, size_t payload_leng
 int
 HE100_NOOP (int fdin)
 {
-   unsigned char noop_payload[1] = {0};
-   unsigned char noop_command[2] = {CMD_TRANSMIT, CMD_NOOP};
-   return HE100_dispatchTransmission(fdin,noop_payload,0,noop_command);
+   return HE100_write(fdin,(unsigned char *)HE100_FRAME_NOOP,sizeof(HE100_FRAME_NOOP));
 }
 
 /**
@@ -626,7 +684,8 @@ int
 HE100_transmitData (int fdin, unsigned char *transmit_data_payload, size_t transmit_data_len)
 {
     unsigned char transmit_data_command[2] = {CMD_TRANSMIT, CMD_TRANSMIT_DATA};
-    return HE100_dispatchTransmission(fdin,transmit_data_payload,transmit_data_len,transmit_data_command);
+    struct iovec transmit_data_iov = {transmit_data_payload, transmit_data_len};
+    return HE100_dispatchTransmissionv(fdin,&transmit_data_iov,1,transmit_data_command);
 }
 
 /**
@@ -637,10 +696,7 @@ int
 HE100_setBeaconInterval (int fdin, int beacon_interval)
 {
    if (beacon_interval > 255 ) return -1; // TODO not possible
-   unsigned char beacon_interval_payload[1];
-   beacon_interval_payload[0] = beacon_interval & 0xff;
-   unsigned char beacon_interval_command[2] = {CMD_TRANSMIT, CMD_BEACON_CONFIG};
-   return HE100_dispatchTransmission(fdin,beacon_interval_payload,1,beacon_interval_command);
+   return HE100_write(fdin,(unsigned char *)HE100_FRAME_BEACON_CONFIG[beacon_interval & 0xff],HE100_BYTE_FRAME_LENGTH);
 }
 
 /**
@@ -651,7 +707,8 @@ int
 HE100_setBeaconMessage (int fdin, unsigned char *set_beacon_message_payload, size_t beacon_message_len)
 {
    unsigned char set_beacon_message_command[2] = {CMD_TRANSMIT, CMD_BEACON_DATA};
-   return HE100_dispatchTransmission(fdin,set_beacon_message_payload,beacon_message_len,set_beacon_message_command);
+   struct iovec set_beacon_message_iov = {set_beacon_message_payload, beacon_message_len};
+   return HE100_dispatchTransmissionv(fdin,&set_beacon_message_iov,1,set_beacon_message_command);
 }
 
 /**
@@ -662,25 +719,24 @@ HE100_setBeaconMessage (int fdin, unsigned char *set_beacon_message_payload, siz
 int
 HE100_fastSetPA (int fdin, int power_level)
 {
-   unsigned char fast_set_pa_payload[1];
-   fast_set_pa_payload[0] = power_level & 0xff;
    if (power_level > MAX_POWER_LEVEL || power_level < MIN_POWER_LEVEL) {
      return 1;
    } 
-   unsigned char fast_set_pa_command[2] = {CMD_TRANSMIT, CMD_FAST_SET_PA};
-   return HE100_dispatchTransmission(fdin,fast_set_pa_payload,1,fast_set_pa_command);
+   return HE100_write(fdin,(unsigned char *)HE100_FRAME_FAST_SET_PA[power_level & 0xff],HE100_BYTE_FRAME_LENGTH);
 }
 
 /**
  * Function returning byte sequence to soft reset HE100 board and restore flash settings
- * no arguments
+ * no arguments. The configuration cached for fdin is dropped.
  */
 int
 HE100_softReset(int fdin)
 {
-   unsigned char soft_reset_payload[1] = {0};
-   unsigned char soft_reset_command[2] = {CMD_TRANSMIT, CMD_RESET};
-   return HE100_dispatchTransmission(fdin,soft_reset_payload,0,soft_reset_command);
+   HE100_Handle *handle = HE100_legacyHandle(fdin);
+   if (handle == NULL) return HE_FAILED_OPEN_PORT;
+   int result = HE100_handleSoftReset(handle);
+   HE100_legacyPut(handle);
+   return result;
 }
 
 /**
@@ -690,9 +746,7 @@ HE100_softReset(int fdin)
 int
 HE100_readFirmwareRevision(int fdin)
 {
-   unsigned char read_firmware_revision_payload[1] = {0};
-   unsigned char read_firmware_revision_command[2] = {CMD_TRANSMIT, CMD_READ_FIRMWARE_V};
-   return HE100_dispatchTransmission(fdin,read_firmware_revision_payload,0,read_firmware_revision_command);
+   return HE100_write(fdin,(unsigned char *)HE100_FRAME_READ_FIRMWARE_V,sizeof(HE100_FRAME_READ_FIRMWARE_V));
 }
 
 /**
@@ -984,34 +1038,56 @@ HE100_prepareConfig (unsigned char &prepared_bytes, struct he100_settings settin
 
 /** 
  * This function calls the dispatch to read the configuration
- * from the transceiver
+ * from the transceiver, and caches it for fdin
  **/
 int 
 HE100_getConfig (int fdin, struct he100_settings * settings)
 {
-    int result = 1;
-    unsigned char get_config_payload[1] = {0};
-    unsigned char get_config_command[2] = {CMD_TRANSMIT, CMD_GET_CONFIG};
-  
-    // the response to this call will contain the  
-    int get_config_result = HE100_dispatchTransmission(fdin,get_config_payload,0,get_config_command);
+    HE100_Handle *handle = HE100_legacyHandle(fdin);
+    if (handle == NULL) return HE_FAILED_OPEN_PORT;
+    int result = HE100_handleGetConfig(handle, settings);
+    HE100_legacyPut(handle);
+    return result;
+}
 
-    if(get_config_result == 0)
-    {
-       unsigned char config_transmission[MAX_FRAME_LENGTH];
-       if ( HE100_read(fdin, 2, config_transmission) > 0 ) // valid number of bytes is great than zero
-       {
-         // TODO verify this is a read frame!
-         unsigned char config_bytes[CFG_PAYLOAD_LENGTH];
-         memcpy (&config_bytes, config_transmission,CFG_PAYLOAD_LENGTH);
-         *settings = HE100_collectConfig(config_bytes); 
-         result = HE100_validateConfig(*settings); 
-       } 
-       else 
-       {
-         result = HE_FAILED_READ;
-       } 
-    }
+/**
+ * Function to read the configuration cached for fdin with no serial
+ * traffic, asking the transceiver only when nothing is cached
+ */
+int
+HE100_currentConfig (int fdin, struct he100_settings * settings)
+{
+    HE100_Handle *handle = HE100_legacyHandle(fdin);
+    if (handle == NULL) return HE_FAILED_OPEN_PORT;
+    int result = HE100_handleCurrentConfig(handle, settings);
+    HE100_legacyPut(handle);
+    return result;
+}
+
+/**
+ * Function to move the transceiver and the serial device to a new interface
+ * rate, falling back to the current one if it cannot be confirmed
+ */
+int
+HE100_negotiateBaud (int fdin, int if_baud_rate)
+{
+    HE100_Handle *handle = HE100_legacyHandle(fdin);
+    if (handle == NULL) return HE_FAILED_OPEN_PORT;
+    int result = HE100_baudNegotiate(handle, if_baud_rate);
+    HE100_legacyPut(handle);
+    return result;
+}
+
+/**
+ * Function to query one telemetry frame from the transceiver
+ */
+int
+HE100_telemetry (int fdin, TELEMETRY_STRUCTURE_type * telemetry)
+{
+    HE100_Handle *handle = HE100_legacyHandle(fdin);
+    if (handle == NULL) return HE_FAILED_OPEN_PORT;
+    int result = HE100_handleTelemetry(handle, telemetry);
+    HE100_legacyPut(handle);
     return result;
 }
 
@@ -1079,7 +1155,7 @@ HE100_validateConfig (struct he100_settings he100_new_settings)
 
     // validate new interface baud rate setting
     if (
-            he100_new_settings.interface_baud_rate >= MAX_IF_BAUD_RATE 
+            he100_new_settings.interface_baud_rate > MAX_IF_BAUD_RATE 
     )
     {
         snprintf(
@@ -1113,19 +1189,17 @@ HE100_validateConfig (struct he100_settings he100_new_settings)
 
     // validate new rf baud rates
     if (
-            he100_new_settings.rx_rf_baud_rate >= MAX_RF_BAUD_RATE
-        &&  he100_new_settings.rx_rf_baud_rate <= MIN_RF_BAUD_RATE // always true
-        &&  he100_new_settings.tx_rf_baud_rate >= MAX_RF_BAUD_RATE
-        &&  he100_new_settings.tx_rf_baud_rate <= MIN_RF_BAUD_RATE // always true
+            he100_new_settings.rx_rf_baud_rate > MAX_RF_BAUD_RATE
+        ||  he100_new_settings.tx_rf_baud_rate > MAX_RF_BAUD_RATE
     ) 
     {
         snprintf(
             validation_log_entry,
             MAX_LOG_BUFFER_LEN,
-            "%s MAX:%d MIN:%d INDEX:%d BAUD:%s ^%s@%d",
+            "%s MAX:%d MIN:%d RX:%d TX:%d ^%s@%d",
             HE_STATUS[HE_INVALID_RF_BAUD_RATE],
             MAX_RF_BAUD_RATE, MIN_RF_BAUD_RATE,
-            he100_new_settings.tx_power_amp_level,rf_baudrate[he100_new_settings.tx_power_amp_level],
+            he100_new_settings.rx_rf_baud_rate,he100_new_settings.tx_rf_baud_rate,
             __func__,__LINE__
         );
         Shakespeare::log(Shakespeare::ERROR, PROCESS, validation_log_entry);
@@ -1248,26 +1322,16 @@ HE100_validateConfig (struct he100_settings he100_new_settings)
 }
 
 /**
- *  Function to persist a given he100_settings struct after it passes validation
+ *  Function to persist a given he100_settings struct after it passes validation.
+ *  Nothing is sent when it matches the configuration cached for fdin.
  */   
 int 
 HE100_setConfig (int fdin, struct he100_settings he100_new_settings)
 {
-    unsigned char set_config_payload[CFG_PAYLOAD_LENGTH] = {0}; 
-    unsigned char set_config_command[2] = {CMD_TRANSMIT, CMD_SET_CONFIG};
-
-    int validate_result=1, prepare_result=1;
-    validate_result = HE100_validateConfig(he100_new_settings);
-
-    if (validate_result==HE_SUCCESS) {
-        prepare_result = HE100_prepareConfig(*set_config_payload,he100_new_settings);
-    }
-
-    if (prepare_result == HE_SUCCESS) {
-        // we have valid array
-        return HE100_dispatchTransmission(fdin, set_config_payload, CFG_PAYLOAD_LENGTH, set_config_command);
-    } else {
-        return HE_INVALID_CONFIG;
-    }
+    HE100_Handle *handle = HE100_legacyHandle(fdin);
+    if (handle == NULL) return HE_FAILED_OPEN_PORT;
+    int result = HE100_handleSetConfig(handle, he100_new_settings);
+    HE100_legacyPut(handle);
+    return result;
 }
 
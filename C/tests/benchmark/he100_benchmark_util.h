@@ -0,0 +1,83 @@
+#ifndef HE100_BENCHMARK_UTIL_H_
+#define HE100_BENCHMARK_UTIL_H_
+
+/*
+ * Helpers shared by the HE100 benchmarks: a raw pseudo terminal pair standing
+ * in for the serial device, and canned frames captured from the radio.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <SC_he100.h>
+
+// 'kenwood' downlink captured from the He100, see ByteSequences.txt
+static const unsigned char bench_receive_frame[36] = {0x48,0x65,0x20,0x04,0x00,0x1a,0x3e,0xa6,0x86,0xa2,0x40,0x40,0x40,0x40,0x60,0xac,0x8a,0x64,0x86,0xaa,0x82,0xe1,0x03,0xf0,0x6b,0x65,0x6e,0x77,0x6f,0x6f,0x64,0x0d,0x8d,0x08,0x63,0x9f};
+static const unsigned char bench_ack_frame[8] = {0x48,0x65,0x20,0x03,0x0a,0x0a,0x37,0xa7};
+
+struct bench_pty {
+    int master; // the library reads from this end
+    int slave;  // the benchmark writes radio traffic to this end
+};
+
+static inline int
+bench_openPty (struct bench_pty *pty)
+{
+    pty->master = open("/dev/ptmx", O_RDWR | O_NOCTTY);
+    if (pty->master < 0) return -1;
+    grantpt(pty->master);
+    unlockpt(pty->master);
+    pty->slave = open(ptsname(pty->master), O_RDWR | O_NOCTTY);
+    if (pty->slave < 0) return -1;
+
+    // raw mode on both ends, the line discipline would otherwise rewrite 0x0a
+    struct termios settings;
+    tcgetattr(pty->slave, &settings);
+    cfmakeraw(&settings);
+    tcsetattr(pty->slave, TCSANOW, &settings);
+    tcgetattr(pty->master, &settings);
+    cfmakeraw(&settings);
+    tcsetattr(pty->master, TCSANOW, &settings);
+    return 0;
+}
+
+static inline void
+bench_closePty (struct bench_pty *pty)
+{
+    close(pty->master);
+    close(pty->slave);
+}
+
+/**
+ * Build a valid receive frame carrying payload_length bytes of data
+ * @return - the total length of the frame
+ */
+static inline size_t
+bench_receiveFrame (unsigned char *frame, size_t payload_length)
+{
+    unsigned char payload[MAX_FRAME_LENGTH];
+    size_t i;
+    for (i=0; i<payload_length; i++) payload[i] = (unsigned char)(i*7+1);
+    unsigned char command[2] = {CMD_RECEIVE, CMD_RECEIVE_DATA};
+    HE100_prepareTransmission(payload, frame, payload_length, command);
+    return payload_length + WRAPPER_LENGTH;
+}
+
+/**
+ * Write a whole buffer to a descriptor, the pty may take it in pieces
+ */
+static inline int
+bench_writeAll (int fd, const unsigned char *bytes, size_t length)
+{
+    size_t written = 0;
+    while (written < length) {
+        ssize_t w = write(fd, bytes+written, length-written);
+        if (w <= 0) return -1;
+        written += w;
+    }
+    return 0;
+}
+
+#endif
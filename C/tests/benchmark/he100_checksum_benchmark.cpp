@@ -0,0 +1,63 @@
+/*
+ * Compares the Fletcher-16 kernels behind HE100_fletcher16 with the external
+ * fletcher_checksum16 the library used before, on frame sized buffers.
+ *
+ * Lengths are a header checksum (4), a short payload checksum, a typical
+ * tested frame and the longest checksummed span of a frame.
+ */
+#include <benchmark/benchmark.h>
+#include <stdlib.h>
+#include <SC_he100.h>
+#include <SC_he100-checksum.h>
+#include <fletcher.h>
+
+static unsigned char data[MAX_FRAME_LENGTH];
+
+static void
+fillData (void)
+{
+    size_t i;
+    srand(1017);
+    for (i=0; i<sizeof(data); i++) data[i] = (unsigned char)rand();
+}
+
+static void
+BM_FletcherExternal (benchmark::State& state)
+{
+    fillData();
+    size_t length = state.range(0);
+    for (auto _ : state) {
+        fletcher_checksum checksum = fletcher_checksum16(data, length);
+        benchmark::DoNotOptimize(checksum);
+    }
+    state.SetBytesProcessed(state.iterations() * length);
+}
+BENCHMARK(BM_FletcherExternal)->Arg(4)->Arg(32)->Arg(MAX_TESTED_FRAME+6)->Arg(MAX_FRAME_LENGTH-4);
+
+static void
+BM_FletcherKernel (benchmark::State& state)
+{
+    int kernel = state.range(0);
+    if (!HE100_checksumSupported(kernel)) {
+        state.SkipWithError("kernel not supported on this CPU");
+        return;
+    }
+    int selected = HE100_checksumKernel();
+    HE100_checksumSelect(kernel);
+    state.SetLabel(HE100_CHECKSUM_KERNEL_NAMES[kernel]);
+
+    fillData();
+    size_t length = state.range(1);
+    for (auto _ : state) {
+        struct HE100_checksum checksum = HE100_fletcher16(data, length);
+        benchmark::DoNotOptimize(checksum);
+    }
+    state.SetBytesProcessed(state.iterations() * length);
+    HE100_checksumSelect(selected);
+}
+BENCHMARK(BM_FletcherKernel)->ArgsProduct({
+    {HE100_CHECKSUM_SCALAR, HE100_CHECKSUM_SSE2, HE100_CHECKSUM_AVX2, HE100_CHECKSUM_NEON},
+    {4, 32, MAX_TESTED_FRAME+6, MAX_FRAME_LENGTH-4}
+});
+
+BENCHMARK_MAIN();
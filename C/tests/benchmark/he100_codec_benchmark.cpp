@@ -0,0 +1,195 @@
+/*
+ * Baseline for the frame codec and configuration paths, run before and after
+ * a rework of either and compared from the JSON output (make json, then
+ * compare.py from Google Benchmark on two runs).
+ *
+ * Frame benchmarks take the payload length, 0 to MAX_TESTED_FRAME; at 0 the
+ * frame read or validated is an ACK, as the radio never sends an empty payload.
+ *
+ * HE100_read is fed from a pseudo terminal one frame at a time, so it pays
+ * for a poll() and a read() per frame, as on the serial line.
+ *
+ * The AX.25 demultiplexer benchmark takes the number of stations routed;
+ * its time per payload should not grow with it.
+ */
+#include <benchmark/benchmark.h>
+#include <string.h>
+#include <SC_he100.h>
+#include <SC_he100-decoder.h>
+#include <SC_he100-ax25.h>
+#include <fletcher.h>
+#include "he100_benchmark_util.h"
+
+// 'getconfig response' payload with the flight callsigns, as in he100_lib_test
+static const unsigned char config_bytes[CFG_PAYLOAD_LENGTH] = {0x00,0x87,0x01,0x01,0x00,0x00,0xa8,0x3c,0x02,0x00,0x08,0xab,0x06,0x00,0x56,0x41,0x33,0x4f,0x52,0x42,0x56,0x45,0x32,0x43,0x55,0x41,0x05,0x00,0x00,0x00,0x41,0x80,0x00,0x00};
+
+static void
+payloadLengths (benchmark::internal::Benchmark *b)
+{
+    static const int lengths[] = {0, 1, 16, 26, 64, 128, MAX_TESTED_FRAME};
+    size_t i;
+    for (i=0; i<sizeof(lengths)/sizeof(lengths[0]); i++) b->Arg(lengths[i]);
+}
+
+// an ACK for an empty payload, otherwise a receive frame
+static size_t
+codecFrame (unsigned char *frame, size_t payload_length)
+{
+    if (payload_length == 0) {
+        memcpy(frame, bench_ack_frame, sizeof(bench_ack_frame));
+        return sizeof(bench_ack_frame);
+    }
+    return bench_receiveFrame(frame, payload_length);
+}
+
+static void
+BM_PrepareTransmission (benchmark::State& state)
+{
+    size_t length = state.range(0);
+    unsigned char payload[MAX_FRAME_LENGTH];
+    unsigned char frame[MAX_FRAME_LENGTH+WRAPPER_LENGTH];
+    unsigned char command[2] = {CMD_TRANSMIT, CMD_TRANSMIT_DATA};
+    size_t i;
+    for (i=0; i<length; i++) payload[i] = (unsigned char)(i*7+3);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(HE100_prepareTransmission(payload, frame, length, command));
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * (length + WRAPPER_LENGTH));
+}
+BENCHMARK(BM_PrepareTransmission)->Apply(payloadLengths);
+
+static void
+BM_ValidateFrame (benchmark::State& state)
+{
+    unsigned char frame[HE100_MAX_WIRE_FRAME];
+    size_t length = codecFrame(frame, state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(HE100_validateFrame(frame, length));
+    }
+    state.SetBytesProcessed(state.iterations() * length);
+}
+BENCHMARK(BM_ValidateFrame)->Apply(payloadLengths);
+
+// the payload checksum of a frame: everything from the tx/rx byte to the payload's end
+static void
+BM_FletcherChecksum16 (benchmark::State& state)
+{
+    unsigned char frame[HE100_MAX_WIRE_FRAME];
+    size_t length = codecFrame(frame, state.range(0)) - 4;
+    for (auto _ : state) {
+        fletcher_checksum checksum = fletcher_checksum16(frame+HE_TX_RX_BYTE, length);
+        benchmark::DoNotOptimize(checksum);
+    }
+    state.SetBytesProcessed(state.iterations() * length);
+}
+BENCHMARK(BM_FletcherChecksum16)->Apply(payloadLengths);
+
+static void
+BM_ReadFromPty (benchmark::State& state)
+{
+    struct bench_pty pty;
+    if (bench_openPty(&pty) != 0) {
+        state.SkipWithError("no pseudo terminal");
+        return;
+    }
+    unsigned char frame[HE100_MAX_WIRE_FRAME];
+    unsigned char payload[MAX_FRAME_LENGTH];
+    size_t length = codecFrame(frame, state.range(0));
+    int expected = state.range(0);
+
+    for (auto _ : state) {
+        bench_writeAll(pty.slave, frame, length);
+        if (HE100_read(pty.master, 1, payload) != expected) {
+            state.SkipWithError("HE100_read failed");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * length);
+    bench_closePty(&pty);
+}
+BENCHMARK(BM_ReadFromPty)->Apply(payloadLengths);
+
+// HE100_collectConfig swaps bytes in place, so every iteration gets a fresh copy
+static void
+BM_CollectConfig (benchmark::State& state)
+{
+    unsigned char buffer[CFG_PAYLOAD_LENGTH];
+    for (auto _ : state) {
+        memcpy(buffer, config_bytes, CFG_PAYLOAD_LENGTH);
+        struct he100_settings settings = HE100_collectConfig(buffer);
+        benchmark::DoNotOptimize(settings);
+    }
+}
+BENCHMARK(BM_CollectConfig);
+
+static void
+BM_PrepareConfig (benchmark::State& state)
+{
+    unsigned char buffer[CFG_PAYLOAD_LENGTH];
+    memcpy(buffer, config_bytes, CFG_PAYLOAD_LENGTH);
+    struct he100_settings settings = HE100_collectConfig(buffer);
+    unsigned char prepared[CFG_PAYLOAD_LENGTH];
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(HE100_prepareConfig(*prepared, settings));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_PrepareConfig);
+
+static void
+BM_ValidateConfig (benchmark::State& state)
+{
+    unsigned char buffer[CFG_PAYLOAD_LENGTH];
+    memcpy(buffer, config_bytes, CFG_PAYLOAD_LENGTH);
+    struct he100_settings settings = HE100_collectConfig(buffer);
+    if (HE100_validateConfig(settings) != HE_SUCCESS) {
+        state.SkipWithError("sample configuration is invalid");
+        return;
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(HE100_validateConfig(settings));
+    }
+}
+BENCHMARK(BM_ValidateConfig);
+
+static void
+countRouted (const struct he100_ax25_view *view, void *context)
+{
+    (*(uint64_t *)context) += view->information_length;
+}
+
+// routed on the source, the last station registered
+static void
+BM_Ax25Demux (benchmark::State& state)
+{
+    struct he100_ax25_demux demux;
+    uint64_t routed = 0;
+    char callsign[16];
+    int i;
+    HE100_ax25DemuxInit(&demux, HE100_AX25_ROUTE_SOURCE, NULL, NULL);
+    for (i=0; i<state.range(0); i++) {
+        snprintf(callsign, sizeof(callsign), "VA2%03d", i);
+        HE100_ax25DemuxRegister(&demux, callsign, 0, countRouted, &routed);
+    }
+
+    unsigned char payload[MAX_TESTED_FRAME];
+    memset(payload, 0, sizeof(payload));
+    HE100_ax25Address("CQ", 0, payload);
+    HE100_ax25Address(callsign, 0, payload + HE100_AX25_ADDRESS_LENGTH);
+    payload[2*HE100_AX25_ADDRESS_LENGTH - 1] |= 0x01;
+    payload[2*HE100_AX25_ADDRESS_LENGTH] = 0x03;
+    payload[2*HE100_AX25_ADDRESS_LENGTH + 1] = 0xf0;
+
+    for (auto _ : state) {
+        if (HE100_ax25DemuxPayload(&demux, payload, sizeof(payload)) != HE_SUCCESS) {
+            state.SkipWithError("payload not routed");
+            break;
+        }
+    }
+    benchmark::DoNotOptimize(routed);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Ax25Demux)->Arg(1)->Arg(8)->Arg(HE100_AX25_MAX_ROUTES);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,317 @@
+/*
+ * Compares the byte-at-a-time receive loop HE100_read used to run with the
+ * bulk-read ring decoder, on bursts of frames written to a pseudo terminal.
+ *
+ * Reported counters:
+ *   syscalls_per_frame - poll() plus read()/readv() calls issued per frame
+ *   cpu_s_per_MB       - CPU seconds spent per megabyte of frames received
+ *
+ * The receive engine benchmarks report CPU time against wall time while the
+ * line is idle, and the time from reading the last byte to the callback.
+ *
+ * A burst lands in the pty all at once, which is the best case for bulk reads;
+ * at 9600 baud on a real line fewer bytes are waiting per poll().
+ *
+ * The capture replay benchmark times the decoder alone, on bursts recorded in
+ * the READ_PIECE sized reads a slow line gives, with no system calls.
+ * The resync benchmark does the same with line noise between the frames,
+ * some of it ending in a stray sync byte, and reports frames_lost.
+ */
+#include <benchmark/benchmark.h>
+#include <poll.h>
+#include <SC_he100.h>
+#include <SC_he100-decoder.h>
+#include <SC_he100-rx.h>
+#include <SC_he100-capture.h>
+#include "he100_benchmark_util.h"
+
+#define BURST_BYTES 2048 // stays well inside the pty buffer
+#define READ_PIECE  48   // bytes per read recorded in the replayed capture
+#define CAPTURE_BURSTS 64
+
+// build a burst of identical frames, an ack when payload_length is zero
+static size_t
+burst (unsigned char *bytes, size_t payload_length, size_t *frames)
+{
+    unsigned char frame[HE100_MAX_WIRE_FRAME];
+    size_t frame_length;
+    if (payload_length == 0) {
+        memcpy(frame, bench_ack_frame, sizeof(bench_ack_frame));
+        frame_length = sizeof(bench_ack_frame);
+    } else {
+        frame_length = bench_receiveFrame(frame, payload_length);
+    }
+    size_t length = 0;
+    *frames = 0;
+    while (length + frame_length <= BURST_BYTES) {
+        memcpy(bytes+length, frame, frame_length);
+        length += frame_length;
+        (*frames)++;
+    }
+    return length;
+}
+
+// the loop HE100_read used before the decoder: one poll() and one read() per byte
+static int
+legacy_readFrame (int fdin, unsigned char *response, uint64_t *syscalls)
+{
+    unsigned char buffer[1];
+    int i=0;
+    int breakcond=MAX_FRAME_LENGTH;
+    struct pollfd fds;
+    fds.fd = fdin;
+    fds.events = POLLIN;
+
+    while (1)
+    {
+        (*syscalls)++;
+        if ( poll(&fds, 1, 5) < 1 ) return -1;
+        (*syscalls)++;
+        if ( read(fdin, &buffer, 1) != 1 ) return -1;
+        if ( i==HE_LENGTH_BYTE_0 && (buffer[0] == 0x0A || buffer[0] == 0xFF) ) {
+            breakcond=8;
+        } else if ( i==5 && breakcond==255 ) {
+            breakcond = buffer[0] + WRAPPER_LENGTH;
+        }
+        if ( HE100_referenceByteSequence(buffer,i) == 0 ) {
+            response[i]=buffer[0];
+            i++;
+        } else {
+            i=0;
+            breakcond=255;
+        }
+        if (i==breakcond) return i;
+    }
+}
+
+static void
+BM_LegacyByteRead (benchmark::State& state)
+{
+    struct bench_pty pty;
+    if (bench_openPty(&pty) != 0) { state.SkipWithError("no pty"); return; }
+
+    unsigned char bytes[BURST_BYTES];
+    size_t frames_per_burst;
+    size_t length = burst(bytes, state.range(0), &frames_per_burst);
+    unsigned char response[HE100_MAX_WIRE_FRAME];
+    uint64_t syscalls = 0, frames = 0;
+
+    for (auto _ : state) {
+        bench_writeAll(pty.slave, bytes, length);
+        size_t f;
+        for (f=0; f<frames_per_burst; f++) {
+            if (legacy_readFrame(pty.master, response, &syscalls) < 0) {
+                state.SkipWithError("lost a frame");
+                break;
+            }
+            frames++;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * length);
+    state.counters["syscalls_per_frame"] = (double)syscalls / frames;
+    state.counters["cpu_s_per_MB"] = benchmark::Counter(
+        state.iterations() * length / 1e6,
+        benchmark::Counter::kIsRate | benchmark::Counter::kInvert
+    );
+    bench_closePty(&pty);
+}
+BENCHMARK(BM_LegacyByteRead)->Arg(0)->Arg(26)->Arg(MAX_TESTED_FRAME);
+
+static void
+BM_DecoderBulkRead (benchmark::State& state)
+{
+    struct bench_pty pty;
+    if (bench_openPty(&pty) != 0) { state.SkipWithError("no pty"); return; }
+
+    unsigned char bytes[BURST_BYTES];
+    size_t frames_per_burst;
+    size_t length = burst(bytes, state.range(0), &frames_per_burst);
+    unsigned char response[HE100_MAX_WIRE_FRAME];
+    size_t response_length;
+    uint64_t polls = 0, frames = 0;
+
+    struct he100_decoder decoder;
+    HE100_decoderInit(&decoder);
+    struct pollfd fds;
+    fds.fd = pty.master;
+    fds.events = POLLIN;
+
+    for (auto _ : state) {
+        bench_writeAll(pty.slave, bytes, length);
+        size_t f = 0;
+        while (f < frames_per_burst) {
+            if (HE100_decoderNext(&decoder, response, &response_length) == 1) {
+                f++;
+                continue;
+            }
+            polls++;
+            if (poll(&fds, 1, 5) < 1 || HE100_decoderFill(&decoder, pty.master) <= 0) {
+                state.SkipWithError("lost a frame");
+                break;
+            }
+        }
+        frames += f;
+    }
+    state.SetBytesProcessed(state.iterations() * length);
+    state.counters["syscalls_per_frame"] = (double)(polls + decoder.read_calls) / frames;
+    state.counters["cpu_s_per_MB"] = benchmark::Counter(
+        state.iterations() * length / 1e6,
+        benchmark::Counter::kIsRate | benchmark::Counter::kInvert
+    );
+    bench_closePty(&pty);
+}
+BENCHMARK(BM_DecoderBulkRead)->Arg(0)->Arg(26)->Arg(MAX_TESTED_FRAME);
+
+static void
+countFrame (const unsigned char *frame, size_t length, int status, void *context)
+{
+    (void)frame; (void)length;
+    if (status == HE_SUCCESS) (*(uint64_t *)context)++;
+}
+
+static void
+BM_ReplayCapture (benchmark::State& state)
+{
+    char path[] = "/tmp/he100_bench_captureXXXXXX";
+    int fd = mkstemp(path);
+    struct he100_capture capture;
+    if (fd < 0 || HE100_captureOpen(&capture, path, 0) != HE_SUCCESS) {
+        state.SkipWithError("cannot create a capture");
+        return;
+    }
+    close(fd);
+
+    unsigned char bytes[BURST_BYTES];
+    size_t frames_per_burst;
+    size_t length = burst(bytes, state.range(0), &frames_per_burst);
+    int b;
+    size_t offset;
+    for (b=0; b<CAPTURE_BURSTS; b++) {
+        for (offset=0; offset<length; offset+=READ_PIECE) {
+            struct iovec piece = {bytes+offset, length-offset < READ_PIECE ? length-offset : READ_PIECE};
+            HE100_captureRecord(&capture, HE100_CAPTURE_RX, 0, &piece, 1, piece.iov_len);
+        }
+    }
+
+    struct he100_decoder decoder;
+    struct he100_replay_stats stats;
+    uint64_t valid = 0;
+    for (auto _ : state) {
+        HE100_decoderInit(&decoder);
+        HE100_captureReplay(&capture, &decoder, 0, countFrame, &valid, &stats);
+        if (stats.frames != frames_per_burst*CAPTURE_BURSTS) {
+            state.SkipWithError("lost a frame");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * stats.rx_bytes);
+    state.SetItemsProcessed(valid);
+    HE100_captureClose(&capture);
+    unlink(path);
+}
+BENCHMARK(BM_ReplayCapture)->Arg(0)->Arg(26)->Arg(MAX_TESTED_FRAME);
+
+// noise of a gap between frames: random bytes, never a sync pair, the last a stray first sync byte
+static size_t
+noise (unsigned char *bytes, size_t length, unsigned int *seed)
+{
+    size_t i;
+    for (i=0; i<length; i++) {
+        bytes[i] = (unsigned char)rand_r(seed);
+        if (bytes[i] == SYNC2 && i > 0 && bytes[i-1] == SYNC1) bytes[i] = 0;
+    }
+    if (length > 0) bytes[length-1] = SYNC1;
+    return length;
+}
+
+static void
+BM_DecoderResync (benchmark::State& state)
+{
+    // frames of each kind with state.range(0) bytes of noise before each
+    static unsigned char bytes[CAPTURE_BURSTS*(HE100_MAX_WIRE_FRAME+1024)];
+    unsigned char frame[HE100_MAX_WIRE_FRAME];
+    size_t frame_length = bench_receiveFrame(frame, MAX_TESTED_FRAME);
+    unsigned int seed = 1;
+    size_t length = 0;
+    int f;
+    for (f=0; f<CAPTURE_BURSTS; f++) {
+        length += noise(bytes+length, state.range(0), &seed);
+        if (f % 2) {
+            memcpy(bytes+length, bench_ack_frame, sizeof(bench_ack_frame));
+            length += sizeof(bench_ack_frame);
+        } else {
+            memcpy(bytes+length, frame, frame_length);
+            length += frame_length;
+        }
+    }
+
+    struct he100_decoder decoder;
+    unsigned char response[HE100_MAX_WIRE_FRAME];
+    size_t response_length;
+    uint64_t lost = 0;
+    for (auto _ : state) {
+        HE100_decoderInit(&decoder);
+        size_t offset;
+        int found = 0;
+        for (offset=0; offset<length; offset+=READ_PIECE) {
+            HE100_decoderFeed(&decoder, bytes+offset, length-offset < READ_PIECE ? length-offset : READ_PIECE);
+            while (HE100_decoderNext(&decoder, response, &response_length) == 1) found++;
+        }
+        lost += CAPTURE_BURSTS - found;
+    }
+    state.SetBytesProcessed(state.iterations() * length);
+    state.counters["frames_lost"] = (double)lost / state.iterations(); // of CAPTURE_BURSTS per pass
+    state.counters["discarded_per_gap"] = (double)decoder.discarded / CAPTURE_BURSTS;
+}
+BENCHMARK(BM_DecoderResync)->Arg(0)->Arg(16)->Arg(256)->Arg(1024);
+
+static void
+ignoreFrame (const unsigned char *frame, size_t length, int status, void *context)
+{
+    (void)frame; (void)length; (void)status; (void)context;
+}
+
+// an idle line: wall time is the 20 ms deadline, CPU time should be close to zero
+static void
+BM_RxEngineIdle (benchmark::State& state)
+{
+    struct bench_pty pty;
+    if (bench_openPty(&pty) != 0) { state.SkipWithError("no pty"); return; }
+    struct he100_rx_engine engine;
+    HE100_rxInit(&engine, pty.master);
+    HE100_rxRegister(&engine, HE100_RX_ANY_COMMAND, ignoreFrame, NULL);
+
+    for (auto _ : state) {
+        HE100_rxRun(&engine, 20);
+    }
+    state.counters["wakeups"] = engine.wakeups;
+    HE100_rxClose(&engine);
+    bench_closePty(&pty);
+}
+BENCHMARK(BM_RxEngineIdle)->Iterations(50);
+
+// one frame at a time: latency from the read that completed it to its callback
+static void
+BM_RxEngineLatency (benchmark::State& state)
+{
+    struct bench_pty pty;
+    if (bench_openPty(&pty) != 0) { state.SkipWithError("no pty"); return; }
+    struct he100_rx_engine engine;
+    HE100_rxInit(&engine, pty.master);
+    HE100_rxRegister(&engine, HE100_RX_ANY_COMMAND, ignoreFrame, NULL);
+
+    for (auto _ : state) {
+        bench_writeAll(pty.slave, bench_receive_frame, sizeof(bench_receive_frame));
+        if (HE100_rxRun(&engine, 1000) != 1) {
+            state.SkipWithError("lost a frame");
+            break;
+        }
+    }
+    state.counters["callback_latency_ns"] = engine.latency_samples ? (double)engine.latency_total / engine.latency_samples : 0;
+    state.counters["callback_latency_max_ns"] = engine.latency_max;
+    HE100_rxClose(&engine);
+    bench_closePty(&pty);
+}
+BENCHMARK(BM_RxEngineLatency);
+
+BENCHMARK_MAIN();
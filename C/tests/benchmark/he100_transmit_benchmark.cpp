@@ -0,0 +1,129 @@
+/*
+ * Compares the copy transmit path, where HE100_dispatchTransmission zeroes a
+ * MAX_FRAME_LENGTH array and HE100_prepareTransmission copies the payload into
+ * it, with the scatter-gather path that writes header, payload buffers and
+ * trailer with one writev.
+ *
+ * The payload is given as two buffers, a message header and its body, so the
+ * copy path also pays for joining them, as a caller of HE100_transmitData has to.
+ *
+ * Frames are written to /dev/null so the device costs nothing; the Prepare
+ * benchmarks leave the write out altogether.
+ */
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <SC_he100.h>
+
+#define MESSAGE_HEADER_LENGTH 16 // e.g. an AX.25 address block in front of the body
+
+static unsigned char message[MAX_FRAME_LENGTH];
+static unsigned char transmit_data_command[2] = {CMD_TRANSMIT, CMD_TRANSMIT_DATA};
+
+static void
+fillMessage (void)
+{
+    size_t i;
+    for (i=0; i<sizeof(message); i++) message[i] = (unsigned char)(i*7 + 3);
+}
+
+// the payload as the caller holds it: a message header and a separate body
+static void
+splitMessage (struct iovec *parts, size_t length)
+{
+    size_t header_length = length < MESSAGE_HEADER_LENGTH ? length : MESSAGE_HEADER_LENGTH;
+    parts[0].iov_base = message;
+    parts[0].iov_len = header_length;
+    parts[1].iov_base = message + 128; // not adjacent to the header
+    parts[1].iov_len = length - header_length;
+}
+
+static void
+BM_CopyPrepare (benchmark::State& state)
+{
+    fillMessage();
+    size_t length = state.range(0);
+    struct iovec parts[2];
+    splitMessage(parts, length);
+
+    for (auto _ : state) {
+        unsigned char joined[MAX_FRAME_LENGTH];
+        memcpy(joined, parts[0].iov_base, parts[0].iov_len);
+        memcpy(joined+parts[0].iov_len, parts[1].iov_base, parts[1].iov_len);
+        unsigned char transmission[MAX_FRAME_LENGTH] = {0};
+        memset (transmission,'\0',MAX_FRAME_LENGTH);
+        HE100_prepareTransmission(joined, transmission, length, transmit_data_command);
+        benchmark::DoNotOptimize(transmission);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * length);
+}
+BENCHMARK(BM_CopyPrepare)->Arg(16)->Arg(26)->Arg(MAX_TESTED_FRAME)->Arg(MAX_FRAME_LENGTH-WRAPPER_LENGTH);
+
+static void
+BM_ScatterGatherPrepare (benchmark::State& state)
+{
+    fillMessage();
+    size_t length = state.range(0);
+    struct iovec parts[2];
+    splitMessage(parts, length);
+
+    for (auto _ : state) {
+        unsigned char header[HE_FIRST_PAYLOAD_BYTE];
+        unsigned char trailer[2];
+        HE100_prepareTransmissionv(parts, 2, transmit_data_command, header, trailer);
+        benchmark::DoNotOptimize(header);
+        benchmark::DoNotOptimize(trailer);
+    }
+    state.SetBytesProcessed(state.iterations() * length);
+}
+BENCHMARK(BM_ScatterGatherPrepare)->Arg(16)->Arg(26)->Arg(MAX_TESTED_FRAME)->Arg(MAX_FRAME_LENGTH-WRAPPER_LENGTH);
+
+static void
+BM_CopyTransmit (benchmark::State& state)
+{
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd < 0) { state.SkipWithError("no /dev/null"); return; }
+    fillMessage();
+    size_t length = state.range(0);
+    struct iovec parts[2];
+    splitMessage(parts, length);
+
+    for (auto _ : state) {
+        unsigned char joined[MAX_FRAME_LENGTH];
+        memcpy(joined, parts[0].iov_base, parts[0].iov_len);
+        memcpy(joined+parts[0].iov_len, parts[1].iov_base, parts[1].iov_len);
+        unsigned char transmission[MAX_FRAME_LENGTH] = {0};
+        memset (transmission,'\0',MAX_FRAME_LENGTH);
+        HE100_prepareTransmission(joined, transmission, length, transmit_data_command);
+        HE100_writeFrame(fd, transmission, length+WRAPPER_LENGTH);
+    }
+    state.SetBytesProcessed(state.iterations() * (length+WRAPPER_LENGTH));
+    close(fd);
+}
+BENCHMARK(BM_CopyTransmit)->Arg(16)->Arg(26)->Arg(MAX_TESTED_FRAME)->Arg(MAX_FRAME_LENGTH-WRAPPER_LENGTH);
+
+static void
+BM_ScatterGatherTransmit (benchmark::State& state)
+{
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd < 0) { state.SkipWithError("no /dev/null"); return; }
+    fillMessage();
+    size_t length = state.range(0);
+    struct iovec parts[2];
+    splitMessage(parts, length);
+
+    for (auto _ : state) {
+        unsigned char header[HE_FIRST_PAYLOAD_BYTE];
+        unsigned char trailer[2];
+        HE100_prepareTransmissionv(parts, 2, transmit_data_command, header, trailer);
+        HE100_writeFramev(fd, header, parts, 2, trailer);
+    }
+    state.SetBytesProcessed(state.iterations() * (length+WRAPPER_LENGTH));
+    close(fd);
+}
+BENCHMARK(BM_ScatterGatherTransmit)->Arg(16)->Arg(26)->Arg(MAX_TESTED_FRAME)->Arg(MAX_FRAME_LENGTH-WRAPPER_LENGTH);
+
+BENCHMARK_MAIN();
@@ -1,7 +1,30 @@
 #include "gtest/gtest.h"
 #include <stdio.h>
 #include <fcntl.h>
+#include <termios.h>
+#include <pthread.h>
+#include <poll.h>
 #include <SC_he100.h>       /* Helium 100 Definitions */
+#include <SC_he100-decoder.h>
+#include <SC_he100-rx.h>
+#include <SC_he100-pipeline.h>
+#include <SC_he100-checksum.h>
+#include <SC_he100-trace.h>
+#include <SC_he100-fragment.h>
+#include <SC_he100-handle.h>
+#include <SC_he100-stats.h>
+#include <SC_he100-frames.h>
+#include <SC_he100-telemetry.h>
+#include <SC_he100-firmware.h>
+#include <SC_he100-capture.h>
+#include <SC_he100-ax25.h>
+#include <SC_he100-scheduler.h>
+#include <SC_he100-rto.h>
+#include <SC_he100-demux.h>
+#include <SC_he100-recovery.h>
+#include <SC_he100-baud.h>
+#include <SC_he100-adapt.h>
+#include "he100_sim.h"
 #include <timer.h>
 #include <fletcher.h>
 #include <Date.h>
@@ -34,6 +57,25 @@ class Helium_100_Test : public ::testing::Test
     //unsigned char setcfg_ack[8]     = {0x48,0x65,0x20,0x06,0x0A,0x0A,0x3A,0xB0};
 };
 
+// open a pseudo terminal pair in raw mode to stand in for the serial device,
+// otherwise the line discipline turns the 0x0a of an ack into 0x0d 0x0a
+static int
+openRawPty (int *pdm, int *pds)
+{
+    *pdm = open("/dev/ptmx", O_RDWR | O_NOCTTY);
+    if (*pdm < 0) return -1;
+    grantpt(*pdm);
+    unlockpt(*pdm);
+    *pds = open(ptsname(*pdm), O_RDWR | O_NOCTTY);
+    if (*pds < 0) return -1;
+
+    struct termios settings;
+    tcgetattr(*pds, &settings);
+    cfmakeraw(&settings);
+    tcsetattr(*pds, TCSANOW, &settings);
+    return 0;
+}
+
 TEST_F(Helium_100_Test, ReadTest) 
 {
     Shakespeare::log_shorthand(LOG_PATH, Shakespeare::NOTICE, PROCESS, "ReadTest");
@@ -76,12 +118,1676 @@ TEST_F(Helium_100_Test, ReadTest)
 
     // flush and close the pseudo serial devices
     fsync(pdm);fsync(pds);
-    close(pdm);close(pds);
+    HE100_closePort(pdm);close(pds);
 
     // final check to make sure read returns successfully
     ASSERT_EQ(26,r);
 }
 
+// This test verifies that the fd functions keep each fd's bytes apart: half
+// a frame read on one fd survives reads on another
+TEST_F(Helium_100_Test, ReadTwoFdsInTurn)
+{
+    unsigned char mock_bytes[36] = {0x48,0x65,0x20,0x04,0x00,0x1a,0x3e,0xa6,0x86,0xa2,0x40,0x40,0x40,0x40,0x60,0xac,0x8a,0x64,0x86,0xaa,0x82,0xe1,0x03,0xf0,0x6b,0x65,0x6e,0x77,0x6f,0x6f,0x64,0x0d,0x8d,0x08,0x63,0x9f};
+
+    int pdm[2], pds[2];
+    ASSERT_EQ(0, openRawPty(&pdm[0], &pds[0]));
+    ASSERT_EQ(0, openRawPty(&pdm[1], &pds[1]));
+
+    unsigned char payload[CS1_MAX_FRAME_SIZE] = {0};
+    int i;
+    for (i=0; i<2; i++) {
+        ASSERT_EQ(20, write(pds[i], mock_bytes, 20));
+        ASSERT_EQ(-1, HE100_read(pdm[i], 1, payload));
+    }
+    for (i=0; i<2; i++) {
+        ASSERT_EQ(16, write(pds[i], mock_bytes+20, 16));
+        ASSERT_EQ(26, HE100_read(pdm[i], 1, payload));
+        ASSERT_EQ(0, memcmp(mock_bytes+8, payload, 26));
+    }
+    HE100_Handle *handles[HE100_LEGACY_HANDLES+1];
+    handles[0] = HE100_legacyHandle(pdm[0]);
+    handles[1] = HE100_legacyHandle(pdm[1]);
+    ASSERT_NE(handles[0], handles[1]);
+    for (i=0; i<2; i++) HE100_legacyPut(handles[i]);
+
+    // half a frame, then the fd is closed without a word and another device
+    // opened on it: the new one starts afresh
+    ASSERT_EQ(20, write(pds[0], mock_bytes, 20));
+    ASSERT_EQ(-1, HE100_read(pdm[0], 1, payload));
+    int other_pdm, other_pds;
+    ASSERT_EQ(0, openRawPty(&other_pdm, &other_pds));
+    close(pds[0]);close(pdm[0]);
+    ASSERT_EQ(pdm[0], dup2(other_pds, pdm[0]));
+    close(other_pds);
+    ASSERT_EQ(36, write(other_pdm, mock_bytes, 36));
+    ASSERT_EQ(26, HE100_read(pdm[0], 1, payload));
+    ASSERT_EQ(0, memcmp(mock_bytes+8, payload, 26));
+    pds[0] = other_pdm;
+
+    // a handle some call is using is never given to another fd
+    int fds[HE100_LEGACY_HANDLES+1];
+    for (i=0; i<HE100_LEGACY_HANDLES+1; i++) {
+        fds[i] = open("/dev/null", O_RDWR);
+        ASSERT_GE(fds[i], 0);
+    }
+    for (i=0; i<HE100_LEGACY_HANDLES; i++) ASSERT_TRUE((handles[i] = HE100_legacyHandle(fds[i])) != NULL);
+    ASSERT_TRUE(HE100_legacyHandle(fds[HE100_LEGACY_HANDLES]) == NULL);
+    HE100_legacyPut(handles[0]);
+    ASSERT_TRUE((handles[0] = HE100_legacyHandle(fds[HE100_LEGACY_HANDLES])) != NULL);
+    for (i=0; i<HE100_LEGACY_HANDLES; i++) HE100_legacyPut(handles[i]);
+    for (i=0; i<HE100_LEGACY_HANDLES+1; i++) ASSERT_EQ(0, HE100_closePort(fds[i]));
+
+    for (i=0; i<2; i++) {
+        HE100_closePort(pdm[i]);close(pds[i]);
+    }
+}
+
+// This test verifies that HE100_read hands back every frame delivered by a
+// single bulk read, one per call, without losing the bytes that follow a frame
+TEST_F(Helium_100_Test, ReadBackToBackFrames)
+{
+    unsigned char mock_bytes[44] = {
+        0x48,0x65,0x20,0x01,0x0a,0x0a,0x35,0xa1, // noop ack
+        0x48,0x65,0x20,0x04,0x00,0x1a,0x3e,0xa6,0x86,0xa2,0x40,0x40,0x40,0x40,0x60,0xac,0x8a,0x64,0x86,0xaa,0x82,0xe1,0x03,0xf0,0x6b,0x65,0x6e,0x77,0x6f,0x6f,0x64,0x0d,0x8d,0x08,0x63,0x9f
+    };
+
+    int pdm, pds;
+    ASSERT_EQ(0, openRawPty(&pdm, &pds));
+
+    ASSERT_EQ(44, write(pds, mock_bytes, 44));
+
+    unsigned char payload[CS1_MAX_FRAME_SIZE] = {0};
+    ASSERT_EQ(0, HE100_read(pdm, 2, payload)); // the ack carries no payload
+    ASSERT_EQ(26, HE100_read(pdm, 2, payload));
+    for (z=0; z<26; z++) {
+        ASSERT_EQ(mock_bytes[16+z], payload[z]);
+    }
+
+    HE100_closePort(pdm);close(pds);
+}
+
+struct RxCount {
+    int frames;
+    int failures;
+    int receive_data;
+};
+
+static void
+countFrame (const unsigned char *frame, size_t length, int status, void *context)
+{
+    struct RxCount *count = (struct RxCount *)context;
+    (void)length;
+    count->frames++;
+    if (status != 0) count->failures++;
+    if (frame[HE_CMD_BYTE] == CMD_RECEIVE_DATA) count->receive_data++;
+}
+
+// This test checks that the receive engine sleeps through an idle line until
+// its deadline, then delivers every frame of a burst to the right callbacks
+TEST_F(Helium_100_Test, RxEngineCallbacks)
+{
+    unsigned char mock_bytes[44] = {
+        0x48,0x65,0x20,0x01,0x0a,0x0a,0x35,0xa1, // noop ack
+        0x48,0x65,0x20,0x04,0x00,0x1a,0x3e,0xa6,0x86,0xa2,0x40,0x40,0x40,0x40,0x60,0xac,0x8a,0x64,0x86,0xaa,0x82,0xe1,0x03,0xf0,0x6b,0x65,0x6e,0x77,0x6f,0x6f,0x64,0x0d,0x8d,0x08,0x63,0x9f
+    };
+    int pdm, pds;
+    ASSERT_EQ(0, openRawPty(&pdm, &pds));
+
+    struct he100_rx_engine engine;
+    ASSERT_EQ(HE_SUCCESS, HE100_rxInit(&engine, pdm));
+    struct RxCount all = {0,0,0};
+    struct RxCount data = {0,0,0};
+    ASSERT_EQ(HE_SUCCESS, HE100_rxRegister(&engine, HE100_RX_ANY_COMMAND, countFrame, &all));
+    ASSERT_EQ(HE_SUCCESS, HE100_rxRegister(&engine, CMD_RECEIVE_DATA, countFrame, &data));
+
+    // idle line: nothing delivered, and no spinning while we wait
+    uint64_t before = HE100_monotonicNs();
+    ASSERT_EQ(0, HE100_rxRun(&engine, 50));
+    ASSERT_LE(50000000u, HE100_monotonicNs() - before);
+    ASSERT_EQ(0u, engine.wakeups);
+
+    ASSERT_EQ(44, write(pds, mock_bytes, 44));
+    int delivered = 0;
+    while (delivered < 2) {
+        int r = HE100_rxRun(&engine, 1000);
+        ASSERT_LT(0, r);
+        delivered += r;
+    }
+    ASSERT_EQ(2, all.frames);
+    ASSERT_EQ(0, all.failures);
+    ASSERT_EQ(1, all.receive_data);
+    ASSERT_EQ(1, data.frames);
+    ASSERT_EQ(2u, engine.latency_samples);
+    ASSERT_GE(engine.latency_max, engine.latency_last);
+
+    HE100_rxClose(&engine);
+    close(pdm);close(pds);
+}
+
+// This test feeds the decoder several frames at once, split at awkward
+// boundaries and surrounded by noise, and expects every frame back in order
+TEST_F(Helium_100_Test, DecoderMultipleFrames)
+{
+    unsigned char ack[8] = {0x48,0x65,0x20,0x03,0x0a,0x0a,0x37,0xa7};
+    unsigned char data[36] = {0x48,0x65,0x20,0x04,0x00,0x1a,0x3e,0xa6,0x86,0xa2,0x40,0x40,0x40,0x40,0x60,0xac,0x8a,0x64,0x86,0xaa,0x82,0xe1,0x03,0xf0,0x6b,0x65,0x6e,0x77,0x6f,0x6f,0x64,0x0d,0x8d,0x08,0x63,0x9f};
+    unsigned char noise[3] = {0x00,0x13,0x37};
+
+    struct he100_decoder decoder;
+    HE100_decoderInit(&decoder);
+
+    unsigned char stream[HE100_DECODER_RING_SIZE];
+    size_t stream_length = 0;
+    memcpy(stream+stream_length, noise, 3); stream_length += 3;
+    memcpy(stream+stream_length, ack, 8); stream_length += 8;
+    memcpy(stream+stream_length, data, 36); stream_length += 36;
+    memcpy(stream+stream_length, noise, 3); stream_length += 3;
+    memcpy(stream+stream_length, data, 36); stream_length += 36;
+
+    unsigned char frame[HE100_MAX_WIRE_FRAME];
+    size_t frame_length = 0;
+    size_t lengths[3] = {8,36,36};
+    unsigned char *expected[3] = {ack,data,data};
+    int found = 0;
+
+    // run the stream through the ring several times so frames wrap around its end
+    int pass;
+    for (pass=0; pass<40; pass++) {
+        size_t fed = 0;
+        while (fed < stream_length) {
+            size_t chunk = (stream_length - fed) < 7 ? (stream_length - fed) : 7;
+            ASSERT_EQ(chunk, HE100_decoderFeed(&decoder, stream+fed, chunk));
+            fed += chunk;
+            while (HE100_decoderNext(&decoder, frame, &frame_length) == 1) {
+                ASSERT_EQ(lengths[found%3], frame_length);
+                ASSERT_EQ(0, memcmp(expected[found%3], frame, frame_length));
+                ASSERT_EQ(0, HE100_validateFrame(frame, frame_length));
+                found++;
+            }
+        }
+    }
+    ASSERT_EQ(3*40, found);
+    ASSERT_EQ(0u, HE100_decoderPending(&decoder));
+}
+
+struct TxOutcome {
+    int calls;
+    int status[8];
+};
+
+static void
+recordOutcome (int status, const unsigned char *response, size_t length, void *context)
+{
+    struct TxOutcome *outcome = (struct TxOutcome *)context;
+    (void)response; (void)length;
+    outcome->status[outcome->calls++] = status;
+}
+
+// This test submits several frames before any ACK arrives, then answers them
+// in one burst: two ACKs and a NACK, leaving the fourth frame to time out
+TEST_F(Helium_100_Test, PipelineCorrelatesAcks)
+{
+    unsigned char acks[24] = {
+        0x48,0x65,0x20,0x03,0x0a,0x0a,0x37,0xa7, // transmit data ack
+        0x48,0x65,0x20,0x03,0x0a,0x0a,0x37,0xa7, // transmit data ack
+        0x48,0x65,0x20,0x03,0xff,0xff,0x21,0x86  // transmit data nack
+    };
+    unsigned char payload[4] = {0x31,0x32,0x33,0x34};
+    int pdm, pds;
+    ASSERT_EQ(0, openRawPty(&pdm, &pds));
+
+    struct he100_pipeline pipeline;
+    ASSERT_EQ(HE_SUCCESS, HE100_pipelineInit(&pipeline, pdm, 4));
+    pipeline.ack_timeout_ms = 100;
+
+    struct TxOutcome outcome;
+    memset(&outcome, 0, sizeof(outcome));
+    int i;
+    for (i=0; i<4; i++) {
+        ASSERT_EQ(HE_SUCCESS, HE100_pipelineTransmitData(&pipeline, payload, 4, recordOutcome, &outcome));
+    }
+    ASSERT_EQ(4, pipeline.in_flight);
+    ASSERT_EQ(0, outcome.calls);
+
+    // all four frames are on the line before the first ACK
+    unsigned char written[4*(4+WRAPPER_LENGTH)];
+    size_t got = 0;
+    while (got < sizeof(written)) {
+        ssize_t n = read(pds, written+got, sizeof(written)-got);
+        ASSERT_GT(n, 0);
+        got += n;
+    }
+    ASSERT_EQ(0, HE100_validateFrame(written+3*(4+WRAPPER_LENGTH), 4+WRAPPER_LENGTH));
+
+    ASSERT_EQ(24, write(pds, acks, 24));
+    ASSERT_EQ(HE_SUCCESS, HE100_pipelineFlush(&pipeline));
+
+    ASSERT_EQ(4, outcome.calls);
+    ASSERT_EQ(HE_SUCCESS, outcome.status[0]);
+    ASSERT_EQ(HE_SUCCESS, outcome.status[1]);
+    ASSERT_EQ(HE_FAILED_NACK, outcome.status[2]);
+    ASSERT_EQ(HE_FAILED_ACK_TIMEOUT, outcome.status[3]);
+    ASSERT_EQ(2u, pipeline.acked);
+    ASSERT_EQ(1u, pipeline.nacked);
+    ASSERT_EQ(1u, pipeline.timed_out);
+
+    // waiting for ever still wakes for the ACK deadline of a frame in flight
+    ASSERT_EQ(HE_SUCCESS, HE100_pipelineTransmitData(&pipeline, payload, 4, recordOutcome, &outcome));
+    ASSERT_EQ(1, HE100_pipelinePoll(&pipeline, -1));
+    ASSERT_EQ(HE_FAILED_ACK_TIMEOUT, outcome.status[4]);
+
+    HE100_pipelineClose(&pipeline);
+    close(pdm);close(pds);
+}
+
+// This test sends a payload split over several buffers through writev and
+// expects the same bytes on the wire as the prepared, copied frame
+TEST_F(Helium_100_Test, ScatterGatherMatchesCopy)
+{
+    unsigned char helium_payload_bytes[26] = {0x86,0xA2,0x40,0x40,0x40,0x40,0x60,0xAC,0x8A,0x64,0x86,0xAA,0x82,0xE1,0x03,0xF0,0x6B,0x65,0x6E,0x77,0x6F,0x6F,0x64,0x0D,0x8D,0x08};
+    unsigned char transmit_command[2] = {CMD_TRANSMIT, CMD_TRANSMIT_DATA};
+    unsigned char noop_command[2] = {CMD_TRANSMIT, CMD_NOOP};
+    unsigned char copied[MAX_FRAME_LENGTH] = {0};
+    unsigned char sent[MAX_FRAME_LENGTH] = {0};
+
+    int pdm, pds;
+    ASSERT_EQ(0, openRawPty(&pdm, &pds));
+
+    // header and body kept apart, with an empty buffer between them
+    struct iovec parts[3] = {
+        {helium_payload_bytes, 7},
+        {helium_payload_bytes+7, 0},
+        {helium_payload_bytes+7, 19}
+    };
+    unsigned char header[HE_FIRST_PAYLOAD_BYTE];
+    unsigned char trailer[2];
+    ASSERT_EQ(26, HE100_prepareTransmissionv(parts, 3, transmit_command, header, trailer));
+    ASSERT_EQ(26+WRAPPER_LENGTH, HE100_writeFramev(pds, header, parts, 3, trailer));
+    ASSERT_EQ(26+WRAPPER_LENGTH, read(pdm, sent, MAX_FRAME_LENGTH));
+    ASSERT_EQ(0, HE100_prepareTransmission(helium_payload_bytes, copied, 26, transmit_command));
+    ASSERT_EQ(0, memcmp(copied, sent, 26+WRAPPER_LENGTH));
+    ASSERT_EQ(0, HE100_validateFrame(sent, 26+WRAPPER_LENGTH));
+
+    // empty payload commands keep their two trailing zero bytes
+    memset(copied, 0, MAX_FRAME_LENGTH);
+    ASSERT_EQ(0, HE100_prepareTransmissionv(NULL, 0, noop_command, header, trailer));
+    ASSERT_EQ(WRAPPER_LENGTH, HE100_writeFramev(pds, header, NULL, 0, trailer));
+    ASSERT_EQ(WRAPPER_LENGTH, read(pdm, sent, MAX_FRAME_LENGTH));
+    ASSERT_EQ(0, HE100_prepareTransmission(helium_payload_bytes, copied, 0, noop_command));
+    ASSERT_EQ(0, memcmp(copied, sent, WRAPPER_LENGTH));
+
+    close(pdm);close(pds);
+}
+
+// This test runs every checksum kernel this CPU supports over random buffers
+// of every length up to MAX_FRAME_LENGTH, whole and in random pieces, and
+// expects the sums fletcher_checksum16 gives
+TEST_F(Helium_100_Test, ChecksumKernelsMatchFletcher)
+{
+    unsigned char data[MAX_FRAME_LENGTH];
+    int selected = HE100_checksumKernel();
+    srand(1017);
+
+    int kernel;
+    for (kernel=0; kernel<HE100_CHECKSUM_KERNELS; kernel++) {
+        if (!HE100_checksumSupported(kernel)) continue;
+        ASSERT_EQ(HE_SUCCESS, HE100_checksumSelect(kernel));
+
+        int pass;
+        for (pass=0; pass<20; pass++) {
+            size_t length;
+            for (length=0; length<=MAX_FRAME_LENGTH; length++) {
+                size_t i;
+                for (i=0; i<length; i++) data[i] = (unsigned char)(pass == 0 ? 0xff : rand());
+
+                fletcher_checksum expected = fletcher_checksum16(data, length);
+                struct HE100_checksum whole = HE100_fletcher16(data, length);
+                ASSERT_EQ(expected.sum1, whole.sum1) << HE100_CHECKSUM_KERNEL_NAMES[kernel] << " " << length;
+                ASSERT_EQ(expected.sum2, whole.sum2) << HE100_CHECKSUM_KERNEL_NAMES[kernel] << " " << length;
+
+                struct HE100_checksum pieces = {0,0};
+                size_t done = 0;
+                while (done < length) {
+                    size_t piece = 1 + rand() % (length - done);
+                    HE100_fletcher16Update(&pieces, data+done, piece);
+                    done += piece;
+                }
+                ASSERT_EQ(expected.sum1, pieces.sum1) << HE100_CHECKSUM_KERNEL_NAMES[kernel] << " " << length;
+                ASSERT_EQ(expected.sum2, pieces.sum2) << HE100_CHECKSUM_KERNEL_NAMES[kernel] << " " << length;
+            }
+        }
+    }
+    ASSERT_EQ(HE_SUCCESS, HE100_checksumSelect(selected));
+    ASSERT_EQ(-1, HE100_checksumSelect(HE100_CHECKSUM_KERNELS));
+}
+
+// This test corrupts a header checksum and a payload checksum. The bad header
+// must be dropped at its eighth byte, without waiting for the 36 bytes it
+// claims, and the bad payload must come back flagged without a second pass
+TEST_F(Helium_100_Test, DecoderRollingChecksum)
+{
+    unsigned char ack[8] = {0x48,0x65,0x20,0x03,0x0a,0x0a,0x37,0xa7};
+    unsigned char data[36] = {0x48,0x65,0x20,0x04,0x00,0x1a,0x3e,0xa6,0x86,0xa2,0x40,0x40,0x40,0x40,0x60,0xac,0x8a,0x64,0x86,0xaa,0x82,0xe1,0x03,0xf0,0x6b,0x65,0x6e,0x77,0x6f,0x6f,0x64,0x0d,0x8d,0x08,0x63,0x9f};
+    unsigned char frame[HE100_MAX_WIRE_FRAME];
+    size_t frame_length = 0;
+
+    struct he100_decoder decoder;
+    HE100_decoderInit(&decoder);
+
+    // only the header of a data frame, with its second checksum byte wrong, then an ack
+    unsigned char bad_header[8];
+    memcpy(bad_header, data, 8);
+    bad_header[HE_HEADER_CHECKSUM_BYTE_2] ^= 0x01;
+    HE100_decoderFeed(&decoder, bad_header, 8);
+    ASSERT_EQ(0, HE100_decoderNext(&decoder, frame, &frame_length));
+    ASSERT_EQ(1u, decoder.header_failures);
+    HE100_decoderFeed(&decoder, ack, 8);
+    ASSERT_EQ(1, HE100_decoderNext(&decoder, frame, &frame_length));
+    ASSERT_EQ(8u, frame_length);
+    ASSERT_EQ(HE_SUCCESS, decoder.status);
+    ASSERT_EQ(0, memcmp(ack, frame, 8));
+
+    // a payload byte flipped: delivered whole, but flagged
+    unsigned char bad_payload[36];
+    memcpy(bad_payload, data, 36);
+    bad_payload[20] ^= 0x40;
+    HE100_decoderFeed(&decoder, bad_payload, 36);
+    ASSERT_EQ(1, HE100_decoderNext(&decoder, frame, &frame_length));
+    ASSERT_EQ(36u, frame_length);
+    ASSERT_EQ(HE_FAILED_CHECKSUM, decoder.status);
+    ASSERT_EQ(HE_FAILED_CHECKSUM, HE100_validateDecodedFrame(frame, frame_length, decoder.status));
+    ASSERT_EQ(HE_FAILED_CHECKSUM, HE100_validateFrame(frame, frame_length));
+    ASSERT_EQ(1u, decoder.payload_failures);
+
+    // the next good frame is not affected
+    HE100_decoderFeed(&decoder, data, 36);
+    ASSERT_EQ(1, HE100_decoderNext(&decoder, frame, &frame_length));
+    ASSERT_EQ(HE_SUCCESS, decoder.status);
+    ASSERT_EQ(0, HE100_validateDecodedFrame(frame, frame_length, decoder.status));
+    ASSERT_EQ(0u, HE100_decoderPending(&decoder));
+}
+
+struct TraceCollect {
+    int events;
+    int acks;
+    int per_thread[4];
+    struct he100_trace_event last;
+};
+
+static void
+collectTrace (const struct he100_trace_event *event, void *context)
+{
+    struct TraceCollect *collect = (struct TraceCollect *)context;
+    collect->events++;
+    if (event->id == HE100_TRACE_ACK) collect->acks++;
+    if (event->id == HE100_TRACE_TX_PREPARED && event->arg[0] < 4) collect->per_thread[event->arg[0]]++;
+    collect->last = *event;
+}
+
+static pthread_barrier_t trace_barrier;
+
+static void *
+traceFromThread (void *arg)
+{
+    uint32_t thread = (uint32_t)(uintptr_t)arg;
+    int i;
+    for (i=0; i<500; i++) HE100_trace(HE100_TRACE_TX_PREPARED, thread, i, 0, 0, 0);
+    // stay alive until all have recorded, a thread that exits hands its ring on
+    pthread_barrier_wait(&trace_barrier);
+    return NULL;
+}
+
+// Acknowledgements are recorded in binary and only turned into text when
+// drained; events from several threads all arrive, and a full ring drops
+TEST_F(Helium_100_Test, TraceRecordsAndDrains)
+{
+    struct TraceCollect collect;
+    memset(&collect, 0, sizeof(collect));
+    // logged as they happen until recording is asked for
+    HE100_trace(HE100_TRACE_NACK, CMD_TRANSMIT_DATA, 0, 0, 0, 0);
+    ASSERT_EQ(0, HE100_traceDrain(collectTrace, &collect));
+    HE100_traceEnable(1);
+    memset(&collect, 0, sizeof(collect));
+
+    unsigned char ack[8] = {0x48,0x65,0x20,0x03,0x0a,0x0a,0x37,0xa7};
+    ASSERT_EQ(0, HE100_validateFrame(ack, 8));
+    ASSERT_EQ(1, HE100_traceDrain(collectTrace, &collect));
+    ASSERT_EQ(HE100_TRACE_ACK, collect.last.id);
+    ASSERT_EQ(CMD_TRANSMIT_DATA, collect.last.arg[0]);
+
+    char line[CS1_MAX_LOG_ENTRY];
+    HE100_traceFormat(&collect.last, line, sizeof(line));
+    ASSERT_STREQ("ACK>CMD_TRANSMIT_DATA:HE100_validateDecodedFrame", line);
+
+    unsigned char frame[20];
+    int i;
+    for (i=0; i<20; i++) frame[i] = (unsigned char)(0xa0+i);
+    HE100_traceFrame(frame, 20);
+    ASSERT_EQ(2, HE100_traceDrain(collectTrace, &collect));
+    HE100_traceFormat(&collect.last, line, sizeof(line));
+    ASSERT_STREQ("Prepared payload+16: B0 B1 B2 B3", line);
+
+    memset(&collect, 0, sizeof(collect));
+    pthread_t threads[4];
+    pthread_barrier_init(&trace_barrier, NULL, 4);
+    for (i=0; i<4; i++) pthread_create(&threads[i], NULL, traceFromThread, (void *)(uintptr_t)i);
+    for (i=0; i<4; i++) pthread_join(threads[i], NULL);
+    pthread_barrier_destroy(&trace_barrier);
+    ASSERT_EQ(2000, HE100_traceDrain(collectTrace, &collect));
+    for (i=0; i<4; i++) ASSERT_EQ(500, collect.per_thread[i]);
+
+    uint64_t dropped = HE100_traceDropped();
+    for (i=0; i<HE100_TRACE_RING_EVENTS+10; i++) HE100_trace(HE100_TRACE_ACK, 3, 0, 0, 0, 0);
+    ASSERT_EQ(dropped+10, HE100_traceDropped());
+    memset(&collect, 0, sizeof(collect));
+    ASSERT_EQ(HE100_TRACE_RING_EVENTS, HE100_traceDrain(collectTrace, &collect));
+
+    HE100_traceEnable(0);
+    HE100_trace(HE100_TRACE_ACK, 3, 0, 0, 0, 0);
+    ASSERT_EQ(0, HE100_traceDrain(collectTrace, &collect));
+}
+
+struct MessageOutcome {
+    int calls;
+    int status;
+    uint16_t message_id;
+    unsigned char message[HE100_FRAGMENT_MAX_MESSAGE];
+    size_t length;
+    uint32_t missing[HE100_FRAGMENT_BITMAP_WORDS];
+};
+
+static void
+recordMessage (int status, uint16_t message_id, const unsigned char *message, size_t length, const uint32_t *missing, void *context)
+{
+    struct MessageOutcome *outcome = (struct MessageOutcome *)context;
+    outcome->calls++;
+    outcome->status = status;
+    outcome->message_id = message_id;
+    outcome->length = length;
+    if (message != NULL) memcpy(outcome->message, message, length);
+    memcpy(outcome->missing, missing, sizeof(outcome->missing));
+}
+
+// build the fragment the sender would put in a frame, as one buffer
+static size_t
+joinFragment (const unsigned char *message, size_t length, uint16_t message_id, int index, unsigned char *fragment)
+{
+    struct iovec slice;
+    if (HE100_fragmentPrepare(message, length, message_id, index, fragment, &slice) != HE_SUCCESS) return 0;
+    memcpy(fragment+HE100_FRAGMENT_HEADER, slice.iov_base, slice.iov_len);
+    return HE100_FRAGMENT_HEADER + slice.iov_len;
+}
+
+// A 1000 byte message is split into frames filled to MAX_TESTED_FRAME and put
+// back together out of order; a message missing a fragment times out and
+// reports which one
+TEST_F(Helium_100_Test, FragmentReassembly)
+{
+    static struct MessageOutcome outcome;
+    static struct he100_reassembly reassembly;
+    memset(&outcome, 0, sizeof(outcome));
+    HE100_reassemblyInit(&reassembly, 50, recordMessage, &outcome);
+
+    unsigned char message[1000];
+    size_t i;
+    for (i=0; i<sizeof(message); i++) message[i] = (unsigned char)(i*13 + 5);
+    ASSERT_EQ(6, HE100_fragmentCount(sizeof(message)));
+    ASSERT_EQ(-1, HE100_fragmentCount(HE100_FRAGMENT_MAX_MESSAGE+1));
+
+    unsigned char fragment[MAX_TESTED_FRAME];
+    int order[7] = {5, 0, 3, 3, 1, 4, 2}; // one duplicate
+    for (i=0; i<7; i++) {
+        size_t length = joinFragment(message, sizeof(message), 0x1234, order[i], fragment);
+        ASSERT_EQ(order[i] == 5 ? (size_t)HE100_FRAGMENT_HEADER + 1000 - 5*HE100_FRAGMENT_DATA : (size_t)MAX_TESTED_FRAME, length);
+        ASSERT_EQ(i == 6 ? 1 : HE_SUCCESS, HE100_reassemblyAccept(&reassembly, fragment, length));
+    }
+    ASSERT_EQ(1, outcome.calls);
+    ASSERT_EQ(HE_SUCCESS, outcome.status);
+    ASSERT_EQ(0x1234, outcome.message_id);
+    ASSERT_EQ(sizeof(message), outcome.length);
+    ASSERT_EQ(0, memcmp(message, outcome.message, sizeof(message)));
+    ASSERT_EQ(1u, reassembly.duplicates);
+
+    // fragment 0 again once the message is delivered: a duplicate, not a new
+    // message that would later time out
+    uint32_t missing[HE100_FRAGMENT_BITMAP_WORDS];
+    size_t length = joinFragment(message, sizeof(message), 0x1234, 0, fragment);
+    ASSERT_EQ(HE_SUCCESS, HE100_reassemblyAccept(&reassembly, fragment, length));
+    ASSERT_EQ(2u, reassembly.duplicates);
+    ASSERT_EQ(-1, HE100_reassemblyMissing(&reassembly, 0x1234, missing));
+    usleep(60000);
+    ASSERT_EQ(0, HE100_reassemblyExpire(&reassembly));
+    ASSERT_EQ(1, outcome.calls);
+
+    // the last fragment through a received frame, AX.25 header in front
+    unsigned char ax25[HE100_AX25_HEADER_LENGTH] = {0x86,0xa2,0x40,0x40,0x40,0x40,0x60,0xac,0x8a,0x64,0x86,0xaa,0x82,0xe1,0x03,0xf0};
+    unsigned char receive_data_command[2] = {CMD_RECEIVE, CMD_RECEIVE_DATA};
+    unsigned char frame[HE100_MAX_WIRE_FRAME];
+    struct iovec payload[2];
+    payload[0].iov_base = ax25;
+    payload[0].iov_len = sizeof(ax25);
+    payload[1].iov_base = fragment;
+    payload[1].iov_len = joinFragment(message, 200, 7, 1, fragment);
+    int payload_length = HE100_prepareTransmissionv(payload, 2, receive_data_command, frame, frame+HE_FIRST_PAYLOAD_BYTE+sizeof(ax25)+payload[1].iov_len);
+    memcpy(frame+HE_FIRST_PAYLOAD_BYTE, ax25, sizeof(ax25));
+    memcpy(frame+HE_FIRST_PAYLOAD_BYTE+sizeof(ax25), fragment, payload[1].iov_len);
+    ASSERT_EQ(HE_SUCCESS, HE100_reassemblyFrame(&reassembly, frame, payload_length+WRAPPER_LENGTH));
+
+    ASSERT_EQ(HE_SUCCESS, HE100_reassemblyMissing(&reassembly, 7, missing));
+    ASSERT_EQ(0x1u, missing[0]);
+
+    // fragment 0 never comes
+    usleep(60000);
+    ASSERT_EQ(1, HE100_reassemblyExpire(&reassembly));
+    ASSERT_EQ(2, outcome.calls);
+    ASSERT_EQ(HE_FAILED_REASSEMBLY_TIMEOUT, outcome.status);
+    ASSERT_EQ(7, outcome.message_id);
+    ASSERT_EQ(0x1u, outcome.missing[0]);
+    ASSERT_EQ(-1, HE100_reassemblyMissing(&reassembly, 7, missing));
+
+    // a sender restarted from id 0 right after its message 0 was delivered:
+    // late fragments within the timeout are duplicates, a new message after it is not
+    length = joinFragment(message, 100, 0, 0, fragment);
+    ASSERT_EQ(1, HE100_reassemblyAccept(&reassembly, fragment, length));
+    ASSERT_EQ(3, outcome.calls);
+    ASSERT_EQ(HE_SUCCESS, HE100_reassemblyAccept(&reassembly, fragment, length));
+    ASSERT_EQ(3, outcome.calls);
+    usleep(60000);
+    length = joinFragment(message+100, 100, 0, 0, fragment);
+    ASSERT_EQ(1, HE100_reassemblyAccept(&reassembly, fragment, length));
+    ASSERT_EQ(4, outcome.calls);
+    ASSERT_EQ(0, outcome.message_id);
+    ASSERT_EQ(100u, outcome.length);
+    ASSERT_EQ(0, memcmp(message+100, outcome.message, 100));
+
+    // not a fragment
+    ASSERT_EQ(HE_INVALID_FRAGMENT, HE100_reassemblyAccept(&reassembly, message, 100));
+}
+
+struct RadioThread {
+    HE100_Handle handle;
+    int result;
+};
+
+static void *
+transmitFromThread (void *arg)
+{
+    struct RadioThread *radio = (struct RadioThread *)arg;
+    unsigned char payload[4] = {0x31,0x32,0x33,0x34};
+    int i;
+    radio->result = HE_SUCCESS;
+    for (i=0; i<50 && radio->result == HE_SUCCESS; i++) {
+        radio->result = HE100_handleTransmitData(&radio->handle, payload, 4);
+    }
+    return NULL;
+}
+
+// Two radios driven from two threads at once, each through its own handle;
+// a NACK is reported to the caller without the legacy soft reset
+TEST_F(Helium_100_Test, HandlesRunInParallel)
+{
+    unsigned char ack[8] = {0x48,0x65,0x20,0x03,0x0a,0x0a,0x37,0xa7};
+    unsigned char nack[8] = {0x48,0x65,0x20,0x03,0xff,0xff,0x21,0x86};
+    int pdm[2], pds[2];
+    static struct RadioThread radios[2];
+    pthread_t threads[2];
+    int i, j;
+
+    for (i=0; i<2; i++) {
+        ASSERT_EQ(0, openRawPty(&pdm[i], &pds[i]));
+        ASSERT_EQ(HE_SUCCESS, HE100_handleInit(&radios[i].handle, pdm[i]));
+        // every ACK is waiting before the first frame goes out
+        for (j=0; j<50; j++) ASSERT_EQ(8, write(pds[i], ack, 8));
+    }
+    for (i=0; i<2; i++) pthread_create(&threads[i], NULL, transmitFromThread, &radios[i]);
+    for (i=0; i<2; i++) pthread_join(threads[i], NULL);
+
+    for (i=0; i<2; i++) {
+        ASSERT_EQ(HE_SUCCESS, radios[i].result);
+        ASSERT_EQ(50u, radios[i].handle.stats.commands);
+        ASSERT_EQ(50u, radios[i].handle.stats.acks);
+        ASSERT_EQ(50u*(4+WRAPPER_LENGTH), radios[i].handle.stats.bytes_written);
+        ASSERT_EQ(0u, HE100_decoderPending(&radios[i].handle.decoder));
+    }
+
+    // drain what was written, then answer with a NACK
+    unsigned char written[50*(4+WRAPPER_LENGTH)];
+    size_t got = 0;
+    while (got < sizeof(written)) {
+        ssize_t n = read(pds[0], written+got, sizeof(written)-got);
+        ASSERT_GT(n, 0);
+        got += n;
+    }
+    ASSERT_EQ(8, write(pds[0], nack, 8));
+    ASSERT_EQ(-1, HE100_handleRead(&radios[0].handle, 1, NULL));
+    ASSERT_EQ(HE_FAILED_NACK, radios[0].handle.status);
+    ASSERT_EQ(1u, radios[0].handle.stats.nacks);
+    ASSERT_EQ(0u, radios[0].handle.stats.soft_resets);
+    struct pollfd nothing_written = {pds[0], POLLIN, 0};
+    ASSERT_EQ(0, poll(&nothing_written, 1, 50));
+
+    for (i=0; i<2; i++) { close(pdm[i]); close(pds[i]); }
+}
+
+// The simulated radio: paced ACKs, the configuration, looped back data, a
+// NACK for a bad checksum and, powered off, the host's own frame echoed back
+TEST_F(Helium_100_Test, SimulatorAnswersCommands)
+{
+    struct he100_sim_options options = {9600, 9600, 0, 0.0, 0.0, 0, 0, 1, 0};
+    static struct he100_sim sim;
+    HE100_Handle handle;
+    ASSERT_EQ(HE_SUCCESS, HE100_simStart(&sim, &options));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleInit(&handle, sim.device));
+
+    // an 8 byte ACK takes over 8 ms at 9600 baud
+    uint64_t start = HE100_monotonicNs();
+    ASSERT_EQ(HE_SUCCESS, HE100_handleNOOP(&handle));
+    ASSERT_GE(HE100_monotonicNs() - start, 8000000u);
+    ASSERT_EQ(1u, handle.stats.acks);
+
+    struct he100_settings settings;
+    ASSERT_EQ(HE_SUCCESS, HE100_handleGetConfig(&handle, &settings));
+    ASSERT_EQ(CFG_IF_BAUD_9600, settings.interface_baud_rate);
+    ASSERT_EQ(0x87, settings.tx_power_amp_level);
+    ASSERT_EQ(HE_SUCCESS, HE100_handleFastSetPA(&handle, 0x20));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleGetConfig(&handle, &settings));
+    ASSERT_EQ(0x20, settings.tx_power_amp_level);
+
+    options.loopback = 1;
+    HE100_simConfigure(&sim, &options);
+    unsigned char data[4] = {0x74,0x65,0x73,0x74};
+    unsigned char received[MAX_FRAME_LENGTH];
+    ASSERT_EQ(HE_SUCCESS, HE100_handleTransmitData(&handle, data, 4));
+    ASSERT_EQ(HE100_AX25_HEADER_LENGTH+4, HE100_handleRead(&handle, 1, received));
+    ASSERT_EQ(CMD_RECEIVE_DATA, handle.response[HE_CMD_BYTE]);
+    ASSERT_EQ(0, memcmp(data, received+HE100_AX25_HEADER_LENGTH, 4));
+
+    // the payload checksum broken on the way to the radio
+    unsigned char command[2] = {CMD_TRANSMIT, CMD_TRANSMIT_DATA};
+    unsigned char frame[4+WRAPPER_LENGTH];
+    struct iovec payload = {data, 4};
+    ASSERT_EQ(4, HE100_prepareTransmissionv(&payload, 1, command, frame, frame+HE_FIRST_PAYLOAD_BYTE+4));
+    memcpy(frame+HE_FIRST_PAYLOAD_BYTE, data, 4);
+    frame[sizeof(frame)-1] ^= 0x01;
+    ASSERT_EQ((ssize_t)sizeof(frame), write(sim.device, frame, sizeof(frame)));
+    ASSERT_EQ(-1, HE100_handleRead(&handle, 1, NULL));
+    ASSERT_EQ(HE_FAILED_NACK, handle.status);
+
+    // the decoder drops the echoed frame, so the ACK never comes
+    options.echo = 1;
+    HE100_simConfigure(&sim, &options);
+    handle.policy.ack_timeout = 1;
+    uint64_t discarded = handle.decoder.discarded;
+    ASSERT_EQ(1, HE100_handleNOOP(&handle));
+    ASSERT_EQ(HE_FAILED_READ, handle.status);
+    ASSERT_GT(handle.decoder.discarded, discarded);
+
+    HE100_simStop(&sim);
+    struct he100_sim_stats stats = HE100_simStats(&sim);
+    ASSERT_EQ(6u, stats.frames_in);
+    ASSERT_EQ(1u, stats.bad_frames);
+    ASSERT_EQ(1u, stats.nacks);
+    ASSERT_EQ(0u, stats.dropped);
+}
+
+static void *
+recordLatencies (void *arg)
+{
+    int i;
+    for (i=0; i<10000; i++) HE100_statsLatency(CMD_TELEMETRY, 1000*(uint64_t)(i%100+1));
+    return arg;
+}
+
+// Counters per command from frames through the simulator and the decoder,
+// and percentiles off the latency histogram with two threads recording
+TEST_F(Helium_100_Test, StatsPerCommand)
+{
+    struct he100_sim_options options = {0, 0, 0, 0.0, 0.0, 0, 0, 1, 0};
+    static struct he100_sim sim;
+    static struct he100_stats_snapshot snapshot;
+    HE100_Handle handle;
+    unsigned char data[4] = {0x74,0x65,0x73,0x74};
+    int i;
+
+    HE100_statsReset();
+    ASSERT_EQ(HE_SUCCESS, HE100_simStart(&sim, &options));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleInit(&handle, sim.device));
+    for (i=0; i<3; i++) ASSERT_EQ(HE_SUCCESS, HE100_handleNOOP(&handle));
+    for (i=0; i<2; i++) ASSERT_EQ(HE_SUCCESS, HE100_handleTransmitData(&handle, data, 4));
+    HE100_simStop(&sim);
+
+    HE100_statsSnapshot(&snapshot);
+    ASSERT_EQ(3u, snapshot.commands[CMD_NOOP].frames_sent);
+    ASSERT_EQ(3u*WRAPPER_LENGTH, snapshot.commands[CMD_NOOP].bytes_out);
+    ASSERT_EQ(3u, snapshot.commands[CMD_NOOP].acks);
+    ASSERT_EQ(3u, snapshot.commands[CMD_NOOP].latency.count);
+    ASSERT_EQ(2u, snapshot.commands[CMD_TRANSMIT_DATA].frames_sent);
+    ASSERT_EQ(2u*(4+WRAPPER_LENGTH), snapshot.commands[CMD_TRANSMIT_DATA].bytes_out);
+    ASSERT_EQ(2u*NOPAY_COMMAND_LENGTH, snapshot.commands[CMD_TRANSMIT_DATA].bytes_in);
+    ASSERT_EQ(0u, snapshot.commands[CMD_TRANSMIT_DATA].nacks);
+
+    // garbage, then a NACK, then a frame with a bad payload checksum
+    unsigned char garbage[3] = {0x00,0x48,0x13};
+    unsigned char nack[8] = {0x48,0x65,0x20,0x03,0xff,0xff,0x21,0x86};
+    unsigned char receive_frame[36] = {0x48,0x65,0x20,0x04,0x00,0x1a,0x3e,0xa6,0x86,0xa2,0x40,0x40,0x40,0x40,0x60,0xac,0x8a,0x64,0x86,0xaa,0x82,0xe1,0x03,0xf0,0x6b,0x65,0x6e,0x77,0x6f,0x6f,0x64,0x0d,0x8d,0x08,0x63,0x9f};
+    unsigned char frame[HE100_MAX_WIRE_FRAME];
+    size_t length;
+    struct he100_decoder decoder;
+    HE100_decoderInit(&decoder);
+    HE100_decoderFeed(&decoder, garbage, sizeof(garbage));
+    HE100_decoderFeed(&decoder, nack, sizeof(nack));
+    HE100_decoderFeed(&decoder, receive_frame, sizeof(receive_frame)-1);
+    unsigned char broken = receive_frame[sizeof(receive_frame)-1] ^ 0xff;
+    HE100_decoderFeed(&decoder, &broken, 1);
+    while (HE100_decoderNext(&decoder, frame, &length) == 1);
+    HE100_statsSnapshot(&snapshot);
+    ASSERT_EQ(1u, snapshot.commands[CMD_TRANSMIT_DATA].nacks);
+    ASSERT_EQ(1u, snapshot.commands[CMD_TRANSMIT_DATA].resyncs);
+    ASSERT_EQ(1u, snapshot.commands[CMD_RECEIVE_DATA].frames_received);
+    ASSERT_EQ(1u, snapshot.commands[CMD_RECEIVE_DATA].checksum_failures);
+    ASSERT_EQ(0u, snapshot.commands[CMD_RECEIVE_DATA].resyncs);
+
+    // 1 to 100 us, 200 times each
+    pthread_t threads[2];
+    for (i=0; i<2; i++) pthread_create(&threads[i], NULL, recordLatencies, NULL);
+    for (i=0; i<2; i++) pthread_join(threads[i], NULL);
+    HE100_statsSnapshot(&snapshot);
+    const struct he100_latency_histogram *latency = &snapshot.commands[CMD_TELEMETRY].latency;
+    ASSERT_EQ(20000u, latency->count);
+    ASSERT_EQ(100u, latency->max_us);
+    ASSERT_EQ(200u*5050, latency->total_us);
+    ASSERT_NEAR(50, HE100_latencyPercentile(latency, 50), 50/8);
+    ASSERT_NEAR(99, HE100_latencyPercentile(latency, 99), 99/8);
+    ASSERT_EQ(100u, HE100_latencyPercentile(latency, 100));
+
+    FILE *dump = tmpfile();
+    ASSERT_EQ(4, HE100_statsDump(dump, &snapshot));
+    fclose(dump);
+
+    HE100_statsReset();
+    HE100_statsSnapshot(&snapshot);
+    ASSERT_EQ(0u, snapshot.commands[CMD_TELEMETRY].latency.count);
+}
+
+// Reading the configuration back and setting it unchanged cost no frames
+// once it is cached; a soft reset drops the cache
+TEST_F(Helium_100_Test, ConfigCache)
+{
+    struct he100_sim_options options = {0, 0, 0, 0.0, 0.0, 0, 0, 1, 0};
+    static struct he100_sim sim;
+    HE100_Handle handle;
+    struct he100_settings settings, current;
+
+    ASSERT_EQ(HE_SUCCESS, HE100_simStart(&sim, &options));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleInit(&handle, sim.device));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleCurrentConfig(&handle, &settings));
+    ASSERT_EQ(1u, HE100_simStats(&sim).frames_in);
+
+    ASSERT_EQ(HE_SUCCESS, HE100_handleCurrentConfig(&handle, &current));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleSetConfig(&handle, settings));
+    ASSERT_EQ(1u, HE100_simStats(&sim).frames_in);
+    ASSERT_EQ(1u, handle.stats.config_hits);
+    ASSERT_EQ(1u, handle.stats.config_skipped);
+
+    settings.tx_power_amp_level = 0x40;
+    ASSERT_EQ(HE_SUCCESS, HE100_handleSetConfig(&handle, settings));
+    ASSERT_EQ(2u, HE100_simStats(&sim).frames_in);
+    ASSERT_EQ(HE_SUCCESS, HE100_handleCurrentConfig(&handle, &current));
+    ASSERT_EQ(0x40, current.tx_power_amp_level);
+    ASSERT_EQ(HE_SUCCESS, HE100_handleSetConfig(&handle, settings));
+    ASSERT_EQ(2u, HE100_simStats(&sim).frames_in);
+
+    // the simulator keeps what was set, a real radio would restore flash here
+    ASSERT_EQ(HE_SUCCESS, HE100_handleSoftReset(&handle));
+    ASSERT_EQ(0, handle.config.valid);
+    ASSERT_EQ(HE_SUCCESS, HE100_handleCurrentConfig(&handle, &current));
+    ASSERT_EQ(4u, HE100_simStats(&sim).frames_in);
+    ASSERT_EQ(0x40, current.tx_power_amp_level);
+
+    HE100_simStop(&sim);
+}
+
+// The configuration the fd functions cached for a device is not taken for
+// that of a device opened later on the same fd
+TEST_F(Helium_100_Test, ConfigCacheReopenedFd)
+{
+    unsigned char config1[CFG_FRAME_LENGTH] = {0x00,0x87,0x01,0x01,0x00,0x00,0xa8,0x3c,0x02,0x00,0x08,0xab,0x06,0x00,0x56,0x41,0x33,0x4f,0x52,0x42,0x56,0x45,0x32,0x43,0x55,0x41,0x05,0x00,0x00,0x00,0x41,0x80,0x00,0x00};
+    unsigned char ack[8] = {0x48,0x65,0x20,0x06,0x0a,0x0a,0x3a,0xb0};
+    unsigned char frame[WRAPPER_LENGTH+CFG_PAYLOAD_LENGTH];
+    struct he100_settings settings = HE100_collectConfig(config1);
+    struct pollfd sent;
+
+    int pdm, pds;
+    ASSERT_EQ(0, openRawPty(&pdm, &pds));
+    ASSERT_EQ(8, write(pds, ack, 8));
+    ASSERT_EQ(HE_SUCCESS, HE100_setConfig(pdm, settings));
+    ASSERT_EQ((int)sizeof(frame), read(pds, frame, sizeof(frame)));
+    // the same settings again are known to be on the radio
+    ASSERT_EQ(HE_SUCCESS, HE100_setConfig(pdm, settings));
+    sent.fd = pds; sent.events = POLLIN;
+    ASSERT_EQ(0, poll(&sent, 1, 50));
+
+    // closed through the library, the same device is reopened on the fd
+    int fd = pdm;
+    ASSERT_EQ(0, HE100_closePort(pdm));
+    close(pds);
+    ASSERT_EQ(0, openRawPty(&pdm, &pds));
+    ASSERT_EQ(fd, pdm);
+    ASSERT_EQ(8, write(pds, ack, 8));
+    ASSERT_EQ(HE_SUCCESS, HE100_setConfig(pdm, settings));
+    ASSERT_EQ((int)sizeof(frame), read(pds, frame, sizeof(frame)));
+
+    // closed behind the library's back, another device is opened on the fd
+    int other_pdm, other_pds;
+    ASSERT_EQ(0, openRawPty(&other_pdm, &other_pds));
+    close(pdm);close(pds);
+    ASSERT_EQ(fd, dup2(other_pds, fd));
+    close(other_pds);
+    ASSERT_EQ(8, write(other_pdm, ack, 8));
+    ASSERT_EQ(HE_SUCCESS, HE100_setConfig(fd, settings));
+    ASSERT_EQ((int)sizeof(frame), read(other_pdm, frame, sizeof(frame)));
+
+    HE100_closePort(fd);close(other_pdm);
+}
+
+// The constant frames are what HE100_prepareTransmission builds at run time
+TEST_F(Helium_100_Test, ConstantFrames)
+{
+    unsigned char noop[10] = {0x48,0x65,0x10,0x01,0x00,0x00,0x11,0x43,0x00,0x00};
+    ASSERT_EQ(0, memcmp(noop, HE100_FRAME_NOOP, sizeof(noop)));
+
+    unsigned char prepared[MAX_FRAME_LENGTH];
+    unsigned char command[2] = {CMD_TRANSMIT, 0};
+    unsigned char empty[5] = {CMD_RESET, CMD_GET_CONFIG, CMD_READ_FIRMWARE_V, CMD_NOOP, CMD_TELEMETRY};
+    const unsigned char *empty_frames[5] = {HE100_FRAME_RESET, HE100_FRAME_GET_CONFIG, HE100_FRAME_READ_FIRMWARE_V, HE100_FRAME_NOOP, HE100_FRAME_TELEMETRY};
+    int i;
+    for (i=0; i<5; i++) {
+        memset(prepared, 0, sizeof(prepared));
+        command[1] = empty[i];
+        HE100_prepareTransmission(NULL, prepared, 0, command);
+        ASSERT_EQ(0, memcmp(prepared, empty_frames[i], HE100_EMPTY_FRAME_LENGTH)) << "command " << (int)empty[i];
+    }
+
+    for (i=0; i<256; i++) {
+        unsigned char value = i;
+        command[1] = CMD_FAST_SET_PA;
+        HE100_prepareTransmission(&value, prepared, 1, command);
+        ASSERT_EQ(0, memcmp(prepared, HE100_FRAME_FAST_SET_PA[i], HE100_BYTE_FRAME_LENGTH)) << "power level " << i;
+        command[1] = CMD_BEACON_CONFIG;
+        HE100_prepareTransmission(&value, prepared, 1, command);
+        ASSERT_EQ(0, memcmp(prepared, HE100_FRAME_BEACON_CONFIG[i], HE100_BYTE_FRAME_LENGTH)) << "interval " << i;
+        ASSERT_EQ(HE_SUCCESS, HE100_validateFrame(prepared, HE100_BYTE_FRAME_LENGTH));
+    }
+}
+
+// Samples polled from the simulator land in the ring file and are there when it is opened again
+TEST_F(Helium_100_Test, TelemetryRing)
+{
+    struct he100_sim_options options = {0, 0, 0, 0.0, 0.0, 0, 0, 1, 0};
+    static struct he100_sim sim;
+    static struct he100_telemetry_poller poller;
+    HE100_Handle handle;
+    struct he100_telemetry_ring ring;
+    char path[] = "/tmp/he100_telemetry_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    ASSERT_EQ(HE_SUCCESS, HE100_simStart(&sim, &options));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleInit(&handle, sim.device));
+    ASSERT_EQ(HE_SUCCESS, HE100_telemetryOpen(&ring, path, 6));
+    ASSERT_EQ(8u, ring.header->capacity);
+
+    ASSERT_EQ(HE_SUCCESS, HE100_telemetryStart(&poller, &handle, &ring, 2));
+    int waited;
+    for (waited=0; waited<2000 && HE100_telemetryCount(&ring) < 3; waited++) usleep(1000);
+    HE100_telemetryStop(&poller);
+    uint64_t count = HE100_telemetryCount(&ring);
+    ASSERT_GE(count, 3u);
+    ASSERT_EQ(0u, poller.failures);
+
+    const struct he100_telemetry_sample *sample = HE100_telemetrySample(&ring, 0);
+    ASSERT_TRUE(sample != NULL);
+    ASSERT_EQ(1, sample->telemetry.op_counter);
+    ASSERT_EQ(0xb4, sample->telemetry.rssi);
+    ASSERT_EQ(2, HE100_telemetrySample(&ring, 1)->telemetry.op_counter);
+    ASSERT_TRUE(HE100_telemetrySample(&ring, count) == NULL);
+    HE100_telemetryClose(&ring);
+    HE100_simStop(&sim);
+
+    struct he100_telemetry_ring reader;
+    uint64_t first;
+    ASSERT_EQ(HE_SUCCESS, HE100_telemetryOpenReadOnly(&reader, path));
+    ASSERT_EQ(count, HE100_telemetryCount(&reader));
+    ASSERT_EQ(1u, HE100_telemetryLatest(&reader, 1, &first));
+    ASSERT_EQ(count-1, first);
+    sample = HE100_telemetrySample(&reader, first);
+    ASSERT_EQ((int)count, sample->telemetry.op_counter);
+    ASSERT_TRUE(HE100_telemetryIntact(sample, first));
+    HE100_telemetryClose(&reader);
+
+    // reopened to append, the history carries on and wraps at the capacity it was made with
+    TELEMETRY_STRUCTURE_type telemetry;
+    memset(&telemetry, 0, sizeof(telemetry));
+    ASSERT_EQ(HE_SUCCESS, HE100_telemetryOpen(&ring, path, 1024));
+    ASSERT_EQ(8u, ring.header->capacity);
+    int i;
+    for (i=0; i<10; i++) HE100_telemetryAppend(&ring, &telemetry, 0);
+    ASSERT_EQ(count+10, HE100_telemetryCount(&ring));
+    ASSERT_EQ(8u, HE100_telemetryLatest(&ring, 100, &first));
+    ASSERT_EQ(count+2, first);
+    ASSERT_TRUE(HE100_telemetrySample(&ring, first-1) == NULL);
+    ASSERT_TRUE(HE100_telemetrySample(&ring, first) != NULL);
+    HE100_telemetryClose(&ring);
+
+    unsigned char short_payload[4] = {0};
+    ASSERT_EQ(HE_INVALID_TELEMETRY, HE100_decodeTelemetry(short_payload, sizeof(short_payload), &telemetry));
+    unlink(path);
+}
+
+// A small image is split into packets at gaps and at HE100_FIRMWARE_PACKET_DATA,
+// then uploaded through a simulator that loses some ACKs
+TEST_F(Helium_100_Test, FirmwareUpload)
+{
+    const char hex[] =
+        ":020000040000FA\r\n"
+        ":10310000000102030405060708090A0B0C0D0E0F47\r\n"
+        ":10311000101112131415161718191A1B1C1D1E1F37\r\n"
+        ":10400000000102030405060708090A0B0C0D0E0F38\r\n"
+        ":10401000101112131415161718191A1B1C1D1E1F28\r\n"
+        ":10402000202122232425262728292A2B2C2D2E2F18\r\n"
+        ":10403000303132333435363738393A3B3C3D3E3F08\r\n"
+        ":10404000404142434445464748494A4B4C4D4E4FF8\r\n"
+        ":10405000505152535455565758595A5B5C5D5E5FE8\r\n"
+        ":10406000606162636465666768696A6B6C6D6E6FD8\r\n"
+        ":10407000707172737475767778797A7B7C7D7E7FC8\r\n"
+        ":10408000808182838485868788898A8B8C8D8E8FB8\r\n"
+        ":10409000909192939495969798999A9B9C9D9E9FA8\r\n"
+        ":02FFFE000031D0\r\n"
+        ":00000001FF\r\n";
+    unsigned char md5[HE100_FIRMWARE_MD5_LENGTH] = {0xa3,0x28,0xf6,0x4a,0xbe,0x4e,0x68,0x7e,0xd8,0x99,0x5b,0xf9,0x28,0x7f,0xf6,0x3f};
+    struct he100_firmware_image image;
+
+    ASSERT_EQ(HE_SUCCESS, HE100_firmwareParse(&image, hex, strlen(hex)));
+    ASSERT_EQ(194u, image.size);
+    ASSERT_EQ(4u, image.packet_count);
+    ASSERT_EQ(0x3100u, image.packets[0].address);
+    ASSERT_EQ(32u, image.packets[0].length);
+    ASSERT_EQ(0x4000u, image.packets[1].address);
+    ASSERT_EQ(128u, image.packets[1].length);
+    ASSERT_EQ(0x4080u, image.packets[2].address);
+    ASSERT_EQ(32u, image.packets[2].length);
+    ASSERT_EQ(0xfffeu, image.packets[3].address);
+    ASSERT_EQ(0x31, image.data[image.packets[3].offset+1]);
+    ASSERT_EQ(0, memcmp(md5, image.md5, sizeof(md5)));
+
+    char progress_path[] = "/tmp/he100_firmware_XXXXXX";
+    int fd = mkstemp(progress_path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    struct he100_sim_options options = {0, 0, 0, 0.0, 0.3, 0, 0, 7, 0};
+    static struct he100_sim sim;
+    struct he100_pipeline pipeline;
+    struct he100_firmware_upload upload;
+    ASSERT_EQ(HE_SUCCESS, HE100_simStart(&sim, &options));
+    ASSERT_EQ(HE_SUCCESS, HE100_pipelineInit(&pipeline, sim.device, 4));
+    pipeline.ack_timeout_ms = 20;
+    ASSERT_EQ(HE_SUCCESS, HE100_firmwareUploadInit(&upload, &image, progress_path));
+    ASSERT_EQ(0u, upload.packets_acked);
+
+    // an update command that lost its ACK is sent again by the next call, after no packets
+    int result = HE_FAILED_ACK_TIMEOUT;
+    int calls;
+    for (calls=0; calls<5 && result != HE_SUCCESS; calls++) result = HE100_firmwareUpload(&pipeline, &upload);
+    ASSERT_EQ(HE_SUCCESS, result);
+    ASSERT_EQ(4u, upload.packets_acked);
+    ASSERT_EQ(194u, upload.bytes_acked);
+    ASSERT_GT(HE100_firmwareRate(&upload), 0.0);
+    HE100_firmwareUploadFree(&upload);
+    HE100_pipelineClose(&pipeline);
+    HE100_simStop(&sim);
+
+    // the progress file lets a new upload carry on where this one stopped
+    ASSERT_EQ(HE_SUCCESS, HE100_firmwareUploadInit(&upload, &image, progress_path));
+    ASSERT_EQ(4u, upload.packets_acked);
+    HE100_firmwareUploadFree(&upload);
+    unlink(progress_path);
+    HE100_firmwareFree(&image);
+
+    char bad[] = ":10310000000102030405060708090A0B0C0D0E0F48\r\n:00000001FF\r\n";
+    ASSERT_EQ(HE_INVALID_FIRMWARE, HE100_firmwareParse(&image, bad, strlen(bad)));
+    // an extended linear address with no address in it
+    char no_base[] = ":00000004FC\r\n:10310000000102030405060708090A0B0C0D0E0F47\r\n:00000001FF\r\n";
+    ASSERT_EQ(HE_INVALID_FIRMWARE, HE100_firmwareParse(&image, no_base, strlen(no_base)));
+}
+
+static void
+countCapturedFrame (const unsigned char *frame, size_t length, int status, void *context)
+{
+    (void)frame; (void)length;
+    if (status == HE_SUCCESS) (*(int *)context)++;
+}
+
+TEST_F(Helium_100_Test, CaptureReplay)
+{
+    char path[] = "/tmp/he100_capture_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    struct he100_capture capture;
+    ASSERT_EQ(HE_SUCCESS, HE100_captureOpen(&capture, path, 4096));
+    struct he100_sim_options options = {0, 0, 0, 0.0, 0.0, 0, 0, 1, 0};
+    static struct he100_sim sim;
+    HE100_Handle handle;
+    struct he100_settings settings;
+    ASSERT_EQ(HE_SUCCESS, HE100_simStart(&sim, &options));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleInit(&handle, sim.device));
+    HE100_captureStart(&capture);
+    ASSERT_EQ(HE_SUCCESS, HE100_handleNOOP(&handle));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleGetConfig(&handle, &settings));
+    HE100_captureStop();
+    HE100_simStop(&sim);
+    HE100_captureClose(&capture);
+
+    // the capture outlives the process that wrote it, trimmed to its records
+    ASSERT_EQ(HE_SUCCESS, HE100_captureOpenReadOnly(&capture, path));
+    ASSERT_EQ(capture.map_length, sizeof(struct he100_capture_file_header) + capture.header->used);
+    uint64_t offset = 0, rx_bytes = 0, first_ns = 0, last_ns = 0;
+    int tx = 0;
+    const struct he100_capture_record *record;
+    while ((record = HE100_captureNext(&capture, &offset)) != NULL) {
+        if (first_ns == 0) first_ns = record->ns;
+        ASSERT_GE(record->ns, last_ns);
+        last_ns = record->ns;
+        if (record->direction == HE100_CAPTURE_TX) {
+            ASSERT_EQ(0, memcmp(tx == 0 ? HE100_FRAME_NOOP : HE100_FRAME_GET_CONFIG, record + 1, record->length));
+            tx++;
+        } else {
+            rx_bytes += record->length;
+        }
+    }
+    ASSERT_EQ(2, tx);
+    ASSERT_EQ(8u + CFG_PAYLOAD_LENGTH + WRAPPER_LENGTH, rx_bytes);
+
+    // the ACK and the configuration come out of the decoder as they did from the radio
+    struct he100_decoder decoder;
+    struct he100_replay_stats stats;
+    int valid = 0;
+    HE100_decoderInit(&decoder);
+    ASSERT_EQ(2u, HE100_captureReplay(&capture, &decoder, 0, countCapturedFrame, &valid, &stats));
+    ASSERT_EQ(2, valid);
+    ASSERT_EQ(2u, stats.tx_records);
+    ASSERT_EQ(rx_bytes, stats.rx_bytes);
+    ASSERT_EQ(0u, HE100_decoderPending(&decoder));
+
+    // at the recorded pace the replay takes at least as long as the capture did
+    HE100_decoderInit(&decoder);
+    uint64_t start = HE100_monotonicNs();
+    ASSERT_EQ(2u, HE100_captureReplay(&capture, &decoder, 1.0, NULL, NULL, NULL));
+    ASSERT_GE(HE100_monotonicNs() - start, last_ns - first_ns);
+
+    HE100_captureClose(&capture);
+    unlink(path);
+}
+
+struct ax25_routed {
+    int calls;
+    char source[HE100_AX25_CALLSIGN_STRING];
+    size_t information_length;
+};
+
+static void
+routeAx25 (const struct he100_ax25_view *view, void *context)
+{
+    struct ax25_routed *routed = (struct ax25_routed *)context;
+    routed->calls++;
+    HE100_ax25Callsign(view->source, routed->source);
+    routed->information_length = view->information_length;
+}
+
+TEST_F(Helium_100_Test, Ax25Demux)
+{
+    // received frame from ByteSequences.txt, CQ from VE2CUA
+    unsigned char frame[] = {0x48,0x65,0x20,0x04,0x00,0x1a,0x3e,0xa6,0x86,0xa2,0x40,0x40,0x40,0x40,0x60,0xac,0x8a,0x64,0x86,0xaa,0x82,0xe1,0x03,0xf0,0x6b,0x65,0x6e,0x77,0x6f,0x6f,0x64,0x0d,0x8d,0x08,0x63,0x9f};
+    const unsigned char *payload = frame + HE_FIRST_PAYLOAD_BYTE;
+    size_t payload_length = sizeof(frame) - WRAPPER_LENGTH;
+    struct he100_ax25_view view;
+    char text[HE100_AX25_CALLSIGN_STRING];
+
+    ASSERT_EQ(HE_SUCCESS, HE100_ax25View(&view, payload, payload_length));
+    ASSERT_EQ(payload, view.destination);
+    ASSERT_EQ(2, HE100_ax25Callsign(view.destination, text));
+    ASSERT_STREQ("CQ", text);
+    ASSERT_EQ(6, HE100_ax25Callsign(view.source, text));
+    ASSERT_STREQ("VE2CUA", text);
+    ASSERT_EQ(0, view.digipeater_count);
+    ASSERT_EQ(0x03, view.control);
+    ASSERT_EQ(0xf0, view.pid);
+    ASSERT_EQ(payload + HE100_AX25_HEADER_LENGTH, view.information);
+    ASSERT_EQ(10u, view.information_length);
+    ASSERT_EQ(0, memcmp("kenwood\r", view.information, 8));
+
+    // a digipeater between the source and the control field, SSIDs on both
+    unsigned char digipeated[] = {0x86,0xa2,0x40,0x40,0x40,0x40,0x60, 0xac,0x8a,0x64,0x86,0xaa,0x82,0x6a, 0xac,0x8a,0x64,0x86,0xaa,0x82,0x63, 0x03,0xf0,'h','i'};
+    ASSERT_EQ(HE_SUCCESS, HE100_ax25View(&view, digipeated, sizeof(digipeated)));
+    ASSERT_EQ(1, view.digipeater_count);
+    ASSERT_EQ(5, HE100_ax25Ssid(view.source));
+    ASSERT_EQ(8, HE100_ax25Callsign(view.source, text));
+    ASSERT_STREQ("VE2CUA-5", text);
+    ASSERT_STREQ("VE2CUA-1", (HE100_ax25Callsign(view.digipeaters, text), text));
+    ASSERT_EQ(2u, view.information_length);
+
+    // no last address bit, and a header cut short
+    digipeated[20] &= 0xfe;
+    ASSERT_EQ(HE_INVALID_AX25, HE100_ax25View(&view, digipeated, sizeof(digipeated)));
+    ASSERT_EQ(HE_INVALID_AX25, HE100_ax25View(&view, payload, 15));
+
+    unsigned char address[HE100_AX25_ADDRESS_LENGTH];
+    ASSERT_EQ(HE_SUCCESS, HE100_ax25Address("ve2cua", 0, address));
+    ASSERT_EQ(0, memcmp(address, payload + HE100_AX25_ADDRESS_LENGTH, HE100_AX25_CALLSIGN_LENGTH));
+    ASSERT_EQ(HE_INVALID_AX25, HE100_ax25Address("VE2CUA7", 0, address));
+    ASSERT_EQ(HE_INVALID_AX25, HE100_ax25Address("VE-2", 0, address));
+
+    // routed on the source; one SSID before any SSID, the rest to the fallback
+    struct ax25_routed any = {0, "", 0}, five = {0, "", 0}, other = {0, "", 0};
+    struct he100_ax25_demux demux;
+    HE100_ax25DemuxInit(&demux, HE100_AX25_ROUTE_SOURCE, routeAx25, &other);
+    ASSERT_EQ(HE_SUCCESS, HE100_ax25DemuxRegister(&demux, "VE2CUA", HE100_AX25_ANY_SSID, routeAx25, &any));
+    ASSERT_EQ(HE_SUCCESS, HE100_ax25DemuxRegister(&demux, "VE2CUA", 5, routeAx25, &five));
+    ASSERT_EQ(HE_INVALID_AX25, HE100_ax25DemuxRegister(&demux, "", 0, routeAx25, &five));
+    ASSERT_EQ(2, demux.route_count);
+
+    HE100_ax25DemuxRxCallback(frame, sizeof(frame), HE_SUCCESS, &demux);
+    ASSERT_EQ(1, any.calls);
+    ASSERT_STREQ("VE2CUA", any.source);
+    ASSERT_EQ(10u, any.information_length);
+    digipeated[20] |= 0x01;
+    ASSERT_EQ(HE_SUCCESS, HE100_ax25DemuxPayload(&demux, digipeated, sizeof(digipeated)));
+    ASSERT_EQ(1, five.calls);
+    ASSERT_STREQ("VE2CUA-5", five.source);
+
+    digipeated[7] = 'W' << 1;
+    ASSERT_EQ(-1, HE100_ax25DemuxPayload(&demux, digipeated, sizeof(digipeated)));
+    ASSERT_EQ(1, other.calls);
+    ASSERT_EQ(HE_INVALID_AX25, HE100_ax25DemuxPayload(&demux, payload, 10));
+    HE100_ax25DemuxRxCallback(frame, sizeof(frame), HE_FAILED_CHECKSUM, &demux);
+    ASSERT_EQ(2u, demux.routed);
+    ASSERT_EQ(1u, demux.unrouted);
+    ASSERT_EQ(1u, demux.invalid);
+
+    // the table holds HE100_AX25_MAX_ROUTES stations
+    char callsign[16];
+    int i;
+    for (i=demux.route_count; i<HE100_AX25_MAX_ROUTES; i++) {
+        snprintf(callsign, sizeof(callsign), "VA2%03d", i);
+        ASSERT_EQ(HE_SUCCESS, HE100_ax25DemuxRegister(&demux, callsign, 0, routeAx25, &other));
+    }
+    ASSERT_EQ(-1, HE100_ax25DemuxRegister(&demux, "VA2XYZ", 0, routeAx25, &other));
+    ASSERT_EQ(HE_SUCCESS, HE100_ax25DemuxRegister(&demux, "VA2031", 0, routeAx25, &any));
+}
+
+struct scheduled_order {
+    struct he100_scheduler *scheduler;
+    unsigned char commands[16];
+    int statuses[16];
+    int count;
+};
+
+static void
+recordScheduled (int status, const unsigned char *response, size_t length, void *context)
+{
+    struct scheduled_order *order = (struct scheduled_order *)context;
+    (void)length;
+    order->commands[order->count] = response != NULL ? response[HE_CMD_BYTE] : 0;
+    order->statuses[order->count] = status;
+    // a power change decided after the third frame is out goes before the rest
+    if (++order->count == 3) HE100_schedulerFastSetPA(order->scheduler, 0x20, recordScheduled, order);
+}
+
+TEST_F(Helium_100_Test, TransmitScheduler)
+{
+    // the simulator's flags: 5 of preamble, 20 of postamble; its RF buffer holds two longest frames
+    const int air_bytes = 5 + HE100_AX25_HEADER_LENGTH + MAX_TESTED_FRAME + 3 + 20;
+    struct he100_sim_options options = {0, 38400, 0, 0.0, 0.0, 0, 0, 1, 2*air_bytes};
+    static struct he100_sim sim;
+    HE100_Handle handle;
+    unsigned char data[MAX_TESTED_FRAME];
+    int i;
+    for (i=0; i<MAX_TESTED_FRAME; i++) data[i] = (unsigned char)i;
+
+    // written as fast as they are ACKed, the third frame finds the buffer full
+    ASSERT_EQ(HE_SUCCESS, HE100_simStart(&sim, &options));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleInit(&handle, sim.device));
+    for (i=0; i<4; i++) HE100_handleTransmitData(&handle, data, sizeof(data));
+    ASSERT_GT(HE100_simStats(&sim).overflows, 0u);
+    HE100_simStop(&sim);
+
+    // paced from the configuration, sped up to match the simulator
+    struct he100_scheduler scheduler;
+    struct he100_settings settings;
+    ASSERT_EQ(HE_SUCCESS, HE100_simStart(&sim, &options));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleInit(&handle, sim.device));
+    ASSERT_EQ(HE_SUCCESS, HE100_schedulerInit(&scheduler, &handle));
+    ASSERT_EQ(9600, scheduler.rf_baud);
+    ASSERT_EQ(5, scheduler.preamble_flags);
+    ASSERT_EQ(20, scheduler.postamble_flags);
+
+    // every bit of a 190 byte frame, 29 stuffed at most in the header; 0xff data is stuffed every fifth bit
+    unsigned char zeros[MAX_TESTED_FRAME], ones[10];
+    memset(zeros, 0, sizeof(zeros));
+    memset(ones, 0xff, sizeof(ones));
+    ASSERT_EQ(198020834u, HE100_schedulerAirtime(&scheduler, zeros, sizeof(zeros)));
+    ASSERT_EQ(49687500u, HE100_schedulerAirtime(&scheduler, ones, sizeof(ones)));
+
+    ASSERT_EQ(HE_SUCCESS, HE100_handleCurrentConfig(&handle, &settings));
+    settings.tx_rf_baud_rate = CFG_RF_BAUD_38400;
+    ASSERT_EQ(HE_SUCCESS, HE100_schedulerConfigure(&scheduler, &settings));
+    ASSERT_EQ(UINT64_MAX, HE100_schedulerDelay(&scheduler));
+
+    struct scheduled_order order;
+    memset(&order, 0, sizeof(order));
+    order.scheduler = &scheduler;
+    const int frames = 8;
+    for (i=0; i<frames; i++) ASSERT_EQ(HE_SUCCESS, HE100_schedulerTransmitData(&scheduler, data, sizeof(data), recordScheduled, &order));
+    ASSERT_EQ(frames, HE100_schedulerPending(&scheduler));
+
+    uint64_t start = HE100_monotonicNs();
+    ASSERT_EQ(frames+1, HE100_schedulerRun(&scheduler, -1));
+    uint64_t elapsed = HE100_monotonicNs() - start;
+
+    // nothing refused, the command ahead of the data queued before it
+    ASSERT_EQ(0u, HE100_simStats(&sim).overflows);
+    ASSERT_EQ(0u, scheduler.stats.nacks);
+    ASSERT_EQ((uint64_t)frames, scheduler.stats.sent[HE100_SCHEDULER_DATA]);
+    ASSERT_EQ(1u, scheduler.stats.sent[HE100_SCHEDULER_COMMAND]);
+    ASSERT_GT(scheduler.stats.paced, 0u);
+    for (i=0; i<frames+1; i++) {
+        ASSERT_EQ(HE_SUCCESS, order.statuses[i]);
+        ASSERT_EQ(i == 3 ? CMD_FAST_SET_PA : CMD_TRANSMIT_DATA, order.commands[i]);
+    }
+
+    // kept busy: all but the two buffered frames had to wait for the air, with little to spare
+    uint64_t air_ns = (uint64_t)air_bytes * 8 * 1000000000 / 38400;
+    ASSERT_GE(elapsed, (frames-2) * air_ns);
+    ASSERT_LE(elapsed, (frames-2) * air_ns * 11 / 10);
+    HE100_simStop(&sim);
+}
+
+TEST_F(Helium_100_Test, AdaptiveTimeout)
+{
+    // RFC 6298 on fixed samples: the first sets the mean and half of it as deviation
+    struct he100_rto rto;
+    int i;
+    HE100_rtoInit(&rto, 20, 2000);
+    ASSERT_EQ(2000000000u, HE100_rtoTimeout(&rto, CMD_NOOP));
+    HE100_rtoSample(&rto, CMD_NOOP, 8000000);
+    ASSERT_EQ(24000000u, HE100_rtoTimeout(&rto, CMD_NOOP));
+    HE100_rtoSample(&rto, CMD_NOOP, 16000000);
+    ASSERT_EQ(9000000u, rto.commands[CMD_NOOP].srtt_ns);
+    ASSERT_EQ(5000000u, rto.commands[CMD_NOOP].rttvar_ns);
+    ASSERT_EQ(29000000u, HE100_rtoTimeout(&rto, CMD_NOOP));
+    for (i=0; i<50; i++) HE100_rtoSample(&rto, CMD_NOOP, 1000000);
+    ASSERT_EQ(20000000u, HE100_rtoTimeout(&rto, CMD_NOOP));
+    HE100_rtoBackoff(&rto, CMD_NOOP);
+    ASSERT_EQ(40000000u, HE100_rtoTimeout(&rto, CMD_NOOP));
+    for (i=0; i<10; i++) HE100_rtoBackoff(&rto, CMD_NOOP);
+    ASSERT_EQ(2000000000u, HE100_rtoTimeout(&rto, CMD_NOOP));
+    ASSERT_EQ(2000000000u, HE100_rtoTimeout(&rto, CMD_TRANSMIT_DATA));
+
+    // ACKs 5 ms after each command
+    struct he100_sim_options options = {0, 0, 0, 0.0, 0.0, 0, 5000, 1, 0};
+    static struct he100_sim sim;
+    HE100_Handle handle;
+    HE100_statsReset();
+    ASSERT_EQ(HE_SUCCESS, HE100_simStart(&sim, &options));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleInit(&handle, sim.device));
+    for (i=0; i<8; i++) ASSERT_EQ(HE_SUCCESS, HE100_handleNOOP(&handle));
+    uint64_t noop_rto = HE100_rtoTimeout(&handle.rto, CMD_NOOP);
+    ASSERT_GE(noop_rto, (uint64_t)HE100_RTO_FLOOR_MS * 1000000);
+    ASSERT_LT(noop_rto, 100000000u);
+
+    // a lost ACK is given up on in tens of milliseconds, not two seconds
+    options.drop_rate = 1.0;
+    HE100_simConfigure(&sim, &options);
+    uint64_t start = HE100_monotonicNs();
+    ASSERT_EQ(1, HE100_handleNOOP(&handle));
+    uint64_t elapsed = HE100_monotonicNs() - start;
+    ASSERT_GE(elapsed, noop_rto);
+    ASSERT_LT(elapsed, 150000000u);
+    ASSERT_EQ(2*noop_rto, HE100_rtoTimeout(&handle.rto, CMD_NOOP));
+
+    // the estimate is on the stats surface
+    struct he100_stats_snapshot snapshot;
+    HE100_statsSnapshot(&snapshot);
+    ASSERT_EQ(2*noop_rto/1000, snapshot.commands[CMD_NOOP].rto_us);
+    ASSERT_EQ(1u, snapshot.commands[CMD_NOOP].rto_timeouts);
+    ASSERT_GE(snapshot.commands[CMD_NOOP].rto_srtt_us, 5000u);
+    ASSERT_LT(snapshot.commands[CMD_NOOP].rto_srtt_us, 20000u);
+
+    // an ACK that comes after its command was given up on is not taken for the next one's
+    options.drop_rate = 0.0;
+    options.latency_us = 300000;
+    HE100_simConfigure(&sim, &options);
+    ASSERT_EQ(1, HE100_handleNOOP(&handle));
+    options.latency_us = 0;
+    HE100_simConfigure(&sim, &options);
+    usleep(300000);
+    ASSERT_EQ(HE_SUCCESS, HE100_handleFastSetPA(&handle, 0x20));
+    ASSERT_EQ(CMD_FAST_SET_PA, handle.response[HE_CMD_BYTE]);
+    ASSERT_EQ(1u, handle.stats.stale);
+    HE100_simStop(&sim);
+}
+
+// A candidate rejected partway through gives up only its first byte, so a
+// frame starting inside it, or at the byte that broke it, is still found
+TEST_F(Helium_100_Test, DecoderResyncKeepsFrames)
+{
+    unsigned char ack[8] = {0x48,0x65,0x20,0x03,0x0a,0x0a,0x37,0xa7};
+    unsigned char data[36] = {0x48,0x65,0x20,0x04,0x00,0x1a,0x3e,0xa6,0x86,0xa2,0x40,0x40,0x40,0x40,0x60,0xac,0x8a,0x64,0x86,0xaa,0x82,0xe1,0x03,0xf0,0x6b,0x65,0x6e,0x77,0x6f,0x6f,0x64,0x0d,0x8d,0x08,0x63,0x9f};
+    // a lone first sync byte, a sync pair, and a header cut short at its length byte
+    unsigned char prefixes[3][4] = {{0x48}, {0x48,0x65}, {0x48,0x65,0x20,0x03}};
+    size_t prefix_lengths[3] = {1,2,4};
+    unsigned char frame[HE100_MAX_WIRE_FRAME];
+    size_t frame_length;
+    struct he100_decoder decoder;
+    int i;
+
+    for (i=0; i<3; i++) {
+        HE100_decoderInit(&decoder);
+        HE100_decoderFeed(&decoder, prefixes[i], prefix_lengths[i]);
+        HE100_decoderFeed(&decoder, i == 2 ? data : ack, i == 2 ? 36 : 8);
+        ASSERT_EQ(1, HE100_decoderNext(&decoder, frame, &frame_length));
+        ASSERT_EQ(0, memcmp(i == 2 ? data : ack, frame, frame_length));
+        ASSERT_EQ(prefix_lengths[i], decoder.discarded);
+        ASSERT_EQ(0u, HE100_decoderPending(&decoder));
+    }
+
+    // noise without a sync byte across the end of the ring, then a sync pair split between reads
+    unsigned char noise[700];
+    memset(noise, 0x65, sizeof(noise));
+    HE100_decoderInit(&decoder);
+    HE100_decoderFeed(&decoder, noise, sizeof(noise));
+    ASSERT_EQ(0, HE100_decoderNext(&decoder, frame, &frame_length));
+    HE100_decoderFeed(&decoder, noise, sizeof(noise));
+    HE100_decoderFeed(&decoder, ack, 1);
+    ASSERT_EQ(0, HE100_decoderNext(&decoder, frame, &frame_length));
+    ASSERT_EQ(1u, HE100_decoderPending(&decoder));
+    HE100_decoderFeed(&decoder, ack+1, 7);
+    ASSERT_EQ(1, HE100_decoderNext(&decoder, frame, &frame_length));
+    ASSERT_EQ(0, memcmp(ack, frame, 8));
+    ASSERT_EQ(2*sizeof(noise), decoder.discarded);
+}
+
+// Frames the radio sends unasked while a command waits are queued by class,
+// the command still gets its own ACK, and HE100_handleRead returns them after
+TEST_F(Helium_100_Test, UnsolicitedFramesQueued)
+{
+    // ACKs 20 ms after each command, so injected frames come first
+    struct he100_sim_options options = {0, 0, 0, 0.0, 0.0, 0, 20000, 1, 0};
+    static struct he100_sim sim;
+    HE100_Handle handle;
+    unsigned char data[4] = {0x74,0x65,0x73,0x74};
+    unsigned char dump[4] = {0x01,0x02,0x03,0x04};
+    unsigned char frames[3][HE100_MAX_WIRE_FRAME];
+    size_t lengths[3];
+    lengths[0] = HE100_simFrame(CMD_RECEIVE_DATA, data, sizeof(data), frames[0]);
+    lengths[1] = HE100_simFrame(CMD_TELEMETRY, dump, sizeof(dump), frames[1]);
+    lengths[2] = HE100_simFrame(CMD_PING_RETURN, data, sizeof(data), frames[2]);
+    unsigned char payload[MAX_FRAME_LENGTH];
+    int i;
+
+    ASSERT_EQ(HE_SUCCESS, HE100_simStart(&sim, &options));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleInit(&handle, sim.device));
+    for (i=0; i<3; i++) ASSERT_EQ(HE_SUCCESS, HE100_simInject(&sim, frames[i], lengths[i]));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleNOOP(&handle));
+    ASSERT_EQ(CMD_NOOP, handle.response[HE_CMD_BYTE]);
+    ASSERT_EQ(1u, HE100_demuxPending(&handle.demux, HE100_DEMUX_RECEIVED));
+    ASSERT_EQ(1u, HE100_demuxPending(&handle.demux, HE100_DEMUX_TELEMETRY));
+    ASSERT_EQ(1u, HE100_demuxPending(&handle.demux, HE100_DEMUX_OA));
+    ASSERT_EQ(0u, handle.stats.stale);
+
+    // read back in the order they arrived, before anything new
+    for (i=0; i<3; i++) {
+        ASSERT_EQ(4, HE100_handleRead(&handle, 1, payload));
+        ASSERT_EQ(0, memcmp(frames[i], handle.response, lengths[i]));
+        ASSERT_EQ(HE_SUCCESS, handle.status);
+    }
+    ASSERT_EQ(-1, HE100_handleRead(&handle, 0, payload));
+
+    // full duplex: each looped back frame lands while a later command waits
+    options.loopback = 1;
+    options.latency_us = 0;
+    options.rf_baud = 96000;
+    HE100_simConfigure(&sim, &options);
+    for (i=0; i<HE100_DEMUX_QUEUE_LENGTH; i++) {
+        data[0] = (unsigned char)i;
+        ASSERT_EQ(HE_SUCCESS, HE100_handleTransmitData(&handle, data, sizeof(data)));
+    }
+    usleep(150000); // all on the air by now
+    ASSERT_EQ(HE_SUCCESS, HE100_handleNOOP(&handle));
+    ASSERT_EQ((size_t)HE100_DEMUX_QUEUE_LENGTH, HE100_demuxPending(&handle.demux, HE100_DEMUX_RECEIVED));
+
+    // one more than the queue holds: it is dropped and counted, not taken for the ACK
+    ASSERT_EQ(HE_SUCCESS, HE100_simInject(&sim, frames[0], lengths[0]));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleNOOP(&handle));
+    ASSERT_EQ(1u, handle.demux.queues[HE100_DEMUX_RECEIVED].dropped);
+    for (i=0; i<HE100_DEMUX_QUEUE_LENGTH; i++) {
+        ASSERT_EQ(HE100_AX25_HEADER_LENGTH+4, HE100_handleRead(&handle, 1, payload));
+        ASSERT_EQ(i, payload[HE100_AX25_HEADER_LENGTH]);
+    }
+    HE100_simStop(&sim);
+    ASSERT_EQ(0u, HE100_simStats(&sim).nacks);
+}
+
+// Soft resets are called for by the error rate, not one bad frame, back off
+// while they do not help, and stop altogether once the breaker opens
+TEST_F(Helium_100_Test, RecoveryBreaker)
+{
+    struct he100_recovery_policy policy;
+    HE100_recoveryDefaults(&policy);
+    policy.window_ns = 1000000000;
+    policy.backoff_ns = 100000000;
+    policy.backoff_max_ns = 400000000;
+    policy.breaker_threshold = 2;
+    policy.cooldown_ns = 1000000000;
+    struct he100_recovery recovery;
+    HE100_recoveryInit(&recovery, &policy);
+    uint64_t t = 5000000000ULL, ms = 1000000;
+    int i;
+
+    // one corrupted frame among good ones, then enough to call for a reset
+    for (i=0; i<5; i++) HE100_recoveryFrame(&recovery, &policy, 1, t);
+    HE100_recoveryFrame(&recovery, &policy, 0, t);
+    ASSERT_EQ(0, HE100_recoveryAllow(&recovery, &policy, t));
+    for (i=0; i<2; i++) HE100_recoveryFrame(&recovery, &policy, 0, t);
+    ASSERT_EQ(1, HE100_recoveryAllow(&recovery, &policy, t));
+    HE100_recoveryReset(&recovery, &policy, HE_SUCCESS, t);
+
+    // errors again before it could help: backed off to 200 ms
+    for (i=0; i<3; i++) HE100_recoveryFrame(&recovery, &policy, 0, t+10*ms);
+    ASSERT_EQ(0, HE100_recoveryAllow(&recovery, &policy, t+10*ms));
+    ASSERT_EQ(1u, recovery.stats.failed);
+    ASSERT_EQ(1u, recovery.stats.suppressed);
+    ASSERT_EQ(0, HE100_recoveryAllow(&recovery, &policy, t+200*ms));
+    ASSERT_EQ(1, HE100_recoveryAllow(&recovery, &policy, t+210*ms));
+    HE100_recoveryReset(&recovery, &policy, HE_SUCCESS, t+210*ms);
+
+    // the second that did not help opens the breaker for the cool-down
+    for (i=0; i<3; i++) HE100_recoveryFrame(&recovery, &policy, 0, t+300*ms);
+    ASSERT_EQ(0, HE100_recoveryAllow(&recovery, &policy, t+300*ms));
+    ASSERT_EQ(HE100_RECOVERY_OPEN, recovery.state);
+    ASSERT_EQ(1u, recovery.stats.trips);
+    ASSERT_EQ(0, HE100_recoveryAllow(&recovery, &policy, t+1200*ms));
+
+    // then one trial, and the breaker closes once frames come through clean
+    for (i=0; i<3; i++) HE100_recoveryFrame(&recovery, &policy, 0, t+1400*ms);
+    ASSERT_EQ(1, HE100_recoveryAllow(&recovery, &policy, t+1400*ms));
+    ASSERT_EQ(HE100_RECOVERY_HALF_OPEN, recovery.state);
+    HE100_recoveryReset(&recovery, &policy, HE_SUCCESS, t+1400*ms);
+    for (i=0; i<4; i++) HE100_recoveryFrame(&recovery, &policy, 1, t+1410*ms);
+    ASSERT_EQ(HE100_RECOVERY_CLOSED, recovery.state);
+    ASSERT_EQ(1u, recovery.stats.recovered);
+    ASSERT_EQ(3u, recovery.stats.resets);
+    ASSERT_EQ(policy.backoff_ns, recovery.backoff_ns);
+
+    // on a handle: corrupted downlinks cost one reset, not one each
+    struct he100_sim_options options = {0, 0, 0, 0.0, 0.0, 0, 0, 1, 0};
+    static struct he100_sim sim;
+    HE100_Handle handle;
+    unsigned char data[4] = {0x74,0x65,0x73,0x74};
+    unsigned char frame[HE100_MAX_WIRE_FRAME];
+    size_t length = HE100_simFrame(CMD_RECEIVE_DATA, data, sizeof(data), frame);
+    frame[length-1] ^= 0x01;
+    ASSERT_EQ(HE_SUCCESS, HE100_simStart(&sim, &options));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleInit(&handle, sim.device));
+    handle.policy.soft_reset_on_invalid = 1;
+    for (i=0; i<8; i++) {
+        ASSERT_EQ(HE_SUCCESS, HE100_simInject(&sim, frame, length));
+        ASSERT_EQ(-1, HE100_handleRead(&handle, 1, NULL));
+        ASSERT_EQ(HE_FAILED_CHECKSUM, handle.status);
+        ASSERT_EQ(i < 2 ? 0u : 1u, handle.stats.soft_resets);
+    }
+    // the first two after it are too few to judge it by
+    ASSERT_EQ(3u, handle.recovery.stats.suppressed);
+    ASSERT_EQ(1u, handle.recovery.stats.failed);
+    HE100_simStop(&sim);
+    ASSERT_EQ(1u, HE100_simStats(&sim).frames_in);
+}
+
+// The host follows the radio to a new interface rate, and finds it again at
+// another if it cannot be heard where it should be
+TEST_F(Helium_100_Test, BaudNegotiation)
+{
+    struct he100_sim_options options = {9600, 9600, 0, 0.0, 0.0, 0, 0, 1, 0};
+    static struct he100_sim sim;
+    HE100_Handle handle;
+    struct he100_settings settings;
+    ASSERT_EQ(HE_SUCCESS, HE100_simStart(&sim, &options));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleInit(&handle, sim.device));
+    handle.policy.ack_timeout = 1;
+    ASSERT_EQ(CFG_IF_BAUD_9600, HE100_baudHostRate(sim.device));
+
+    ASSERT_EQ(HE_SUCCESS, HE100_handleGetConfig(&handle, &settings));
+    settings.interface_baud_rate = CFG_IF_BAUD_115200;
+    ASSERT_EQ(HE_SUCCESS, HE100_validateConfig(settings));
+    ASSERT_EQ(HE_SUCCESS, HE100_baudNegotiate(&handle, CFG_IF_BAUD_115200));
+    ASSERT_EQ(CFG_IF_BAUD_115200, HE100_baudHostRate(sim.device));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleNOOP(&handle));
+    ASSERT_EQ(0u, HE100_simStats(&sim).baud_mismatches);
+    // already there
+    uint64_t commands = handle.stats.commands;
+    ASSERT_EQ(HE_SUCCESS, HE100_baudNegotiate(&handle, CFG_IF_BAUD_115200));
+    ASSERT_EQ(commands, handle.stats.commands);
+#ifndef B76800
+    ASSERT_EQ(HE_INVALID_IF_BAUD_RATE, HE100_baudNegotiate(&handle, CFG_IF_BAUD_76800));
+#endif
+    ASSERT_EQ(HE_SUCCESS, HE100_baudNegotiate(&handle, CFG_IF_BAUD_9600));
+    ASSERT_EQ(CFG_IF_BAUD_9600, HE100_baudHostRate(sim.device));
+
+    // the radio went to 19200 behind the handle's back: nothing answers at
+    // 9600 or 115200, it is found at 19200 and put back to 9600
+    options.if_baud = 19200;
+    HE100_simConfigure(&sim, &options);
+    ASSERT_EQ(HE_FAILED_SET_BAUD, HE100_baudNegotiate(&handle, CFG_IF_BAUD_115200));
+    ASSERT_EQ(CFG_IF_BAUD_9600, HE100_baudHostRate(sim.device));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleNOOP(&handle));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleGetConfig(&handle, &settings));
+    ASSERT_EQ(CFG_IF_BAUD_9600, settings.interface_baud_rate);
+    ASSERT_LT(0u, HE100_simStats(&sim).baud_mismatches);
+
+    HE100_simStop(&sim);
+}
+
+// The RF rate steps down at once on errors or a weak signal, and up only
+// after good windows, a stronger signal and a hold at the rate
+TEST_F(Helium_100_Test, RfRateAdaptation)
+{
+    struct he100_adapt_policy policy;
+    HE100_adaptDefaults(&policy);
+    policy.window_frames = 10;
+    policy.up_windows = 2;
+    policy.hold_ns = 1000;
+    struct he100_handle_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    struct he100_adapt adapt;
+    memset(&adapt, 0, sizeof(adapt));
+    adapt.rate = CFG_RF_BAUD_9600;
+    adapt.rssi = -1;
+    TELEMETRY_STRUCTURE_type telemetry;
+    memset(&telemetry, 0, sizeof(telemetry));
+
+    // not a window yet, then a clean one, then a second: up
+    stats.frames = 9;
+    ASSERT_EQ(CFG_RF_BAUD_9600, HE100_adaptDecide(&adapt, &policy, &stats, 2000));
+    stats.frames = 10;
+    ASSERT_EQ(CFG_RF_BAUD_9600, HE100_adaptDecide(&adapt, &policy, &stats, 2000));
+    stats.frames = 20;
+    ASSERT_EQ(CFG_RF_BAUD_19200, HE100_adaptDecide(&adapt, &policy, &stats, 2000));
+    // two errors in ten step down, one keeps the rate but breaks the run
+    stats.frames = 30; stats.invalid = 1; stats.nacks = 1;
+    ASSERT_EQ(CFG_RF_BAUD_1200, HE100_adaptDecide(&adapt, &policy, &stats, 2000));
+    stats.frames = 40; stats.invalid = 2;
+    ASSERT_EQ(CFG_RF_BAUD_9600, HE100_adaptDecide(&adapt, &policy, &stats, 2000));
+    ASSERT_EQ(0, adapt.good);
+    ASSERT_EQ(4u, adapt.stats.windows);
+
+    // the signal holds 9600 but not 19200 plus the margin: no step up
+    telemetry.rssi = 85;
+    HE100_adaptRssi(&adapt, &telemetry);
+    stats.frames = 50;
+    HE100_adaptDecide(&adapt, &policy, &stats, 2000);
+    stats.frames = 60;
+    ASSERT_EQ(CFG_RF_BAUD_9600, HE100_adaptDecide(&adapt, &policy, &stats, 2000));
+    telemetry.rssi = 120;
+    HE100_adaptRssi(&adapt, &telemetry);
+    stats.frames = 70;
+    ASSERT_EQ(CFG_RF_BAUD_19200, HE100_adaptDecide(&adapt, &policy, &stats, 2000));
+    // nor right after a change
+    adapt.changed = 1500;
+    stats.frames = 80;
+    ASSERT_EQ(CFG_RF_BAUD_9600, HE100_adaptDecide(&adapt, &policy, &stats, 2000));
+    // and it fades below the floor of 9600 without a window closing
+    telemetry.rssi = 0;
+    HE100_adaptRssi(&adapt, &telemetry);
+    HE100_adaptRssi(&adapt, &telemetry);
+    ASSERT_EQ(CFG_RF_BAUD_9600, HE100_adaptDecide(&adapt, &policy, &stats, 2000));
+    HE100_adaptRssi(&adapt, &telemetry);
+    ASSERT_EQ(CFG_RF_BAUD_1200, HE100_adaptDecide(&adapt, &policy, &stats, 2000));
+
+    // applied through the configuration, the scheduler paced to it
+    struct he100_sim_options options = {9600, 9600, 0, 0.0, 0.0, 0, 0, 1, 0};
+    static struct he100_sim sim;
+    HE100_Handle handle;
+    struct he100_scheduler scheduler;
+    struct he100_settings settings;
+    ASSERT_EQ(HE_SUCCESS, HE100_simStart(&sim, &options));
+    ASSERT_EQ(HE_SUCCESS, HE100_handleInit(&handle, sim.device));
+    ASSERT_EQ(HE_SUCCESS, HE100_schedulerInit(&scheduler, &handle));
+    ASSERT_EQ(HE_SUCCESS, HE100_adaptInit(&adapt, &handle, &scheduler));
+    ASSERT_EQ(CFG_RF_BAUD_9600, adapt.rate);
+    policy.window_frames = 2;
+    policy.up_windows = 1;
+    policy.hold_ns = 0;
+    int i;
+    for (i=0; i<2; i++) ASSERT_EQ(HE_SUCCESS, HE100_handleNOOP(&handle));
+    ASSERT_EQ(HE_SUCCESS, HE100_adaptStep(&adapt, &policy, &handle));
+    ASSERT_EQ(CFG_RF_BAUD_19200, adapt.rate);
+    ASSERT_EQ(1u, adapt.stats.ups);
+    ASSERT_EQ(19200, scheduler.rf_baud);
+    ASSERT_EQ(HE_SUCCESS, HE100_handleGetConfig(&handle, &settings));
+    ASSERT_EQ(CFG_RF_BAUD_19200, settings.rx_rf_baud_rate);
+    ASSERT_EQ(CFG_RF_BAUD_19200, settings.tx_rf_baud_rate);
+    // the window reopened at the change
+    ASSERT_EQ(HE_SUCCESS, HE100_adaptStep(&adapt, &policy, &handle));
+    ASSERT_EQ(CFG_RF_BAUD_19200, adapt.rate);
+
+    settings.tx_rf_baud_rate = MAX_RF_BAUD_RATE+1;
+    ASSERT_EQ(HE_INVALID_RF_BAUD_RATE, HE100_validateConfig(settings));
+    HE100_simStop(&sim);
+}
+
 // TODO regenerate sample bytes from latest HE100 boards
 // This test verifies the preparation of a transmission frame, and compares
 // with a previously captured transmission from the Radio itself
@@ -0,0 +1,477 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  he100_sim.c
+ *
+ *    Description:  He100 simulator on a pseudo terminal.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 04:31:50 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdlib.h>     /*  C Standard General Utilities Library */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <string.h>     /*  String function definitions */
+#include <fcntl.h>      /*  File control definitions */
+#include <unistd.h>     /*  UNIX standard function definitions */
+#include <errno.h>      /*  Error number definitions */
+#include <poll.h>       /*  ppoll() */
+#include <termios.h>    /*  POSIX terminal control definitions */
+#include <time.h>       /*  clock_gettime() */
+
+#include <SC_he100.h>
+#include "he100_sim.h"
+
+static const int HE100_SIM_IF_BAUD[5] = {9600, 19200, 38400, 76800, 115200};
+
+// 'getconfig response' captured from the He100, see ByteSequences.txt, with
+// the VA3ORB and VE2CUA callsigns HE100_validateConfig expects
+static const unsigned char HE100_SIM_DEFAULT_CONFIG[CFG_PAYLOAD_LENGTH] = {
+    0x00,0x87,0x01,0x01,0x00,0x00,0xa8,0x3c,0x02,0x00,0x08,0xab,0x06,0x00,0x56,0x41,0x33,
+    0x4f,0x52,0x42,0x56,0x45,0x32,0x43,0x55,0x41,0x05,0x00,0x00,0x00,0x41,0x80,0x00,0x00
+};
+
+// address, control and PID the radio puts in front of received data
+static const unsigned char HE100_SIM_AX25_HEADER[16] = {
+    0x86,0xa2,0x40,0x40,0x40,0x40,0x60,0xac,0x8a,0x64,0x86,0xaa,0x82,0xe1,0x03,0xf0
+};
+
+// the library's HE100_monotonicNs, kept here so the simulator links on its own
+static uint64_t
+HE100_simNow (void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+size_t
+HE100_simFrame (unsigned char command, const unsigned char *payload, size_t length, unsigned char *frame)
+{
+    frame[HE_SYNC_BYTE_1] = SYNC1;
+    frame[HE_SYNC_BYTE_2] = SYNC2;
+    frame[HE_TX_RX_BYTE] = CMD_RECEIVE;
+    frame[HE_CMD_BYTE] = command;
+    frame[HE_LENGTH_BYTE_0] = length >> 8;
+    frame[HE_LENGTH_BYTE] = length & 0xff;
+    struct HE100_checksum checksum = HE100_fletcher16(frame+HE_TX_RX_BYTE, 4);
+    frame[HE_HEADER_CHECKSUM_BYTE_1] = checksum.sum1;
+    frame[HE_HEADER_CHECKSUM_BYTE_2] = checksum.sum2;
+    if (length > 0) memcpy(frame+HE_FIRST_PAYLOAD_BYTE, payload, length);
+    checksum = HE100_fletcher16(frame+HE_TX_RX_BYTE, length+6);
+    frame[HE_FIRST_PAYLOAD_BYTE+length] = checksum.sum1;
+    frame[HE_FIRST_PAYLOAD_BYTE+length+1] = checksum.sum2;
+    return length + WRAPPER_LENGTH;
+}
+
+// ACK and NACK have no payload, the length bytes carry 0x0a or 0xff
+static size_t
+HE100_simAck (unsigned char command, int nack, unsigned char *frame)
+{
+    unsigned char code = nack ? HE_NOACK : HE_ACK;
+    frame[HE_SYNC_BYTE_1] = SYNC1;
+    frame[HE_SYNC_BYTE_2] = SYNC2;
+    frame[HE_TX_RX_BYTE] = CMD_RECEIVE;
+    frame[HE_CMD_BYTE] = command;
+    frame[HE_LENGTH_BYTE_0] = code;
+    frame[HE_LENGTH_BYTE] = code;
+    struct HE100_checksum checksum = HE100_fletcher16(frame+HE_TX_RX_BYTE, 4);
+    frame[HE_HEADER_CHECKSUM_BYTE_1] = checksum.sum1;
+    frame[HE_HEADER_CHECKSUM_BYTE_2] = checksum.sum2;
+    return NOPAY_COMMAND_LENGTH;
+}
+
+static int
+HE100_simChance (struct he100_sim *sim, double rate)
+{
+    if (rate <= 0) return 0;
+    return rand_r(&sim->options.seed) < rate * ((double)RAND_MAX + 1);
+}
+
+// nanoseconds to move length bytes at baud, 8N1 on the interface
+static uint64_t
+HE100_simWireTime (size_t length, int baud, int bits_per_byte)
+{
+    if (baud <= 0) return 0;
+    return (uint64_t)length * bits_per_byte * 1000000000ULL / baud;
+}
+
+// the termios speed of an interface rate, 0 for none the host can set
+static speed_t
+HE100_simSpeed (int baud)
+{
+    switch (baud) {
+        case 9600 :     return B9600;
+        case 19200 :    return B19200;
+        case 38400 :    return B38400;
+        case 115200 :   return B115200;
+        default :       return 0;
+    }
+}
+
+// whether the host tty runs at baud; the pty has one set of settings for both ends
+static int
+HE100_simHostAt (struct he100_sim *sim, int baud)
+{
+    if (baud <= 0) return 1;
+    struct termios settings;
+    if (tcgetattr(sim->master, &settings) != 0) return 1;
+    return cfgetospeed(&settings) == HE100_simSpeed(baud);
+}
+
+// preamble or postamble flags, packed low byte first; 0 means 20
+static size_t
+HE100_simFlags (struct he100_sim *sim, int byte)
+{
+    size_t flags = sim->config[byte] | sim->config[byte+1] << 8;
+    return flags == 0 ? 20 : flags;
+}
+
+/*
+ * Queue bytes for the host. They leave in the order they are ready, no earlier
+ * than not_before, one at a time on the line, and arrive a wire time later;
+ * faults are applied here. A frame ready sooner goes ahead of one waiting for
+ * later, as an ACK does of data still on the air.
+ */
+static int
+HE100_simSchedule (struct he100_sim *sim, const unsigned char *bytes, size_t length, uint64_t not_before)
+{
+    if (HE100_simChance(sim, sim->options.drop_rate)) {
+        sim->stats.dropped++;
+        return HE_SUCCESS;
+    }
+    if (sim->scheduled_count == HE100_SIM_MAX_SCHEDULED || length > HE100_SIM_MAX_FRAME) return -1;
+
+    // what is ready by then has not started on the line yet, not_before is never in the past
+    uint64_t ready = not_before + (uint64_t)sim->options.latency_us * 1000;
+    int at = sim->scheduled_count;
+    while (at > 0 && sim->scheduled[at-1].ready > ready) at--;
+    memmove(sim->scheduled+at+1, sim->scheduled+at, (sim->scheduled_count-at)*sizeof(sim->scheduled[0]));
+    sim->scheduled_count++;
+
+    struct he100_sim_scheduled *out = &sim->scheduled[at];
+    memcpy(out->bytes, bytes, length);
+    out->length = length;
+    out->ready = ready;
+    out->wire_ns = HE100_simWireTime(length, sim->options.if_baud, 10);
+    out->baud = sim->options.if_baud;
+    size_t i;
+    for (i=0; i<length; i++) {
+        if (HE100_simChance(sim, sim->options.bit_error_rate)) {
+            out->bytes[i] ^= 1 << (rand_r(&sim->options.seed) % 8);
+            sim->stats.corrupted_bytes++;
+        }
+    }
+
+    // everything from here on waits for the line behind the frame before it
+    int j;
+    for (j=at; j<sim->scheduled_count; j++) {
+        uint64_t start = sim->scheduled[j].ready;
+        if (j > 0 && start < sim->scheduled[j-1].due) start = sim->scheduled[j-1].due;
+        sim->scheduled[j].due = start + sim->scheduled[j].wire_ns;
+    }
+    return HE_SUCCESS;
+}
+
+static void
+HE100_simRespond (struct he100_sim *sim, unsigned char command, int nack, uint64_t now)
+{
+    unsigned char frame[HE100_SIM_MAX_FRAME];
+    HE100_simSchedule(sim, frame, HE100_simAck(command, nack, frame), now);
+    if (nack) sim->stats.nacks++;
+    else sim->stats.acks++;
+}
+
+// answer one complete, checked frame from the host
+static void
+HE100_simCommand (struct he100_sim *sim, const unsigned char *frame, size_t payload_length, uint64_t now)
+{
+    unsigned char command = frame[HE_CMD_BYTE];
+    const unsigned char *payload = frame + HE_FIRST_PAYLOAD_BYTE;
+    unsigned char response[HE100_SIM_MAX_FRAME];
+
+    switch (command) {
+        case CMD_GET_CONFIG :
+            HE100_simSchedule(sim, response, HE100_simFrame(command, sim->config, CFG_PAYLOAD_LENGTH, response), now);
+            break;
+        case CMD_READ_FIRMWARE_V :
+            HE100_simSchedule(sim, response, HE100_simFrame(command, sim->firmware, HE100_SIM_FIRMWARE_LENGTH, response), now);
+            break;
+        case CMD_TELEMETRY :
+            sim->op_counter++;
+            sim->telemetry[0] = sim->op_counter & 0xff;
+            sim->telemetry[1] = sim->op_counter >> 8;
+            HE100_simSchedule(sim, response, HE100_simFrame(command, sim->telemetry, HE100_SIM_TELEMETRY_LENGTH, response), now);
+            break;
+        case CMD_SET_CONFIG :
+            if (payload_length != CFG_PAYLOAD_LENGTH) {
+                HE100_simRespond(sim, command, 1, now);
+                break;
+            }
+            HE100_simRespond(sim, command, 0, now);
+            memcpy(sim->config, payload, CFG_PAYLOAD_LENGTH);
+            // the radio switches interface rate once the ACK is out
+            if (sim->options.if_baud > 0 && sim->config[CFG_IF_BAUD_BYTE] <= CFG_IF_BAUD_115200) {
+                sim->options.if_baud = HE100_SIM_IF_BAUD[sim->config[CFG_IF_BAUD_BYTE]];
+            }
+            break;
+        case CMD_FAST_SET_PA :
+            HE100_simRespond(sim, command, payload_length != 1, now);
+            if (payload_length == 1) sim->config[CFG_PA_BYTE] = payload[0];
+            break;
+        case CMD_TRANSMIT_DATA : {
+            // flags, the AX.25 header, the data, FCS, closing flag and flags again
+            size_t air_length = HE100_simFlags(sim, CFG_TX_PREAM_BYTE) + sizeof(HE100_SIM_AX25_HEADER) + payload_length + 3 + HE100_simFlags(sim, CFG_TX_POSTAM_BYTE);
+            uint64_t start = now > sim->air_free ? now : sim->air_free;
+            if (sim->options.rf_buffer > 0 && sim->options.rf_baud > 0) {
+                uint64_t backlog = (start - now) * sim->options.rf_baud / 8000000000ULL;
+                if (backlog + air_length > (uint64_t)sim->options.rf_buffer) {
+                    sim->stats.overflows++;
+                    HE100_simRespond(sim, command, 1, now);
+                    break;
+                }
+            }
+            HE100_simRespond(sim, command, 0, now);
+            sim->air_free = start + HE100_simWireTime(air_length, sim->options.rf_baud, 8);
+            if (sim->options.loopback && payload_length + sizeof(HE100_SIM_AX25_HEADER) <= MAX_FRAME_LENGTH) {
+                // on the air with the AX.25 header, then back down the interface
+                unsigned char received[MAX_FRAME_LENGTH];
+                memcpy(received, HE100_SIM_AX25_HEADER, sizeof(HE100_SIM_AX25_HEADER));
+                memcpy(received+sizeof(HE100_SIM_AX25_HEADER), payload, payload_length);
+                HE100_simSchedule(sim, response, HE100_simFrame(CMD_RECEIVE_DATA, received, payload_length + sizeof(HE100_SIM_AX25_HEADER), response), sim->air_free);
+            }
+            break;
+        }
+        case CMD_NOOP :
+        case CMD_RESET :
+        case CMD_WRITE_FLASH :
+        case CMD_RF_CONFIGURE :
+        case CMD_BEACON_DATA :
+        case CMD_BEACON_CONFIG :
+        case CMD_DIO_KEY_WRITE :
+        case CMD_FIRMWARE_UPDATE :
+        case CMD_FIRMWARE_PACKET :
+            HE100_simRespond(sim, command, 0, now);
+            break;
+        default :
+            HE100_simRespond(sim, command, 1, now);
+            break;
+    }
+}
+
+/*
+ * Take every whole frame out of the input. Frames with no payload are sent
+ * by the library with two zero bytes after the header, so a frame is always
+ * its payload length plus the wrapper.
+ */
+static void
+HE100_simParse (struct he100_sim *sim, uint64_t now)
+{
+    size_t start = 0;
+    while (sim->input_length - start >= HE_FIRST_PAYLOAD_BYTE) {
+        unsigned char *frame = sim->input + start;
+        if (frame[HE_SYNC_BYTE_1] != SYNC1 || frame[HE_SYNC_BYTE_2] != SYNC2 || frame[HE_TX_RX_BYTE] != CMD_TRANSMIT) {
+            start++;
+            continue;
+        }
+        struct HE100_checksum header = HE100_fletcher16(frame+HE_TX_RX_BYTE, 4);
+        if (header.sum1 != frame[HE_HEADER_CHECKSUM_BYTE_1] || header.sum2 != frame[HE_HEADER_CHECKSUM_BYTE_2]) {
+            sim->stats.bad_frames++;
+            start++;
+            continue;
+        }
+
+        size_t payload_length = (size_t)frame[HE_LENGTH_BYTE_0] << 8 | frame[HE_LENGTH_BYTE];
+        size_t frame_length = payload_length + WRAPPER_LENGTH;
+        if (frame_length > HE100_SIM_MAX_FRAME) {
+            start++;
+            continue;
+        }
+        if (sim->input_length - start < frame_length) break;
+
+        sim->stats.frames_in++;
+        int bad = 0;
+        if (payload_length > 0) {
+            struct HE100_checksum checksum = HE100_fletcher16(frame+HE_TX_RX_BYTE, payload_length+6);
+            bad = checksum.sum1 != frame[frame_length-2] || checksum.sum2 != frame[frame_length-1];
+        }
+        if (bad) {
+            sim->stats.bad_frames++;
+            HE100_simRespond(sim, frame[HE_CMD_BYTE], 1, now);
+        } else {
+            HE100_simCommand(sim, frame, payload_length, now);
+        }
+        start += frame_length;
+    }
+
+    memmove(sim->input, sim->input+start, sim->input_length-start);
+    sim->input_length -= start;
+}
+
+static void
+HE100_simInput (struct he100_sim *sim, const unsigned char *bytes, size_t length, uint64_t now)
+{
+    sim->stats.bytes_in += length;
+    if (!HE100_simHostAt(sim, sim->options.if_baud)) {
+        // framing errors, nothing the radio can parse
+        sim->stats.baud_mismatches++;
+        return;
+    }
+    if (sim->options.echo) {
+        // powered off, the host reads back its own frames
+        HE100_simSchedule(sim, bytes, length, now);
+        return;
+    }
+    if (length > sizeof(sim->input) - sim->input_length) {
+        // the host wrote garbage faster than frames complete, start over
+        sim->input_length = 0;
+        if (length > sizeof(sim->input)) length = sizeof(sim->input);
+    }
+    memcpy(sim->input+sim->input_length, bytes, length);
+    sim->input_length += length;
+    HE100_simParse(sim, now);
+}
+
+// write every response whose time has come, returns ns to the next one or -1
+static int64_t
+HE100_simFlush (struct he100_sim *sim, uint64_t now)
+{
+    int sent = 0;
+    while (sent < sim->scheduled_count && sim->scheduled[sent].due <= now) {
+        struct he100_sim_scheduled *out = &sim->scheduled[sent];
+        if (!HE100_simHostAt(sim, out->baud)) {
+            // the host reads it as noise
+            sim->stats.baud_mismatches++;
+            sent++;
+            continue;
+        }
+        size_t written = 0;
+        while (written < out->length) {
+            ssize_t w = write(sim->master, out->bytes+written, out->length-written);
+            if (w == -1 && errno == EINTR) continue;
+            if (w <= 0) break;
+            written += w;
+        }
+        sim->stats.frames_out++;
+        sim->stats.bytes_out += written;
+        sent++;
+    }
+    if (sent > 0) {
+        sim->scheduled_count -= sent;
+        memmove(sim->scheduled, sim->scheduled+sent, sim->scheduled_count*sizeof(sim->scheduled[0]));
+    }
+    return sim->scheduled_count > 0 ? (int64_t)(sim->scheduled[0].due - now) : -1;
+}
+
+static void *
+HE100_simThread (void *arg)
+{
+    struct he100_sim *sim = (struct he100_sim *)arg;
+    unsigned char bytes[512];
+
+    while (!__atomic_load_n(&sim->stop, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&sim->lock);
+        int64_t wait = HE100_simFlush(sim, HE100_simNow());
+        pthread_mutex_unlock(&sim->lock);
+
+        // wake for the next response, or every 10 ms to notice a stop
+        if (wait < 0 || wait > 10000000) wait = 10000000;
+        struct timespec timeout = {0, (long)wait};
+        struct pollfd fds = {sim->master, POLLIN, 0};
+        if (ppoll(&fds, 1, &timeout, NULL) <= 0) continue;
+
+        ssize_t n = read(sim->master, bytes, sizeof(bytes));
+        if (n <= 0) continue;
+        pthread_mutex_lock(&sim->lock);
+        HE100_simInput(sim, bytes, n, HE100_simNow());
+        pthread_mutex_unlock(&sim->lock);
+    }
+    return NULL;
+}
+
+int
+HE100_simStart (struct he100_sim *sim, const struct he100_sim_options *options)
+{
+    memset(sim, 0, sizeof(*sim));
+    if (options != NULL) sim->options = *options;
+    memcpy(sim->config, HE100_SIM_DEFAULT_CONFIG, CFG_PAYLOAD_LENGTH);
+    float firmware = 3.13f;
+    memcpy(sim->firmware, &firmware, HE100_SIM_FIRMWARE_LENGTH);
+    sim->telemetry[7] = 0xb4; // rssi
+
+    sim->master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (sim->master < 0) return HE_FAILED_OPEN_PORT;
+    if (grantpt(sim->master) != 0 || unlockpt(sim->master) != 0 || ptsname_r(sim->master, sim->device_path, sizeof(sim->device_path)) != 0) {
+        close(sim->master);
+        return HE_FAILED_OPEN_PORT;
+    }
+    sim->device = open(sim->device_path, O_RDWR | O_NOCTTY);
+    if (sim->device < 0) {
+        close(sim->master);
+        return HE_FAILED_OPEN_PORT;
+    }
+
+    // raw, the line discipline would otherwise rewrite 0x0a
+    struct termios settings;
+    tcgetattr(sim->device, &settings);
+    cfmakeraw(&settings);
+    // and at the radio's rate, as SC_openPort leaves it
+    if (HE100_simSpeed(sim->options.if_baud) != 0) {
+        cfsetispeed(&settings, HE100_simSpeed(sim->options.if_baud));
+        cfsetospeed(&settings, HE100_simSpeed(sim->options.if_baud));
+    }
+    tcsetattr(sim->device, TCSANOW, &settings);
+
+    pthread_mutex_init(&sim->lock, NULL);
+    if (pthread_create(&sim->thread, NULL, HE100_simThread, sim) != 0) {
+        close(sim->device);
+        close(sim->master);
+        return HE_FAILED_OPEN_PORT;
+    }
+    sim->running = 1;
+    return HE_SUCCESS;
+}
+
+void
+HE100_simStop (struct he100_sim *sim)
+{
+    if (!sim->running) return;
+    __atomic_store_n(&sim->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(sim->thread, NULL);
+    pthread_mutex_destroy(&sim->lock);
+    HE100_closePort(sim->device); // drops the handle the fd functions kept for it
+    close(sim->master);
+    sim->running = 0;
+}
+
+void
+HE100_simConfigure (struct he100_sim *sim, const struct he100_sim_options *options)
+{
+    pthread_mutex_lock(&sim->lock);
+    sim->options = *options;
+    pthread_mutex_unlock(&sim->lock);
+}
+
+int
+HE100_simInject (struct he100_sim *sim, const unsigned char *frame, size_t length)
+{
+    pthread_mutex_lock(&sim->lock);
+    int r = HE100_simSchedule(sim, frame, length, HE100_simNow());
+    pthread_mutex_unlock(&sim->lock);
+    return r;
+}
+
+struct he100_sim_stats
+HE100_simStats (struct he100_sim *sim)
+{
+    pthread_mutex_lock(&sim->lock);
+    struct he100_sim_stats stats = sim->stats;
+    pthread_mutex_unlock(&sim->lock);
+    return stats;
+}
@@ -0,0 +1,129 @@
+#ifndef HE100_SIM_H_
+#define HE100_SIM_H_
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  he100_sim.h
+ *
+ *    Description:  He100 simulator on a pseudo terminal. A thread holds the
+ *                  master side, parses the frames the library writes to the
+ *                  slave side and answers as the radio would: ACK or NACK,
+ *                  configuration, firmware revision and telemetry frames, and
+ *                  optionally the transmitted data looped back as received
+ *                  data. Responses are paced to the interface and RF baud
+ *                  rates, air time counting the preamble and postamble flags
+ *                  of the radio's configuration, and faults can be injected: bit errors, dropped
+ *                  responses, echo of everything written (the HE_POWER_OFF
+ *                  case) and fixed latency.
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 04:31:50 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <SC_he100.h>
+
+#define HE100_SIM_MAX_SCHEDULED     32  // responses waiting for their time on the wire
+#define HE100_SIM_MAX_FRAME         (MAX_FRAME_LENGTH+WRAPPER_LENGTH)
+#define HE100_SIM_FIRMWARE_LENGTH   4
+#define HE100_SIM_TELEMETRY_LENGTH  16  // TELEMETRY_STRUCTURE_type as the radio packs it
+
+struct he100_sim_options {
+    int if_baud;            // interface bits per second, 0 to answer at once
+    int rf_baud;            // air bits per second for looped back data, 0 for none
+    int loopback;           // answer CMD_TRANSMIT_DATA with CMD_RECEIVE_DATA too
+    double bit_error_rate;  // chance of each response byte having a bit flipped
+    double drop_rate;       // chance of a response not being sent at all
+    int echo;               // powered off: send back every byte as written
+    int latency_us;         // added before every response
+    unsigned int seed;      // for the fault injection
+    int rf_buffer;          // air bytes the radio holds waiting to transmit, 0 for no limit; CMD_TRANSMIT_DATA beyond it is NACKed
+};
+
+struct he100_sim_stats {
+    uint64_t bytes_in;
+    uint64_t frames_in;
+    uint64_t bad_frames;        // checksum failures, answered with a NACK
+    uint64_t acks;
+    uint64_t nacks;
+    uint64_t frames_out;
+    uint64_t bytes_out;
+    uint64_t dropped;
+    uint64_t corrupted_bytes;
+    uint64_t overflows;         // CMD_TRANSMIT_DATA refused with the RF buffer full
+    uint64_t baud_mismatches;   // reads and frames lost to the host tty at another rate than the radio
+};
+
+struct he100_sim_scheduled {
+    uint64_t ready;         // CLOCK_MONOTONIC ns when it may start on the line
+    uint64_t wire_ns;       // time the line takes to carry it
+    int baud;               // the interface rate it goes out at
+    uint64_t due;           // CLOCK_MONOTONIC ns when the last byte has been sent
+    size_t length;
+    unsigned char bytes[HE100_SIM_MAX_FRAME];
+};
+
+struct he100_sim {
+    int master;                 // the radio side
+    int device;                 // the side to hand to the library, raw mode
+    char device_path[64];
+    struct he100_sim_options options;
+    pthread_t thread;
+    int running;
+    int stop;
+    pthread_mutex_t lock;       // guards the radio state and options against the test thread
+    // radio state
+    unsigned char config[CFG_PAYLOAD_LENGTH];
+    unsigned char firmware[HE100_SIM_FIRMWARE_LENGTH];
+    unsigned char telemetry[HE100_SIM_TELEMETRY_LENGTH];
+    uint16_t op_counter;
+    // bytes written by the library, not yet a whole frame
+    unsigned char input[2*HE100_SIM_MAX_FRAME];
+    size_t input_length;
+    // responses in the order they go out
+    struct he100_sim_scheduled scheduled[HE100_SIM_MAX_SCHEDULED];
+    int scheduled_count;
+    uint64_t air_free;          // when the RF channel is next idle
+    struct he100_sim_stats stats;
+};
+
+/**
+ * Function to open a pseudo terminal pair and start the radio thread
+ * @param options - NULL for an ideal radio that answers at once
+ * @return - HE_SUCCESS, or HE_FAILED_OPEN_PORT
+ */
+int HE100_simStart (struct he100_sim *sim, const struct he100_sim_options *options);
+
+/* Function to stop the radio thread and close both sides */
+void HE100_simStop (struct he100_sim *sim);
+
+/* Function to change the options of a running simulator */
+void HE100_simConfigure (struct he100_sim *sim, const struct he100_sim_options *options);
+
+/**
+ * Function to send a frame from the radio unprompted, such as received data
+ * @return - HE_SUCCESS, or -1 if too many responses are waiting
+ */
+int HE100_simInject (struct he100_sim *sim, const unsigned char *frame, size_t length);
+
+/**
+ * Function to build a radio to host frame, header and checksums included
+ * @param frame - at least length+WRAPPER_LENGTH bytes
+ * @return - the length of the frame
+ */
+size_t HE100_simFrame (unsigned char command, const unsigned char *payload, size_t length, unsigned char *frame);
+
+/* Function to copy the counters, consistently */
+struct he100_sim_stats HE100_simStats (struct he100_sim *sim);
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  he100_sim_main.c
+ *
+ *    Description:  Runs the He100 simulator on its own, so the library, the
+ *                  benchmarks or a ground tool can be pointed at the printed
+ *                  device in place of /dev/ttyS2.
+ *
+ *                  usage: he100-sim [-i if_baud] [-r rf_baud] [-l] [-b bit_error_rate]
+ *                                   [-d drop_rate] [-e] [-L latency_us] [-s seed]
+ *                                   [-B rf_buffer]
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 04:31:50 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <stdlib.h>     /*  C Standard General Utilities Library */
+#include <signal.h>     /*  sigwait() */
+#include <unistd.h>     /*  getopt() */
+#include <inttypes.h>   /*  PRIu64 */
+
+#include "he100_sim.h"
+
+int
+main (int argc, char **argv)
+{
+    struct he100_sim_options options = {9600, 9600, 0, 0.0, 0.0, 0, 0, 1, 0};
+    int opt;
+    while ((opt = getopt(argc, argv, "i:r:lb:d:eL:s:B:")) != -1) {
+        switch (opt) {
+            case 'i' : options.if_baud = atoi(optarg); break;
+            case 'r' : options.rf_baud = atoi(optarg); break;
+            case 'l' : options.loopback = 1; break;
+            case 'b' : options.bit_error_rate = atof(optarg); break;
+            case 'd' : options.drop_rate = atof(optarg); break;
+            case 'e' : options.echo = 1; break;
+            case 'L' : options.latency_us = atoi(optarg); break;
+            case 's' : options.seed = strtoul(optarg, NULL, 0); break;
+            case 'B' : options.rf_buffer = atoi(optarg); break;
+            default :
+                fprintf(stderr, "usage: %s [-i if_baud] [-r rf_baud] [-l] [-b bit_error_rate] [-d drop_rate] [-e] [-L latency_us] [-s seed] [-B rf_buffer]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    // block before the radio thread starts so only sigwait sees them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    struct he100_sim sim;
+    if (HE100_simStart(&sim, &options) != HE_SUCCESS) {
+        perror("he100-sim");
+        return 1;
+    }
+    printf("%s\n", sim.device_path);
+    fflush(stdout);
+
+    int signal;
+    sigwait(&signals, &signal);
+
+    struct he100_sim_stats stats = HE100_simStats(&sim);
+    HE100_simStop(&sim);
+    fprintf(
+        stderr,
+        "bytes in %" PRIu64 ", frames in %" PRIu64 ", bad frames %" PRIu64 ", acks %" PRIu64 ", nacks %" PRIu64
+        ", frames out %" PRIu64 ", bytes out %" PRIu64 ", dropped %" PRIu64 ", corrupted bytes %" PRIu64 ", overflows %" PRIu64 ", baud mismatches %" PRIu64 "\n",
+        stats.bytes_in, stats.frames_in, stats.bad_frames, stats.acks, stats.nacks,
+        stats.frames_out, stats.bytes_out, stats.dropped, stats.corrupted_bytes, stats.overflows, stats.baud_mismatches
+    );
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  he100-capture-replay.c
+ *
+ *    Description:  Replays the bytes received in a capture written by
+ *                  HE100_captureStart through the decoder, printing each
+ *                  frame it finds with its validation status, then what was
+ *                  replayed. A speed of 1 keeps the recorded timing, 0 (the
+ *                  default) replays as fast as possible.
+ *
+ *                  usage: he100-capture-replay <capture file> [speed]
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 08:12:51 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <stdlib.h>     /*  C Standard General Utilities Library */
+
+#include <SC_he100.h>
+#include <SC_he100-capture.h>
+
+static void
+printFrame (const unsigned char *frame, size_t length, int status, void *context)
+{
+    (void)context;
+    printf("%-28s", HE_STATUS[status]);
+    HE100_dumpHex(stdout, (unsigned char *)frame, length);
+}
+
+int
+main (int argc, char **argv)
+{
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "usage: %s <capture file> [speed]\n", argv[0]);
+        return 1;
+    }
+    double speed = argc == 3 ? atof(argv[2]) : 0;
+
+    struct he100_capture capture;
+    if (HE100_captureOpenReadOnly(&capture, argv[1]) != HE_SUCCESS) {
+        fprintf(stderr, "%s: not a version %d capture\n", argv[1], HE100_CAPTURE_VERSION);
+        return 1;
+    }
+
+    struct he100_decoder decoder;
+    struct he100_replay_stats stats;
+    HE100_decoderInit(&decoder);
+    HE100_captureReplay(&capture, &decoder, speed, printFrame, NULL, &stats);
+    printf(
+        "# %llu records, %llu sent frames skipped, %llu bytes received: %llu frames, %llu bytes discarded, %lu left over\n",
+        (unsigned long long)stats.records, (unsigned long long)stats.tx_records,
+        (unsigned long long)stats.rx_bytes, (unsigned long long)stats.frames,
+        (unsigned long long)decoder.discarded, (unsigned long)HE100_decoderPending(&decoder)
+    );
+    if (capture.header->dropped > 0) printf("# %llu records did not fit the capture\n", (unsigned long long)capture.header->dropped);
+
+    HE100_captureClose(&capture);
+    return 0;
+}
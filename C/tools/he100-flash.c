@@ -0,0 +1,74 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  he100-flash.c
+ *
+ *    Description:  Uploads an Intel HEX firmware image to the radio and asks
+ *                  it to flash it. Progress is kept in <hex file>.progress,
+ *                  so running it again after an interruption sends only the
+ *                  packets the radio has not acknowledged.
+ *
+ *                  usage: he100-flash <serial device> <hex file> [window]
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 07:30:12 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <stdlib.h>     /*  C Standard General Utilities Library */
+#include <unistd.h>     /*  UNIX standard function definitions */
+
+#include <SC_he100.h>
+#include <SC_he100-pipeline.h>
+#include <SC_he100-firmware.h>
+#include "SC_serial.h"
+
+int
+main (int argc, char **argv)
+{
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "usage: %s <serial device> <hex file> [window]\n", argv[0]);
+        return 1;
+    }
+    int window = argc == 4 ? atoi(argv[3]) : HE100_PIPELINE_DEFAULT_WINDOW;
+
+    struct he100_firmware_image image;
+    if (HE100_firmwareLoad(&image, argv[2]) != HE_SUCCESS) {
+        fprintf(stderr, "%s: not a valid Intel HEX image\n", argv[2]);
+        return 1;
+    }
+    printf("%s: %lu bytes in %lu packets\n", argv[2], (unsigned long)image.size, (unsigned long)image.packet_count);
+
+    char progress_path[4096];
+    snprintf(progress_path, sizeof(progress_path), "%s.progress", argv[2]);
+    struct he100_firmware_upload upload;
+    HE100_firmwareUploadInit(&upload, &image, progress_path);
+    if (upload.packets_acked > 0) printf("resuming: %lu packets already acknowledged\n", (unsigned long)upload.packets_acked);
+
+    int fdin = SC_openPort(argv[1]);
+    struct he100_pipeline pipeline;
+    if (fdin <= 0 || HE100_pipelineInit(&pipeline, fdin, window) != HE_SUCCESS) {
+        fprintf(stderr, "%s: cannot open\n", argv[1]);
+        return 1;
+    }
+
+    int result = HE100_firmwareUpload(&pipeline, &upload);
+    printf(
+        "%lu/%lu packets acknowledged, %.0f B/s, %llu resent: %s\n",
+        (unsigned long)upload.packets_acked, (unsigned long)image.packet_count,
+        HE100_firmwareRate(&upload), (unsigned long long)upload.resent, HE_STATUS[result]
+    );
+    if (result == HE_SUCCESS) unlink(progress_path);
+
+    HE100_pipelineClose(&pipeline);
+    SC_closePort(fdin);
+    HE100_firmwareUploadFree(&upload);
+    HE100_firmwareFree(&image);
+    return result == HE_SUCCESS ? 0 : 1;
+}
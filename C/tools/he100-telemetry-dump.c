@@ -0,0 +1,68 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  he100-telemetry-dump.c
+ *
+ *    Description:  Prints the latest samples of a telemetry ring written by
+ *                  HE100_telemetryStart, oldest first, one per line. The ring
+ *                  is mapped read only, so it may be dumped while the poller
+ *                  runs; a sample overwritten while it was printed is marked.
+ *
+ *                  usage: he100-telemetry-dump <ring file> [samples]
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 06:41:27 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <stdlib.h>     /*  C Standard General Utilities Library */
+
+#include <SC_he100.h>
+#include <SC_he100-telemetry.h>
+
+int
+main (int argc, char **argv)
+{
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "usage: %s <ring file> [samples]\n", argv[0]);
+        return 1;
+    }
+    size_t wanted = argc == 3 ? strtoul(argv[2], NULL, 10) : 20;
+
+    struct he100_telemetry_ring ring;
+    if (HE100_telemetryOpenReadOnly(&ring, argv[1]) != HE_SUCCESS) {
+        fprintf(stderr, "%s: not a version %d telemetry ring\n", argv[1], HE100_TELEMETRY_VERSION);
+        return 1;
+    }
+
+    uint64_t first;
+    size_t n = HE100_telemetryLatest(&ring, wanted, &first);
+    printf("# %llu samples appended, ring of %u\n", (unsigned long long)HE100_telemetryCount(&ring), ring.header->capacity);
+    printf("# index time_s latency_us op_counter msp430_temp time_count rssi bytes_rx bytes_tx\n");
+
+    uint64_t index;
+    for (index=first; index<first+n; index++) {
+        const struct he100_telemetry_sample *sample = HE100_telemetrySample(&ring, index);
+        if (sample == NULL) {
+            printf("%llu overwritten\n", (unsigned long long)index);
+            continue;
+        }
+        const TELEMETRY_STRUCTURE_type *t = &sample->telemetry;
+        printf(
+            "%llu %.3f %u %u %u %02x%02x%02x %u %u %u",
+            (unsigned long long)index, sample->ns / 1e9, sample->latency_us,
+            t->op_counter, t->msp430_temp, t->time_count[2], t->time_count[1], t->time_count[0],
+            t->rssi, t->bytes_received, t->bytes_transmitted
+        );
+        printf(HE100_telemetryIntact(sample, index) ? "\n" : " overwritten\n");
+    }
+
+    HE100_telemetryClose(&ring);
+    return 0;
+}
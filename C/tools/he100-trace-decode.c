@@ -0,0 +1,68 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  he100-trace-decode.c
+ *
+ *    Description:  Prints a raw trace file written by HE100_traceStart as text,
+ *                  one event per line: seconds since the first event, thread,
+ *                  and the line the library would have logged.
+ *
+ *                  usage: he100-trace-decode <trace file>
+ *
+ *        Version:  1.0
+ *        Created:  26-10-17 02:14:40 PM
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Space Concordia
+ *   Organization:  Space Concordia ConSat1
+ *
+ * =====================================================================================
+ */
+#include <stdio.h>      /*  Standard input/output definitions */
+#include <string.h>     /*  String function definitions */
+
+#include <SC_he100.h>
+#include <SC_he100-trace.h>
+
+int
+main (int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <trace file>\n", argv[0]);
+        return 1;
+    }
+
+    FILE *trace = fopen(argv[1], "rb");
+    if (trace == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    struct he100_trace_file_header header;
+    if (
+            fread(&header, sizeof(header), 1, trace) != 1
+        ||  memcmp(header.magic, HE100_TRACE_MAGIC, sizeof(header.magic)) != 0
+        ||  header.version != HE100_TRACE_VERSION
+        ||  header.event_size != sizeof(struct he100_trace_event)
+       )
+    {
+        fprintf(stderr, "%s: not a version %d trace file\n", argv[1], HE100_TRACE_VERSION);
+        fclose(trace);
+        return 1;
+    }
+
+    struct he100_trace_event event;
+    uint64_t first = 0;
+    int events = 0;
+    while (fread(&event, sizeof(event), 1, trace) == 1) {
+        // events are in order per thread only, the first one read is close enough
+        if (events++ == 0) first = event.ns;
+        char line[256];
+        HE100_traceFormat(&event, line, sizeof(line));
+        printf("%12.6f [%u] %s\n", (double)(int64_t)(event.ns - first) / 1e9, event.thread, line);
+    }
+
+    fclose(trace);
+    return 0;
+}